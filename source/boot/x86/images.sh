@@ -80,6 +80,24 @@ menuentry "Escape" {
 	boot
 }
 
+menuentry "Escape - AHCI" {
+	multiboot /boot/escape$suffix escape root=/dev/ext2-sda1 swapdev=/dev/sda3
+	module /sbin/initloader initloader
+	module /sbin/pci pci /dev/pci
+	module /sbin/ahci ahci /sys/dev/ahci
+	module /sbin/ext2 ext2 /dev/ext2-sda1 /dev/sda1
+	boot
+}
+
+menuentry "Escape - virtio" {
+	multiboot /boot/escape$suffix escape root=/dev/ext2-vda1 swapdev=/dev/vda3
+	module /sbin/initloader initloader
+	module /sbin/pci pci /dev/pci
+	module /sbin/virtioblk virtioblk /sys/dev/virtioblk
+	module /sbin/ext2 ext2 /dev/ext2-vda1 /dev/vda1
+	boot
+}
+
 menuentry "Escape - Test" {
 	multiboot /boot/escape_test$suffix escape_test
 	module /sbin/initloader initloader
@@ -20,12 +20,14 @@
 #include <fs/fsdev.h>
 #include <fs/permissions.h>
 #include <sys/common.h>
+#include <sys/conf.h>
 #include <sys/debug.h>
 #include <sys/endian.h>
 #include <sys/io.h>
 #include <sys/proc.h>
 #include <dirent.h>
 #include <errno.h>
+#include <getopt.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,18 +51,43 @@ static void sigTermHndl(int) {
 	fsdev->stop();
 }
 
+static void usage(const char *name) {
+	fprintf(stderr,"Usage: %s [--icache <inodes>] <fsPath> <devicePath>\n",name);
+	fprintf(stderr,"    --icache <inodes>: the number of inodes to cache (%zu by default)\n",
+		EXT2_ICACHE_SIZE);
+	exit(EXIT_FAILURE);
+}
+
 int main(int argc,char *argv[]) {
-	if(argc != 3)
-		error("Usage: %s <fsPath> <devicePath>",argv[0]);
+	size_t icacheSize = EXT2_ICACHE_SIZE;
+
+	int opt;
+	const struct option longopts[] = {
+		{"icache",	required_argument,	0,	'i'},
+		{0, 0, 0, 0},
+	};
+	while((opt = getopt_long(argc,argv,"",longopts,NULL)) != -1) {
+		switch(opt) {
+			case 'i': icacheSize = strtoul(optarg,NULL,0); break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if(optind + 2 != argc || icacheSize == 0)
+		usage(argv[0]);
+
+	const char *fsPath = argv[optind];
+	const char *devPath = argv[optind + 1];
 
 	/* the backend has to be a block device */
-	if(!isblock(argv[2]))
-		error("'%s' is neither a block-device nor a regular file",argv[2]);
+	if(!isblock(devPath))
+		error("'%s' is neither a block-device nor a regular file",devPath);
 
 	if(signal(SIGTERM,sigTermHndl) == SIG_ERR)
 		error("Unable to set signal-handler for SIGTERM");
 
-	fsdev = new fs::FSDevice<fs::OpenFile>(new Ext2FileSystem(argv[2]),argv[1]);
+	fsdev = new fs::FSDevice<fs::OpenFile>(new Ext2FileSystem(devPath,icacheSize),fsPath,
+		sysconf(CONF_CPU_COUNT));
 	fsdev->loop();
 	return 0;
 }
@@ -80,9 +107,9 @@ static int open_device(const char *path) {
 	return fd;
 }
 
-Ext2FileSystem::Ext2FileSystem(const char *device)
+Ext2FileSystem::Ext2FileSystem(const char *device,size_t icacheSize)
 		: fd(open_device(device)), sb(this), bgs(this),
-		  inodeCache(this), blockCache(this) {
+		  inodeCache(this,icacheSize), blockCache(this), devLock(), _lock() {
 }
 
 Ext2FileSystem::~Ext2FileSystem() {
@@ -113,6 +140,7 @@ error:
 
 ino_t Ext2FileSystem::open(fs::User *u,const char *path,ssize_t *sympos,ino_t root,uint flags,
 		mode_t mode,int fd,fs::OpenFile **file) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	ino_t ino = Ext2Path::resolve(this,u,path,sympos,root,flags,mode);
 	if(ino < 0)
 		return ino;
@@ -156,6 +184,7 @@ ino_t Ext2FileSystem::open(fs::User *u,const char *path,ssize_t *sympos,ino_t ro
 }
 
 void Ext2FileSystem::close(fs::OpenFile *file) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	/* decrease references so that we can remove the cached inode and maybe even delete the file */
 	Ext2CInode *cnode = inodeCache.request(file->ino,IMODE_READ);
 	cnode->refs--;
@@ -163,6 +192,7 @@ void Ext2FileSystem::close(fs::OpenFile *file) {
 }
 
 int Ext2FileSystem::stat(fs::OpenFile *file,struct stat *info) {
+	std::shared_lock<std::shared_mutex> guard(_lock);
 	const Ext2CInode *cnode = inodeCache.request(file->ino,IMODE_READ);
 	if(cnode == NULL)
 		return -ENOBUFS;
@@ -184,18 +214,22 @@ int Ext2FileSystem::stat(fs::OpenFile *file,struct stat *info) {
 }
 
 int Ext2FileSystem::chmod(fs::OpenFile *file,mode_t mode) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	return Ext2INode::chmod(this,&file->user,file->ino,mode);
 }
 
 int Ext2FileSystem::chown(fs::OpenFile *file,uid_t uid,gid_t gid) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	return Ext2INode::chown(this,&file->user,file->ino,uid,gid);
 }
 
 int Ext2FileSystem::utime(fs::OpenFile *file,const struct utimbuf *utimes) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	return Ext2INode::utime(this,&file->user,file->ino,utimes);
 }
 
 int Ext2FileSystem::truncate(fs::OpenFile *file,off_t length) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	// TODO implement me!
 	if(length > 0)
 		return -ENOTSUP;
@@ -209,14 +243,28 @@ int Ext2FileSystem::truncate(fs::OpenFile *file,off_t length) {
 }
 
 ssize_t Ext2FileSystem::read(fs::OpenFile *file,void *buffer,off_t offset,size_t count) {
-	return Ext2File::read(this,file->ino,buffer,offset,count);
+	std::shared_lock<std::shared_mutex> guard(_lock);
+	/* grow the readahead window as long as the file is read sequentially */
+	if(offset == file->nextOffset) {
+		size_t ra = file->readahead ? file->readahead * 2 : EXT2_RA_MIN;
+		file->readahead = esc::Util::min(ra,EXT2_RA_MAX);
+	}
+	else
+		file->readahead = 0;
+
+	ssize_t res = Ext2File::read(this,file->ino,buffer,offset,count,file->readahead);
+	if(res > 0)
+		file->nextOffset = offset + res;
+	return res;
 }
 
 ssize_t Ext2FileSystem::write(fs::OpenFile *file,const void *buffer,off_t offset,size_t count) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	return Ext2File::write(this,file->ino,buffer,offset,count);
 }
 
 int Ext2FileSystem::link(fs::OpenFile *dst,fs::OpenFile *dir,const char *name) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	return linkIno(dst->ino,dir,name,false);
 }
 
@@ -248,10 +296,12 @@ int Ext2FileSystem::doUnlink(fs::OpenFile *dir,const char *name,bool isdir) {
 }
 
 int Ext2FileSystem::unlink(fs::OpenFile *dir,const char *name) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	return doUnlink(dir,name,false);
 }
 
 int Ext2FileSystem::mkdir(fs::OpenFile *dir,const char *name,mode_t mode) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	int res;
 	Ext2CInode *cdir = inodeCache.request(dir->ino,IMODE_WRITE);
 	if(cdir == NULL)
@@ -262,6 +312,7 @@ int Ext2FileSystem::mkdir(fs::OpenFile *dir,const char *name,mode_t mode) {
 }
 
 int Ext2FileSystem::rmdir(fs::OpenFile *dir,const char *name) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	int res;
 	Ext2CInode *cdir = inodeCache.request(dir->ino,IMODE_WRITE);
 	if(cdir == NULL)
@@ -275,6 +326,7 @@ int Ext2FileSystem::rmdir(fs::OpenFile *dir,const char *name) {
 }
 
 int Ext2FileSystem::symlink(fs::OpenFile *dir,const char *name,const char *target) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	int res;
 	Ext2CInode *cdir = inodeCache.request(dir->ino,IMODE_WRITE);
 	if(cdir == NULL)
@@ -297,6 +349,7 @@ int Ext2FileSystem::symlink(fs::OpenFile *dir,const char *name,const char *targe
 
 int Ext2FileSystem::rename(fs::OpenFile *oldDir,const char *oldName,fs::OpenFile *newDir,
 		const char *newName) {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	ino_t oldFile = find(oldDir,oldName);
 	if(oldFile < 0)
 		return oldFile;
@@ -316,6 +369,7 @@ int Ext2FileSystem::rename(fs::OpenFile *oldDir,const char *oldName,fs::OpenFile
 }
 
 void Ext2FileSystem::sync() {
+	std::lock_guard<std::shared_mutex> guard(_lock);
 	sb.update();
 	bgs.update();
 	/* flush inodes first, because they may create dirty blocks */
@@ -324,6 +378,7 @@ void Ext2FileSystem::sync() {
 }
 
 void Ext2FileSystem::print(FILE *f) {
+	std::shared_lock<std::shared_mutex> guard(_lock);
 	fprintf(f,"Total blocks: %u\n",le32tocpu(sb.get()->blockCount));
 	fprintf(f,"Total inodes: %u\n",le32tocpu(sb.get()->inodeCount));
 	fprintf(f,"Free blocks: %u\n",le32tocpu(sb.get()->freeBlockCount));
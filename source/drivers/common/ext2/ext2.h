@@ -25,6 +25,7 @@
 #include <fs/fsdev.h>
 #include <sys/common.h>
 #include <sys/endian.h>
+#include <mutex>
 
 #include "bgmng.h"
 #include "dir.h"
@@ -34,6 +35,9 @@
 static const size_t DISK_SECTOR_SIZE		= 512;
 static const size_t EXT2_ICACHE_SIZE		= 64;
 static const size_t EXT2_BCACHE_SIZE		= 2048;
+/* the initial and max. number of blocks to read ahead for sequential reads */
+static const size_t EXT2_RA_MIN			= 4;
+static const size_t EXT2_RA_MAX			= fs::BlockCache::MAX_FILL;
 
 static const uint EXT2_SUPERBLOCK_LOCK		= 0xF7180002;
 
@@ -52,7 +56,7 @@ public:
 		Ext2FileSystem *_fs;
 	};
 
-	explicit Ext2FileSystem(const char *device);
+	explicit Ext2FileSystem(const char *device,size_t icacheSize = EXT2_ICACHE_SIZE);
 	virtual ~Ext2FileSystem();
 
 	ino_t open(fs::User *u,const char *path,ssize_t *pos,ino_t root,uint flags,mode_t mode,int fd,
@@ -216,4 +220,13 @@ public:
 	/* caches */
 	Ext2INodeCache inodeCache;
 	Ext2BlockCache blockCache;
+
+	/* protects the file position of fd */
+	std::mutex devLock;
+
+private:
+	/* reads and stats share this lock, all other operations take it exclusively. the block cache
+	 * and the inode cache lock themselves, so that concurrent reads only contend in the caches.
+	 * the allocators and the superblock and blockgroup managers are only used by writers */
+	std::shared_mutex _lock;
 };
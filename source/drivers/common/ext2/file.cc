@@ -140,7 +140,8 @@ int Ext2File::truncate(Ext2FileSystem *e,Ext2CInode *cnode,bool del) {
 	return 0;
 }
 
-ssize_t Ext2File::read(Ext2FileSystem *e,ino_t inodeNo,void *buffer,off_t offset,size_t count) {
+ssize_t Ext2File::read(Ext2FileSystem *e,ino_t inodeNo,void *buffer,off_t offset,size_t count,
+		size_t readahead) {
 	Ext2CInode *cnode;
 	ssize_t res;
 
@@ -150,21 +151,21 @@ ssize_t Ext2File::read(Ext2FileSystem *e,ino_t inodeNo,void *buffer,off_t offset
 		return -ENOBUFS;
 
 	/* read */
-	res = readIno(e,cnode,buffer,offset,count);
+	res = readIno(e,cnode,buffer,offset,count,readahead);
 	if(res <= 0) {
 		e->inodeCache.release(cnode);
 		return res;
 	}
 
 	/* mark accessed */
-	cnode->inode.accesstime = cputole32(time(NULL));
-	e->inodeCache.markDirty(cnode);
+	e->inodeCache.markAccessed(cnode,time(NULL));
 	e->inodeCache.release(cnode);
 
 	return res;
 }
 
-ssize_t Ext2File::readIno(Ext2FileSystem *e,const Ext2CInode *cnode,void *buffer,off_t offset,size_t count) {
+ssize_t Ext2File::readIno(Ext2FileSystem *e,const Ext2CInode *cnode,void *buffer,off_t offset,
+		size_t count,size_t readahead) {
 	/* nothing left to read? */
 	int32_t inoSize = le32tocpu(cnode->inode.size);
 	if((int32_t)offset < 0 || (int32_t)offset >= inoSize)
@@ -190,6 +191,14 @@ ssize_t Ext2File::readIno(Ext2FileSystem *e,const Ext2CInode *cnode,void *buffer
 		offset %= blockSize;
 		blockCount = (offset + count + blockSize - 1) / blockSize;
 
+		/* bring the blocks (and the ones to read ahead) into the cache with as few reads as
+		 * possible, but don't go beyond the end of the file. for huge requests, don't fill more
+		 * than half of the cache to not evict the blocks again before we've copied them */
+		size_t fileBlocks = (inoSize + blockSize - 1) / blockSize;
+		size_t prefetchCount = esc::Util::min(blockCount + readahead,fileBlocks - startBlock);
+		if(prefetchCount <= EXT2_BCACHE_SIZE / 2)
+			prefetch(e,cnode,startBlock,prefetchCount);
+
 		/* use the offset in the first block; after the first one the offset is 0 anyway */
 		leftBytes = count;
 		bufWork = (uint8_t*)buffer;
@@ -217,6 +226,27 @@ ssize_t Ext2File::readIno(Ext2FileSystem *e,const Ext2CInode *cnode,void *buffer
 	return count;
 }
 
+void Ext2File::prefetch(Ext2FileSystem *e,const Ext2CInode *cnode,block_t first,size_t count) {
+	block_t start = 0;
+	size_t run = 0;
+	for(size_t i = 0; i < count; ++i) {
+		block_t block = Ext2INode::getDataBlock(e,cnode,first + i);
+		/* extend the current run, if possible */
+		if(run > 0 && block == start + run && run < BlockCache::MAX_FILL) {
+			run++;
+			continue;
+		}
+
+		if(run > 0)
+			e->blockCache.fill(start,run);
+		/* holes are not read from disk */
+		start = block;
+		run = block != 0 ? 1 : 0;
+	}
+	if(run > 0)
+		e->blockCache.fill(start,run);
+}
+
 ssize_t Ext2File::write(Ext2FileSystem *e,ino_t inodeNo,const void *buffer,off_t offset,size_t count) {
 	/* at first we need the inode */
 	Ext2CInode *cnode = e->inodeCache.request(inodeNo,IMODE_WRITE);
@@ -69,9 +69,11 @@ public:
 	 * 	not copied anywhere
 	 * @param offset the offset
 	 * @param count the number of bytes to read
+	 * @param readahead the number of blocks to read ahead
 	 * @return the number of read bytes
 	 */
-	static ssize_t read(Ext2FileSystem *e,ino_t inodeNo,void *buffer,off_t offset,size_t count);
+	static ssize_t read(Ext2FileSystem *e,ino_t inodeNo,void *buffer,off_t offset,size_t count,
+		size_t readahead = 0);
 
 	/**
 	 * Reads <count> bytes at <offset> into <buffer> from the given cached inode. It will not
@@ -83,9 +85,11 @@ public:
 	 * 	not copied anywhere
 	 * @param offset the offset
 	 * @param count the number of bytes to read
+	 * @param readahead the number of blocks to read ahead
 	 * @return the number of read bytes
 	 */
-	static ssize_t readIno(Ext2FileSystem *e,const Ext2CInode *cnode,void *buffer,off_t offset,size_t count);
+	static ssize_t readIno(Ext2FileSystem *e,const Ext2CInode *cnode,void *buffer,off_t offset,
+		size_t count,size_t readahead = 0);
 
 	/**
 	 * Writes <count> bytes at <offset> from <buffer> to the inode with given number. Will
@@ -114,6 +118,11 @@ public:
 	static ssize_t writeIno(Ext2FileSystem *e,Ext2CInode *cnode,const void *buffer,off_t offset,size_t count);
 
 private:
+	/**
+	 * Reads the data blocks <first> .. <first> + <count> - 1 of the given inode into the block
+	 * cache. Physically consecutive blocks are read at once.
+	 */
+	static void prefetch(Ext2FileSystem *e,const Ext2CInode *cnode,block_t first,size_t count);
 	/**
 	 * Free's the given doubly-indirect-block
 	 */
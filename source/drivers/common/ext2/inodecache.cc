@@ -35,98 +35,107 @@
 
 using namespace fs;
 
-Ext2INodeCache::Ext2INodeCache(Ext2FileSystem *fs)
-		: _hits(), _misses(), _cache(new Ext2CInode[EXT2_ICACHE_SIZE]), _fs(fs) {
-	size_t i;
-	Ext2CInode *inode = _cache;
-	for(i = 0; i < EXT2_ICACHE_SIZE; i++) {
+Ext2INodeCache::Ext2INodeCache(Ext2FileSystem *fs,size_t size)
+		: _hits(), _misses(), _evictions(), _scans(), _writebacks(), _size(size), _hashSize(1),
+		  _hashmap(), _oldest(), _newest(), _cache(new Ext2CInode[size]), _fs(fs), _lock() {
+	/* use a power of 2 for the hashmap with about 2 inodes per bucket */
+	while(_hashSize * 2 < _size)
+		_hashSize *= 2;
+	_hashmap = new Ext2CInode*[_hashSize]();
+
+	/* initially, all inodes are free and in the LRU list */
+	for(size_t i = 0; i < _size; i++) {
+		Ext2CInode *inode = _cache + i;
 		inode->inodeNo = EXT2_BAD_INO;
 		inode->refs = 0;
 		inode->dirty = false;
-		inode++;
+		inode->hnext = NULL;
+		lruAdd(inode,true);
 	}
 }
 
+static int cmpInodes(const void *a,const void *b) {
+	const Ext2CInode *i1 = *(const Ext2CInode**)a;
+	const Ext2CInode *i2 = *(const Ext2CInode**)b;
+	return i1->inodeNo < i2->inodeNo ? -1 : (i1->inodeNo > i2->inodeNo ? 1 : 0);
+}
+
 void Ext2INodeCache::flush() {
-	Ext2CInode *inode,*end = _cache + EXT2_ICACHE_SIZE;
+	Ext2CInode *batch[WRITEBACK_BATCH];
+	size_t count = 0;
+	Ext2CInode *inode,*end = _cache + _size;
+	std::lock_guard<std::mutex> guard(_lock);
+	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
 	for(inode = _cache; inode < end; inode++) {
 		if(inode->dirty) {
-			sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
-			acquire(inode,IMODE_READ);
-			write(inode);
-			release(inode);
+			batch[count++] = inode;
+			if(count == WRITEBACK_BATCH) {
+				writeSorted(batch,count);
+				count = 0;
+			}
 		}
 	}
+	if(count > 0)
+		writeSorted(batch,count);
+	sassert(tpool_unlock(ALLOC_LOCK) == 0);
 }
 
 Ext2CInode *Ext2INodeCache::request(ino_t no,uint mode) {
-	/* search for the inode. perhaps it's already in cache */
-	Ext2CInode *startNode = _cache + (no & (EXT2_ICACHE_SIZE - 1));
-	Ext2CInode *iend = _cache + EXT2_ICACHE_SIZE;
 	Ext2CInode *inode;
 	if(no <= EXT2_BAD_INO)
 		return NULL;
 
+	/* inodes are rarely missed and their blocks are usually cached, so that we keep the lock
+	 * while loading one */
+	std::lock_guard<std::mutex> guard(_lock);
+
 	/* tpool_lock the request of an inode */
 	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
 
-	for(inode = startNode; inode < iend; inode++) {
-		if(inode->inodeNo == no) {
-			acquire(inode,mode);
-			_hits++;
-			return inode;
-		}
-	}
-	/* look in 0 .. startNode; separate it to make the average-case fast */
-	if(inode == iend) {
-		for(inode = _cache; inode < startNode; inode++) {
-			if(inode->inodeNo == no) {
-				acquire(inode,mode);
-				_hits++;
-				return inode;
-			}
-		}
-	}
-
-	/* ok, not in cache. so we start again at the position to find a usable node */
-	/* if we have to load it from disk anyway I think we can waste a few cycles more
-	 * to reduce the number of cycles in the cache-lookup. therefore
-	 * we don't collect the information in the loops above. */
-	for(inode = startNode; inode < iend; inode++) {
-		if(inode->inodeNo == EXT2_BAD_INO || inode->refs == 0)
-			break;
+	/* search for the inode. perhaps it's already in cache */
+	inode = lookup(no);
+	if(inode) {
+		if(inode->refs == 0)
+			lruRemove(inode);
+		acquire(inode,mode);
+		_hits++;
+		return inode;
 	}
-	if(inode == iend) {
-		for(inode = _cache; inode < startNode; inode++) {
-			if(inode->inodeNo == EXT2_BAD_INO || inode->refs == 0)
-				break;
-		}
 
-		if(inode == startNode) {
-			printf("NO FREE INODE-CACHE-SLOT! What to to??");
-			return NULL;
-		}
+	/* ok, not in cache. so reuse the least recently used one */
+	inode = _oldest;
+	if(inode == NULL) {
+		sassert(tpool_unlock(ALLOC_LOCK) == 0);
+		printe("All %zu inode-cache entries are in use",_size);
+		return NULL;
 	}
 
 	/* write the old inode back, if necessary */
-	if(inode->dirty && inode->inodeNo != EXT2_BAD_INO) {
-		acquire(inode,IMODE_READ);
-		write(inode);
-		doRelease(inode,false);
+	if(inode->inodeNo != EXT2_BAD_INO) {
+		if(inode->dirty)
+			writeBack(inode);
+		hashRemove(inode);
+		_evictions++;
 	}
+	lruRemove(inode);
 
 	/* build node */
 	inode->inodeNo = no;
 	inode->dirty = false;
+	Ext2CInode **bucket = _hashmap + (no & (_hashSize - 1));
+	inode->hnext = *bucket;
+	*bucket = inode;
+
 	/* first for writing because we have to load it */
 	acquire(inode,IMODE_WRITE);
 
 	read(inode);
 
-	/* now use for the requested mode */
-	if(mode != IMODE_WRITE) {
-		doRelease(inode,false);
-		acquire(inode,mode);
+	/* now use for the requested mode. we keep our reference, because releasing it would put the
+	 * inode on the LRU list, so that it could be reused while we're using it */
+	if(~mode & IMODE_WRITE) {
+		sassert(tpool_unlock((uint)inode) == 0);
+		sassert(tpool_lock((uint)inode,0) == 0);
 	}
 
 	_misses++;
@@ -135,19 +144,28 @@ Ext2CInode *Ext2INodeCache::request(ino_t no,uint mode) {
 
 void Ext2INodeCache::print(FILE *f) {
 	float hitrate;
-	size_t used = 0,dirty = 0;
-	Ext2CInode *inode,*end = _cache + EXT2_ICACHE_SIZE;
+	size_t used = 0,dirty = 0,refd = 0;
+	Ext2CInode *inode,*end = _cache + _size;
+	std::lock_guard<std::mutex> guard(_lock);
 	for(inode = _cache; inode < end; inode++) {
 		if(inode->inodeNo != EXT2_BAD_INO)
 			used++;
 		if(inode->dirty)
 			dirty++;
+		if(inode->refs > 0)
+			refd++;
 	}
-	fprintf(f,"\tTotal entries: %zu\n",EXT2_ICACHE_SIZE);
+	fprintf(f,"\tTotal entries: %zu\n",_size);
+	fprintf(f,"\tHash buckets: %zu\n",_hashSize);
 	fprintf(f,"\tUsed entries: %zu\n",used);
+	fprintf(f,"\tReferenced entries: %zu\n",refd);
 	fprintf(f,"\tDirty entries: %zu\n",dirty);
 	fprintf(f,"\tHits: %zu\n",_hits);
 	fprintf(f,"\tMisses: %zu\n",_misses);
+	fprintf(f,"\tEvictions: %zu\n",_evictions);
+	fprintf(f,"\tWritebacks: %zu\n",_writebacks);
+	fprintf(f,"\tScanned entries: %zu (%.3f per lookup)\n",_scans,
+		_hits + _misses == 0 ? 0.0f : (float)_scans / (_hits + _misses));
 	if(_hits == 0)
 		hitrate = 0;
 	else
@@ -167,46 +185,137 @@ void Ext2INodeCache::doRelease(Ext2CInode *ino,bool unlockAlloc) {
 
 	/* don't write dirty blocks back here, because this would lead to too many writes. */
 	/* skipping it until the inode-cache-entry should be reused, is better */
+	_lock.lock();
 	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
-	/* if there are no references and no links anymore, we have to delete the file */
+	/* if there are no references and no links anymore, we have to delete the file. this only
+	 * happens for writers, because open files keep a reference */
 	if(--ino->refs == 0) {
 		if(ino->inode.linkCount == 0) {
+			/* keep it referenced while removing it to not reuse it in the meantime. removing
+			 * requests other inodes, so that we can't hold the lock */
+			ino->refs++;
+			_lock.unlock();
 			Ext2File::remove(_fs,ino);
+			_lock.lock();
+			ino->refs--;
 			/* ensure that we don't use the cached inode again */
+			hashRemove(ino);
 			ino->inodeNo = EXT2_BAD_INO;
 			ino->dirty = false;
+			lruAdd(ino,false);
 		}
+		else
+			lruAdd(ino,true);
 	}
 	if(unlockAlloc)
 		sassert(tpool_unlock(ALLOC_LOCK) == 0);
 	sassert(tpool_unlock((uint)ino) == 0);
+	_lock.unlock();
 }
 
-void Ext2INodeCache::read(Ext2CInode *inode) {
-	uint32_t inodesPerGroup = le32tocpu(_fs->sb.get()->inodesPerGroup);
-	Ext2BlockGrp *group = _fs->bgs.get((inode->inodeNo - 1) / inodesPerGroup);
-	size_t inodesPerBlock = _fs->blockSize() / sizeof(Ext2Inode);
-	size_t noInGroup = (inode->inodeNo - 1) % inodesPerGroup;
-	block_t blockNo = le32tocpu(group->inodeTable) + noInGroup / inodesPerBlock;
-	size_t inodeInBlock = (inode->inodeNo - 1) % inodesPerBlock;
-	CBlock *block = _fs->blockCache.request(blockNo,BlockCache::READ);
-	vassert(block != NULL,"Fetching block %d failed",blockNo);
-	memcpy(&(inode->inode),(uint8_t*)block->buffer + inodeInBlock * sizeof(Ext2Inode),
-			sizeof(Ext2Inode));
-	_fs->blockCache.release(block);
+Ext2CInode *Ext2INodeCache::lookup(ino_t no) {
+	Ext2CInode *inode = _hashmap[no & (_hashSize - 1)];
+	while(inode != NULL) {
+		_scans++;
+		if(inode->inodeNo == no)
+			return inode;
+		inode = inode->hnext;
+	}
+	return NULL;
+}
+
+void Ext2INodeCache::hashRemove(Ext2CInode *inode) {
+	Ext2CInode **prev = _hashmap + (inode->inodeNo & (_hashSize - 1));
+	while(*prev != inode) {
+		assert(*prev != NULL);
+		prev = &(*prev)->hnext;
+	}
+	*prev = inode->hnext;
+	inode->hnext = NULL;
+}
+
+void Ext2INodeCache::lruRemove(Ext2CInode *inode) {
+	if(inode->prev)
+		inode->prev->next = inode->next;
+	else
+		_newest = inode->next;
+	if(inode->next)
+		inode->next->prev = inode->prev;
+	else
+		_oldest = inode->prev;
+}
+
+void Ext2INodeCache::lruAdd(Ext2CInode *inode,bool newest) {
+	if(newest) {
+		inode->prev = NULL;
+		inode->next = _newest;
+		if(_newest)
+			_newest->prev = inode;
+		else
+			_oldest = inode;
+		_newest = inode;
+	}
+	else {
+		inode->next = NULL;
+		inode->prev = _oldest;
+		if(_oldest)
+			_oldest->next = inode;
+		else
+			_newest = inode;
+		_oldest = inode;
+	}
 }
 
-void Ext2INodeCache::write(Ext2CInode *inode) {
+void Ext2INodeCache::writeBack(Ext2CInode *victim) {
+	/* the inodes that will be reused next are likely dirty as well. so, write them back, too */
+	Ext2CInode *batch[WRITEBACK_BATCH];
+	size_t count = 0;
+	batch[count++] = victim;
+	for(Ext2CInode *inode = victim->prev; inode && count < WRITEBACK_BATCH; inode = inode->prev) {
+		if(inode->dirty)
+			batch[count++] = inode;
+	}
+	writeSorted(batch,count);
+}
+
+void Ext2INodeCache::writeSorted(Ext2CInode **inodes,size_t count) {
+	qsort(inodes,count,sizeof(Ext2CInode*),cmpInodes);
+
+	CBlock *block = NULL;
+	for(size_t i = 0; i < count; ++i) {
+		size_t offset;
+		block_t blockNo = getBlock(inodes[i]->inodeNo,&offset);
+		/* the inodes are sorted, so that we only need to request the block once */
+		if(block == NULL || block->blockNo != blockNo) {
+			if(block)
+				_fs->blockCache.release(block);
+			block = _fs->blockCache.request(blockNo,BlockCache::WRITE);
+			vassert(block != NULL,"Fetching block %d failed",blockNo);
+			_fs->blockCache.markDirty(block);
+		}
+
+		memcpy((uint8_t*)block->buffer + offset,&inodes[i]->inode,sizeof(Ext2Inode));
+		inodes[i]->dirty = false;
+		_writebacks++;
+	}
+	if(block)
+		_fs->blockCache.release(block);
+}
+
+block_t Ext2INodeCache::getBlock(ino_t no,size_t *offset) {
 	uint32_t inodesPerGroup = le32tocpu(_fs->sb.get()->inodesPerGroup);
-	Ext2BlockGrp *group = _fs->bgs.get((inode->inodeNo - 1) / inodesPerGroup);
+	Ext2BlockGrp *group = _fs->bgs.get((no - 1) / inodesPerGroup);
 	size_t inodesPerBlock = _fs->blockSize() / sizeof(Ext2Inode);
-	size_t noInGroup = (inode->inodeNo - 1) % inodesPerGroup;
-	block_t blockNo = le32tocpu(group->inodeTable) + noInGroup / inodesPerBlock;
-	size_t inodeInBlock = (inode->inodeNo - 1) % inodesPerBlock;
-	CBlock *block = _fs->blockCache.request(blockNo,BlockCache::WRITE);
+	size_t noInGroup = (no - 1) % inodesPerGroup;
+	*offset = ((no - 1) % inodesPerBlock) * sizeof(Ext2Inode);
+	return le32tocpu(group->inodeTable) + noInGroup / inodesPerBlock;
+}
+
+void Ext2INodeCache::read(Ext2CInode *inode) {
+	size_t offset;
+	block_t blockNo = getBlock(inode->inodeNo,&offset);
+	CBlock *block = _fs->blockCache.request(blockNo,BlockCache::READ);
 	vassert(block != NULL,"Fetching block %d failed",blockNo);
-	memcpy((uint8_t*)block->buffer + inodeInBlock * sizeof(Ext2Inode),&(inode->inode),
-			sizeof(Ext2Inode));
-	_fs->blockCache.markDirty(block);
+	memcpy(&(inode->inode),(uint8_t*)block->buffer + offset,sizeof(Ext2Inode));
 	_fs->blockCache.release(block);
 }
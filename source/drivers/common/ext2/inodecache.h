@@ -21,6 +21,7 @@
 
 #include <sys/common.h>
 #include <stdio.h>
+#include <mutex>
 
 #include "inode.h"
 
@@ -30,6 +31,11 @@ struct Ext2CInode {
 	ino_t inodeNo;
 	ushort dirty;
 	ushort refs;
+	/* the LRU list of unreferenced inodes */
+	Ext2CInode *prev;
+	Ext2CInode *next;
+	/* the next inode in the hashmap-bucket */
+	Ext2CInode *hnext;
 	fs::Ext2Inode inode;
 };
 
@@ -38,13 +44,26 @@ enum {
 	IMODE_WRITE	= 0x2,
 };
 
+/**
+ * The inode cache finds the cached inodes via a hashmap. The unreferenced inodes are kept in a
+ * LRU list, whose least recently used entry is reused on a miss. Dirty inodes are written back in
+ * batches, sorted by their inode number to write all inodes of an inode-table block at once.
+ * The cache has its own lock, because concurrent readers of the file system use it.
+ */
 class Ext2INodeCache {
+	/* the max. number of dirty inodes that are written back together on eviction */
+	static const size_t WRITEBACK_BATCH	= 16;
+
 public:
 	/**
 	 * Inits the inode-cache
+	 *
+	 * @param fs the filesystem
+	 * @param size the number of inodes to cache
 	 */
-	explicit Ext2INodeCache(Ext2FileSystem *fs);
+	explicit Ext2INodeCache(Ext2FileSystem *fs,size_t size);
 	~Ext2INodeCache() {
+		delete[] _hashmap;
 		delete[] _cache;
 	}
 
@@ -62,6 +81,19 @@ public:
 		inode->dirty = true;
 	}
 
+	/**
+	 * Sets the access time of the given inode to <time> and marks it dirty. In contrast to
+	 * markDirty, this may be used by concurrent readers.
+	 *
+	 * @param inode the inode
+	 * @param time the access time
+	 */
+	void markAccessed(Ext2CInode *inode,time_t time) {
+		std::lock_guard<std::mutex> guard(_lock);
+		inode->inode.accesstime = cputole32(time);
+		inode->dirty = true;
+	}
+
 	/**
 	 * Requests the inode with given number. That means if it is in the cache you'll simply get it.
 	 * Otherwise it is fetched from disk and put into the cache. The references of the cache-inode
@@ -101,16 +133,51 @@ private:
 	 */
 	void doRelease(Ext2CInode *ino,bool unlockAlloc);
 	/**
-	 * Reads the inode from block-cache. Requires inode->inodeNo to be valid!
+	 * Searches for the inode with given number in the hashmap
 	 */
-	void read(Ext2CInode *inode);
+	Ext2CInode *lookup(ino_t no);
 	/**
-	 * Writes the inode back to the cached block, which can be written to disk later
+	 * Removes the given inode from the hashmap
 	 */
-	void write(Ext2CInode *inode);
+	void hashRemove(Ext2CInode *inode);
+	/**
+	 * Removes the given inode from the LRU list
+	 */
+	void lruRemove(Ext2CInode *inode);
+	/**
+	 * Appends the given inode to the LRU list. If <newest> is true, it becomes the most recently
+	 * used one, otherwise it will be reused next.
+	 */
+	void lruAdd(Ext2CInode *inode,bool newest);
+	/**
+	 * Writes back <victim> together with further unreferenced dirty inodes
+	 */
+	void writeBack(Ext2CInode *victim);
+	/**
+	 * Writes the given inodes, sorted by inode number, to the cached blocks
+	 */
+	void writeSorted(Ext2CInode **inodes,size_t count);
+	/**
+	 * Determines the block and the offset in this block of the given inode
+	 */
+	block_t getBlock(ino_t no,size_t *offset);
+	/**
+	 * Reads the inode from block-cache. Requires inode->inodeNo to be valid!
+	 */
+	void read(Ext2CInode *inode);
 
 	size_t _hits;
 	size_t _misses;
+	size_t _evictions;
+	size_t _scans;
+	size_t _writebacks;
+	size_t _size;
+	size_t _hashSize;
+	Ext2CInode **_hashmap;
+	Ext2CInode *_oldest;
+	Ext2CInode *_newest;
 	Ext2CInode *_cache;
 	Ext2FileSystem *_fs;
+	/* protects the hashmap, the LRU list, the reference counts and the dirty flags */
+	std::mutex _lock;
 };
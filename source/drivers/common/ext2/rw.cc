@@ -28,6 +28,8 @@
 #include "rw.h"
 
 int Ext2RW::readSectors(Ext2FileSystem *e,void *buffer,uint64_t lba,size_t secCount) {
+	/* seek and read have to be done at once */
+	std::lock_guard<std::mutex> guard(e->devLock);
 	off_t off = seek(e->fd,lba * DISK_SECTOR_SIZE,SEEK_SET);
 	if(off < 0) {
 		printe("Unable to seek to %x",lba * DISK_SECTOR_SIZE);
@@ -44,6 +46,8 @@ int Ext2RW::readSectors(Ext2FileSystem *e,void *buffer,uint64_t lba,size_t secCo
 }
 
 int Ext2RW::writeSectors(Ext2FileSystem *e,const void *buffer,uint64_t lba,size_t secCount) {
+	/* seek and write have to be done at once */
+	std::lock_guard<std::mutex> guard(e->devLock);
 	off_t off = seek(e->fd,lba * DISK_SECTOR_SIZE,SEEK_SET);
 	if(off < 0) {
 		printe("Unable to seek to %x",lba * DISK_SECTOR_SIZE);
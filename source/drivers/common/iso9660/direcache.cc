@@ -27,20 +27,23 @@
 #include "rw.h"
 
 ISO9660DirCache::ISO9660DirCache(ISO9660FileSystem *h)
-	: _nextFree(0), _cache(new ISOCDirEntry[ISO_DIRE_CACHE_SIZE]()), _fs(h) {
+	: _lock(), _nextFree(0), _cache(new ISOCDirEntry[ISO_DIRE_CACHE_SIZE]()), _fs(h) {
 }
 
-const ISOCDirEntry *ISO9660DirCache::get(ino_t id) {
+bool ISO9660DirCache::get(ino_t id,ISOCDirEntry *res) {
 	const ISODirEntry *e;
 	fs::CBlock *blk;
 	block_t blockLBA;
 	size_t i,blockSize,offset;
 	int unused = -1;
 
+	std::lock_guard<std::mutex> guard(_lock);
 	/* search in the cache */
 	for(i = 0; i < ISO_DIRE_CACHE_SIZE; i++) {
-		if(_cache[i].id == id)
-			return _cache + i;
+		if(_cache[i].id == id) {
+			*res = _cache[i];
+			return true;
+		}
 		if(unused < 0 && _cache[i].id == 0)
 			unused = i;
 	}
@@ -63,18 +66,20 @@ const ISOCDirEntry *ISO9660DirCache::get(ino_t id) {
 		blockLBA = id / blockSize + offset / blockSize;
 		blk = _fs->blockCache.request(blockLBA,fs::BlockCache::READ);
 		if(blk == NULL)
-			return NULL;
+			return false;
 		e = (const ISODirEntry*)((uintptr_t)blk->buffer + (offset % blockSize));
 		/* don't copy the name! */
 		memcpy(&(_cache[unused].entry),e,sizeof(ISODirEntry));
 		_cache[unused].id = id;
 		_fs->blockCache.release(blk);
 	}
-	return _cache + unused;
+	*res = _cache[unused];
+	return true;
 }
 
 void ISO9660DirCache::print(FILE *f) {
 	size_t i,freeEntries = 0;
+	std::lock_guard<std::mutex> guard(_lock);
 	for(i = 0; i < ISO_DIRE_CACHE_SIZE; i++) {
 		if(_cache[i].id == 0)
 			freeEntries++;
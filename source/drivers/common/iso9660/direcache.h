@@ -20,6 +20,7 @@
 #pragma once
 
 #include <sys/common.h>
+#include <mutex>
 #include <stdio.h>
 
 #include "common.h"
@@ -73,12 +74,14 @@ public:
 
 	/**
 	 * Retrieves the directory-entry with given id (LBA * blockSize + offset in directory)
-	 * Note that the entries will NOT contain the name!
+	 * Note that the entries will NOT contain the name! The entry is copied to <e>, because the
+	 * cache slot might be reused by another thread at any time.
 	 *
 	 * @param id the id
-	 * @return the cached directory-entry or NULL if failed
+	 * @param e the entry to write to
+	 * @return true if successful
 	 */
-	const ISOCDirEntry *get(ino_t id);
+	bool get(ino_t id,ISOCDirEntry *e);
 
 	/**
 	 * Prints information and statistics of the directory-entry-cache to the given file
@@ -88,6 +91,7 @@ public:
 	void print(FILE *f);
 
 private:
+	std::mutex _lock;
 	size_t _nextFree;
 	ISOCDirEntry *_cache;
 	ISO9660FileSystem *_fs;
@@ -32,15 +32,15 @@
 #include "rw.h"
 
 ssize_t ISO9660File::read(ISO9660FileSystem *h,ino_t inodeNo,void *buffer,off_t offset,size_t count) {
-	const ISOCDirEntry *e;
+	ISOCDirEntry ce;
+	const ISOCDirEntry *e = &ce;
 	fs::CBlock *blk;
 	uint8_t *bufWork;
 	block_t startBlock;
 	size_t c,i,blockSize,blockCount,leftBytes;
 
 	/* at first we need the direntry */
-	e = h->dirCache.get(inodeNo);
-	if(e == NULL)
+	if(!h->dirCache.get(inodeNo,&ce))
 		return -ENOBUFS;
 
 	/* nothing left to read? */
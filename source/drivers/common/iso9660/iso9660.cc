@@ -19,6 +19,7 @@
 
 #include <esc/util.h>
 #include <sys/common.h>
+#include <sys/conf.h>
 #include <sys/debug.h>
 #include <sys/io.h>
 #include <sys/proc.h>
@@ -76,7 +77,7 @@ int main(int argc,char *argv[]) {
 			error("Unable to find cd-device with /boot/escape on it");
 	}
 
-	fs::FSDevice<fs::OpenFile> fsdev(fs,argv[1]);
+	fs::FSDevice<fs::OpenFile> fsdev(fs,argv[1],sysconf(CONF_CPU_COUNT));
 	fsdev.loop();
 	return 0;
 }
@@ -89,8 +90,8 @@ bool ISO9660FileSystem::ISO9660BlockCache::writeBlocks(const void *,size_t,size_
 }
 
 ISO9660FileSystem::ISO9660FileSystem(const char *device)
-		: FileSystem(), fd(::open(device,O_RDONLY)), primary(), dummy(initPrimaryVol(this,device)),
-		  dirCache(this), blockCache(this) {
+		: FileSystem(), fd(::open(device,O_RDONLY)), devLock(), primary(),
+		  dummy(initPrimaryVol(this,device)), dirCache(this), blockCache(this) {
 }
 
 int ISO9660FileSystem::initPrimaryVol(ISO9660FileSystem *fs,const char *device) {
@@ -131,10 +132,12 @@ void ISO9660FileSystem::close(fs::OpenFile *) {
 
 int ISO9660FileSystem::stat(fs::OpenFile *file,struct stat *info) {
 	time_t ts;
-	const ISOCDirEntry *e = dirCache.get(file->ino);
-	if(e == NULL)
+	ISOCDirEntry ce;
+	if(!dirCache.get(file->ino,&ce))
 		return -ENOBUFS;
 
+	const ISOCDirEntry *e = &ce;
+
 	ts = dirDate2Timestamp(&e->entry.created);
 	info->st_atime = ts;
 	info->st_mtime = ts;
@@ -24,6 +24,7 @@
 #include <fs/fsdev.h>
 #include <sys/common.h>
 #include <sys/stat.h>
+#include <mutex>
 
 #include "common.h"
 #include "direcache.h"
@@ -235,6 +236,8 @@ private:
 public:
 	/* the fd for the device */
 	int fd;
+	/* protects the file position of fd */
+	std::mutex devLock;
 
 	ISOVolDesc primary;
 	int dummy;
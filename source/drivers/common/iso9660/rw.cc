@@ -21,6 +21,7 @@
 #include <sys/common.h>
 #include <sys/io.h>
 #include <sys/thread.h>
+#include <mutex>
 #include <stdio.h>
 
 #include "iso9660.h"
@@ -29,6 +30,8 @@
 int ISO9660RW::readSectors(ISO9660FileSystem *fs,void *buffer,uint64_t lba,size_t secCount) {
 	int fd = fs->fd;
 
+	/* seek and read have to be done at once */
+	std::lock_guard<std::mutex> guard(fs->devLock);
 	off_t off = seek(fd,lba * ATAPI_SECTOR_SIZE,SEEK_SET);
 	if(off < 0) {
 		printe("Unable to seek to %x",lba * ATAPI_SECTOR_SIZE);
@@ -35,8 +35,9 @@ public:
 		return 64 * 1024;
 	}
 	virtual ssize_t send(const void *packet,size_t size) {
-		Packet *pkt = (Packet*)malloc(sizeof(Packet) + size);
-		pkt->length = size;
+		Packet *pkt = alloc(size);
+		if(!pkt)
+			return -ENOMEM;
 		memcpy(pkt->data,packet,size);
 		insert(pkt);
 		(*handler)();
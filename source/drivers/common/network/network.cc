@@ -157,6 +157,8 @@ static const NICDesc nics[] = {
 	{0x8086,	0x2e6e,	"/sbin/e1000",	"cemedia",		"CE Media Processor"},
 
 	{0x10ec,	0x8029,	"/sbin/ne2k",	"ne2k",			"NE2000"},
+
+	{0x1af4,	0x1000,	"/sbin/virtionet","virtio",		"Virtio"},
 };
 
 static const int TIMEOUT = 2000; /* ms */
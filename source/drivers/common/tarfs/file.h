@@ -48,10 +48,11 @@ struct TarINode {
 	}
 
 	void reference() {
-		_refs++;
+		__sync_fetch_and_add(&_refs,1);
 	}
 	void deference() {
-		if(--_refs == 0)
+		/* the last reference might be dropped by closing a file, which is done without lock */
+		if(__sync_sub_and_fetch(&_refs,1) == 0)
 			delete this;
 	}
 
@@ -24,11 +24,13 @@
 #include <fs/fsdev.h>
 #include <fs/permissions.h>
 #include <sys/common.h>
+#include <sys/conf.h>
 #include <sys/endian.h>
 #include <sys/proc.h>
 #include <sys/stat.h>
 #include <usergroup/usergroup.h>
 #include <dirent.h>
+#include <mutex>
 #include <stdlib.h>
 #include <time.h>
 
@@ -89,11 +91,12 @@ struct OpenTarFile : public OpenFile {
 
 class TarFileSystem : public FileSystem<OpenTarFile> {
 public:
-	explicit TarFileSystem(FILE *archive) : FileSystem<OpenTarFile>(), _archive(archive) {
+	explicit TarFileSystem(FILE *archive) : FileSystem<OpenTarFile>(), _archive(archive), _lock() {
 		init(_archive);
 	}
 
-	ino_t open(User *u,const char *path,ssize_t *,ino_t root,uint flags,mode_t mode,int fd,OpenTarFile **file) override  {
+	ino_t open(User *u,const char *path,ssize_t *,ino_t root,uint flags,mode_t mode,int fd,OpenTarFile **file) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		/* TODO support different root inodes */
 		if(root != 0)
 			return -ENOTSUP;
@@ -126,15 +129,18 @@ public:
 	}
 
 	int stat(OpenTarFile *file,struct stat *info) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		*info = file->file->info;
 		return 0;
 	}
 
 	ssize_t read(OpenTarFile *file,void *data,off_t pos,size_t count) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		return file->read(data,pos,count);
 	}
 
 	ssize_t write(OpenTarFile *file,const void *data,off_t pos,size_t count) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		ssize_t res = file->write(data,pos,count);
 		if(res > 0)
 			changed = true;
@@ -142,6 +148,7 @@ public:
 	}
 
 	int truncate(OpenTarFile *file,off_t length) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		return file->truncate(length);
 	}
 
@@ -151,6 +158,7 @@ public:
 	}
 
 	int unlink(OpenTarFile *dir,const char *name) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		char path[MAX_PATH_LEN];
 		snprintf(path,sizeof(path),"%s/%s",dir->path.c_str(),name);
 
@@ -175,6 +183,7 @@ public:
 	}
 
 	int mkdir(OpenTarFile *dir,const char *name,mode_t mode) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		char path[MAX_PATH_LEN];
 		snprintf(path,sizeof(path),"%s/%s",dir->path.c_str(),name);
 
@@ -198,6 +207,7 @@ public:
 	}
 
 	int rmdir(OpenTarFile *dir,const char *name) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		char path[MAX_PATH_LEN];
 		snprintf(path,sizeof(path),"%s/%s",dir->path.c_str(),name);
 
@@ -223,6 +233,7 @@ public:
 	}
 
 	int rename(OpenTarFile *oldDir,const char *oldName,OpenTarFile *newDir,const char *newName) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		char oldPath[MAX_PATH_LEN];
 		char newPath[MAX_PATH_LEN];
 		snprintf(oldPath,sizeof(oldPath),"%s/%s",oldDir->path.c_str(),oldName);
@@ -257,6 +268,7 @@ public:
 	}
 
 	int chmod(OpenTarFile *file,mode_t mode) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		struct stat *info = &file->file->info;
 		if(!Permissions::canChmod(&file->user,info->st_uid))
 			return -EPERM;
@@ -267,6 +279,7 @@ public:
 	}
 
 	int chown(OpenTarFile *file,uid_t uid,gid_t gid) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		struct stat *info = &file->file->info;
 		if(!Permissions::canChown(&file->user,info->st_uid,info->st_gid,uid,gid))
 			return -EPERM;
@@ -280,6 +293,7 @@ public:
 	}
 
 	int utime(OpenTarFile *file,const struct utimbuf *utimes) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		struct stat *info = &file->file->info;
 		if(!Permissions::canUtime(&file->user,info->st_uid))
 			return -EPERM;
@@ -291,6 +305,7 @@ public:
 	}
 
 	void print(FILE *f) override {
+		std::lock_guard<std::mutex> guard(_lock);
 		fprintf(f,"file : %s\n",archiveFile);
 		fprintf(f,"dirty: %s\n",changed ? "yes" : "no");
 	}
@@ -365,6 +380,8 @@ private:
 	}
 
 	FILE *_archive;
+	/* the tree and the archive are shared by all clients */
+	std::mutex _lock;
 };
 
 static char buffer[Tar::BLOCK_SIZE];
@@ -437,7 +454,7 @@ int main(int argc,char **argv) {
 
 	{
 		TarFileSystem fs(ar);
-		FSDevice<OpenTarFile> dev(&fs,argv[1]);
+		FSDevice<OpenTarFile> dev(&fs,argv[1],sysconf(CONF_CPU_COUNT));
 		dev.loop();
 	}
 
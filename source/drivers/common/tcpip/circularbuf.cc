@@ -26,8 +26,8 @@
 ssize_t CircularBuf::push(seq_type seqNo,uint8_t type,const void *data,size_t size) {
 	size_t seqadd = type == TYPE_CTRL ? 1 : size;
 	assert(seqadd <= _max);
-	// if we put in a control-message, it can't be out-of-order
-	if(type == TYPE_CTRL && seqNo != _seqAcked)
+	// control-packets have no data and can only be appended to the contiguous part
+	if(type == TYPE_CTRL && (seqNo != nextSeq() || _ctrlCount == MAX_CTRLS))
 		return -EINVAL;
 	// ensure that we don't use up more than our window size
 	if(_current == _max)
@@ -63,199 +63,213 @@ ssize_t CircularBuf::push(seq_type seqNo,uint8_t type,const void *data,size_t si
 		seqadd -= relEnd - winEnd;
 		relEnd = winEnd;
 	}
-	// now we know that seqNo and [begin,begin+size] fits into our window
 
-	// find the position in the list
-	size_t oldcur = _current;
-	if(_packets.size() == 0)
-		add(_packets.end(),seqNo,type,begin,size,seqadd);
-	else {
-		for(auto it = _packets.begin(); seqadd > 0 && it != _packets.end(); ++it) {
-			seq_type relSeq = it->start - _seqStart;
-			// skip packet if it is already acked, but not yet pulled data
-			// this might have a start before _seqStart if we already pulled some of that data
-			if(relSeq >= _max)
-				continue;
+	// everything in front of the end of the contiguous part is already there
+	size_t start = relStart;
+	size_t end = relStart + seqadd;
+	if(start < _contig) {
+		start = std::min(_contig,end);
+		begin += start - relStart;
+	}
+	if(start == end)
+		return 0;
+	// now we know that [start,end) fits into our window and is behind the contiguous part
 
-			// is there something missing?
-			if(relStart < relSeq) {
-				size_t amount = std::min(seqadd,static_cast<size_t>(relSeq - relStart));
-				add(it,seqNo,type,begin,size,amount);
-				relStart += amount;
-				seqNo += amount;
-				begin += amount;
-				seqadd -= amount;
-			}
+	if(type == TYPE_DATA && !_buf)
+		_buf = new uint8_t[_max];
+
+	// copy the parts that we don't have yet
+	size_t added = 0;
+	size_t i = 0;
+	for(size_t cur = start; cur < end; ) {
+		while(i < _rangeCount && rel(_ranges[i].end) <= cur)
+			i++;
 
+		size_t gapEnd = end;
+		if(i < _rangeCount) {
+			size_t rstart = rel(_ranges[i].start);
 			// duplicate data?
-			if(relStart < relSeq + it->size()) {
-				// we're done
-				if(relEnd <= relSeq + it->size())
-					seqadd = 0;
-				else {
-					// skip this part
-					size_t diff = relSeq + it->size() - relStart;
-					relStart += diff;
-					seqNo += diff;
-					begin += diff;
-					seqadd -= diff;
-				}
+			if(rstart <= cur) {
+				cur = rel(_ranges[i].end);
+				continue;
 			}
+			gapEnd = std::min(end,rstart);
 		}
-		// something left to insert?
-		if(seqadd > 0)
-			add(_packets.end(),seqNo,type,begin,size,seqadd);
+
+		if(type == TYPE_DATA)
+			copyIn(cur,begin + (cur - start),gapEnd - cur);
+		added += gapEnd - cur;
+		cur = gapEnd;
+	}
+
+	if(added == 0 || !addRange(start,end))
+		return 0;
+	if(type == TYPE_CTRL)
+		_ctrls[_ctrlCount++] = seqNo;
+	_current += added;
+	return added;
+}
+
+bool CircularBuf::addRange(size_t start,size_t end) {
+	if(start <= _contig) {
+		_contig = std::max(_contig,end);
+		// the contiguous part might reach the first ranges now
+		size_t n = 0;
+		for(; n < _rangeCount && rel(_ranges[n].start) <= _contig; ++n)
+			_contig = std::max(_contig,rel(_ranges[n].end));
+		memmove(_ranges,_ranges + n,(_rangeCount - n) * sizeof(Range));
+		_rangeCount -= n;
+		return true;
+	}
+
+	// find the ranges that overlap with or touch [start,end)
+	size_t i = 0;
+	while(i < _rangeCount && rel(_ranges[i].end) < start)
+		i++;
+	size_t j = i;
+	for(; j < _rangeCount && rel(_ranges[j].start) <= end; ++j) {
+		start = std::min(start,rel(_ranges[j].start));
+		end = std::max(end,rel(_ranges[j].end));
 	}
-	return _current - oldcur;
+
+	// either insert a new range or replace the ranges i..j-1 with a single one
+	if(i == j) {
+		if(_rangeCount == MAX_RANGES)
+			return false;
+		memmove(_ranges + i + 1,_ranges + i,(_rangeCount - i) * sizeof(Range));
+		_rangeCount++;
+	}
+	else {
+		memmove(_ranges + i + 1,_ranges + j,(_rangeCount - j) * sizeof(Range));
+		_rangeCount -= j - i - 1;
+	}
+	_ranges[i].start = _seqStart + start;
+	_ranges[i].end = _seqStart + end;
+	return true;
 }
 
-void CircularBuf::add(std::list<SeqPacket>::iterator it,seq_type seqNo,uint8_t type,
-		const uint8_t *data,size_t size,size_t dataSize) {
-	_packets.insert(it,SeqPacket(seqNo,type,data,type == TYPE_CTRL ? size : dataSize));
-	_current += dataSize;
-	if(type == TYPE_DATA)
-		_curData += dataSize;
+void CircularBuf::copyIn(size_t relSeq,const uint8_t *data,size_t size) {
+	size_t p = pos(relSeq);
+	size_t first = std::min(size,_max - p);
+	memcpy(_buf + p,data,first);
+	memcpy(_buf,data + first,size - first);
+}
+
+void CircularBuf::copyOut(size_t relSeq,uint8_t *data,size_t size) const {
+	size_t p = pos(relSeq);
+	size_t first = std::min(size,_max - p);
+	memcpy(data,_buf + p,first);
+	memcpy(data + first,_buf,size - first);
+}
+
+size_t CircularBuf::dataAt(size_t relSeq,size_t size) const {
+	if(relSeq >= _contig)
+		return 0;
+
+	// stop in front of the next control-packet
+	size_t amount = std::min(size,_contig - relSeq);
+	for(size_t i = 0; i < _ctrlCount; ++i) {
+		size_t ctrl = rel(_ctrls[i]);
+		if(ctrl >= relSeq) {
+			amount = std::min(amount,ctrl - relSeq);
+			break;
+		}
+	}
+	return amount;
+}
+
+void CircularBuf::consume(size_t amount) {
+	_seqStart += amount;
+	_head = pos(amount);
+	_contig -= amount;
+	_current -= amount;
+}
+
+void CircularBuf::popCtrl() {
+	memmove(_ctrls,_ctrls + 1,--_ctrlCount * sizeof(seq_type));
+	consume(1);
 }
 
 int CircularBuf::forget(seq_type seqNo) {
 	seq_type relSeq = seqNo - _seqAcked;
-	if(relSeq > _current)
+	if(relSeq > nextSeq() - _seqAcked)
 		return -EINVAL;
 
 	_seqAcked = seqNo;
-	pull(NULL,relSeq);
+	pull(NULL,rel(seqNo));
 	return 0;
 }
 
-CircularBuf::seq_type CircularBuf::getAck() {
-	// search for the first not acked packet
-	auto it = _packets.begin();
-	for(; it != _packets.end() && it->start != _seqAcked; ++it)
-		;
-
-	// search for the next hole
-	seq_type last = _seqAcked;
-	for(; it != _packets.end(); ++it) {
-		// is there still something missing?
-		if(it->start != last)
-			break;
-		last += it->size();
-	}
-	_seqAcked = last;
-	return last;
+size_t CircularBuf::get(seq_type seqNo,void *buf,size_t size) const {
+	size_t relSeq = rel(seqNo);
+	size_t amount = dataAt(relSeq,size);
+	copyOut(relSeq,reinterpret_cast<uint8_t*>(buf),amount);
+	return amount;
 }
 
-size_t CircularBuf::getOffset(const SeqPacket &pkt,seq_type seqNo) {
-	size_t offset = 0;
-	if(pkt.start != seqNo) {
-		if(pkt.start < seqNo)
-			offset = seqNo - pkt.start;
-		else
-			offset = (std::numeric_limits<seq_type>::max() - pkt.start) + seqNo + 1;
-	}
-	return offset;
-}
+size_t CircularBuf::span(seq_type seqNo,const uint8_t **data,size_t size) const {
+	size_t relSeq = rel(seqNo);
+	size_t amount = dataAt(relSeq,size);
+	if(amount == 0)
+		return 0;
 
-size_t CircularBuf::get(seq_type seqNo,void *buf,size_t size) {
-	// search for the first not acked packet
-	auto it = _packets.begin();
-	for(; it != _packets.end() && it->start != _seqAcked; ++it)
-		;
-
-	uint8_t *pos = reinterpret_cast<uint8_t*>(buf);
-	seq_type relSeq = seqNo - _seqStart;
-	size_t orgsize = size;
-	for(; size > 0 && it != _packets.end(); ++it) {
-		// skip packets that are in front of what we're looking for
-		seq_type relPktNo = it->start - _seqStart;
-		if(relPktNo + it->size() <= relSeq)
-			continue;
+	size_t p = pos(relSeq);
+	*data = _buf + p;
+	return std::min(amount,_max - p);
+}
 
-		size_t offset = getOffset(*it,seqNo);
-		size_t amount = std::min(size,it->size() - offset);
-		// skip control packets
-		if(it->type == TYPE_DATA) {
-			memcpy(pos,it->data + offset,amount);
-			pos += amount;
-			size -= amount;
-		}
-		seqNo += amount;
-	}
-	return orgsize - size;
+size_t CircularBuf::front(const uint8_t **data,size_t size) {
+	while(_ctrlCount > 0 && _ctrls[0] == _seqStart && _seqStart != _seqAcked)
+		popCtrl();
+	return span(_seqStart,data,std::min(size,rel(_seqAcked)));
 }
 
 size_t CircularBuf::pull(void *buf,size_t size) {
 	size_t oldsize = size;
-	uint8_t *pos = reinterpret_cast<uint8_t*>(buf);
-	while(size > 0 && _packets.size() > 0) {
-		SeqPacket &pkt = _packets.front();
-		seq_type relAcked = _seqAcked - _seqStart;
-		seq_type relStart = pkt.start - _seqStart;
-		seq_type offset = getOffset(pkt,_seqStart);
-		if(relStart + offset >= relAcked)
-			break;
-
-		size_t pktsize = pkt.size();
-		size_t amount = std::min(size,pktsize - offset);
+	uint8_t *dst = reinterpret_cast<uint8_t*>(buf);
+	while(size > 0 && _seqStart != _seqAcked) {
 		// skip control packets when we want to pull data
-		if(pos && pkt.type == TYPE_DATA) {
-			memcpy(pos,pkt.data + offset,amount);
-			pos += amount;
-			size -= amount;
+		if(_ctrlCount > 0 && _ctrls[0] == _seqStart) {
+			popCtrl();
+			if(!dst)
+				size--;
+			continue;
 		}
-		else if(!pos)
-			size -= amount;
-		_seqStart += amount;
-		if(amount != pktsize - offset)
-			break;
 
-		_current -= pktsize;
-		if(pkt.type == TYPE_DATA)
-			_curData -= pktsize;
-		_packets.pop_front();
+		size_t amount = dataAt(0,std::min(size,rel(_seqAcked)));
+		if(dst) {
+			copyOut(0,dst,amount);
+			dst += amount;
+		}
+		consume(amount);
+		size -= amount;
 	}
 	return oldsize - size;
 }
 
-size_t CircularBuf::pullctrl(void *buf,size_t size,seq_type *seqNo) {
-	if(_packets.size() > 0) {
-		SeqPacket &pkt = _packets.front();
-		assert(pkt.type == TYPE_CTRL);
-
-		size_t amount = std::min(pkt._size,size);
-		memcpy(buf,pkt.data,amount);
-		_seqStart += pkt.size();
-		_current -= pkt.size();
-		*seqNo = pkt.start;
-		_packets.pop_front();
-		return amount;
-	}
-	return false;
-}
-
 void CircularBuf::print(esc::OStream &os,bool data) {
-	os << "CircularBuffer[start=" << _seqStart << ", ack=" << _seqAcked
-	   << ", cur=" << _current << ", curdata=" << _curData << ", max=" << _max << "]\n";
-	for(auto it = _packets.begin(); it != _packets.end(); ++it) {
-		os << "[" << it->start << " .. " << (it->start + it->size()) << ":" << it->size();
-		os << "b:" << it->type << "]";
-		if(data) {
-			for(size_t i = 0; i < it->_size; ++i) {
-				if(i % 16 == 0)
-					os << "\n ";
-				os << esc::fmt(it->data[i],"0x",2) << ' ';
-			}
+	os << "CircularBuffer[start=" << _seqStart << ", ack=" << _seqAcked << ", contig=" << _contig
+	   << ", cur=" << _current << ", max=" << _max << "]\n";
+	for(size_t i = 0; i < _rangeCount; ++i)
+		os << "[" << _ranges[i].start << " .. " << _ranges[i].end << "]";
+	for(size_t i = 0; i < _ctrlCount; ++i)
+		os << "<ctrl @ " << _ctrls[i] << ">";
+	if(data) {
+		for(size_t i = 0; i < _contig; ++i) {
+			if(i % 16 == 0)
+				os << "\n ";
+			os << esc::fmt(_buf ? _buf[pos(i)] : 0,"0x",2) << ' ';
 		}
-		os << "\n";
 	}
+	os << "\n";
 }
 
 static void test_assertSequence(const CircularBuf &cb) {
-	size_t i = 0;
-	for(auto it = cb.packets().begin(); it != cb.packets().end(); ++it) {
-		for(size_t start = i, end = i + it->size(); i < end; ++i)
-			test_assertInt(it->data[i - start],i);
-	}
+	uint8_t buf[128];
+	CircularBuf::seq_type start = cb.nextExp();
+	size_t count = cb.get(start,buf,sizeof(buf));
+	for(size_t i = 0; i < count; ++i)
+		test_assertInt(buf[i],start + i);
 }
 
 void CircularBuf::unittest() {
@@ -433,12 +447,75 @@ void CircularBuf::unittest() {
 
 		test_assertSSize(buf.push(100,TYPE_DATA,data,16),16);
 		test_assertInt(buf.getAck(),116);
+		test_assertSSize(buf.push(116,TYPE_DATA,data,1),-EINVAL);
 		// pull not the entire packet
 		test_assertSSize(buf.pull(testdata,4),4);
 
-		// now our window is still full, but _seqAcked - _seqStart is less than 16
-		test_assertSSize(buf.push(116,TYPE_DATA,data,1),-EINVAL);
-		test_assertSSize(buf.push(116,TYPE_DATA,data,12),-EINVAL);
+		// the pulled bytes are free again, but not more
+		test_assertSSize(buf.push(116,TYPE_DATA,data + 16,1),1);
+		test_assertSSize(buf.push(116,TYPE_DATA,data + 16,12),3);
+		test_assertSSize(buf.push(120,TYPE_DATA,data + 20,1),-EINVAL);
+
+		fflush(stdout);
+	}
+
+	// wrap around in the ring
+	{
+		CircularBuf buf;
+		buf.init(0,8);
+		memset(testdata,0,sizeof(testdata));
+
+		test_assertSSize(buf.push(0,TYPE_DATA,data,6),6);
+		test_assertInt(buf.getAck(),6);
+		test_assertSSize(buf.pull(testdata,6),6);
+
+		// the data is split into two parts now
+		test_assertSSize(buf.push(8,TYPE_DATA,data + 8,4),4);
+		test_assertSSize(buf.push(6,TYPE_DATA,data + 6,2),2);
+		test_assertInt(buf.getAck(),12);
+
+		const uint8_t *span;
+		test_assertSize(buf.span(6,&span,16),2);
+		test_assertInt(span[0],6);
+		test_assertSize(buf.span(8,&span,16),4);
+		test_assertInt(span[0],8);
+		test_assertSize(buf.get(7,testdata + 7,16),5);
+
+		test_assertSSize(buf.pull(testdata + 6,16),6);
+		for(size_t i = 0; i < 12; ++i)
+			test_assertInt(testdata[i],i);
+
+		fflush(stdout);
+	}
+
+	// control packets
+	{
+		CircularBuf buf;
+		buf.init(10,16);
+		memset(testdata,0,sizeof(testdata));
+
+		test_assertSSize(buf.push(14,TYPE_DATA,data + 4,4),4);
+		// not at the end of the contiguous part
+		test_assertSSize(buf.push(18,TYPE_CTRL,NULL,0),-EINVAL);
+		test_assertSSize(buf.push(10,TYPE_DATA,data,4),4);
+		test_assertSSize(buf.push(18,TYPE_CTRL,NULL,0),1);
+		test_assertInt(buf.getAck(),19);
+		test_assertSize(buf.available(),8);
+
+		// get stops in front of the control packet
+		test_assertSize(buf.get(16,testdata,16),2);
+
+		test_assertSSize(buf.pull(testdata,16),8);
+		for(size_t i = 0; i < 8; ++i)
+			test_assertInt(testdata[i],i);
+		test_assertSize(buf.available(),0);
+		test_assertSize(buf.windowSize(),16);
+
+		// forget counts the control packet
+		test_assertSSize(buf.push(19,TYPE_DATA,data,2),2);
+		test_assertSSize(buf.push(21,TYPE_CTRL,NULL,0),1);
+		test_assertInt(buf.forget(22),0);
+		test_assertSize(buf.windowSize(),16);
 
 		fflush(stdout);
 	}
@@ -17,6 +17,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+
 #pragma once
 
 #include <esc/proto/socket.h>
@@ -24,49 +25,27 @@
 #include <algorithm>
 #include <assert.h>
 #include <errno.h>
-#include <limits>
-#include <list>
 #include <string.h>
 
-/**
- * +----------------+                  \
- * |                |                  |
- * |   unreached    |                  |- free
- * |                |                  |
- * +-------vv-------+ <-- seqStart     /  <-- _packets
- * |                |
- * |     acked      |
- * |                |
- * +-------vv-------+ <-- seqAcked
- * |                |
- * |    not yet     |
- * |   contiguous   |
- * |                |
- * +-------vv-------+                  \ <-- _packets + _max
- * |                |                  |
- * |   unreached    |                  |- free
- * |                |                  |
- * +----------------+                  /
- */
 
 class CircularBuf;
 static esc::OStream &operator<<(esc::OStream &os,const CircularBuf &cb);
 
 /**
- * This class implements a circular buffer required for TCP. It is used for both the sending and
- * the receiving side.
- * For sending, we push() sent data into the buffer in order to know what to resend if a timeout
- * triggers. To do so, we use get() to get the already sent data again. When we receive the ACK,
- * we forget() the data.
- * For receiving, we push() received data into the buffer. When sending the next packet, we use
- * getAck() to ACK the data. Later we use pull() to pull the data out of the circular buffer and
- * pass it to the application.
- * The data is kept in a std::list of SeqPacket, ordered by the sequence number. Additionally, we
- * keep the start of the window (_seqStart) and the ACK position (_seqAcked).
+ * A buffer for a sequence number window. The data is stored in a contiguous byte ring with the
+ * size of the window, which is allocated as soon as the first data is pushed. Data that arrives
+ * out of order is put at its position in the ring and the received ranges behind the contiguous
+ * part are remembered in a small sorted set. Control-packets occupy one sequence number, but have
+ * no data.
  */
 class CircularBuf {
 	friend esc::OStream &operator<<(esc::OStream &os,const CircularBuf &cb);
 
+	/* the max. number of out-of-order ranges; further segments are dropped */
+	static const size_t MAX_RANGES	= 32;
+	/* the max. number of control-packets in the buffer */
+	static const size_t MAX_CTRLS	= 4;
+
 public:
 	typedef uint32_t seq_type;
 
@@ -75,61 +54,44 @@ public:
 		TYPE_DATA
 	};
 
-	/**
-	 * A packet that was pushed. Holds the data with the associated sequence number
-	 */
-	struct SeqPacket {
-		explicit SeqPacket(seq_type _start,uint8_t _type,const uint8_t *_data,size_t sz)
-			: start(_start), type(_type), data(sz ? new uint8_t[sz] : NULL), _size(sz) {
-			memcpy(data,_data,_size);
-		}
-		SeqPacket(const SeqPacket&) = delete;
-		SeqPacket &operator=(const SeqPacket&) = delete;
-		SeqPacket(SeqPacket &&p) : start(p.start), type(p.type), data(p.data), _size(p._size) {
-			p.data = NULL;
-		}
-		~SeqPacket() {
-			delete[] data;
-		}
-
-		size_t size() const {
-			return type == TYPE_CTRL ? 1 : _size;
-		}
-
-		seq_type start;
-		uint8_t type;
-		uint8_t *data;
-		size_t _size;
-	};
-
 	/**
 	 * Creates an uninitialized circular buffer, i.e. with sequence number 0.
 	 */
-	explicit CircularBuf() : _max(), _current(), _curData(), _packets(), _seqStart(), _seqAcked() {
+	explicit CircularBuf()
+		: _buf(), _max(), _head(), _contig(), _current(), _seqStart(), _seqAcked(), _ranges(),
+		  _rangeCount(), _ctrls(), _ctrlCount() {
+	}
+	CircularBuf(const CircularBuf&) = delete;
+	CircularBuf &operator=(const CircularBuf&) = delete;
+	~CircularBuf() {
+		delete[] _buf;
 	}
 
 	/**
-	 * Inits the circular buffer.
+	 * Inits the circular buffer. Everything that is currently in the buffer is thrown away.
 	 *
 	 * @param start the initial sequence number to use
 	 * @param size the maximum number of bytes to hold
 	 */
 	void init(seq_type start,size_t size) {
+		if(size != _max) {
+			delete[] _buf;
+			_buf = NULL;
+		}
 		_seqStart = _seqAcked = start;
 		_max = size;
+		_head = _contig = _current = 0;
+		_rangeCount = _ctrlCount = 0;
 	}
 
-	/**
-	 * @return the packet list
-	 */
-	const std::list<SeqPacket> &packets() const {
-		return _packets;
-	}
 	/**
 	 * @return the number of data-bytes to pull()
 	 */
 	size_t available() const {
-		return _curData;
+		size_t ctrls = 0;
+		for(size_t i = 0; i < _ctrlCount && rel(_ctrls[i]) < rel(_seqAcked); ++i)
+			ctrls++;
+		return rel(_seqAcked) - ctrls;
 	}
 	/**
 	 * @return the total capacity
@@ -150,10 +112,10 @@ public:
 		return _seqAcked;
 	}
 	/**
-	 * @return the next sequence number that is used (meaningless for the receive buffer)
+	 * @return the next sequence number that is used, i.e. the end of the contiguous part
 	 */
 	seq_type nextSeq() const {
-		return _seqAcked + _current;
+		return _seqStart + _contig;
 	}
 	/**
 	 * @param seqNo the sequence number
@@ -167,7 +129,8 @@ public:
 	/**
 	 * Pushes the given data at given position into the buffer. This might fail if the position is
 	 * completely outside the window. If the start or the end position is inside the window, some
-	 * data will be kept, some will be ignored.
+	 * data will be kept, some will be ignored. Control-packets can only be appended to the
+	 * contiguous part.
 	 *
 	 * @param seqNo the sequence number of the first byte of the data
 	 * @param type the type (TYPE_{CTRL,DATA})
@@ -182,7 +145,10 @@ public:
 	 *
 	 * @return the new ACK position
 	 */
-	seq_type getAck();
+	seq_type getAck() {
+		_seqAcked = nextSeq();
+		return _seqAcked;
+	}
 
 	/**
 	 * Forgets all data up to <seqNo>. That is, the data is ACKed and pulled to /dev/null.
@@ -194,34 +160,47 @@ public:
 
 	/**
 	 * Gets already pushed data into <buf>. That is, it copies as much data as possible beginning
-	 * at <seqNo> into <buf>.
+	 * at <seqNo> into <buf>, but stops in front of the next control-packet.
 	 *
 	 * @param seqNo the sequence number where to start
 	 * @param buf the buffer to write to
 	 * @param size the size of the buffer
 	 * @return the number of copied bytes
 	 */
-	size_t get(seq_type seqNo,void *buf,size_t size);
+	size_t get(seq_type seqNo,void *buf,size_t size) const;
 
 	/**
-	 * Pulls ACKed data into <buf>. That is, it starts at the beginning and copies all data into
-	 * <buf> and throws it away afterwards (rotates the window forward).
+	 * Determines the data beginning at <seqNo> that is stored contiguously in the ring. In
+	 * contrast to get(), the data is not copied and the span ends at the end of the ring.
 	 *
-	 * @param buf the buffer to write to
-	 * @param size the size of the buffer
-	 * @return the number of copied bytes
+	 * @param seqNo the sequence number where to start
+	 * @param data will be set to the beginning of the data
+	 * @param size the max. number of bytes
+	 * @return the number of bytes at <data>
 	 */
-	size_t pull(void *buf,size_t size);
+	size_t span(seq_type seqNo,const uint8_t **data,size_t size) const;
+
+	/**
+	 * Determines the ACKed data at the beginning that is stored contiguously in the ring, so that
+	 * it can be used without copying it. Use pull(NULL,...) afterwards to throw it away.
+	 * Control-packets at the beginning are thrown away immediately.
+	 *
+	 * @param data will be set to the beginning of the data
+	 * @param size the max. number of bytes
+	 * @return the number of bytes at <data>
+	 */
+	size_t front(const uint8_t **data,size_t size);
 
 	/**
-	 * Pulls the next control-packet out of the circular buffer.
+	 * Pulls ACKed data into <buf>. That is, it starts at the beginning and copies all data into
+	 * <buf> and throws it away afterwards (rotates the window forward). If <buf> is NULL, <size>
+	 * sequence numbers are thrown away, including control-packets.
 	 *
 	 * @param buf the buffer to write to
 	 * @param size the size of the buffer
-	 * @param seqNo will be set to the used sequence number
-	 * @return the number of copied bytes or 0 if there was no packet
+	 * @return the number of copied bytes
 	 */
-	size_t pullctrl(void *buf,size_t size,seq_type *seqNo);
+	size_t pull(void *buf,size_t size);
 
 	/**
 	 * Prints the state of the circular buffer to <os>.
@@ -234,16 +213,40 @@ public:
 	static void unittest();
 
 private:
-	void add(std::list<SeqPacket>::iterator,seq_type seqNo,uint8_t type,const uint8_t *data,
-		size_t size,size_t dataSize);
-	size_t getOffset(const SeqPacket &pkt,seq_type seqNo);
+	struct Range {
+		seq_type start;
+		seq_type end;
+	};
+
+	size_t rel(seq_type seqNo) const {
+		return static_cast<seq_type>(seqNo - _seqStart);
+	}
+	size_t pos(size_t relSeq) const {
+		return (_head + relSeq) % _max;
+	}
+	size_t dataAt(size_t relSeq,size_t size) const;
+	void copyIn(size_t relSeq,const uint8_t *data,size_t size);
+	void copyOut(size_t relSeq,uint8_t *data,size_t size) const;
+	bool addRange(size_t relStart,size_t relEnd);
+	void consume(size_t amount);
+	void popCtrl();
 
+	uint8_t *_buf;
 	size_t _max;
+	/* the position of _seqStart in the ring */
+	size_t _head;
+	/* the number of contiguous sequence numbers, beginning at _seqStart */
+	size_t _contig;
+	/* the number of used sequence numbers, including the out-of-order ranges */
 	size_t _current;
-	size_t _curData;
-	std::list<SeqPacket> _packets;
 	seq_type _seqStart;
 	seq_type _seqAcked;
+	/* the ranges behind the contiguous part that have been received, sorted and disjoint */
+	Range _ranges[MAX_RANGES];
+	size_t _rangeCount;
+	/* the sequence numbers of the control-packets, sorted */
+	seq_type _ctrls[MAX_CTRLS];
+	size_t _ctrlCount;
 };
 
 static inline esc::OStream &operator<<(esc::OStream &os,const CircularBuf &cb) {
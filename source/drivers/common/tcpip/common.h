@@ -56,11 +56,6 @@ struct PendingRequest {
 			void *data;
 			bool needsSrc;
 		} read;
-		struct {
-			const void *data;
-			size_t remaining;
-			uint32_t seqNo;
-		} write;
 		struct {
 			int fd;
 			int devfd;
@@ -37,24 +37,62 @@ Link::~Link() {
 	destroybuf(_buffer);
 }
 
-ssize_t Link::read(void *buffer,size_t size) {
-	ssize_t res = ::read(fd(),buffer,size);
+ssize_t Link::receive() {
+	ssize_t res = ::read(fd(),_buffer,_batchSize);
 	if(res > 0) {
-		PRINT("Received packet of " << res << " bytes:\n"
-			<< *reinterpret_cast<Ethernet<>*>(buffer));
-		_rxpkts++;
-		_rxbytes += res;
+		for(ssize_t pos = 0; pos < res; ) {
+			const esc::NIC::BatchPacket *pkt = reinterpret_cast<const esc::NIC::BatchPacket*>(
+				rxbuffer() + pos);
+			PRINT("Received packet of " << pkt->length << " bytes:\n"
+				<< *reinterpret_cast<const Ethernet<>*>(pkt->data));
+			_rxpkts++;
+			_rxbytes += pkt->length;
+			pos += esc::NIC::batchSize(pkt->length);
+		}
 	}
 	return res;
 }
 
 ssize_t Link::write(const void *buffer,size_t size) {
-	ssize_t res = ::write(fd(),buffer,size);
-	if(res > 0) {
-		PRINT("Sent packet of " << res << " bytes:\n"
-			<< *reinterpret_cast<const Ethernet<>*>(buffer));
-		_txpkts++;
-		_txbytes += res;
+	size_t bsize = esc::NIC::batchSize(size);
+	if(size > mtu())
+		return -EINVAL;
+
+	// pretend that we've sent it, if we're asked to lose it
+	if(_loss > 0 && (uint)(rand() % 1000) < _loss)
+		return size;
+
+	// make room, if necessary
+	if(_txpos + bsize > _batchSize) {
+		ssize_t res = flush();
+		if(res < 0)
+			return res;
+	}
+
+	uint8_t *txbuf = reinterpret_cast<uint8_t*>(_buffer) + _batchSize;
+	esc::NIC::BatchPacket *pkt = reinterpret_cast<esc::NIC::BatchPacket*>(txbuf + _txpos);
+	pkt->length = size;
+	memcpy(pkt->data,buffer,size);
+	_txpos += bsize;
+
+	PRINT("Sent packet of " << size << " bytes:\n"
+		<< *reinterpret_cast<const Ethernet<>*>(buffer));
+	_txpkts++;
+	_txbytes += size;
+
+	if(!_corked) {
+		ssize_t res = flush();
+		if(res < 0)
+			return res;
 	}
+	return size;
+}
+
+ssize_t Link::flush() {
+	if(_txpos == 0)
+		return 0;
+
+	ssize_t res = ::write(fd(),reinterpret_cast<uint8_t*>(_buffer) + _batchSize,_txpos);
+	_txpos = 0;
 	return res;
 }
@@ -26,25 +26,32 @@
 
 #include "common.h"
 
+/**
+ * A link to a NIC. The NIC channel is used in batch mode: the buffer that is shared with the
+ * driver consists of a receive area, into which the driver puts as many packets as available, and
+ * a transmit area, in which outgoing packets are collected while the link is corked.
+ */
 class Link : public esc::NIC, public std::enable_shared_from_this<Link> {
 public:
 	static const size_t NAME_LEN	= 16;
+	/* the min. size of the receive and transmit area */
+	static const size_t BATCH_SIZE	= 64 * 1024;
 
 	explicit Link(const std::string &n,const char *path)
 		: esc::NIC(path,O_RDWRMSG), _rtid(), _rxpkts(), _txpkts(), _rxbytes(), _txbytes(),
-		  _mtu(getMTU()), _name(n), _status(esc::Net::DOWN), _mac(getMAC()), _ip(), _subnetmask() {
-		sharebuf(fd(),mtu(),&_buffer,0);
+		  _mtu(getMTU()), _name(n), _status(esc::Net::DOWN), _mac(getMAC()), _ip(), _subnetmask(),
+		  _buffer(), _batchSize(MAX(BATCH_SIZE,esc::NIC::batchSize(_mtu))), _txpos(),
+		  _corked(), _loss() {
+		sharebuf(fd(),_batchSize * 2,&_buffer,0);
 		if(_buffer == NULL)
 			throw esc::default_error("Not enough memory for buffer",-ENOMEM);
+		enableBatch();
 	}
 	~Link();
 
 	const std::string &name() const {
 		return _name;
 	}
-	void *sharedmem() {
-		return _buffer;
-	}
 
 	ulong txpackets() const {
 		return _txpkts;
@@ -87,6 +94,16 @@ public:
 		_subnetmask = nm;
 	}
 
+	/**
+	 * The loss rate is used for testing: write() drops the given number of packets per thousand.
+	 */
+	uint loss() const {
+		return _loss;
+	}
+	void loss(uint permille) {
+		_loss = permille;
+	}
+
 	tid_t tid() const {
 		return _rtid;
 	}
@@ -94,10 +111,48 @@ public:
 		_rtid = tid;
 	}
 
-	ssize_t read(void *buffer,size_t size);
+	/**
+	 * Receives the next batch of packets. Blocks until at least one packet is available.
+	 *
+	 * @return the number of bytes in the batch or a negative error code
+	 */
+	ssize_t receive();
+	/**
+	 * @return the receive area, which contains the last batch (see esc::NIC::BatchPacket)
+	 */
+	const uint8_t *rxbuffer() const {
+		return reinterpret_cast<const uint8_t*>(_buffer);
+	}
+
+	/**
+	 * Sends the given packet. If the link is corked, the packet is only queued.
+	 *
+	 * @param buffer the packet
+	 * @param size the packet size
+	 * @return the size or a negative error code
+	 */
 	ssize_t write(const void *buffer,size_t size);
 
+	/**
+	 * Collects all packets that are written from now on until uncork() is called and sends them
+	 * with a single message to the driver.
+	 */
+	void cork() {
+		_corked = true;
+	}
+	/**
+	 * Sends all queued packets and stops collecting them.
+	 *
+	 * @return the number of sent bytes or a negative error code
+	 */
+	ssize_t uncork() {
+		_corked = false;
+		return flush();
+	}
+
 private:
+	ssize_t flush();
+
 	tid_t _rtid;
 	ulong _rxpkts;
 	ulong _txpkts;
@@ -110,4 +165,8 @@ private:
 	esc::Net::IPv4Addr _ip;
 	esc::Net::IPv4Addr _subnetmask;
 	void *_buffer;
+	size_t _batchSize;
+	size_t _txpos;
+	bool _corked;
+	uint _loss;
 };
@@ -83,7 +83,7 @@ StreamSocket::~StreamSocket() {
 		if(_localPort >= PRIVATE_PORTS)
 			_ports.release(_localPort);
 	}
-	Timeouts::cancel(_timeoutId);
+	delete[] _backlog;
 }
 
 void StreamSocket::state(State st) {
@@ -112,13 +112,11 @@ int StreamSocket::connect(const esc::Socket::Addr *sa,msgid_t mid) {
 		TCP::addSocket(this,_localPort,remotePort());
 	}
 
-	MSSOption option;
-	option.kind = OPTION_MSS;
-	option.length = sizeof(option);
-	option.mss = cputobe16(route.link->mtu() - IPv4<TCP>().size());
+	SynOptions options;
+	size_t optSize = buildSynOptions(&options,route.link->mtu() - IPv4<TCP>().size(),true);
 
 	// send SYN packet
-	ssize_t res = sendCtrlPkt(TCP::FL_SYN,&option);
+	ssize_t res = sendCtrlPkt(TCP::FL_SYN,&options,optSize);
 	if(res < 0)
 		return res;
 
@@ -153,10 +151,11 @@ int StreamSocket::accept(msgid_t mid,int devfd,esc::ClientDevice<Socket> *dev) {
 	if(_state != STATE_LISTEN)
 		return -EINVAL;
 
-	SynPacket syn;
-	CircularBuf::seq_type seqNo;
-	if(_rxCircle.pullctrl(&syn,sizeof(syn),&seqNo))
-		return forkSocket(devfd,mid,dev,syn,seqNo);
+	if(!_synQueue.empty()) {
+		SynPacket syn = _synQueue.front();
+		_synQueue.pop_front();
+		return forkSocket(devfd,mid,dev,syn);
+	}
 
 	if(_pending.count > 0)
 		return -EAGAIN;
@@ -171,28 +170,31 @@ int StreamSocket::accept(msgid_t mid,int devfd,esc::ClientDevice<Socket> *dev) {
 ssize_t StreamSocket::sendto(msgid_t mid,const esc::Socket::Addr *,const void *data,size_t size) {
 	if(_state != STATE_ESTABLISHED)
 		return -ENOTCONN;
-
-	CircularBuf::seq_type seqNo = _txCircle.nextSeq();
-	// TODO handle requests that are larger. probably we want to increase the txCircle in this case
-	if(size > _txCircle.windowSize())
-		return -EINVAL;
 	if(_pending.count > 0)
 		return -EAGAIN;
 
 	PRINT_TCP(_localPort,remotePort(),"Application wants to send %zu bytes",size);
 
-	// push it into our txCircle
-	size_t amount = std::min(_remoteWinSize,size);
-	sassert(_txCircle.push(seqNo,CircularBuf::TYPE_DATA,data,amount) == (ssize_t)amount);
-	// send it
-	sendData(true);
-
-	// register request; the response is sent as soon as the sent data has been ACKed
+	// push as much as possible into our txCircle and send it, as far as the windows allow it
+	size_t amount = std::min(_txCircle.windowSize(),size);
+	if(amount > 0) {
+		sassert(_txCircle.push(_txCircle.nextSeq(),CircularBuf::TYPE_DATA,data,amount) ==
+			(ssize_t)amount);
+	}
+	sendData();
+
+	// if everything fitted into the txCircle, the request is done
+	if(amount == size)
+		return size;
+
+	// otherwise copy the rest, because <data> is only valid during this call. the response is
+	// sent as soon as everything has been pushed into the txCircle
+	_backlogSize = size - amount;
+	_backlogPos = 0;
+	_backlog = new uint8_t[_backlogSize];
+	memcpy(_backlog,reinterpret_cast<const uint8_t*>(data) + amount,_backlogSize);
 	_pending.mid = mid;
 	_pending.count = size;
-	_pending.d.write.data = data;
-	_pending.d.write.remaining = size - amount;
-	_pending.d.write.seqNo = seqNo + size;
 	return 0;
 }
 
@@ -210,7 +212,7 @@ ssize_t StreamSocket::recvfrom(msgid_t mid,bool needsSrc,void *buffer,size_t siz
 	if(shouldPush()) {
 		if(replyRead(mid,needsSrc,buffer,size)) {
 			/* inform the sender about our increased window-size */
-			sendCtrlPkt(TCP::FL_ACK,NULL,true);
+			sendCtrlPkt(TCP::FL_ACK,NULL,0,true);
 			return 0;
 		}
 	}
@@ -253,6 +255,10 @@ int StreamSocket::abort() {
 
 void StreamSocket::disconnect() {
 	_closed = true;
+	// the client is gone, so that there is nobody to receive the rest of a write request
+	delete[] _backlog;
+	_backlog = NULL;
+
 	switch(_state) {
 		// if the socket is completely closed, we can destroy it immediately
 		case STATE_CLOSED:
@@ -289,36 +295,34 @@ void StreamSocket::timeout() {
 			state(STATE_CLOSED);
 			break;
 
-		case STATE_ESTABLISHED:
-			if(_pending.count > 0) {
-				PRINT_TCP(_localPort,remotePort(),"timeout. Resending data.");
-				sendData(true);
+		default: {
+			if(flightSize() == 0) {
+				print("Timeout without outstanding data during state %s!?",stateName(_state));
+				break;
 			}
-			break;
 
-		default: {
-			// if there is an un-ACKed control-packet, resend it
-			if(_ctrlpkt.flags) {
-				PRINT_TCP(_localPort,remotePort(),"timeout. Resending control-packet.");
-				if(_ctrlpkt.timeout < 8000) {
-					_ctrlpkt.timeout *= 2;
-					ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),
-						_ctrlpkt.flags,&_ctrlpkt.option,_ctrlpkt.optSize,_ctrlpkt.optSize,
-						_ctrlpkt.seqNo,_rxCircle.nextExp(),_rxCircle.windowSize());
-					if(res < 0) {
-						// TODO handle error
-						printe("TCP::send");
-					}
-					Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),
-						_ctrlpkt.timeout);
-				}
-				else {
+			// back off the timer and start again at the oldest unACKed byte (RFC 6298 and 5681)
+			_rto = std::min(_rto * 2,MAX_RTO);
+			_ssthresh = std::max(flightSize() / 2,2 * _mss);
+			_cwnd = _mss;
+			_sndNxt = _txCircle.nextExp();
+			_inRecovery = false;
+			_dupAcks = 0;
+			_rttActive = false;
+
+			// if the oldest unACKed packet is a control-packet, give up after a few tries
+			if(_ctrlpkt.flags && _ctrlpkt.seqNo == _sndNxt) {
+				if(_ctrlpkt.retries++ == MAX_CTRL_RETRIES) {
 					replyPending<int>(-ETIMEOUT);
 					state(STATE_CLOSED);
+					break;
 				}
+				PRINT_TCP(_localPort,remotePort(),"timeout. Resending control-packet.");
 			}
-			else
-				print("Timeout for a non-control-packet during state %s!?",stateName(_state));
+			else {
+				PRINT_TCP(_localPort,remotePort(),"timeout. Resending data (rto=%u)",_rto);
+			}
+			sendData();
 		}
 		break;
 	}
@@ -336,7 +340,9 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 
   	CircularBuf::seq_type seqNo = be32tocpu(tcp->seqNumber);
 	CircularBuf::seq_type ackNo = be32tocpu(tcp->ackNumber);
-	_remoteWinSize = be16tocpu(tcp->windowSize);
+	// the window in SYN packets is never scaled
+	size_t oldWinSize = _remoteWinSize;
+	_remoteWinSize = be16tocpu(tcp->windowSize) << ((tcp->ctrlFlags & TCP::FL_SYN) ? 0 : _sndShift);
 
 	// validate checksum
 	uint16_t checksum = esc::Net::ipv4PayloadChecksum(ip->src,ip->dst,TCP::IP_PROTO,
@@ -376,6 +382,7 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 			// determine type of packet
 			uint8_t type = seglen ? CircularBuf::TYPE_DATA : CircularBuf::TYPE_CTRL;
 		  	const uint8_t *data = seglen ? reinterpret_cast<const uint8_t*>(tcp) + dataOff : NULL;
+			bool inOrder = seqNo == _rxCircle.nextExp();
 
 		  	// only accept data in established state
 	  		if(_rxCircle.push(seqNo,type,data,seglen) < 0) {
@@ -383,15 +390,20 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 					PRINT_TCP(_localPort,remotePort(),"received unexpected seq %u, expected %u",
 						seqNo,_rxCircle.nextExp());
 					// always sent an ACK here
-	  				sendCtrlPkt(TCP::FL_ACK,NULL,true);
+	  				sendCtrlPkt(TCP::FL_ACK,NULL,0,true);
 	  			}
 				return;
 			}
+
+			// answer out-of-order packets immediately, so that the sender can fast retransmit
+			if(!inOrder)
+				ackForced = true;
 		}
 	}
 
 	// handle acks
 	if(tcp->ctrlFlags & TCP::FL_ACK) {
+		CircularBuf::seq_type una = _txCircle.nextExp();
 		int res = _txCircle.forget(ackNo);
 		if(res < 0) {
 			PRINT_TCP(_localPort,remotePort(),"received unexpected ack %u, expected %u",
@@ -401,40 +413,46 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 			else
 				ackForced = true;
 		}
-		else if(_pending.count > 0 && _pending.isWrite()) {
-			if(ackNo >= _pending.d.write.seqNo) {
-				replyPending<ssize_t>(_pending.count);
-				Timeouts::cancel(_timeoutId);
-			}
-		}
-		// if this is an ACK for our last control packet, stop waiting for it
-		else if(ackNo > _ctrlpkt.seqNo && _ctrlpkt.flags != 0) {
-			_ctrlpkt.flags = 0;
-			Timeouts::cancel(_timeoutId);
+		else {
+			if(ackNo != una)
+				ackReceived(ackNo,ackNo - una);
+			// an ACK that moves the right window edge forward is a window update, not a duplicate.
+			// we don't require an unchanged window (RFC 5681), because the window shrinks if the
+			// receiver buffers out-of-order data
+			else if(seglen == 0 && !(tcp->ctrlFlags & (TCP::FL_SYN | TCP::FL_FIN)) &&
+					!seqBefore(una + oldWinSize,ackNo + _remoteWinSize) && flightSize() > 0)
+				dupAckReceived();
+
+			// if this is an ACK for our last control packet, stop waiting for it
+			if(_ctrlpkt.flags != 0 && seqBefore(_ctrlpkt.seqNo,ackNo))
+				_ctrlpkt.flags = 0;
 		}
 	}
 
 	// send outstanding data
-	sendData(false);
+	sendData();
 
 	// handle state changes
 	switch(_state) {
 		case STATE_LISTEN: {
 			if(tcp->ctrlFlags == TCP::FL_SYN) {
 				SynPacket syn;
-				syn.mss = parseMSS(tcp);
+				parseOptions(tcp,&syn.mss,&syn.wscale);
 				syn.winSize = be16tocpu(tcp->windowSize);
 				syn.src.family = esc::Socket::AF_INET;
 				syn.src.d.ipv4.addr = ip->src.value();
 				syn.src.d.ipv4.port = be16tocpu(tcp->srcPort);
+				syn.seqNo = seqNo;
 				// is there already a pending accept?
 				if(_pending.count > 0 && (_pending.mid & 0xFFFF) == MSG_DEV_OBTAIN) {
-					forkSocket(_pending.d.accept.devfd,_pending.mid,_pending.d.accept.dev,syn,seqNo);
+					forkSocket(_pending.d.accept.devfd,_pending.mid,_pending.d.accept.dev,syn);
 					_pending.count = 0;
 				}
-				else {
-					if(_rxCircle.push(seqNo,CircularBuf::TYPE_CTRL,&syn,sizeof(SynPacket)) < 0)
-						print("Unable to push SYN packet");
+				else if(!isQueued(syn)) {
+					if(_synQueue.size() < MAX_BACKLOG)
+						_synQueue.push_back(syn);
+					else
+						print("SYN queue is full. Dropping SYN packet");
 				}
 			}
 		}
@@ -445,8 +463,17 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 				if((tcp->ctrlFlags & (TCP::FL_ACK | TCP::FL_SYN)) == (TCP::FL_ACK | TCP::FL_SYN)) {
 					_txCircle.init(_txCircle.nextSeq(),SEND_BUF_SIZE);
 					_rxCircle.init(seqNo + 1,RECV_BUF_SIZE);
-					_mss = parseMSS(tcp);
-					PRINT_TCP(_localPort,remotePort(),"Got MSS: %zu",_mss);
+					uint16_t mss;
+					int wscale;
+					parseOptions(tcp,&mss,&wscale);
+					_mss = mss;
+					// window scaling is only used if both sides offered it
+					if(wscale >= 0) {
+						_sndShift = std::min<int>(wscale,MAX_WSCALE);
+						_rcvShift = WSCALE;
+					}
+					_cwnd = initialWindow();
+					PRINT_TCP(_localPort,remotePort(),"Got MSS: %zu, window scale: %d",_mss,wscale);
 
 					state(STATE_ESTABLISHED);
 					replyPending<int>(0);
@@ -486,7 +513,7 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 			}
 			else if(ackNo > _ctrlpkt.seqNo && (tcp->ctrlFlags & TCP::FL_ACK)) {
 				state(STATE_FIN_WAIT_2);
-				Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),3000);
+				Timeouts::program(_timer,3000);
 			}
 		}
 		break;
@@ -517,7 +544,7 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 
 	// first ACK data and send ACK packet, if required
 	if(_state != STATE_CLOSED)
-		sendCtrlPkt(TCP::FL_ACK,NULL,ackForced);
+		sendCtrlPkt(TCP::FL_ACK,NULL,0,ackForced);
 
 	// push data to application if either PSH is set, we don't have much window space left or the
 	// state is not ESTABLISHED anymore
@@ -530,125 +557,284 @@ void StreamSocket::push(const esc::Socket::Addr &,const Packet &pkt,size_t) {
 
 	// program timeout, if we went into TIME_WAIT state
 	if(oldstate != STATE_TIME_WAIT && _state == STATE_TIME_WAIT)
-		Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),1000);
+		Timeouts::program(_timer,1000);
 }
 
-uint16_t StreamSocket::parseMSS(const TCP *tcp) {
+void StreamSocket::parseOptions(const TCP *tcp,uint16_t *mss,int *wscale) {
 	size_t dataOff = (tcp->dataOffset >> 4) * 4;
 	size_t optSize = dataOff - sizeof(TCP);
-	if(optSize > 0) {
-		const uint8_t* options = reinterpret_cast<const uint8_t*>(tcp + 1);
-		while(optSize > 0) {
-			const OptionHeader *optHead = reinterpret_cast<const OptionHeader*>(options);
-			switch(optHead->kind) {
-				case OPTION_MSS:
-					const MSSOption *mssOpt = reinterpret_cast<const MSSOption*>(optHead);
-					return be16tocpu(mssOpt->mss);
-			}
+	const uint8_t* options = reinterpret_cast<const uint8_t*>(tcp + 1);
+	// use the defaults for everything that is not present
+	*mss = DEF_MSS;
+	*wscale = -1;
+	while(optSize > 0) {
+		const OptionHeader *optHead = reinterpret_cast<const OptionHeader*>(options);
+		if(optHead->kind == OPTION_EOL)
+			break;
+		if(optHead->kind == OPTION_NOP) {
+			options++;
+			optSize--;
+			continue;
+		}
+		// stop at malformed options
+		if(optSize < sizeof(OptionHeader) || optHead->length < sizeof(OptionHeader) ||
+				optHead->length > optSize)
+			break;
 
-			options += optHead->length;
-			optSize -= optHead->length;
+		switch(optHead->kind) {
+			case OPTION_MSS:
+				if(optHead->length == sizeof(MSSOption))
+					*mss = be16tocpu(reinterpret_cast<const MSSOption*>(optHead)->mss);
+				break;
+
+			case OPTION_WS:
+				if(optHead->length == sizeof(WSOption))
+					*wscale = reinterpret_cast<const WSOption*>(optHead)->shift;
+				break;
 		}
+
+		options += optHead->length;
+		optSize -= optHead->length;
 	}
-	// use the default size
-	return DEF_MSS;
 }
 
-ssize_t StreamSocket::sendCtrlPkt(uint8_t flags,MSSOption *opt,bool forceACK) {
+size_t StreamSocket::buildSynOptions(SynOptions *opt,size_t mss,bool ws) {
+	opt->mss.kind = OPTION_MSS;
+	opt->mss.length = sizeof(opt->mss);
+	opt->mss.mss = cputobe16(mss);
+	if(!ws)
+		return sizeof(opt->mss);
+
+	opt->nop = OPTION_NOP;
+	opt->ws.kind = OPTION_WS;
+	opt->ws.length = sizeof(opt->ws);
+	opt->ws.shift = WSCALE;
+	return sizeof(*opt);
+}
+
+uint16_t StreamSocket::rcvWindow(uint8_t flags) const {
+	uint8_t shift = (flags & TCP::FL_SYN) ? 0 : _rcvShift;
+	return std::min<size_t>(_rxCircle.windowSize() >> shift,0xFFFF);
+}
+
+ssize_t StreamSocket::sendCtrlPkt(uint8_t flags,const SynOptions *opt,size_t optSize,bool forceACK) {
 	assert(flags != 0);
 	CircularBuf::seq_type lastAck = _rxCircle.nextExp();
 	CircularBuf::seq_type ack = _rxCircle.getAck();
-	size_t optSize = opt ? sizeof(*opt) : 0;
+	// SYN and FIN occupy a sequence number and have to be resent until they are ACKed
+	bool reliable = flags & (TCP::FL_SYN | TCP::FL_FIN);
+	// but they can't be sent before all data in front of them
+	bool deferred = reliable && _sndNxt != _txCircle.nextSeq();
 
 	// automatically ACK the any not-yet-ACKed packets, or if we are forced to send an ACK
-	if((flags & ~TCP::FL_ACK) || lastAck != ack || forceACK) {
+	if(!deferred && ((flags & ~TCP::FL_ACK) || lastAck != ack || forceACK)) {
 		if(lastAck != ack)
 			flags |= TCP::FL_ACK;
 		ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),flags,opt,optSize,optSize,
-			_txCircle.nextSeq(),(flags & TCP::FL_ACK) ? ack : 0,_rxCircle.windowSize());
+			_sndNxt,(flags & TCP::FL_ACK) ? ack : 0,rcvWindow(flags));
 		if(res < 0)
 			return res;
 	}
 
-	// do we expect an response?
-	if(flags & ~TCP::FL_ACK) {
+	if(reliable) {
 		// then remember that we've send the control-packed and wait for the ACK
 		_ctrlpkt.seqNo = _txCircle.nextSeq();
 		_ctrlpkt.flags = flags;
 		_ctrlpkt.optSize = optSize;
 		if(opt)
 			_ctrlpkt.option = *opt;
-		_ctrlpkt.timeout = 1000;
-		_txCircle.push(_txCircle.nextSeq(),CircularBuf::TYPE_CTRL,NULL,0);
-		Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),_ctrlpkt.timeout);
+		_ctrlpkt.retries = 0;
+		_txCircle.push(_ctrlpkt.seqNo,CircularBuf::TYPE_CTRL,NULL,0);
+		// a deferred one is sent by sendData()
+		if(!deferred) {
+			_sndNxt = _sndMax = _ctrlpkt.seqNo + 1;
+			Timeouts::program(_timer,_rto);
+		}
 	}
 	return 0;
 }
 
-void StreamSocket::sendData(bool resend) {
-	CircularBuf::seq_type seqNo = _txCircle.nextExp();
-	CircularBuf::seq_type start = resend ? seqNo : _txCircle.nextSeq();
-	/* have all bytes we've sent so far been ACKed? */
-	if(_pending.count && _pending.isWrite() &&
-			seqNo >= _pending.d.write.seqNo - (CircularBuf::seq_type)_pending.d.write.remaining) {
-		/* in this case push new data into the tx-circle in order to send them afterwards */
-		size_t amount = std::min(_remoteWinSize,_pending.d.write.remaining);
-		size_t offset = _pending.count - _pending.d.write.remaining;
-		const char *data = reinterpret_cast<const char*>(_pending.d.write.data) + offset;
-		sassert(_txCircle.push(seqNo,CircularBuf::TYPE_DATA,data,amount) == (ssize_t)amount);
-		_pending.d.write.remaining -= amount;
-	}
-
-	if(_txCircle.available() > 0) {
-		CircularBuf::seq_type lastAck = _rxCircle.nextExp();
-		CircularBuf::seq_type ackNo = _rxCircle.getAck();
-		// TODO allocate that just once
-		uint8_t *buf = new uint8_t[_mss];
-		size_t left = _remoteWinSize;
-		while(left > 0) {
-			size_t limit = std::min(left,std::min(_mtu,_mss));
-			size_t amount = _txCircle.get(start,buf,limit);
-			if(amount == 0)
-				break;
+ssize_t StreamSocket::resendCtrlPkt() {
+	ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),_ctrlpkt.flags,&_ctrlpkt.option,
+		_ctrlpkt.optSize,_ctrlpkt.optSize,_ctrlpkt.seqNo,_rxCircle.nextExp(),
+		rcvWindow(_ctrlpkt.flags));
+	if(res < 0) {
+		// TODO handle error
+		printe("TCP::send");
+	}
+	return res;
+}
 
-			// TODO don't use FL_PSH all the time
-			ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),
-				TCP::FL_ACK | TCP::FL_PSH,buf,amount,0,start,ackNo,_rxCircle.windowSize());
-			if(res < 0) {
-				print("Sending data failed: %s",strerror(res));
-				break;
-			}
+size_t StreamSocket::sendSegment(CircularBuf::seq_type seqNo,size_t limit) {
+	// send the data directly from the ring, unless it wraps around at the end of the ring
+	const uint8_t *data,*rest;
+	uint8_t *buf = NULL;
+	size_t amount = _txCircle.span(seqNo,&data,limit);
+	if(amount > 0 && amount < limit && _txCircle.span(seqNo + amount,&rest,1) > 0) {
+		buf = new uint8_t[limit];
+		amount = _txCircle.get(seqNo,buf,limit);
+		data = buf;
+	}
 
-			start += amount;
-			left -= amount;
+	if(amount > 0) {
+		// TODO don't use FL_PSH all the time
+		ssize_t res = TCP::send(remoteIP(),_localPort,remotePort(),
+			TCP::FL_ACK | TCP::FL_PSH,data,amount,0,seqNo,_rxCircle.getAck(),rcvWindow());
+		if(res < 0) {
+			print("Sending data failed: %s",strerror(res));
+			amount = 0;
 		}
-		delete[] buf;
+	}
+	delete[] buf;
+	return amount;
+}
+
+void StreamSocket::fillTxCircle() {
+	if(!_backlog)
+		return;
+
+	size_t amount = std::min(_txCircle.windowSize(),_backlogSize - _backlogPos);
+	if(amount > 0) {
+		sassert(_txCircle.push(_txCircle.nextSeq(),CircularBuf::TYPE_DATA,_backlog + _backlogPos,
+			amount) == (ssize_t)amount);
+		_backlogPos += amount;
+	}
+
+	// if the rest of the write request is in the txCircle now, we're done with it
+	if(_backlogPos == _backlogSize) {
+		delete[] _backlog;
+		_backlog = NULL;
+		replyPending<ssize_t>(_pending.count);
+	}
+}
+
+void StreamSocket::sendData() {
+	fillTxCircle();
+
+	// send new data as long as neither the congestion window nor the remote window is exhausted
+	size_t wnd = std::min(_cwnd,_remoteWinSize);
+	size_t segSize = std::min(_mtu,_mss);
+	while(flightSize() < wnd) {
+		size_t amount = sendSegment(_sndNxt,std::min(wnd - flightSize(),segSize));
+		if(amount == 0)
+			break;
 
-		// no packet sent yet and something to ACK?
-		if(left == _remoteWinSize && lastAck != ackNo) {
-			seqNo = _txCircle.nextSeq();
-			TCP::send(remoteIP(),_localPort,remotePort(),
-				TCP::FL_ACK,buf,0,0,seqNo,ackNo,_rxCircle.windowSize());
+		// time one segment at once, but never a retransmitted one (Karn's algorithm)
+		if(!_rttActive && !seqBefore(_sndNxt,_sndMax)) {
+			_rttActive = true;
+			_rttSeq = _sndNxt;
+			_rttStart = rdtsc();
 		}
-		else if(left != _remoteWinSize)
-			Timeouts::program(_timeoutId,std::make_memfun(this,&StreamSocket::timeout),1000);
+
+		_sndNxt += amount;
+		if(seqBefore(_sndMax,_sndNxt))
+			_sndMax = _sndNxt;
+	}
+
+	// send the deferred or lost control-packet, if all data in front of it has been sent
+	if(_ctrlpkt.flags && _sndNxt == _ctrlpkt.seqNo) {
+		resendCtrlPkt();
+		_sndNxt++;
+		if(seqBefore(_sndMax,_sndNxt))
+			_sndMax = _sndNxt;
 	}
+
+	if(flightSize() > 0 && !_timer.pending())
+		Timeouts::program(_timer,_rto);
 }
 
-int StreamSocket::forkSocket(int devfd,msgid_t mid,esc::ClientDevice<Socket> *dev,SynPacket &syn,
-		CircularBuf::seq_type seqNo) {
+void StreamSocket::ackReceived(CircularBuf::seq_type ackNo,size_t acked) {
+	// after a timeout, the peer might ACK data that we are about to send again
+	if(seqBefore(_sndNxt,ackNo))
+		_sndNxt = ackNo;
+
+	if(_rttActive && seqBefore(_rttSeq,ackNo)) {
+		updateRTO(tsctotime(rdtsc() - _rttStart));
+		_rttActive = false;
+	}
+
+	if(_inRecovery) {
+		// a full ACK terminates the fast recovery (RFC 6582)
+		if(!seqBefore(ackNo,_recover)) {
+			_cwnd = _ssthresh;
+			_inRecovery = false;
+		}
+		// a partial ACK means that the next segment has been lost, too
+		else {
+			sendSegment(ackNo,std::min(_mtu,_mss));
+			_cwnd -= std::min(_cwnd,acked);
+			if(acked >= _mss)
+				_cwnd += _mss;
+		}
+	}
+	// slow start
+	else if(_cwnd < _ssthresh)
+		_cwnd += std::min(acked,_mss);
+	// congestion avoidance
+	else
+		_cwnd += std::max<size_t>(_mss * _mss / _cwnd,1);
+	_dupAcks = 0;
+
+	// restart the retransmission timer, if there is still outstanding data
+	if(flightSize() > 0)
+		Timeouts::program(_timer,_rto);
+	else
+		Timeouts::cancel(_timer);
+}
+
+void StreamSocket::dupAckReceived() {
+	_dupAcks++;
+	// each further duplicate ACK means that another segment has left the network
+	if(_inRecovery)
+		_cwnd += _mss;
+	else if(_dupAcks == DUPACK_THRESHOLD) {
+		CircularBuf::seq_type una = _txCircle.nextExp();
+		PRINT_TCP(_localPort,remotePort(),"fast retransmit of %u",una);
+		_ssthresh = std::max(flightSize() / 2,2 * _mss);
+		_recover = _sndMax;
+		_inRecovery = true;
+		_rttActive = false;
+		sendSegment(una,std::min(_mtu,_mss));
+		_cwnd = _ssthresh + DUPACK_THRESHOLD * _mss;
+	}
+}
+
+void StreamSocket::updateRTO(uint64_t rtt) {
+	if(!_hasRTT) {
+		_srtt = rtt;
+		_rttvar = rtt / 2;
+		_hasRTT = true;
+	}
+	else {
+		uint64_t delta = _srtt > rtt ? _srtt - rtt : rtt - _srtt;
+		_rttvar = (3 * _rttvar + delta) / 4;
+		_srtt = (7 * _srtt + rtt) / 8;
+	}
+
+	// we can't be more precise than the timer wheel
+	uint64_t rto = (_srtt + std::max<uint64_t>(Timeouts::TICK * 1000,4 * _rttvar)) / 1000;
+	_rto = std::max<uint64_t>(MIN_RTO,std::min<uint64_t>(MAX_RTO,rto));
+}
+
+int StreamSocket::forkSocket(int devfd,msgid_t mid,esc::ClientDevice<Socket> *dev,
+		const SynPacket &syn) {
+	Route route = Route::find(esc::Net::IPv4Addr(syn.src.d.ipv4.addr));
+	if(!route.valid())
+		return -ENETUNREACH;
+
 	int nfd = createchan(devfd,O_RDWRMSG);
 	if(nfd < 0)
 		return nfd;
 
 	StreamSocket *s = new StreamSocket(nfd,esc::Socket::PROTO_TCP);
 	s->_mss = syn.mss;
+	s->_mtu = route.link->mtu() - Ethernet<IPv4<TCP>>().size();
 	s->_remoteAddr = syn.src;
 	s->_localPort = _localPort;
+	s->_remoteWinSize = syn.winSize;
+	s->_cwnd = s->initialWindow();
 	s->state(STATE_SYN_RECEIVED);
-	syn.winSize = std::max<size_t>(1024,std::min<size_t>(64 * 1024,syn.winSize));
-	s->_txCircle.init(s->_txCircle.nextSeq(),syn.winSize);
-	s->_rxCircle.init(seqNo + 1,RECV_BUF_SIZE);
+	s->_rxCircle.init(syn.seqNo + 1,RECV_BUF_SIZE);
 	int res = TCP::addSocket(s,s->_localPort,s->remotePort());
 	if(res < 0) {
 		delete s;
@@ -656,7 +842,17 @@ int StreamSocket::forkSocket(int devfd,msgid_t mid,esc::ClientDevice<Socket> *de
 	}
 
 	dev->add(nfd,s);
-	s->sendCtrlPkt(TCP::FL_SYN | TCP::FL_ACK);
+
+	// we may only use window scaling, if the peer offered it (RFC 7323)
+	bool ws = syn.wscale >= 0;
+	SynOptions options;
+	size_t optSize = buildSynOptions(&options,route.link->mtu() - IPv4<TCP>().size(),ws);
+	s->sendCtrlPkt(TCP::FL_SYN | TCP::FL_ACK,&options,optSize);
+	if(ws) {
+		s->_sndShift = std::min<int>(syn.wscale,MAX_WSCALE);
+		s->_rcvShift = WSCALE;
+	}
+
 	s->_pending.count = 1;
 	s->_pending.mid = mid;
 	s->_pending.d.accept.fd = fd();
@@ -665,32 +861,39 @@ int StreamSocket::forkSocket(int devfd,msgid_t mid,esc::ClientDevice<Socket> *de
 	return 0;
 }
 
+bool StreamSocket::isQueued(const SynPacket &syn) const {
+	for(auto it = _synQueue.begin(); it != _synQueue.end(); ++it) {
+		if(it->seqNo == syn.seqNo && it->src.d.ipv4.addr == syn.src.d.ipv4.addr &&
+				it->src.d.ipv4.port == syn.src.d.ipv4.port)
+			return true;
+	}
+	return false;
+}
+
 bool StreamSocket::replyRead(msgid_t mid,bool needsSrc,void *buffer,size_t size) {
-	ssize_t res = _rxCircle.available();
-	uint8_t *buf = reinterpret_cast<uint8_t*>(buffer);
-	bool success = true;
-	if(res > 0) {
-		if(buffer == NULL)
-			buf = new uint8_t[size];
-		res = _rxCircle.pull(buf,size);
+	ssize_t res = 0;
+	const uint8_t *data = NULL;
+	if(_rxCircle.available() > 0) {
+		// with shared memory, we copy the data directly into the buffer of the client. otherwise,
+		// we reply with the first contiguous part of the ring and throw it away afterwards.
+		if(buffer)
+			res = _rxCircle.pull(buffer,size);
+		else
+			res = _rxCircle.front(&data,size);
 		// don't pass EOF to application, if the available data is non-contiguous
-		if(res == 0) {
-			success = false;
-			goto done;
-		}
-
-		// if there is no additional data, we're done with pushing, if we were anyway
-		if(!_rxCircle.available())
-			_push = false;
+		if(res == 0)
+			return false;
 	}
 
+	reply(mid,_remoteAddr,needsSrc,buffer,data,res);
+	if(!buffer && res > 0)
+		_rxCircle.pull(NULL,res);
 	PRINT_TCP(_localPort,remotePort(),"passed %zd bytes to application (%zu left)",res,_rxCircle.available());
-	reply(mid,_remoteAddr,needsSrc,buffer ? buffer : NULL,buf,res);
 
-done:
-	if(res > 0 && buffer == NULL)
-		delete[] buf;
-	return success;
+	// if there is no additional data, we're done with pushing, if we were anyway
+	if(!_rxCircle.available())
+		_push = false;
+	return true;
 }
 
 const char *StreamSocket::stateName(State st) const {
@@ -20,6 +20,8 @@
 #pragma once
 
 #include <sys/common.h>
+#include <limits>
+#include <list>
 #include <stdlib.h>
 
 #include "../circularbuf.h"
@@ -32,10 +34,25 @@ class TCP;
 
 class StreamSocket : public Socket {
 public:
-	static const size_t SEND_BUF_SIZE	= 32 * 1024;
-	static const size_t RECV_BUF_SIZE	= 32 * 1024;
+	static const size_t SEND_BUF_SIZE	= 256 * 1024;
+	static const size_t RECV_BUF_SIZE	= 256 * 1024;
 	static const size_t FORCE_PSH_PERC	= 50;
 	static const size_t DEF_MSS			= 536;
+	/* the window scale we announce; RECV_BUF_SIZE >> WSCALE has to fit into 16 bits */
+	static const uint8_t WSCALE			= 3;
+	static const uint8_t MAX_WSCALE		= 14;
+	/* bounds for the retransmission timeout in milliseconds (RFC 6298) */
+	static const uint INIT_RTO			= 1000;
+	static const uint MIN_RTO			= 200;
+	static const uint MAX_RTO			= 60 * 1000;
+	/* the number of retransmissions of a SYN or FIN before we give up */
+	static const uint MAX_CTRL_RETRIES	= 4;
+	/* the number of duplicate ACKs that trigger a fast retransmit (RFC 5681) */
+	static const uint DUPACK_THRESHOLD	= 3;
+	/* the max. number of connections that wait for accept() */
+	static const size_t MAX_BACKLOG		= 16;
+
+	static_assert((RECV_BUF_SIZE >> WSCALE) <= 0xFFFF,"RECV_BUF_SIZE too large for WSCALE");
 
 	enum State {
 		STATE_CLOSED,
@@ -62,32 +79,55 @@ public:
 		uint16_t mss;
 	} A_PACKED;
 
+	struct WSOption {
+		uint8_t kind;
+		uint8_t length;
+		uint8_t shift;
+	} A_PACKED;
+
+	/* the options we put into SYN packets. the NOP aligns them to 4 bytes */
+	struct SynOptions {
+		MSSOption mss;
+		uint8_t nop;
+		WSOption ws;
+	} A_PACKED;
+
 	struct CtrlPacket {
 		uint8_t flags;
-		MSSOption option;
+		SynOptions option;
 		CircularBuf::seq_type seqNo;
 		size_t optSize;
-		uint timeout;
+		uint retries;
 	};
 	struct SynPacket {
 		uint16_t mss;
 		esc::Socket::Addr src;
 		uint16_t winSize;
+		/* the window scale of the peer or -1 if it doesn't support it */
+		int wscale;
+		CircularBuf::seq_type seqNo;
 	};
 
 	enum {
+		OPTION_EOL	= 0x0,
+		OPTION_NOP	= 0x1,
 		OPTION_MSS	= 0x2,
+		OPTION_WS	= 0x3,
 	};
 
 	explicit StreamSocket(int f,int proto)
-			: Socket(f,proto), _closed(false), _timeoutId(Timeouts::allocateId()), _localPort(),
-			  _remoteAddr(), _mtu(), _mss(DEF_MSS), _state(STATE_CLOSED), _ctrlpkt(), _txCircle(),
-			  _rxCircle(), _push() {
+			: Socket(f,proto), _closed(false), _timer(std::make_memfun(this,&StreamSocket::timeout)),
+			  _localPort(), _remoteAddr(), _mtu(), _mss(DEF_MSS), _remoteWinSize(), _sndShift(),
+			  _rcvShift(), _state(STATE_CLOSED), _ctrlpkt(), _txCircle(), _rxCircle(), _push(), _synQueue(),
+			  _sndNxt(), _sndMax(), _backlog(), _backlogSize(), _backlogPos(), _srtt(), _rttvar(),
+			  _rto(INIT_RTO), _hasRTT(), _rttActive(), _rttSeq(), _rttStart(), _cwnd(),
+			  _ssthresh(std::numeric_limits<size_t>::max()), _recover(), _inRecovery(), _dupAcks() {
 		if(proto != esc::Socket::PROTO_TCP)
 			VTHROWE("Protocol " << proto << " is not supported by stream socket",-ENOTSUP);
 
-		_rxCircle.init(0,SEND_BUF_SIZE);
-		_txCircle.init((rand() << 16) | rand(),RECV_BUF_SIZE);
+		_rxCircle.init(0,RECV_BUF_SIZE);
+		_txCircle.init((rand() << 16) | rand(),SEND_BUF_SIZE);
+		_sndNxt = _sndMax = _txCircle.nextSeq();
 	}
 	virtual ~StreamSocket();
 
@@ -116,7 +156,15 @@ public:
 
 private:
 	void state(State st);
-	static uint16_t parseMSS(const TCP *tcp);
+	static void parseOptions(const TCP *tcp,uint16_t *mss,int *wscale);
+	static size_t buildSynOptions(SynOptions *opt,size_t mss,bool ws);
+
+	/**
+	 * @return true if sequence number <a> is in front of <b>, taking wraparounds into account
+	 */
+	static bool seqBefore(CircularBuf::seq_type a,CircularBuf::seq_type b) {
+		return (int32_t)(a - b) < 0;
+	}
 
 	bool closing() const {
 		return _state == STATE_CLOSED || _state == STATE_CLOSING || _state == STATE_CLOSE_WAIT ||
@@ -136,13 +184,34 @@ private:
 		return left < (cap * FORCE_PSH_PERC) / 100;
 	}
 
+	/**
+	 * @return the number of sent, but not yet ACKed bytes
+	 */
+	size_t flightSize() const {
+		return _sndNxt - _txCircle.nextExp();
+	}
+	/**
+	 * @return the initial congestion window (RFC 5681)
+	 */
+	size_t initialWindow() const {
+		return std::min(4 * _mss,std::max<size_t>(2 * _mss,4380));
+	}
+	uint16_t rcvWindow(uint8_t flags = 0) const;
+
 	const char *stateName(State st) const;
-	ssize_t sendCtrlPkt(uint8_t flags,MSSOption *opt = NULL,bool forceACK = false);
-	void sendData(bool resend);
+	ssize_t sendCtrlPkt(uint8_t flags,const SynOptions *opt = NULL,size_t optSize = 0,
+		bool forceACK = false);
+	ssize_t resendCtrlPkt();
+	size_t sendSegment(CircularBuf::seq_type seqNo,size_t limit);
+	void sendData();
+	void fillTxCircle();
+	void ackReceived(CircularBuf::seq_type ackNo,size_t acked);
+	void dupAckReceived();
+	void updateRTO(uint64_t rtt);
 	void timeout();
 
-	int forkSocket(int devfd,msgid_t mid,esc::ClientDevice<Socket> *dev,SynPacket &syn,
-		CircularBuf::seq_type seqNo);
+	int forkSocket(int devfd,msgid_t mid,esc::ClientDevice<Socket> *dev,const SynPacket &syn);
+	bool isQueued(const SynPacket &syn) const;
 	bool replyRead(msgid_t mid,bool needsSrc,void *buffer,size_t size);
 	template<typename T>
 	void replyPending(T result) {
@@ -157,8 +226,8 @@ private:
 	/* true if the client closed the socket */
 	bool _closed;
 
-	/* our id for programming timeouts */
-	int _timeoutId;
+	/* for retransmissions and the FIN_WAIT_2 and TIME_WAIT states */
+	Timeouts::Timer _timer;
 
 	/* connection information */
 	esc::port_t _localPort;
@@ -166,6 +235,9 @@ private:
 	size_t _mtu;
 	size_t _mss;
 	size_t _remoteWinSize;
+	/* window scaling (RFC 7323) for the remote window and our window */
+	uint8_t _sndShift;
+	uint8_t _rcvShift;
 
 	/* our state */
 	State _state;
@@ -177,6 +249,33 @@ private:
 	CircularBuf _txCircle;
 	CircularBuf _rxCircle;
 	bool _push;
+	/* the connection requests that have not been accepted yet */
+	std::list<SynPacket> _synQueue;
+	/* the next sequence number to send; the rest of the txCircle has not been sent yet */
+	CircularBuf::seq_type _sndNxt;
+	/* the highest sequence number sent so far */
+	CircularBuf::seq_type _sndMax;
+	/* the part of a write request that did not fit into the txCircle */
+	uint8_t *_backlog;
+	size_t _backlogSize;
+	size_t _backlogPos;
+
+	/* round-trip time estimation (RFC 6298); times are in microseconds, the RTO in milliseconds */
+	uint64_t _srtt;
+	uint64_t _rttvar;
+	uint _rto;
+	bool _hasRTT;
+	/* the segment we're currently timing */
+	bool _rttActive;
+	CircularBuf::seq_type _rttSeq;
+	uint64_t _rttStart;
+
+	/* congestion control (NewReno, RFC 5681 and RFC 6582) */
+	size_t _cwnd;
+	size_t _ssthresh;
+	CircularBuf::seq_type _recover;
+	bool _inRecovery;
+	uint _dupAcks;
 
 	static PortMng<PRIVATE_PORTS_CNT> _ports;
 };
@@ -261,6 +261,7 @@ public:
 		set(MSG_NET_LINK_REM,std::make_memfun(this,&NetDevice::linkRem));
 		set(MSG_NET_LINK_CONFIG,std::make_memfun(this,&NetDevice::linkConfig));
 		set(MSG_NET_LINK_MAC,std::make_memfun(this,&NetDevice::linkMAC));
+		set(MSG_NET_LINK_LOSS,std::make_memfun(this,&NetDevice::linkLoss));
 		set(MSG_NET_ROUTE_ADD,std::make_memfun(this,&NetDevice::routeAdd));
 		set(MSG_NET_ROUTE_REM,std::make_memfun(this,&NetDevice::routeRem));
 		set(MSG_NET_ROUTE_CONFIG,std::make_memfun(this,&NetDevice::routeConfig));
@@ -336,6 +337,23 @@ public:
 			is << esc::ValueResponse<esc::NIC::MAC>::success(link->mac()) << esc::Reply();
 	}
 
+	void linkLoss(esc::IPCStream &is) {
+		esc::CStringBuf<Link::NAME_LEN> name;
+		uint permille;
+		is >> name >> permille;
+
+		std::lock_guard<std::mutex> guard(mutex);
+		errcode_t res = 0;
+		std::shared_ptr<Link> link = LinkMng::getByName(name.str());
+		if(!link)
+			res = -ENOTFOUND;
+		else if(permille > 1000)
+			res = -EINVAL;
+		else
+			link->loss(permille);
+		is << res << esc::Reply();
+	}
+
 	void routeAdd(esc::IPCStream &is) {
 		esc::CStringBuf<Link::NAME_LEN> link;
 		esc::Net::IPv4Addr ip,gw,netmask;
@@ -480,9 +498,8 @@ static int receiveThread(void *arg) {
 
 	std::shared_ptr<Link> *linkptr = reinterpret_cast<std::shared_ptr<Link>*>(arg);
 	const std::shared_ptr<Link> link = *linkptr;
-	uint8_t *buffer = reinterpret_cast<uint8_t*>(link->sharedmem());
 	while(link->status() != esc::Net::KILLED) {
-		ssize_t res = link->read(buffer,link->mtu());
+		ssize_t res = link->receive();
 		if(res < 0) {
 			if(res != -EINTR) {
 				printe("Reading packet failed");
@@ -491,15 +508,26 @@ static int receiveThread(void *arg) {
 			continue;
 		}
 
-		if((size_t)res >= sizeof(Ethernet<>)) {
-			std::lock_guard<std::mutex> guard(mutex);
-			Packet pkt(buffer,res);
-			ssize_t err = Ethernet<>::receive(link,pkt);
-			if(err < 0)
-				std::cerr << "Ignored packet of size " << res << ": " << strerror(err) << "\n";
+		// handle all packets of the batch and send the responses together
+		std::lock_guard<std::mutex> guard(mutex);
+		link->cork();
+		for(ssize_t pos = 0; pos < res; ) {
+			const esc::NIC::BatchPacket *bpkt = reinterpret_cast<const esc::NIC::BatchPacket*>(
+				link->rxbuffer() + pos);
+			size_t len = bpkt->length;
+			if(len >= sizeof(Ethernet<>)) {
+				Packet pkt(const_cast<uint8_t*>(bpkt->data),len);
+				ssize_t err = Ethernet<>::receive(link,pkt);
+				if(err < 0)
+					std::cerr << "Ignored packet of size " << len << ": " << strerror(err) << "\n";
+			}
+			else
+				printe("Ignoring packet of size %zu",len);
+			pos += esc::NIC::batchSize(len);
 		}
-		else
-			printe("Ignoring packet of size %zd",res);
+		ssize_t err = link->uncork();
+		if(err < 0)
+			std::cerr << "Sending the responses failed: " << strerror(err) << "\n";
 	}
 	LinkMng::rem(link->name());
 	delete linkptr;
@@ -21,6 +21,7 @@
 #include <sys/proc.h>
 #include <sys/thread.h>
 #include <sys/time.h>
+#include <limits>
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -29,37 +30,51 @@
 
 #define print(...)
 
-int Timeouts::_nextId;
-std::list<Timeouts::Entry> Timeouts::_list;
+Timeouts::Timer *Timeouts::_slots[SLOTS];
+uint64_t Timeouts::_lastTick;
+size_t Timeouts::_count;
 extern std::mutex mutex;
 
-void Timeouts::program(int id,callback_type *cb,uint msecs) {
+void Timeouts::insert(Timer **list,Timer &t) {
+	t._next = *list;
+	if(t._next)
+		t._next->_pprev = &t._next;
+	t._pprev = list;
+	*list = &t;
+}
+
+void Timeouts::remove(Timer &t) {
+	*t._pprev = t._next;
+	if(t._next)
+		t._next->_pprev = t._pprev;
+	t._pprev = NULL;
+	t._next = NULL;
+}
+
+void Timeouts::program(Timer &t,uint msecs) {
 	// first cancel the old one
-	cancel(id);
-
-	// insert new timeout, sorted in ascending order
-	uint64_t ts = rdtsc() + timetotsc(msecs * 1000);
-	auto it = _list.begin();
-	for(; it != _list.end(); ++it) {
-		if(it->timestamp > ts)
-			break;
-	}
-	print("Inserting timeout %d @ %Luus",id,tsctotime(ts));
-	if(it == _list.begin())
+	cancel(t);
+
+	// if the wheel was empty, the timeout thread doesn't tick. so, start at the current tick and
+	// wake it up
+	uint64_t now = ticks();
+	if(_count++ == 0) {
+		_lastTick = now;
 		kill(getpid(),SIGUSR2);
-	_list.insert(it,Entry(id,cb,ts));
+	}
+
+	// count from the current tick, because the timeout thread might lag behind. round up to never
+	// expire too early
+	t._expires = now + std::max<uint64_t>((msecs + TICK - 1) / TICK,1);
+	print("Inserting timeout %p @ tick %Lu",&t,t._expires);
+	insert(_slots + t._expires % SLOTS,t);
 }
 
-void Timeouts::cancel(int id) {
-	for(auto it = _list.begin(); it != _list.end(); ++it) {
-		if(it->id == id) {
-			delete it->cb;
-			print("Removing timeout %d",id);
-			if(it == _list.begin())
-				kill(getpid(),SIGUSR2);
-			_list.erase(it);
-			break;
-		}
+void Timeouts::cancel(Timer &t) {
+	if(t.pending()) {
+		print("Removing timeout %p",&t);
+		remove(t);
+		_count--;
 	}
 }
 
@@ -72,25 +87,36 @@ int Timeouts::thread(void*) {
 		error("Unable to set signal handler");
 
 	while(1) {
-		uint64_t next = std::numeric_limits<uint64_t>::max();
-		if(_list.size() > 0)
-			next = _list.front().timestamp - rdtsc();
-		print("Sleeping for %Luus @ %Luus",tsctotime(next),tsctotime(rdtsc()));
-		usleep(tsctotime(next));
-		print("Waked up @ %Luus",tsctotime(rdtsc()));
-
-		// it's sorted
+		// sleep until the next tick or until the first timeout is programmed
+		usleep(_count > 0 ? TICK * 1000 : std::numeric_limits<time_t>::max());
+
 		std::lock_guard<std::mutex> guard(mutex);
-		uint64_t now = rdtsc();
-		while(_list.size() > 0 && _list.front().timestamp <= now) {
-			auto it = _list.begin();
-			callback_type *cb = it->cb;
-			print("Triggering timeout %d @ %Luus",it->id,tsctotime(rdtsc()));
-			_list.erase(it);
+		uint64_t now = ticks();
+		// if we've overslept a whole revolution, every slot needs to be visited once
+		if(now - _lastTick > SLOTS)
+			_lastTick = now - SLOTS;
 
-			(*cb)();
+		// move the expired timeouts to a separate list first, because the callbacks might program
+		// or cancel other timeouts
+		Timer *expired = NULL;
+		for(; _lastTick < now; ++_lastTick) {
+			Timer *t = _slots[(_lastTick + 1) % SLOTS];
+			while(t) {
+				Timer *next = t->_next;
+				if(t->_expires <= now) {
+					remove(*t);
+					insert(&expired,*t);
+				}
+				t = next;
+			}
+		}
 
-			delete cb;
+		while(expired) {
+			Timer *t = expired;
+			print("Triggering timeout %p @ tick %Lu",t,now);
+			remove(*t);
+			_count--;
+			(*t->_cb)();
 		}
 	}
 	return 0;
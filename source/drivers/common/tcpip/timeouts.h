@@ -20,36 +20,90 @@
 #pragma once
 
 #include <sys/common.h>
+#include <sys/time.h>
 #include <functor.h>
-#include <list>
 #include <mutex>
 
+/**
+ * Manages all timeouts of the TCP/IP stack. The timeouts are kept in a hashed timer wheel with
+ * SLOTS slots of TICK milliseconds each. Thus, programming and canceling a timeout is O(1). A
+ * timeout that lies more than one revolution in the future simply stays in its slot until its
+ * round has come. The timeout thread only ticks while there are timeouts.
+ */
 class Timeouts {
 	Timeouts() = delete;
 
 public:
 	typedef std::Functor<void> callback_type;
 
-	struct Entry {
-		explicit Entry(int _id,callback_type *_cb,uint64_t _timestamp)
-			: id(_id), cb(_cb), timestamp(_timestamp) {
+	/* the resolution of the wheel in milliseconds */
+	static const uint TICK		= 10;
+	/* the number of slots */
+	static const size_t SLOTS	= 256;
+
+	/**
+	 * A timeout that can be programmed and canceled repeatedly. It is typically embedded into the
+	 * object that wants to be notified.
+	 */
+	class Timer {
+		friend class Timeouts;
+
+	public:
+		/**
+		 * Creates a timer that is not programmed yet
+		 *
+		 * @param cb the callback to call on expiry (is deleted with the timer)
+		 */
+		explicit Timer(callback_type *cb) : _cb(cb), _pprev(), _next(), _expires() {
+		}
+		Timer(const Timer&) = delete;
+		Timer &operator=(const Timer&) = delete;
+		~Timer() {
+			Timeouts::cancel(*this);
+			delete _cb;
+		}
+
+		/**
+		 * @return true if the timer is programmed
+		 */
+		bool pending() const {
+			return _pprev != NULL;
 		}
 
-		int id;
-		callback_type *cb;
-		uint64_t timestamp;
+	private:
+		callback_type *_cb;
+		Timer **_pprev;
+		Timer *_next;
+		uint64_t _expires;
 	};
 
 	static int thread(void*);
 
-	static int allocateId() {
-		return _nextId++;
-	}
+	/**
+	 * Programs <t> to expire in <msecs> milliseconds. If it is already programmed, the old
+	 * timeout is replaced. The mutex has to be held.
+	 *
+	 * @param t the timer
+	 * @param msecs the number of milliseconds
+	 */
+	static void program(Timer &t,uint msecs);
 
-	static void program(int id,callback_type *cb,uint msecs);
-	static void cancel(int id);
+	/**
+	 * Cancels <t>, if it is programmed. The mutex has to be held.
+	 *
+	 * @param t the timer
+	 */
+	static void cancel(Timer &t);
 
 private:
-	static int _nextId;
-	static std::list<Entry> _list;
+	static uint64_t ticks() {
+		return tsctotime(rdtsc()) / (TICK * 1000);
+	}
+	static void insert(Timer **list,Timer &t);
+	static void remove(Timer &t);
+
+	static Timer *_slots[SLOTS];
+	/* the last tick that has been processed */
+	static uint64_t _lastTick;
+	static size_t _count;
 };
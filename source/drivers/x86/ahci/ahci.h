@@ -0,0 +1,227 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/common.h>
+#include <stdio.h>
+
+#define DBG_LEVEL	1
+
+#if DBG_LEVEL > 0
+#	define DBG1(fmt...)		print(fmt)
+#else
+#	define DBG1(...)
+#endif
+
+#if DBG_LEVEL > 1
+#	define DBG2(fmt...)		print(fmt)
+#else
+#	define DBG2(...)
+#endif
+
+/* the definitions below are taken from the "Serial ATA AHCI 1.3.1 Specification" and the
+ * "ATA/ATAPI Command Set (ACS-3)" */
+
+enum {
+	AHCI_CLASS				= 0x01,			/* mass storage controller */
+	AHCI_SUBCLASS			= 0x06,			/* SATA */
+	AHCI_BAR				= 5,			/* ABAR: AHCI base memory register */
+};
+
+/* generic host control */
+enum {
+	REG_CAP					= 0x00,			/* host capabilities */
+	REG_GHC					= 0x04,			/* global host control */
+	REG_IS					= 0x08,			/* interrupt status */
+	REG_PI					= 0x0C,			/* ports implemented */
+	REG_VS					= 0x10,			/* version */
+	REG_CAP2				= 0x24,			/* host capabilities extended */
+};
+
+enum {
+	CAP_NP_MASK				= 0x1F,			/* number of ports - 1 */
+	CAP_NCS_SHIFT			= 8,			/* number of command slots - 1 */
+	CAP_NCS_MASK			= 0x1F << 8,
+	CAP_SNCQ				= 1 << 30,		/* supports native command queuing */
+	CAP_S64A				= 1 << 31,		/* supports 64-bit addressing */
+};
+
+enum {
+	GHC_HR					= 1 << 0,		/* HBA reset */
+	GHC_IE					= 1 << 1,		/* interrupt enable */
+	GHC_AE					= 1 << 31,		/* AHCI enable */
+};
+
+/* the port registers, relative to 0x100 + port * 0x80 */
+enum {
+	PREG_CLB				= 0x00,			/* command list base address */
+	PREG_CLBU				= 0x04,			/* command list base address upper 32 bits */
+	PREG_FB					= 0x08,			/* FIS base address */
+	PREG_FBU				= 0x0C,			/* FIS base address upper 32 bits */
+	PREG_IS					= 0x10,			/* interrupt status */
+	PREG_IE					= 0x14,			/* interrupt enable */
+	PREG_CMD				= 0x18,			/* command and status */
+	PREG_TFD				= 0x20,			/* task file data */
+	PREG_SIG				= 0x24,			/* signature */
+	PREG_SSTS				= 0x28,			/* SATA status */
+	PREG_SCTL				= 0x2C,			/* SATA control */
+	PREG_SERR				= 0x30,			/* SATA error */
+	PREG_SACT				= 0x34,			/* SATA active (NCQ tags) */
+	PREG_CI					= 0x38,			/* command issue */
+};
+
+static const size_t PORT_REGS_OFFSET	= 0x100;
+static const size_t PORT_REGS_SIZE		= 0x80;
+static const size_t MAX_PORTS			= 32;
+
+enum {
+	PCMD_ST					= 1 << 0,		/* start processing the command list */
+	PCMD_SUD				= 1 << 1,		/* spin-up device */
+	PCMD_POD				= 1 << 2,		/* power on device */
+	PCMD_FRE				= 1 << 4,		/* FIS receive enable */
+	PCMD_FR					= 1 << 14,		/* FIS receive DMA engine is running */
+	PCMD_CR					= 1 << 15,		/* command list DMA engine is running */
+};
+
+enum {
+	PIS_DHRS				= 1 << 0,		/* device to host register FIS received */
+	PIS_PSS					= 1 << 1,		/* PIO setup FIS received */
+	PIS_DSS					= 1 << 2,		/* DMA setup FIS received */
+	PIS_SDBS				= 1 << 3,		/* set device bits FIS received (NCQ completion) */
+	PIS_DPS					= 1 << 5,		/* a PRD with the I bit has been processed */
+	PIS_OFS					= 1 << 24,		/* overflow */
+	PIS_INFS				= 1 << 26,		/* interface non-fatal error */
+	PIS_IFS					= 1 << 27,		/* interface fatal error */
+	PIS_HBDS				= 1 << 28,		/* host bus data error */
+	PIS_HBFS				= 1 << 29,		/* host bus fatal error */
+	PIS_TFES				= 1 << 30,		/* task file error */
+
+	PIS_ERRORS				= PIS_OFS | PIS_IFS | PIS_HBDS | PIS_HBFS | PIS_TFES,
+	PIS_DONE				= PIS_DHRS | PIS_SDBS | PIS_DPS,
+};
+
+enum {
+	TFD_ERR					= 1 << 0,
+	TFD_DRQ					= 1 << 3,
+	TFD_BSY					= 1 << 7,
+};
+
+enum {
+	SSTS_DET_MASK			= 0xF,
+	SSTS_DET_PRESENT		= 0x3,			/* device present and phy communication established */
+	SCTL_DET_INIT			= 0x1,			/* perform interface initialization (COMRESET) */
+};
+
+enum {
+	SIG_ATA					= 0x00000101,
+	SIG_ATAPI				= 0xEB140101,
+};
+
+enum {
+	FIS_TYPE_REG_H2D		= 0x27,
+	FIS_H2D_CMD				= 1 << 7,		/* the FIS contains a command (vs. a control update) */
+};
+
+enum {
+	CMD_IDENTIFY			= 0xEC,
+	CMD_READ_DMA_EXT		= 0x25,
+	CMD_WRITE_DMA_EXT		= 0x35,
+	CMD_READ_FPDMA_QUEUED	= 0x60,
+	CMD_WRITE_FPDMA_QUEUED	= 0x61,
+};
+
+/* the device register value; LBA addressing */
+static const uint8_t DEVICE_LBA			= 0x40;
+
+/* the IDENTIFY words we are interested in */
+enum {
+	ID_MODEL				= 27,			/* 40 ASCII chars */
+	ID_LBA28_SECS			= 60,			/* 2 words */
+	ID_QUEUE_DEPTH			= 75,			/* bits 0..4: max. queue depth - 1 */
+	ID_SATA_CAPS			= 76,			/* bit 8: NCQ is supported */
+	ID_FEATURES				= 83,			/* bit 10: LBA48 is supported */
+	ID_LBA48_SECS			= 100,			/* 4 words */
+	ID_SECTOR_SIZE			= 106,			/* bit 12: the logical sector size is in 117..118 */
+	ID_LOG_SEC_SIZE			= 117,			/* 2 words; in words */
+};
+
+static const size_t ATA_SEC_SIZE		= 512;
+
+/* register host to device FIS */
+struct FISRegH2D {
+	uint8_t type;
+	uint8_t flags;
+	uint8_t command;
+	uint8_t featureLo;
+	uint8_t lba0;
+	uint8_t lba1;
+	uint8_t lba2;
+	uint8_t device;
+	uint8_t lba3;
+	uint8_t lba4;
+	uint8_t lba5;
+	uint8_t featureHi;
+	uint8_t countLo;
+	uint8_t countHi;
+	uint8_t icc;
+	uint8_t control;
+	uint32_t : 32;
+} A_PACKED;
+
+/* an entry in the command list */
+struct CmdHeader {
+	/* bits 0..4: command FIS length in dwords, bit 6: write, bits 16..31: PRDT length */
+	uint32_t flags;
+	/* the number of bytes that have been transferred */
+	volatile uint32_t prdbc;
+	uint32_t ctba;
+	uint32_t ctbau;
+	uint32_t reserved[4];
+} A_PACKED;
+
+enum {
+	CMDH_WRITE				= 1 << 6,
+	CMDH_PRDTL_SHIFT		= 16,
+};
+
+/* physical region descriptor */
+struct PRD {
+	uint32_t dba;
+	uint32_t dbau;
+	uint32_t : 32;
+	/* bits 0..21: byte count - 1, bit 31: interrupt on completion */
+	uint32_t dbc;
+} A_PACKED;
+
+/* the number of PRDs per command table; chosen so that a table fills exactly 1 KiB */
+static const size_t PRDT_ENTRIES		= 56;
+/* the max. number of bytes a PRD can describe */
+static const size_t PRD_MAX_BYTES		= 4 * 1024 * 1024;
+
+struct CmdTable {
+	uint8_t cfis[64];
+	uint8_t acmd[16];
+	uint8_t reserved[48];
+	PRD prdt[PRDT_ENTRIES];
+} A_PACKED;
+
+static const size_t CMD_SLOTS			= 32;
+static const size_t RECV_FIS_SIZE		= 256;
+
@@ -0,0 +1,119 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/irq.h>
+#include <sys/mman.h>
+#include <sys/sync.h>
+#include <sys/thread.h>
+#include <stdlib.h>
+
+#include "hba.h"
+#include "port.h"
+
+HBA::HBA(esc::PCI &pci,const esc::PCI::Device &dev)
+		: _irqsem(), _cap(), _mmio(), _ports() {
+	// map the AHCI registers
+	const esc::PCI::Bar &bar = dev.bars[AHCI_BAR];
+	if(bar.addr == 0 || bar.type != esc::PCI::Bar::BAR_MEM)
+		error("BAR %d of the HBA is no memory BAR",AHCI_BAR);
+	uintptr_t phys = bar.addr;
+	_mmio = reinterpret_cast<volatile uint32_t*>(mmapphys(&phys,bar.size,0,MAP_PHYS_MAP));
+	if(_mmio == NULL)
+		error("Unable to map MMIO region %p..%p",phys,phys + bar.size - 1);
+	DBG1("Mapped MMIO region %p..%p @ %p",phys,phys + bar.size - 1,_mmio);
+
+	// enable memory space and bus mastering; interrupts are enabled in start()
+	uint32_t statusCmd = pci.read(dev.bus,dev.dev,dev.func,0x04);
+	pci.write(dev.bus,dev.dev,dev.func,0x04,(statusCmd & ~0x400) | 0x6);
+
+	// switch to AHCI mode and keep the interrupts disabled while we're setting up the ports
+	writeReg(REG_GHC,GHC_AE);
+	_cap = readReg(REG_CAP);
+	uint32_t pi = readReg(REG_PI);
+	DBG1("AHCI %x.%x: %zu ports, %zu slots, NCQ=%d, 64bit=%d",
+		readReg(REG_VS) >> 16,readReg(REG_VS) & 0xFFFF,(size_t)(_cap & CAP_NP_MASK) + 1,
+		slots(),ncq(),addr64());
+
+	for(size_t i = 0; i < MAX_PORTS; ++i) {
+		if(~pi & (1U << i))
+			continue;
+
+		Port *p = new Port(this,i,_mmio + (PORT_REGS_OFFSET + i * PORT_REGS_SIZE) / sizeof(uint32_t));
+		if(p->init())
+			_ports[i] = p;
+		else
+			delete p;
+	}
+
+	// create the IRQ sem here to ensure that we've registered it if the first interrupt arrives
+	if(pci.hasCap(dev.bus,dev.dev,dev.func,esc::PCI::CAP_MSI)) {
+		DBG1("Using MSIs (%u)",dev.irq);
+		uint64_t msiaddr;
+		uint32_t msival;
+		_irqsem = semcrtirq(dev.irq,"AHCI",&msiaddr,&msival);
+		if(_irqsem < 0)
+			error("Unable to create irq-semaphore");
+
+		pci.enableMSIs(dev.bus,dev.dev,dev.func,msiaddr,msival);
+	}
+	else {
+		DBG1("Using legacy IRQs (%u)",dev.irq);
+		_irqsem = semcrtirq(dev.irq,"AHCI",NULL,NULL);
+		if(_irqsem < 0)
+			error("Unable to create irq-semaphore");
+	}
+}
+
+void HBA::start() {
+	writeReg(REG_IS,readReg(REG_IS));
+	writeReg(REG_GHC,GHC_AE | GHC_IE);
+	if(startthread(irqThread,this) < 0)
+		error("Unable to start interrupt-thread");
+	if(startthread(watchdogThread,this) < 0)
+		error("Unable to start watchdog-thread");
+}
+
+int HBA::watchdogThread(void *arg) {
+	HBA *hba = reinterpret_cast<HBA*>(arg);
+	while(1) {
+		usleep(WATCHDOG_INTERVAL * 1000);
+		for(size_t i = 0; i < MAX_PORTS; ++i) {
+			if(hba->_ports[i])
+				hba->_ports[i]->checkTimeouts(WATCHDOG_INTERVAL);
+		}
+	}
+	return 0;
+}
+
+int HBA::irqThread(void *arg) {
+	HBA *hba = reinterpret_cast<HBA*>(arg);
+	while(1) {
+		semdown(hba->_irqsem);
+
+		// the port interrupts have to be acknowledged before the global ones
+		uint32_t is = hba->readReg(REG_IS);
+		for(size_t i = 0; i < MAX_PORTS; ++i) {
+			if((is & (1U << i)) && hba->_ports[i])
+				hba->_ports[i]->handleIntr();
+		}
+		hba->writeReg(REG_IS,is);
+	}
+	return 0;
+}
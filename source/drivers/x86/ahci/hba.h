@@ -0,0 +1,94 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/proto/pci.h>
+#include <sys/common.h>
+
+#include "ahci.h"
+
+class Port;
+
+/**
+ * The AHCI host bus adapter. It maps the registers, sets up all ports that have a SATA disk
+ * attached and runs the thread that handles the interrupts and a watchdog thread, which recovers
+ * from commands whose completion never arrives.
+ */
+class HBA {
+public:
+	/**
+	 * Initializes the given HBA
+	 *
+	 * @param pci the PCI device
+	 * @param dev the PCI device of the HBA
+	 */
+	explicit HBA(esc::PCI &pci,const esc::PCI::Device &dev);
+
+	/**
+	 * @return the number of command slots per port
+	 */
+	size_t slots() const {
+		return ((_cap & CAP_NCS_MASK) >> CAP_NCS_SHIFT) + 1;
+	}
+	/**
+	 * @return whether the HBA supports native command queuing
+	 */
+	bool ncq() const {
+		return _cap & CAP_SNCQ;
+	}
+	/**
+	 * @return whether the HBA can access physical memory above 4G
+	 */
+	bool addr64() const {
+		return _cap & CAP_S64A;
+	}
+
+	/**
+	 * @param no the port number
+	 * @return the port with given number or NULL if it does not exist or has no usable disk
+	 */
+	Port *port(size_t no) {
+		return no < MAX_PORTS ? _ports[no] : NULL;
+	}
+
+	/**
+	 * Enables the interrupts and starts the interrupt thread and the watchdog
+	 */
+	void start();
+
+private:
+	/* the interval in which the watchdog checks for lost completions */
+	static const int WATCHDOG_INTERVAL	= 500;	/* ms */
+
+	static int irqThread(void *arg);
+	static int watchdogThread(void *arg);
+
+	uint32_t readReg(uint reg) const {
+		return _mmio[reg / sizeof(uint32_t)];
+	}
+	void writeReg(uint reg,uint32_t value) {
+		_mmio[reg / sizeof(uint32_t)] = value;
+	}
+
+	int _irqsem;
+	uint32_t _cap;
+	volatile uint32_t *_mmio;
+	Port *_ports[MAX_PORTS];
+};
@@ -0,0 +1,445 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/ipc/ipcstream.h>
+#include <esc/proto/file.h>
+#include <esc/util.h>
+#include <sys/common.h>
+#include <sys/mman.h>
+#include <sys/thread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hba.h"
+#include "port.h"
+
+static_assert(sizeof(CmdHeader) == 32,"Command header has the wrong size");
+static_assert(sizeof(CmdTable) == 1024,"Command table has the wrong size");
+
+Port::Port(HBA *hba,uint no,volatile uint32_t *regs)
+	: BlockDisk(), _hba(hba), _no(no), _regs(regs), _mem(), _memPhys(), _ncq(), _depth(1),
+	  _secSize(ATA_SEC_SIZE), _sectors(), _model(), _partTable(), _mutex(), _used(), _issued(),
+	  _freeSlots(), _slots() {
+}
+
+bool Port::init() {
+	if((readReg(PREG_SSTS) & SSTS_DET_MASK) != SSTS_DET_PRESENT)
+		return false;
+	if(readReg(PREG_SIG) != SIG_ATA) {
+		DBG1("Port %u: ignoring non-ATA device (signature %#x)",_no,readReg(PREG_SIG));
+		return false;
+	}
+
+	// the port has to be idle before we can change the command list and FIS base
+	if(!stop(true)) {
+		print("Port %u: unable to stop the command engine",_no);
+		return false;
+	}
+
+	uintptr_t phys = 0;
+	_mem = reinterpret_cast<Memory*>(mmapphys(&phys,sizeof(Memory),PAGE_SIZE,MAP_PHYS_ALLOC));
+	if(_mem == NULL) {
+		printe("Port %u: unable to allocate %zu bytes of DMA memory",_no,sizeof(Memory));
+		return false;
+	}
+	_memPhys = phys;
+	if(!_hba->addr64() && (uint64_t)_memPhys + sizeof(Memory) > 0x100000000ULL) {
+		print("Port %u: DMA memory is not accessible for the HBA",_no);
+		return false;
+	}
+	memset(_mem,0,sizeof(Memory));
+
+	uint64_t clb = _memPhys + offsetof(Memory,cmdList);
+	uint64_t fb = _memPhys + offsetof(Memory,recvFIS);
+	writeReg(PREG_CLB,clb);
+	writeReg(PREG_CLBU,clb >> 32);
+	writeReg(PREG_FB,fb);
+	writeReg(PREG_FBU,fb >> 32);
+	for(size_t i = 0; i < CMD_SLOTS; ++i) {
+		uint64_t ctba = _memPhys + offsetof(Memory,tables) + i * sizeof(CmdTable);
+		_mem->cmdList[i].ctba = ctba;
+		_mem->cmdList[i].ctbau = ctba >> 32;
+	}
+
+	writeReg(PREG_SERR,0xFFFFFFFF);
+	writeReg(PREG_IS,0xFFFFFFFF);
+	start();
+
+	if(!identify())
+		return false;
+
+	// read the partition table
+	uint8_t mbr[ATA_SEC_SIZE];
+	if(_secSize == ATA_SEC_SIZE && readPolled(0,mbr,1))
+		part_fillPartitions(_partTable,mbr);
+	else
+		print("Port %u: unable to read partition table",_no);
+
+	usemcrt(&_freeSlots,_depth);
+
+	writeReg(PREG_IS,0xFFFFFFFF);
+	writeReg(PREG_IE,PIS_DONE | PIS_ERRORS);
+	print("Port %u: '%s', %Lu sectors a %zu bytes, %s, depth %zu",
+		_no,_model,_sectors,_secSize,_ncq ? "NCQ" : "no NCQ",_depth);
+	return true;
+}
+
+bool Port::waitReg(uint reg,uint32_t mask,uint32_t value,int timeout) {
+	for(int i = 0; (readReg(reg) & mask) != value; ++i) {
+		if(i >= timeout)
+			return false;
+		usleep(1000);
+	}
+	return true;
+}
+
+bool Port::stop(bool fis) {
+	writeReg(PREG_CMD,readReg(PREG_CMD) & ~PCMD_ST);
+	if(!waitReg(PREG_CMD,PCMD_CR,0,STOP_TIMEOUT))
+		return false;
+	if(fis) {
+		writeReg(PREG_CMD,readReg(PREG_CMD) & ~PCMD_FRE);
+		if(!waitReg(PREG_CMD,PCMD_FR,0,STOP_TIMEOUT))
+			return false;
+	}
+	return true;
+}
+
+void Port::start() {
+	// the device has to be idle before we can set ST
+	waitReg(PREG_TFD,TFD_BSY | TFD_DRQ,0,CMD_TIMEOUT);
+	writeReg(PREG_CMD,readReg(PREG_CMD) | PCMD_FRE | PCMD_SUD | PCMD_POD);
+	writeReg(PREG_CMD,readReg(PREG_CMD) | PCMD_ST);
+}
+
+void Port::restart() {
+	if(!stop(false))
+		print("Port %u: unable to stop the command engine",_no);
+	writeReg(PREG_SERR,0xFFFFFFFF);
+	writeReg(PREG_IS,0xFFFFFFFF);
+
+	// if the device is still busy, we have to reset the interface (COMRESET). with NCQ, the
+	// device refuses further queued commands after an error until it has been reset, too.
+	if(_ncq || (readReg(PREG_TFD) & (TFD_BSY | TFD_DRQ))) {
+		DBG1("Port %u: resetting device",_no);
+		writeReg(PREG_SCTL,(readReg(PREG_SCTL) & ~0xF) | SCTL_DET_INIT);
+		usleep(1000);
+		writeReg(PREG_SCTL,readReg(PREG_SCTL) & ~0xF);
+		waitReg(PREG_SSTS,SSTS_DET_MASK,SSTS_DET_PRESENT,CMD_TIMEOUT);
+		writeReg(PREG_SERR,0xFFFFFFFF);
+	}
+
+	start();
+}
+
+bool Port::identify() {
+	uint16_t *id = reinterpret_cast<uint16_t*>(_mem->bounce[0]);
+	PRD *prd = _mem->tables[0].prdt;
+	uint64_t phys = _memPhys + offsetof(Memory,bounce);
+	prd->dba = phys;
+	prd->dbau = phys >> 32;
+	prd->dbc = ATA_SEC_SIZE - 1;
+	setupCommand(0,CMD_IDENTIFY,0,0,1,false);
+	if(!execPolled(0)) {
+		print("Port %u: IDENTIFY failed (tfd=%#x)",_no,readReg(PREG_TFD));
+		return false;
+	}
+
+	for(size_t i = 0; i < 40; i += 2) {
+		_model[i] = id[ID_MODEL + i / 2] >> 8;
+		_model[i + 1] = id[ID_MODEL + i / 2] & 0xFF;
+	}
+	for(ssize_t i = 39; i >= 0 && _model[i] == ' '; --i)
+		_model[i] = '\0';
+
+	if(id[ID_FEATURES] & (1 << 10))
+		_sectors = *reinterpret_cast<uint64_t*>(id + ID_LBA48_SECS);
+	else
+		_sectors = *reinterpret_cast<uint32_t*>(id + ID_LBA28_SECS);
+	// bit 14 = valid, bit 12 = the logical sector size is larger than 256 words
+	if((id[ID_SECTOR_SIZE] & 0xD000) == 0x5000)
+		_secSize = *reinterpret_cast<uint32_t*>(id + ID_LOG_SEC_SIZE) * 2;
+
+	_ncq = _hba->ncq() && (id[ID_SATA_CAPS] & (1 << 8));
+	if(_ncq)
+		_depth = esc::Util::min(_hba->slots(),(size_t)(id[ID_QUEUE_DEPTH] & 0x1F) + 1);
+	return true;
+}
+
+bool Port::readPolled(uint64_t lba,void *buffer,size_t secCount) {
+	size_t prds;
+	bool bounced;
+	size_t count = secCount * _secSize;
+	if(setupPRDT(0,NULL,count,&bounced,&prds) != count)
+		return false;
+	setupCommand(0,CMD_READ_DMA_EXT,lba,secCount,prds,false);
+	if(!execPolled(0))
+		return false;
+	memcpy(buffer,_mem->bounce[0],count);
+	return true;
+}
+
+bool Port::execPolled(uint slot) {
+	writeReg(PREG_CI,1U << slot);
+	for(int i = 0; readReg(PREG_CI) & (1U << slot); ++i) {
+		if(i >= CMD_TIMEOUT || (readReg(PREG_IS) & PIS_ERRORS)) {
+			restart();
+			return false;
+		}
+		usleep(1000);
+	}
+	return (readReg(PREG_TFD) & TFD_ERR) == 0;
+}
+
+void Port::submit(Request *req,void *buf,uint64_t lba,size_t count) {
+	uint8_t *cur = reinterpret_cast<uint8_t*>(buf);
+	bool write = req->op == Request::OP_WRITE;
+	uint cmd;
+	if(_ncq)
+		cmd = write ? CMD_WRITE_FPDMA_QUEUED : CMD_READ_FPDMA_QUEUED;
+	else
+		cmd = write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT;
+
+	if(req->err == 0)
+		req->count = count;
+	while(req->err == 0 && count > 0) {
+		uint slot = allocSlot();
+
+		bool bounced;
+		size_t prds;
+		size_t amount = setupPRDT(slot,cur,count,&bounced,&prds);
+		if(bounced && write)
+			memcpy(_mem->bounce[slot],cur,amount);
+		setupCommand(slot,cmd,lba,amount / _secSize,prds,write);
+
+		Slot *s = _slots + slot;
+		s->req = req;
+		s->copyDst = bounced && !write ? cur : NULL;
+		s->copyLen = amount;
+		s->retries = 0;
+
+		get(req);
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			issue(slot);
+		}
+
+		cur += amount;
+		lba += amount / _secSize;
+		count -= amount;
+	}
+
+	put(req,true);
+}
+
+size_t Port::setupPRDT(uint slot,void *buf,size_t count,bool *bounced,size_t *prds) {
+	PRD *prdt = _mem->tables[slot].prdt;
+	uintptr_t virt = reinterpret_cast<uintptr_t>(buf);
+
+	// if possible, let the HBA access the buffer of the client directly. this requires a
+	// word-aligned buffer in a locked region. the shared memory of the clients and our own memory
+	// is locked.
+	if(buf && (virt & 1) == 0) {
+		uintptr_t pages[PRDT_ENTRIES];
+		uintptr_t start = esc::Util::round_page_dn(virt);
+		size_t pageCount = esc::Util::min(
+			(esc::Util::round_page_up(virt + count) - start) / PAGE_SIZE,PRDT_ENTRIES);
+		if(virt2phys(reinterpret_cast<void*>(start),pages,pageCount) == 0) {
+			uint64_t prdEnd = 0;
+			size_t n = 0,total = 0;
+			count = esc::Util::min(count,pageCount * PAGE_SIZE - (virt - start));
+			for(size_t i = 0; i < pageCount && total < count; ++i) {
+				size_t off = i == 0 ? virt - start : 0;
+				uint64_t phys = (uint64_t)pages[i] + off;
+				size_t amount = esc::Util::min((size_t)PAGE_SIZE - off,count - total);
+				if(!_hba->addr64() && phys + amount > 0x100000000ULL)
+					break;
+
+				// merge physically contiguous pages
+				size_t prdBytes = n > 0 ? (prdt[n - 1].dbc & 0x3FFFFF) + 1 : 0;
+				if(n > 0 && phys == prdEnd && prdBytes + amount <= PRD_MAX_BYTES)
+					prdt[n - 1].dbc = prdBytes + amount - 1;
+				else {
+					prdt[n].dba = phys;
+					prdt[n].dbau = phys >> 32;
+					prdt[n].dbc = amount - 1;
+					n++;
+				}
+				prdEnd = phys + amount;
+				total += amount;
+			}
+
+			// we can only transfer whole sectors
+			size_t trim = total % _secSize;
+			while(n > 0 && trim > 0) {
+				size_t prdBytes = (prdt[n - 1].dbc & 0x3FFFFF) + 1;
+				if(prdBytes > trim) {
+					prdt[n - 1].dbc = prdBytes - trim - 1;
+					break;
+				}
+				trim -= prdBytes;
+				n--;
+			}
+			total -= total % _secSize;
+
+			if(total > 0) {
+				*bounced = false;
+				*prds = n;
+				return total;
+			}
+		}
+	}
+
+	// use the bounce buffer of the slot
+	uint64_t phys = _memPhys + offsetof(Memory,bounce) + slot * BOUNCE_SIZE;
+	size_t amount = esc::Util::min(count,BOUNCE_SIZE);
+	prdt[0].dba = phys;
+	prdt[0].dbau = phys >> 32;
+	prdt[0].dbc = amount - 1;
+	*bounced = true;
+	*prds = 1;
+	return amount;
+}
+
+void Port::setupCommand(uint slot,uint cmd,uint64_t lba,size_t secCount,size_t prds,bool write) {
+	FISRegH2D *fis = reinterpret_cast<FISRegH2D*>(_mem->tables[slot].cfis);
+	memset(fis,0,sizeof(*fis));
+	fis->type = FIS_TYPE_REG_H2D;
+	fis->flags = FIS_H2D_CMD;
+	fis->command = cmd;
+	fis->lba0 = lba & 0xFF;
+	fis->lba1 = (lba >> 8) & 0xFF;
+	fis->lba2 = (lba >> 16) & 0xFF;
+	fis->lba3 = (lba >> 24) & 0xFF;
+	fis->lba4 = (lba >> 32) & 0xFF;
+	fis->lba5 = (lba >> 40) & 0xFF;
+	if(cmd == CMD_READ_FPDMA_QUEUED || cmd == CMD_WRITE_FPDMA_QUEUED) {
+		// the sector count is in the features register and the tag in the count register
+		fis->featureLo = secCount & 0xFF;
+		fis->featureHi = (secCount >> 8) & 0xFF;
+		fis->countLo = slot << 3;
+		fis->device = DEVICE_LBA;
+	}
+	else if(cmd != CMD_IDENTIFY) {
+		fis->countLo = secCount & 0xFF;
+		fis->countHi = (secCount >> 8) & 0xFF;
+		fis->device = DEVICE_LBA;
+	}
+
+	CmdHeader *hdr = _mem->cmdList + slot;
+	hdr->flags = (sizeof(FISRegH2D) / sizeof(uint32_t)) | (write ? CMDH_WRITE : 0) |
+		(prds << CMDH_PRDTL_SHIFT);
+	hdr->prdbc = 0;
+}
+
+void Port::issue(uint slot) {
+	// ensure that the compiler doesn't move the writes to the command table behind this point
+	asm volatile ("" : : : "memory");
+	_issued |= 1U << slot;
+	_slots[slot].ticks = 0;
+	if(_ncq)
+		writeReg(PREG_SACT,1U << slot);
+	writeReg(PREG_CI,1U << slot);
+}
+
+uint Port::allocSlot() {
+	usemdown(&_freeSlots);
+
+	std::lock_guard<std::mutex> guard(_mutex);
+	uint slot = 0;
+	while(_used & (1U << slot))
+		slot++;
+	_used |= 1U << slot;
+	return slot;
+}
+
+void Port::freeSlot(uint slot) {
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		_used &= ~(1U << slot);
+	}
+	usemup(&_freeSlots);
+}
+
+void Port::handleIntr() {
+	uint32_t is = readReg(PREG_IS);
+	writeReg(PREG_IS,is);
+	process(is,0);
+}
+
+void Port::checkTimeouts(int interval) {
+	process(0,interval);
+}
+
+void Port::process(uint32_t is,int interval) {
+	uint32_t done,failed = 0;
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		// all commands that are no longer active have been completed
+		uint32_t active = readReg(PREG_CI) | readReg(PREG_SACT);
+		done = _issued & ~active;
+		_issued &= ~done;
+
+		// if a completion got lost, we would wait forever. so, handle it like an error
+		bool timeout = false;
+		for(uint slot = 0; interval > 0 && slot < CMD_SLOTS; ++slot) {
+			if((_issued & (1U << slot)) && ++_slots[slot].ticks * interval >= CMD_TIMEOUT)
+				timeout = true;
+		}
+
+		if((is & PIS_ERRORS) || timeout) {
+			// we don't know which of the active commands failed, so that we retry all of them
+			print("Port %u: %s (is=%#x, tfd=%#x, serr=%#x); retrying %#x",
+				_no,timeout ? "timeout" : "error",is,readReg(PREG_TFD),readReg(PREG_SERR),_issued);
+			uint32_t retry = _issued;
+			_issued = 0;
+			restart();
+			for(uint slot = 0; slot < CMD_SLOTS; ++slot) {
+				if(~retry & (1U << slot))
+					continue;
+				if(++_slots[slot].retries < RETRY_COUNT)
+					issue(slot);
+				else
+					failed |= 1U << slot;
+			}
+		}
+	}
+
+	for(uint slot = 0; done | failed; ++slot) {
+		if(done & (1U << slot))
+			complete(slot,true);
+		else if(failed & (1U << slot))
+			complete(slot,false);
+		done &= ~(1U << slot);
+		failed &= ~(1U << slot);
+	}
+}
+
+void Port::complete(uint slot,bool success) {
+	Slot *s = _slots + slot;
+	Request *req = s->req;
+	if(success && s->copyDst)
+		memcpy(s->copyDst,_mem->bounce[slot],s->copyLen);
+	if(!success)
+		print("Port %u: giving up after %d retries",_no,RETRY_COUNT);
+
+	s->req = NULL;
+	freeSlot(slot);
+	put(req,success);
+}
@@ -0,0 +1,186 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/ipc/clientdevice.h>
+#include <sys/common.h>
+#include <sys/messages.h>
+#include <sys/sync.h>
+#include <memory>
+#include <mutex>
+
+#include "../ata/partition.h"
+#include "../blk/disk.h"
+#include "ahci.h"
+
+class HBA;
+
+/**
+ * A port of the HBA with a SATA disk attached to it. Each port has its own command list with up to
+ * 32 slots. If both the HBA and the disk support native command queuing, all of them can be in
+ * flight at the same time and the disk completes them in the order it likes. Otherwise, only one
+ * command is issued at a time. In both cases, submit() does not wait for the completion; the reply
+ * is sent by the interrupt thread of the HBA.
+ */
+class Port : public BlockDisk {
+	/* the size of the bounce buffer per slot */
+	static const size_t BOUNCE_SIZE		= 4096;
+	static const int RETRY_COUNT		= 3;
+	static const int CMD_TIMEOUT		= 3000;	/* ms */
+	static const int STOP_TIMEOUT		= 500;	/* ms */
+
+	struct Slot {
+		Request *req;
+		/* the destination for the data in the bounce buffer, if it's a read via bounce buffer */
+		void *copyDst;
+		size_t copyLen;
+		int retries;
+		/* the number of watchdog ticks since the command has been issued */
+		int ticks;
+	};
+
+	/* the memory that is accessed by the HBA */
+	struct Memory {
+		CmdHeader cmdList[CMD_SLOTS];
+		uint8_t recvFIS[RECV_FIS_SIZE];
+		CmdTable tables[CMD_SLOTS] A_ALIGNED(1024);
+		uint8_t bounce[CMD_SLOTS][BOUNCE_SIZE] A_ALIGNED(4096);
+	};
+
+public:
+	/**
+	 * Creates the port <no> of the given HBA
+	 *
+	 * @param hba the HBA
+	 * @param no the port number
+	 * @param regs the registers of the port
+	 */
+	explicit Port(HBA *hba,uint no,volatile uint32_t *regs);
+
+	/**
+	 * Detects the device, sets up the memory structures and identifies the device. The interrupts
+	 * of the HBA have to be disabled at this point.
+	 *
+	 * @return true if there is a usable disk
+	 */
+	bool init();
+
+	/**
+	 * @return the port number
+	 */
+	uint id() const {
+		return _no;
+	}
+	virtual size_t secSize() const override {
+		return _secSize;
+	}
+	/**
+	 * @return the number of sectors of the disk
+	 */
+	uint64_t sectors() const {
+		return _sectors;
+	}
+	/**
+	 * @return the number of commands that can be in flight
+	 */
+	size_t depth() const {
+		return _depth;
+	}
+	/**
+	 * @return whether native command queuing is used
+	 */
+	bool ncq() const {
+		return _ncq;
+	}
+	/**
+	 * @return the model number
+	 */
+	const char *model() const {
+		return _model;
+	}
+	/**
+	 * @return the partition table
+	 */
+	sPartition *partitions() {
+		return _partTable;
+	}
+
+	/**
+	 * Issues the commands for the given request. Blocks only if there are no free command slots.
+	 */
+	virtual void submit(Request *req,void *buf,uint64_t lba,size_t count) override;
+
+	/**
+	 * Handles an interrupt of this port. Completes all finished commands and recovers from
+	 * errors.
+	 */
+	void handleIntr();
+
+	/**
+	 * Is called by the watchdog every <interval> milliseconds. Treats commands that take longer
+	 * than CMD_TIMEOUT like failed commands, i.e., resets the port and retries them.
+	 *
+	 * @param interval the time since the last call in milliseconds
+	 */
+	void checkTimeouts(int interval);
+
+private:
+	uint32_t readReg(uint reg) const {
+		return _regs[reg / sizeof(uint32_t)];
+	}
+	void writeReg(uint reg,uint32_t value) {
+		_regs[reg / sizeof(uint32_t)] = value;
+	}
+	bool waitReg(uint reg,uint32_t mask,uint32_t value,int timeout);
+
+	bool stop(bool fis);
+	void start();
+	void restart();
+	bool identify();
+	bool readPolled(uint64_t lba,void *buffer,size_t secCount);
+	bool execPolled(uint slot);
+
+	size_t setupPRDT(uint slot,void *buf,size_t count,bool *bounced,size_t *prds);
+	void setupCommand(uint slot,uint cmd,uint64_t lba,size_t secCount,size_t prds,bool write);
+	void issue(uint slot);
+	void process(uint32_t is,int interval);
+
+	uint allocSlot();
+	void freeSlot(uint slot);
+	void complete(uint slot,bool success);
+
+	HBA *_hba;
+	uint _no;
+	volatile uint32_t *_regs;
+	Memory *_mem;
+	uintptr_t _memPhys;
+	bool _ncq;
+	size_t _depth;
+	size_t _secSize;
+	uint64_t _sectors;
+	char _model[41];
+	sPartition _partTable[PARTITION_COUNT];
+	std::mutex _mutex;
+	/* the allocated slots and the slots that have been issued to the HBA */
+	uint32_t _used;
+	uint32_t _issued;
+	tUserSem _freeSlots;
+	Slot _slots[CMD_SLOTS];
+};
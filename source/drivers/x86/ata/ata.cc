@@ -18,8 +18,10 @@
  */
 
 #include <sys/arch/x86/ports.h>
+#include <esc/util.h>
 #include <sys/common.h>
 #include <sys/debug.h>
+#include <sys/mman.h>
 #include <sys/proc.h>
 #include <signal.h>
 #include <stdio.h>
@@ -29,31 +31,64 @@
 #include "controller.h"
 #include "device.h"
 
+/* the max. number of sectors per command */
+static const size_t MAX_SECS_LBA28		= 0xFF;
+static const size_t MAX_SECS_LBA48		= 0xFFFF;
+/* a PRD may not cross a 64K boundary */
+static const uintptr_t PRD_BOUNDARY		= 64 * 1024;
+
+static bool ata_readWriteDMA(sATADevice *device,uint op,uint cmd,void *buffer,uint64_t lba,
+		size_t secSize,size_t secCount);
+static size_t ata_setupPRDT(sATAController *ctrl,void *buffer,size_t secSize,size_t secCount,
+		bool *direct);
+static bool ata_doDMA(sATADevice *device,uint op,void *buffer,size_t size,bool direct);
 static bool ata_setupCommand(sATADevice *device,uint64_t lba,size_t secCount,uint cmd);
 static uint ata_getCommand(sATADevice *device,uint op);
 
 bool ata_readWrite(sATADevice *device,uint op,void *buffer,uint64_t lba,size_t secSize,
 		size_t secCount) {
 	uint cmd = ata_getCommand(device,op);
-	if(!ata_setupCommand(device,lba,secCount,cmd))
-		return false;
-
 	switch(cmd) {
 		case COMMAND_PACKET:
 		case COMMAND_READ_SEC:
 		case COMMAND_READ_SEC_EXT:
 		case COMMAND_WRITE_SEC:
 		case COMMAND_WRITE_SEC_EXT:
+			if(!ata_setupCommand(device,lba,secCount,cmd))
+				return false;
 			return ata_transferPIO(device,op,buffer,secSize,secCount,true);
 		case COMMAND_READ_DMA:
 		case COMMAND_READ_DMA_EXT:
 		case COMMAND_WRITE_DMA:
 		case COMMAND_WRITE_DMA_EXT:
-			return ata_transferDMA(device,op,buffer,secSize,secCount);
+			return ata_readWriteDMA(device,op,cmd,buffer,lba,secSize,secCount);
 	}
 	return false;
 }
 
+static bool ata_readWriteDMA(sATADevice *device,uint op,uint cmd,void *buffer,uint64_t lba,
+		size_t secSize,size_t secCount) {
+	size_t maxSecs = device->info.features.lba48 ? MAX_SECS_LBA48 : MAX_SECS_LBA28;
+	if(secCount == 0)
+		return false;
+
+	/* use as few commands as possible; the PRDT determines how much we can do at once */
+	while(secCount > 0) {
+		bool direct;
+		size_t count = ata_setupPRDT(device->ctrl,buffer,secSize,esc::Util::min(secCount,maxSecs),
+			&direct);
+		if(!ata_setupCommand(device,lba,count,cmd))
+			return false;
+		if(!ata_doDMA(device,op,buffer,count * secSize,direct))
+			return false;
+
+		buffer = (uint8_t*)buffer + count * secSize;
+		lba += count;
+		secCount -= count;
+	}
+	return true;
+}
+
 bool ata_transferPIO(sATADevice *device,uint op,void *buffer,size_t secSize,
 		size_t secCount,bool waitFirst) {
 	size_t i;
@@ -91,15 +126,91 @@ bool ata_transferPIO(sATADevice *device,uint op,void *buffer,size_t secSize,
 }
 
 bool ata_transferDMA(sATADevice *device,uint op,void *buffer,size_t secSize,size_t secCount) {
-	sATAController* ctrl = device->ctrl;
-	uint8_t status;
+	/* the command has already been sent, so we have to transfer everything at once */
+	bool direct;
+	if(ata_setupPRDT(device->ctrl,buffer,secSize,secCount,&direct) != secCount) {
+		ATA_LOG("Device %d: DMA-transfer of %zu sectors is too large",device->id,secCount);
+		return false;
+	}
+	return ata_doDMA(device,op,buffer,secCount * secSize,direct);
+}
+
+static size_t ata_setupPRDT(sATAController *ctrl,void *buffer,size_t secSize,size_t secCount,
+		bool *direct) {
+	uintptr_t virt = (uintptr_t)buffer;
 	size_t size = secCount * secSize;
-	int res;
 
-	/* setup PRDT */
+	/* if the buffer is in a locked region (the shared memory of the client or our own memory),
+	 * we can let the controller access it directly. the controller requires word-aligned
+	 * buffers and physical addresses below 4G, though. */
+	if(size > 0 && (virt & 1) == 0) {
+		uintptr_t start = esc::Util::round_page_dn(virt);
+		size_t pages = esc::Util::min((esc::Util::round_page_up(virt + size) - start) / PAGE_SIZE,
+			DMA_MAX_PAGES);
+		if(virt2phys((void*)start,ctrl->dma_pages,pages) == 0) {
+			sPRD *prdt = ctrl->dma_prdt_virt;
+			uint64_t prdStart = 0,prdEnd = 0;
+			size_t n = 0,total = 0;
+			size = esc::Util::min(size,pages * PAGE_SIZE - (virt - start));
+			for(size_t i = 0; i < pages && total < size; ++i) {
+				size_t off = i == 0 ? virt - start : 0;
+				uint64_t phys = (uint64_t)ctrl->dma_pages[i] + off;
+				size_t amount = esc::Util::min((size_t)PAGE_SIZE - off,size - total);
+				if(phys + amount > 0x100000000ULL)
+					break;
+
+				/* merge physically contiguous pages into one PRD, as long as we stay within 64K */
+				if(n > 0 && prdEnd == phys &&
+						(prdStart & ~(PRD_BOUNDARY - 1)) == ((phys + amount - 1) & ~(PRD_BOUNDARY - 1))) {
+					prdEnd += amount;
+					/* a byteCount of 0 means 64K */
+					prdt[n - 1].byteCount = prdEnd - prdStart;
+				}
+				else {
+					prdt[n].buffer = (uint32_t)phys;
+					prdt[n].byteCount = amount;
+					prdt[n].last = 0;
+					prdStart = phys;
+					prdEnd = phys + amount;
+					n++;
+				}
+				total += amount;
+			}
+
+			/* the PRDs may end in the middle of a sector; cut them at the last full one */
+			size_t secs = total / secSize;
+			if(secs > 0) {
+				size_t excess = total - secs * secSize;
+				while(excess > 0) {
+					size_t bytes = prdt[n - 1].byteCount ? prdt[n - 1].byteCount : PRD_BOUNDARY;
+					if(bytes > excess) {
+						prdt[n - 1].byteCount = bytes - excess;
+						break;
+					}
+					excess -= bytes;
+					n--;
+				}
+				prdt[n - 1].last = 1;
+				*direct = true;
+				return secs;
+			}
+		}
+	}
+
+	/* fall back to the bounce buffer */
+	secCount = esc::Util::min(secCount,DMA_BUF_SIZE / secSize);
 	ctrl->dma_prdt_virt->buffer = (uint32_t)(uintptr_t)ctrl->dma_buf_phys;
-	ctrl->dma_prdt_virt->byteCount = size;
+	/* a byteCount of 0 means 64K */
+	ctrl->dma_prdt_virt->byteCount = secCount * secSize;
 	ctrl->dma_prdt_virt->last = 1;
+	*direct = false;
+	return secCount;
+}
+
+static bool ata_doDMA(sATADevice *device,uint op,void *buffer,size_t size,bool direct) {
+	sATAController* ctrl = device->ctrl;
+	uint8_t status;
+	int res;
 
 	/* stop running transfers */
 	ATA_PR2("Stopping running transfers");
@@ -112,8 +223,7 @@ bool ata_transferDMA(sATADevice *device,uint op,void *buffer,size_t secSize,size
 	ctrl_outbmrl(ctrl,BMR_REG_PRDT,reinterpret_cast<uintptr_t>(ctrl->dma_prdt_phys));
 
 	/* write data to buffer, if we should write */
-	/* TODO we should use the buffer directly when reading from the client */
-	if(op == OP_WRITE || op == OP_PACKET)
+	if(!direct && (op == OP_WRITE || op == OP_PACKET))
 		memcpy(ctrl->dma_buf_virt,buffer,size);
 
 	/* it seems to be necessary to read those ports here */
@@ -145,7 +255,7 @@ bool ata_transferDMA(sATADevice *device,uint op,void *buffer,size_t secSize,size
 	ctrl_inbmrb(ctrl,BMR_REG_STATUS);
 	ctrl_outbmrb(ctrl,BMR_REG_COMMAND,0);
 	/* copy data when reading */
-	if(op == OP_READ)
+	if(!direct && op == OP_READ)
 		memcpy(buffer,ctrl->dma_buf_virt,size);
 	return true;
 }
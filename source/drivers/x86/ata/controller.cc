@@ -46,8 +46,6 @@ static const int IDE_CTRL_BAR				= 4;
 
 static const size_t BMR_SEC_OFFSET			= 0x8;
 
-static const size_t DMA_BUF_SIZE			= 64 * 1024;
-
 static bool ctrl_isBusResponding(sATAController* ctrl);
 
 static PCI::Device ideCtrl;
@@ -115,9 +113,11 @@ void ctrl_init(bool useDma,bool useIRQ) {
 		ctrls[i].bmrBase = ideCtrl.bars[IDE_CTRL_BAR].addr;
 		if(useDma && ctrls[i].bmrBase) {
 			ctrls[i].bmrBase += i * BMR_SEC_OFFSET;
-			/* allocate memory for PRDT and buffer */
+			/* allocate memory for PRDT and buffer. the PRDT may not cross a 64K boundary, which
+			 * is guaranteed by the alignment */
 			ctrls[i].dma_prdt_virt = static_cast<sPRD*>(
-				mmapphys((uintptr_t*)&ctrls[i].dma_prdt_phys,8,4096,MAP_PHYS_ALLOC));
+				mmapphys((uintptr_t*)&ctrls[i].dma_prdt_phys,DMA_MAX_PAGES * sizeof(sPRD),4096,
+					MAP_PHYS_ALLOC));
 			if(!ctrls[i].dma_prdt_virt)
 				error("Unable to allocate PRDT for controller %d",ctrls[i].id);
 			ctrls[i].dma_buf_virt = mmapphys((uintptr_t*)&ctrls[i].dma_buf_phys,
@@ -95,6 +95,11 @@ enum {
 static const int DMA_TRANSFER_TIMEOUT		= 3000;	/* ms */
 static const int DMA_TRANSFER_SLEEPTIME		= 20;	/* ms */
 
+/* the max. number of pages a DMA-transfer directly from/to the client's buffer may span */
+static const size_t DMA_MAX_PAGES			= 128;
+/* the size of the bounce buffer, used if we can't do DMA with the client's buffer directly */
+static const size_t DMA_BUF_SIZE			= 64 * 1024;
+
 static const int PIO_TRANSFER_TIMEOUT		= 3000;	/* ms */
 static const int PIO_TRANSFER_SLEEPTIME		= 0;	/* ms */
 
@@ -331,6 +336,8 @@ struct sATAController {
 	sPRD *dma_prdt_virt;
 	void *dma_buf_phys;
 	void *dma_buf_virt;
+	/* the physical addresses of the pages of the current DMA-buffer */
+	uintptr_t dma_pages[DMA_MAX_PAGES];
 	sATADevice devices[2];
 };
 
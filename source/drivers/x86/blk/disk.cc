@@ -0,0 +1,124 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/ipc/ipcstream.h>
+#include <esc/proto/file.h>
+#include <sys/common.h>
+#include <sys/thread.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#include "disk.h"
+
+BlockDisk::BlockDisk() : _reqMutex(), _freeReqs(), _reqFree(), _reqs() {
+	usemcrt(&_freeReqs,MAX_REQS);
+	for(size_t i = 0; i < MAX_REQS; ++i) {
+		_reqs[i].next = _reqFree;
+		_reqFree = _reqs + i;
+	}
+}
+
+Request *BlockDisk::alloc(int fd,msgid_t mid,uint op) {
+	usemdown(&_freeReqs);
+
+	Request *req;
+	{
+		std::lock_guard<std::mutex> guard(_reqMutex);
+		req = _reqFree;
+		_reqFree = req->next;
+		req->used = true;
+	}
+
+	req->fd = fd;
+	req->mid = mid;
+	req->op = op;
+	req->count = 0;
+	req->pending = 1;
+	req->err = 0;
+	return req;
+}
+
+void BlockDisk::drain(int fd) {
+	// this happens only if a client closes the channel with outstanding requests
+	while(1) {
+		bool busy = false;
+		{
+			std::lock_guard<std::mutex> guard(_reqMutex);
+			for(size_t i = 0; i < MAX_REQS; ++i) {
+				if(_reqs[i].used && _reqs[i].fd == fd) {
+					busy = true;
+					break;
+				}
+			}
+		}
+		if(!busy)
+			break;
+		usleep(1000);
+	}
+}
+
+void BlockDisk::get(Request *req) {
+	std::lock_guard<std::mutex> guard(_reqMutex);
+	req->pending++;
+}
+
+void BlockDisk::put(Request *req,bool success) {
+	bool last;
+	{
+		std::lock_guard<std::mutex> guard(_reqMutex);
+		// there is no EIO; ENXIO is the closest we have for a device that failed
+		if(!success && req->err == 0)
+			req->err = -ENXIO;
+		last = --req->pending == 0;
+	}
+	if(last)
+		finish(req);
+}
+
+void BlockDisk::finish(Request *req) {
+	ulong buffer[IPC_DEF_SIZE / sizeof(ulong)];
+	try {
+		esc::IPCStream is(req->fd,buffer,sizeof(buffer),req->mid);
+		if(req->err != 0) {
+			if(req->op == Request::OP_READ)
+				is << esc::FileRead::Response::error(req->err) << esc::Reply();
+			else
+				is << esc::FileWrite::Response::error(req->err) << esc::Reply();
+		}
+		else if(req->op == Request::OP_READ) {
+			is << esc::FileRead::Response::success(req->count) << esc::Reply();
+			if(!req->shm && req->count > 0)
+				is << esc::ReplyData(req->data,req->count);
+		}
+		else
+			is << esc::FileWrite::Response::success(req->count) << esc::Reply();
+	}
+	catch(const std::exception &e) {
+		printe("Unable to reply to client %d: %s",req->fd,e.what());
+	}
+
+	req->shm.reset();
+	{
+		std::lock_guard<std::mutex> guard(_reqMutex);
+		req->used = false;
+		req->next = _reqFree;
+		_reqFree = req;
+	}
+	usemup(&_freeReqs);
+}
@@ -0,0 +1,130 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/ipc/clientdevice.h>
+#include <sys/common.h>
+#include <sys/messages.h>
+#include <sys/sync.h>
+#include <memory>
+#include <mutex>
+
+/**
+ * A read or write request of a client. It is split into as many commands as necessary and the
+ * reply is sent as soon as the last one has been completed.
+ */
+struct Request {
+	enum {
+		OP_READ,
+		OP_WRITE,
+	};
+
+	/* the max. number of bytes that can be transferred via message */
+	static const size_t MAX_RW_SIZE		= 4096;
+
+	int fd;
+	msgid_t mid;
+	uint op;
+	size_t count;
+	/* keeps the shared memory of the client alive until the commands are completed */
+	std::shared_ptr<esc::SharedMemory> shm;
+	/* the number of running commands, plus one while the request is being submitted */
+	uint pending;
+	/* 0 or the error code for the reply */
+	int err;
+	bool used;
+	Request *next;
+	/* the data for transfers via message */
+	uint8_t data[MAX_RW_SIZE];
+};
+
+/**
+ * The base class of the disks that complete the requests asynchronously (AHCI and virtio-blk).
+ * It manages the requests of the clients: the disk calls get() for every command it issues for
+ * a request and put() as soon as the command has been completed. The last put() sends the reply
+ * to the client.
+ */
+class BlockDisk {
+public:
+	/* the max. number of requests that can be in flight */
+	static const size_t MAX_REQS		= 32;
+
+	explicit BlockDisk();
+	virtual ~BlockDisk() {
+	}
+
+	/**
+	 * @return the sector size
+	 */
+	virtual size_t secSize() const = 0;
+
+	/**
+	 * Allocates a request for the client <fd>. Blocks until one is available.
+	 *
+	 * @param fd the file descriptor for the client
+	 * @param mid the message id for the reply
+	 * @param op the operation (Request::OP_*)
+	 * @return the request
+	 */
+	Request *alloc(int fd,msgid_t mid,uint op);
+
+	/**
+	 * Submits the given request, i.e., issues the commands to transfer <count> bytes from/to
+	 * <buf>, starting at sector <lba>. If req->err is already set, no command is issued and the
+	 * request is completed immediately.
+	 *
+	 * @param req the request
+	 * @param buf the buffer (in the shared memory of the client or req->data)
+	 * @param lba the first sector
+	 * @param count the number of bytes (a multiple of the sector size)
+	 */
+	virtual void submit(Request *req,void *buf,uint64_t lba,size_t count) = 0;
+
+	/**
+	 * Waits until all requests of client <fd> have been completed.
+	 *
+	 * @param fd the file descriptor for the client
+	 */
+	void drain(int fd);
+
+protected:
+	/**
+	 * Adds a running command to the given request.
+	 *
+	 * @param req the request
+	 */
+	void get(Request *req);
+
+	/**
+	 * Removes a running command from the given request and sends the reply if it was the last one.
+	 *
+	 * @param req the request
+	 * @param success whether the command was successful
+	 */
+	void put(Request *req,bool success);
+
+private:
+	void finish(Request *req);
+
+	std::mutex _reqMutex;
+	tUserSem _freeReqs;
+	Request *_reqFree;
+	Request _reqs[MAX_REQS];
+};
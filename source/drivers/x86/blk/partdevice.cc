@@ -0,0 +1,124 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/ipc/ipcstream.h>
+#include <esc/proto/file.h>
+#include <sys/common.h>
+#include <sys/messages.h>
+#include <sys/mman.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "partdevice.h"
+
+using namespace esc;
+
+BlockPartitionDevice::BlockPartitionDevice(BlockDisk *disk,sPartition *part,const char *name,
+		mode_t mode)
+	: ClientDevice(name,mode,DEV_TYPE_BLOCK,
+		DEV_OPEN | DEV_DELEGATE | DEV_READ | DEV_WRITE | DEV_SIZE | DEV_CLOSE),
+	  _disk(disk), _part(part) {
+	set(MSG_DEV_DELEGATE,std::make_memfun(this,&BlockPartitionDevice::delegate));
+	set(MSG_FILE_READ,std::make_memfun(this,&BlockPartitionDevice::read));
+	set(MSG_FILE_WRITE,std::make_memfun(this,&BlockPartitionDevice::write));
+	set(MSG_FILE_SIZE,std::make_memfun(this,&BlockPartitionDevice::size));
+	set(MSG_FILE_CLOSE,std::make_memfun(this,&BlockPartitionDevice::close),false);
+}
+
+void BlockPartitionDevice::delegate(IPCStream &is) {
+	Client *c = (*this)[is.fd()];
+	DevDelegate::Request r;
+	is >> r;
+	assert(c->shm() == NULL && !is.error());
+
+	/* the same as for ATA: populate and lock the memory to let the device access it and to
+	 * prevent that we have to swap while swapping */
+	int res = -EINVAL;
+	if(r.arg == DEL_ARG_SHFILE)
+		res = joinshm(c,r.nfd,MAP_POPULATE | MAP_NOSWAP | MAP_LOCKED);
+	is << DevDelegate::Response(res) << Reply();
+}
+
+void BlockPartitionDevice::read(IPCStream &is) {
+	FileRead::Request r;
+	is >> r;
+	assert(!is.error());
+
+	Request *req = _disk->alloc(is.fd(),is.msgid(),Request::OP_READ);
+	req->err = isValid(is.fd(),r.offset,r.count,r.shmemoff) ? 0 : -EINVAL;
+	_disk->submit(req,getBuffer(req,is.fd(),r.shmemoff),
+		_part->start + r.offset / _disk->secSize(),r.count);
+}
+
+void BlockPartitionDevice::write(IPCStream &is) {
+	FileWrite::Request r;
+	is >> r;
+
+	Request *req = _disk->alloc(is.fd(),is.msgid(),Request::OP_WRITE);
+	if(r.shmemoff == -1)
+		is >> ReceiveData(req->data,sizeof(req->data));
+	assert(!is.error());
+
+	req->err = isValid(is.fd(),r.offset,r.count,r.shmemoff) ? 0 : -EINVAL;
+	_disk->submit(req,getBuffer(req,is.fd(),r.shmemoff),
+		_part->start + r.offset / _disk->secSize(),r.count);
+}
+
+void BlockPartitionDevice::size(IPCStream &is) {
+	is << FileSize::Response::success(_part->size * _disk->secSize()) << Reply();
+}
+
+void BlockPartitionDevice::close(IPCStream &is) {
+	/* the device might still access the shared memory of the client */
+	_disk->drain(is.fd());
+	ClientDevice::close(is);
+}
+
+bool BlockPartitionDevice::isValid(int fd,size_t offset,size_t count,ssize_t shmemoff) {
+	size_t secSize = _disk->secSize();
+	bool valid = offset % secSize == 0 && count % secSize == 0 && offset + count > offset &&
+		offset + count <= _part->size * secSize;
+
+	/* the device accesses the buffer directly, so that it has to be completely in the shared
+	 * memory of the client */
+	if(valid && shmemoff == -1)
+		valid = count <= Request::MAX_RW_SIZE;
+	else if(valid) {
+		Client *c = (*this)[fd];
+		valid = c->shm() != NULL && shmemoff >= 0 &&
+			(size_t)shmemoff + count > (size_t)shmemoff &&
+			(size_t)shmemoff + count <= c->sharedmem()->size;
+	}
+
+	if(!valid) {
+		print("Invalid request: offset=%zu, count=%zu, shmemoff=%zd, partSize=%zu",
+			offset,count,shmemoff,_part->size * secSize);
+	}
+	return valid;
+}
+
+void *BlockPartitionDevice::getBuffer(Request *req,int fd,ssize_t shmemoff) {
+	if(req->err != 0)
+		return NULL;
+	if(shmemoff == -1)
+		return req->data;
+	Client *c = (*this)[fd];
+	req->shm = c->sharedmem();
+	return c->shm() + shmemoff;
+}
@@ -0,0 +1,56 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/ipc/clientdevice.h>
+#include <sys/common.h>
+
+#include "../ata/partition.h"
+#include "disk.h"
+
+/**
+ * A partition of a BlockDisk. In contrast to the ATA driver, the handlers don't wait until the
+ * transfer is finished, but let the disk send the reply. Thus, multiple requests can be in flight.
+ */
+class BlockPartitionDevice : public esc::ClientDevice<> {
+public:
+	/**
+	 * Creates the device for the given partition
+	 *
+	 * @param disk the disk
+	 * @param part the partition
+	 * @param name the device name
+	 * @param mode the permissions
+	 */
+	explicit BlockPartitionDevice(BlockDisk *disk,sPartition *part,const char *name,mode_t mode);
+
+	void delegate(esc::IPCStream &is);
+	void read(esc::IPCStream &is);
+	void write(esc::IPCStream &is);
+	void size(esc::IPCStream &is);
+	void close(esc::IPCStream &is);
+
+private:
+	bool isValid(int fd,size_t offset,size_t count,ssize_t shmemoff);
+	void *getBuffer(Request *req,int fd,ssize_t shmemoff);
+
+	BlockDisk *_disk;
+	sPartition *_part;
+};
@@ -244,6 +244,7 @@ ssize_t E1000::send(const void *packet,size_t size) {
 }
 
 void E1000::receive() {
+	size_t received = 0;
 	uint32_t head = readReg(REG_RDH);
 	while(_curRxBuf != head) {
 		RxDesc *desc = _bufs->rxDescs + _curRxBuf;
@@ -254,24 +255,23 @@ void E1000::receive() {
 		DBG2("RX %u: %#08Lx..%#08Lx st=%#02x err=%#02x",
 			_curRxBuf,desc->buffer,desc->buffer + desc->length,desc->status,desc->error);
 
-		// read data into packet
+		// read data into packet; if the ring is full, the packet is dropped
 		size_t size = desc->length;
-		Packet *pkt = (Packet*)malloc(sizeof(Packet) + size);
-		if(!pkt) {
-			printe("Not enough memory to read packet");
-			break;
+		Packet *pkt = alloc(size);
+		if(pkt) {
+			memcpy(pkt->data,_bufs->rxBuf + _curRxBuf * RX_BUF_SIZE,size);
+			insert(pkt);
+			received++;
 		}
-		pkt->length = size;
-		memcpy(pkt->data,_bufs->rxBuf + _curRxBuf * RX_BUF_SIZE,size);
-
-		// insert into list
-		insert(pkt);
-		(*_handler)();
 
 		// to next packet
 		_curRxBuf = (_curRxBuf + 1) % RX_BUF_COUNT;
 	}
 
+	// notify the device once for all received packets
+	if(received > 0)
+		(*_handler)();
+
 	// set new tail
 	if(_curRxBuf == head)
 		writeReg(REG_RDT,(head + RX_BUF_COUNT - 1) % RX_BUF_COUNT);
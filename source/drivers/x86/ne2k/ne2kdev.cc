@@ -193,6 +193,8 @@ ssize_t Ne2k::send(const void *packet,size_t size) {
 }
 
 void Ne2k::receive() {
+	size_t received = 0;
+
 	/* fetch current counter */
 	writeReg(REG_CMD,CMD_COMPLDMA | CMD_PAGE1 | CMD_STP);
 	uint8_t current = readReg(REG_CURR);
@@ -212,23 +214,22 @@ void Ne2k::receive() {
 
 		head.length -= 4;
 
-		/* read data into packet */
-		Packet *pkt = (Packet*)malloc(sizeof(Packet) + head.length);
-		if(!pkt) {
-			printe("Not enough memory to read packet");
-			break;
+		/* read data into packet; if the ring is full, the packet is dropped */
+		Packet *pkt = alloc(head.length);
+		if(pkt) {
+			accessPROM((_nextPacket << 8) | 0x4,head.length,pkt->data,PROM_READ);
+			insert(pkt);
+			received++;
 		}
-		pkt->length = head.length;
-		accessPROM((_nextPacket << 8) | 0x4,head.length,pkt->data,PROM_READ);
 
 		/* move boundary forward */
 		_nextPacket = head.status >> 8;
 		writeReg(REG_BNRY,_nextPacket == PAGE_RX ? (PAGE_STOP - 1) : _nextPacket - 1);
+	}
 
-		/* insert into list */
-		insert(pkt);
+	/* notify the device once for all received packets */
+	if(received > 0)
 		(*_handler)();
-	}
 }
 
 int Ne2k::irqThread(void *ptr) {
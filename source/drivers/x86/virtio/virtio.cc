@@ -0,0 +1,80 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/irq.h>
+#include <stdlib.h>
+
+#include "virtio.h"
+
+bool VirtIO::find(esc::PCI &pci,uint16_t devId,uchar cls,uchar subcls,int no,
+		esc::PCI::Device &dev) {
+	// other devices might have the same class, so check the ids as well
+	for(int i = 0; pci.tryByClass(dev,cls,subcls,i) == 0; ++i) {
+		if(dev.vendorId == VENDOR_ID && dev.deviceId == devId && no-- == 0)
+			return true;
+	}
+	return false;
+}
+
+VirtIO::VirtIO(esc::PCI &pci,const esc::PCI::Device &dev,const char *name)
+		: _base(), _size(), _features(), _irqsem() {
+	const esc::PCI::Bar &bar = dev.bars[0];
+	if(bar.addr == 0 || bar.type != esc::PCI::Bar::BAR_IO)
+		error("BAR 0 of the virtio device is no I/O BAR");
+	_base = bar.addr;
+	_size = bar.size;
+	if(reqports(_base,_size) < 0)
+		error("Unable to request io-ports %u..%u",_base,_base + _size - 1);
+	VDBG1("Using io-ports %u..%u",_base,_base + _size - 1);
+
+	// enable I/O space and bus mastering and make sure that INTx is not disabled
+	uint32_t statusCmd = pci.read(dev.bus,dev.dev,dev.func,0x04);
+	pci.write(dev.bus,dev.dev,dev.func,0x04,(statusCmd & ~0x400) | 0x5);
+
+	// create the IRQ sem here to ensure that we've registered it if the first interrupt arrives.
+	// without MSI-X, the device uses the legacy interrupt, which might be shared.
+	VDBG1("Listening to IRQ %u",dev.irq);
+	_irqsem = semcrtirq(dev.irq,name,NULL,NULL);
+	if(_irqsem < 0)
+		error("Unable to create irq-semaphore");
+
+	// reset the device and tell it that we know how to drive it
+	setStatus(0);
+	setStatus(STATUS_ACK);
+	setStatus(STATUS_ACK | STATUS_DRIVER);
+}
+
+VirtIO::~VirtIO() {
+	setStatus(0);
+	relports(_base,_size);
+}
+
+uint32_t VirtIO::negotiate(uint32_t wanted) {
+	uint32_t host = indword(_base + REG_HOST_FEATURES);
+	_features = host & wanted;
+	outdword(_base + REG_GUEST_FEATURES,_features);
+	VDBG1("Features: host=%#08x, wanted=%#08x, using=%#08x",host,wanted,_features);
+	return _features;
+}
+
+void VirtIO::fail(const char *msg) {
+	setStatus(getStatus() | STATUS_FAILED);
+	error("%s",msg);
+}
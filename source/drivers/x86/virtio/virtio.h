@@ -0,0 +1,218 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/proto/pci.h>
+#include <sys/arch/x86/ports.h>
+#include <sys/common.h>
+
+#define VIRTIO_DBG_LEVEL	1
+
+#if VIRTIO_DBG_LEVEL > 0
+#	define VDBG1(fmt...)	print(fmt)
+#else
+#	define VDBG1(...)
+#endif
+
+#if VIRTIO_DBG_LEVEL > 1
+#	define VDBG2(fmt...)	print(fmt)
+#else
+#	define VDBG2(...)
+#endif
+
+/**
+ * The transport of a virtio device, using the legacy virtio-pci interface. That is, the device
+ * has its registers in the I/O space of BAR 0 and the device-specific configuration follows the
+ * common registers (we don't use MSI-X, which would move it behind the MSI-X registers).
+ *
+ * Note that this is the interface of the transitional devices QEMU provides by default, so that
+ * it works with all QEMU versions we care about.
+ */
+class VirtIO {
+public:
+	static const uint16_t VENDOR_ID		= 0x1af4;
+	static const uint16_t DEV_NET		= 0x1000;
+	static const uint16_t DEV_BLOCK		= 0x1001;
+
+	enum {
+		REG_HOST_FEATURES	= 0x00,		/* features of the device (32 bit) */
+		REG_GUEST_FEATURES	= 0x04,		/* features we want to use (32 bit) */
+		REG_QUEUE_PFN		= 0x08,		/* page frame of the selected queue (32 bit) */
+		REG_QUEUE_SIZE		= 0x0C,		/* size of the selected queue (16 bit) */
+		REG_QUEUE_SEL		= 0x0E,		/* queue selector (16 bit) */
+		REG_QUEUE_NOTIFY	= 0x10,		/* notifies the device about new buffers (16 bit) */
+		REG_STATUS			= 0x12,		/* device status (8 bit) */
+		REG_ISR				= 0x13,		/* interrupt status; reading acknowledges it (8 bit) */
+		REG_CONFIG			= 0x14,		/* start of the device-specific configuration */
+	};
+
+	enum {
+		STATUS_ACK			= 1 << 0,	/* we have found the device */
+		STATUS_DRIVER		= 1 << 1,	/* we know how to drive it */
+		STATUS_DRIVER_OK	= 1 << 2,	/* the driver is ready */
+		STATUS_FAILED		= 1 << 7,	/* we gave up */
+	};
+
+	enum {
+		ISR_QUEUE			= 1 << 0,	/* a queue has used buffers */
+		ISR_CONFIG			= 1 << 1,	/* the configuration has changed */
+	};
+
+	enum {
+		F_NOTIFY_ON_EMPTY	= 1 << 24,
+		F_RING_INDIRECT		= 1 << 28,	/* indirect descriptor tables */
+		F_RING_EVENT_IDX	= 1 << 29,
+	};
+
+	/**
+	 * Searches for the virtio device with given device id
+	 *
+	 * @param pci the PCI device
+	 * @param devId the device id (DEV_*)
+	 * @param cls the PCI class of the device
+	 * @param subcls the PCI subclass of the device
+	 * @param no the number (if there are multiple devices with this id)
+	 * @param dev will be set to the device
+	 * @return true if it has been found
+	 */
+	static bool find(esc::PCI &pci,uint16_t devId,uchar cls,uchar subcls,int no,
+		esc::PCI::Device &dev);
+
+	/**
+	 * Requests the I/O ports of the given device, resets it and tells it that we are going to
+	 * drive it.
+	 *
+	 * @param pci the PCI device
+	 * @param dev the virtio device
+	 * @param name the name of the device (used for the interrupt)
+	 */
+	explicit VirtIO(esc::PCI &pci,const esc::PCI::Device &dev,const char *name);
+	~VirtIO();
+
+	/**
+	 * @return the semaphore for the interrupts of the device
+	 */
+	int irqsem() const {
+		return _irqsem;
+	}
+
+	/**
+	 * Negotiates the features. That is, we use all features in <wanted> the device offers.
+	 *
+	 * @param wanted the features that we would like to use
+	 * @return the features to use
+	 */
+	uint32_t negotiate(uint32_t wanted);
+	/**
+	 * @return the negotiated features
+	 */
+	uint32_t features() const {
+		return _features;
+	}
+
+	/**
+	 * Reads from the device-specific configuration.
+	 *
+	 * @param off the offset in the configuration
+	 * @return the value
+	 */
+	uint8_t config8(size_t off) const {
+		return inbyte(_base + REG_CONFIG + off);
+	}
+	uint16_t config16(size_t off) const {
+		return inword(_base + REG_CONFIG + off);
+	}
+	uint32_t config32(size_t off) const {
+		return indword(_base + REG_CONFIG + off);
+	}
+	uint64_t config64(size_t off) const {
+		/* the device might change the value in between; read until we get a consistent one */
+		uint32_t hi,lo;
+		do {
+			hi = config32(off + 4);
+			lo = config32(off);
+		}
+		while(hi != config32(off + 4));
+		return ((uint64_t)hi << 32) | lo;
+	}
+
+	/**
+	 * @param idx the queue index
+	 * @return the number of descriptors of queue <idx> (0 if it does not exist)
+	 */
+	uint16_t queueSize(uint16_t idx) {
+		outword(_base + REG_QUEUE_SEL,idx);
+		return inword(_base + REG_QUEUE_SIZE);
+	}
+	/**
+	 * Tells the device the location of queue <idx>.
+	 *
+	 * @param idx the queue index
+	 * @param phys the physical address of the queue (page aligned)
+	 */
+	void setQueue(uint16_t idx,uintptr_t phys) {
+		outword(_base + REG_QUEUE_SEL,idx);
+		outdword(_base + REG_QUEUE_PFN,phys / PAGE_SIZE);
+	}
+	/**
+	 * Notifies the device that there are new buffers in queue <idx>. This is a VM exit, so
+	 * call it as rarely as possible.
+	 *
+	 * @param idx the queue index
+	 */
+	void notify(uint16_t idx) {
+		outword(_base + REG_QUEUE_NOTIFY,idx);
+	}
+
+	/**
+	 * Reads and thereby acknowledges the interrupt status.
+	 *
+	 * @return the interrupt status (ISR_*)
+	 */
+	uint8_t isr() {
+		return inbyte(_base + REG_ISR);
+	}
+
+	/**
+	 * Tells the device that the driver is ready.
+	 */
+	void ready() {
+		setStatus(getStatus() | STATUS_DRIVER_OK);
+	}
+	/**
+	 * Tells the device that we gave up and terminates.
+	 *
+	 * @param msg the error message
+	 */
+	A_NORETURN void fail(const char *msg);
+
+private:
+	uint8_t getStatus() const {
+		return inbyte(_base + REG_STATUS);
+	}
+	void setStatus(uint8_t status) {
+		outbyte(_base + REG_STATUS,status);
+	}
+
+	uint16_t _base;
+	size_t _size;
+	uint32_t _features;
+	int _irqsem;
+};
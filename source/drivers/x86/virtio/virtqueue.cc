@@ -0,0 +1,159 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/util.h>
+#include <sys/common.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "virtqueue.h"
+
+static_assert(sizeof(VirtQueue::Desc) == 16,"Descriptor has the wrong size");
+
+VirtQueue::VirtQueue(VirtIO *dev,uint16_t idx)
+		: _dev(dev), _idx(idx), _size(dev->queueSize(idx)), _mem(), _memSize(), _descs(),
+		  _avail(), _used(), _freeHead(), _freeCount(_size), _availIdx(), _kickIdx(),
+		  _usedIdx(), _cookies() {
+	if(_size == 0)
+		error("Queue %u does not exist",idx);
+
+	// the legacy layout: the descriptors and the available ring, followed by the used ring on
+	// the next page
+	size_t availOff = _size * sizeof(Desc);
+	size_t usedOff = esc::Util::round_page_up(availOff + sizeof(uint16_t) * (3 + _size));
+	_memSize = usedOff + esc::Util::round_page_up(sizeof(uint16_t) * 3 + sizeof(UsedElem) * _size);
+
+	uintptr_t phys = 0;
+	_mem = mmapphys(&phys,_memSize,PAGE_SIZE,MAP_PHYS_ALLOC);
+	if(_mem == NULL)
+		error("Unable to allocate %zu bytes for queue %u",_memSize,idx);
+	memset(_mem,0,_memSize);
+
+	_descs = reinterpret_cast<Desc*>(_mem);
+	_avail = reinterpret_cast<Avail*>(reinterpret_cast<uintptr_t>(_mem) + availOff);
+	_used = reinterpret_cast<Used*>(reinterpret_cast<uintptr_t>(_mem) + usedOff);
+	_cookies = new void*[_size]();
+
+	// all descriptors are free
+	for(uint16_t i = 0; i < _size; ++i)
+		_descs[i].next = i + 1;
+
+	_dev->setQueue(idx,phys);
+	VDBG1("Queue %u: %u descriptors @ %p",idx,_size,phys);
+}
+
+VirtQueue::~VirtQueue() {
+	_dev->setQueue(_idx,0);
+	delete[] _cookies;
+	munmap(_mem);
+}
+
+bool VirtQueue::add(const Buffer *bufs,size_t count,void *cookie) {
+	if(count == 0 || count > _freeCount)
+		return false;
+
+	// the free descriptors are linked via next, so that we just have to take the first <count>
+	uint16_t head = _freeHead;
+	uint16_t last = head;
+	for(size_t i = 0, cur = head; i < count; ++i) {
+		Desc *d = _descs + cur;
+		d->addr = bufs[i].phys;
+		d->len = bufs[i].len;
+		d->flags = (bufs[i].write ? DESC_WRITE : 0) | (i + 1 < count ? DESC_NEXT : 0);
+		last = cur;
+		cur = d->next;
+	}
+	_freeHead = _descs[last].next;
+	_freeCount -= count;
+
+	_cookies[head] = cookie;
+	_avail->ring[_availIdx % _size] = head;
+	_availIdx++;
+	return true;
+}
+
+bool VirtQueue::addIndirect(const Buffer *bufs,size_t count,Desc *table,uint64_t tablePhys,
+		void *cookie) {
+	for(size_t i = 0; i < count; ++i) {
+		table[i].addr = bufs[i].phys;
+		table[i].len = bufs[i].len;
+		table[i].flags = (bufs[i].write ? DESC_WRITE : 0) | (i + 1 < count ? DESC_NEXT : 0);
+		table[i].next = i + 1;
+	}
+
+	Buffer buf;
+	buf.phys = tablePhys;
+	buf.len = count * sizeof(Desc);
+	buf.write = false;
+	if(!add(&buf,1,cookie))
+		return false;
+	_descs[_avail->ring[(_availIdx - 1) % _size]].flags = DESC_INDIRECT;
+	return true;
+}
+
+void VirtQueue::kick() {
+	if(_availIdx == _kickIdx)
+		return;
+
+	// the device has to see the ring entries before the new index. x86 doesn't reorder stores,
+	// so that it suffices to prevent the compiler from doing so.
+	asm volatile ("" : : : "memory");
+	_avail->idx = _availIdx;
+	_kickIdx = _availIdx;
+
+	// but loads might be done before stores. thus, we need a full barrier here to not miss that
+	// the device has stopped polling in the meantime.
+	__sync_synchronize();
+	if(~_used->flags & USED_NO_NOTIFY)
+		_dev->notify(_idx);
+}
+
+void *VirtQueue::get(uint32_t *len) {
+	if(_usedIdx == _used->idx)
+		return NULL;
+	// read the index before the element
+	asm volatile ("" : : : "memory");
+
+	volatile UsedElem *elem = _used->ring + (_usedIdx % _size);
+	uint16_t head = elem->id;
+	*len = elem->len;
+	_usedIdx++;
+
+	// put the chain back into the free list
+	uint16_t last = head;
+	size_t count = 1;
+	while(_descs[last].flags & DESC_NEXT) {
+		last = _descs[last].next;
+		count++;
+	}
+	_descs[last].next = _freeHead;
+	_freeHead = head;
+	_freeCount += count;
+
+	void *cookie = _cookies[head];
+	_cookies[head] = NULL;
+	return cookie;
+}
+
+bool VirtQueue::enableIntrs() {
+	_avail->flags &= ~AVAIL_NO_INTERRUPT;
+	__sync_synchronize();
+	return _usedIdx == _used->idx;
+}
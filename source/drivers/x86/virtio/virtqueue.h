@@ -0,0 +1,179 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/common.h>
+
+#include "virtio.h"
+
+/**
+ * A virtqueue, i.e., the descriptor table, the available ring, in which we put the chains of
+ * descriptors for the device, and the used ring, in which the device puts them back. A chain
+ * describes one request with multiple buffers (e.g., a header, the data and a status byte), some
+ * read and some written by the device.
+ *
+ * Every notification of the device and every interrupt is expensive in a VM. Thus, add() only
+ * puts the chain into the ring and kick() makes all added chains visible with a single
+ * notification, which is omitted if the device tells us that it doesn't need it. Likewise,
+ * the interrupts can be disabled while the used ring is processed.
+ *
+ * The queue is not thread-safe; the caller has to synchronize the accesses.
+ */
+class VirtQueue {
+	enum {
+		DESC_NEXT			= 1 << 0,	/* the chain continues in the next field */
+		DESC_WRITE			= 1 << 1,	/* the buffer is written by the device */
+		DESC_INDIRECT		= 1 << 2,	/* the buffer contains a table of descriptors */
+	};
+
+	enum {
+		AVAIL_NO_INTERRUPT	= 1 << 0,	/* we don't want to get interrupts */
+	};
+
+	enum {
+		USED_NO_NOTIFY		= 1 << 0,	/* the device doesn't want to be notified */
+	};
+
+	struct Avail {
+		uint16_t flags;
+		uint16_t idx;
+		uint16_t ring[];
+	} A_PACKED;
+
+	struct UsedElem {
+		uint32_t id;
+		uint32_t len;
+	} A_PACKED;
+
+	struct Used {
+		uint16_t flags;
+		uint16_t idx;
+		UsedElem ring[];
+	} A_PACKED;
+
+public:
+	struct Desc {
+		uint64_t addr;
+		uint32_t len;
+		uint16_t flags;
+		uint16_t next;
+	} A_PACKED;
+
+	/**
+	 * A buffer in a chain
+	 */
+	struct Buffer {
+		uint64_t phys;
+		uint32_t len;
+		/* whether the device writes to the buffer */
+		bool write;
+	};
+
+	/**
+	 * Allocates the memory for queue <idx> of the given device and tells the device about it.
+	 *
+	 * @param dev the device
+	 * @param idx the queue index
+	 */
+	explicit VirtQueue(VirtIO *dev,uint16_t idx);
+	~VirtQueue();
+
+	/**
+	 * @return the number of descriptors
+	 */
+	size_t size() const {
+		return _size;
+	}
+	/**
+	 * @return the number of free descriptors
+	 */
+	size_t free() const {
+		return _freeCount;
+	}
+
+	/**
+	 * Adds a chain of <count> buffers, which is handed to the device by the next kick().
+	 *
+	 * @param bufs the buffers; the ones read by the device have to come first
+	 * @param count the number of buffers
+	 * @param cookie the value get() returns when the device is done with the chain
+	 * @return true on success, false if there are not enough free descriptors
+	 */
+	bool add(const Buffer *bufs,size_t count,void *cookie);
+
+	/**
+	 * Like add(), but the chain is built in <table>, so that it needs only one descriptor in
+	 * the queue. This requires VirtIO::F_RING_INDIRECT.
+	 *
+	 * @param bufs the buffers; the ones read by the device have to come first
+	 * @param count the number of buffers
+	 * @param table the descriptor table with at least <count> entries
+	 * @param tablePhys the physical address of <table>
+	 * @param cookie the value get() returns when the device is done with the chain
+	 * @return true on success, false if there is no free descriptor
+	 */
+	bool addIndirect(const Buffer *bufs,size_t count,Desc *table,uint64_t tablePhys,void *cookie);
+
+	/**
+	 * Makes all chains that have been added since the last call available to the device and
+	 * notifies it, if necessary.
+	 */
+	void kick();
+
+	/**
+	 * Removes the next chain from the used ring, if there is any.
+	 *
+	 * @param len will be set to the number of bytes the device has written
+	 * @return the cookie of the chain or NULL if there is none
+	 */
+	void *get(uint32_t *len);
+
+	/**
+	 * Asks the device to not send interrupts for this queue. This is just a hint.
+	 */
+	void disableIntrs() {
+		_avail->flags |= AVAIL_NO_INTERRUPT;
+	}
+	/**
+	 * Enables the interrupts again. Since the device might have used chains before it has seen
+	 * that, the caller has to process the used ring again if false is returned.
+	 *
+	 * @return true if the used ring is empty
+	 */
+	bool enableIntrs();
+
+private:
+	VirtIO *_dev;
+	uint16_t _idx;
+	uint16_t _size;
+	void *_mem;
+	size_t _memSize;
+	Desc *_descs;
+	volatile Avail *_avail;
+	volatile Used *_used;
+	uint16_t _freeHead;
+	uint16_t _freeCount;
+	/* the next index in the available ring and its value at the last kick */
+	uint16_t _availIdx;
+	uint16_t _kickIdx;
+	/* the next index in the used ring we haven't seen yet */
+	uint16_t _usedIdx;
+	void **_cookies;
+};
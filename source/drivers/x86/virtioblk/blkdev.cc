@@ -0,0 +1,335 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/ipc/ipcstream.h>
+#include <esc/proto/file.h>
+#include <esc/util.h>
+#include <sys/common.h>
+#include <sys/mman.h>
+#include <sys/thread.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blkdev.h"
+
+BlkDev::BlkDev(esc::PCI &pci,const esc::PCI::Device &dev)
+	: BlockDisk(), _dev(pci,dev,"virtio-blk"), _queue(), _mem(), _memPhys(), _sectors(), _blkSize(SEC_SIZE),
+	  _sizeMax(), _segs(MAX_SEGS), _depth(MAX_CMDS), _partTable(), _mutex(), _freeCmds(),
+	  _cmdFree(), _cmds() {
+	uint32_t features = _dev.negotiate(
+		F_SIZE_MAX | F_SEG_MAX | F_RO | F_BLK_SIZE | VirtIO::F_RING_INDIRECT);
+
+	_sectors = _dev.config64(CFG_CAPACITY);
+	if(features & F_BLK_SIZE)
+		_blkSize = _dev.config32(CFG_BLK_SIZE);
+	if(features & F_SIZE_MAX)
+		_sizeMax = _dev.config32(CFG_SIZE_MAX);
+	if((features & F_SEG_MAX) && _dev.config32(CFG_SEG_MAX) > 0)
+		_segs = esc::Util::min(_segs,(size_t)_dev.config32(CFG_SEG_MAX));
+
+	_queue = new VirtQueue(&_dev,0);
+	if(_queue->size() < 3)
+		_dev.fail("The request queue is too small");
+	if(indirect())
+		_depth = esc::Util::min(_depth,_queue->size());
+	else {
+		// every buffer of a chain occupies a descriptor in the queue. thus, divide them among
+		// the commands, but leave enough buffers per command to transfer larger blocks directly.
+		_depth = esc::Util::max((size_t)1,esc::Util::min(_depth,_queue->size() / 18));
+		_segs = esc::Util::min(_segs,_queue->size() / _depth - 2);
+	}
+
+	uintptr_t phys = 0;
+	_mem = reinterpret_cast<Memory*>(mmapphys(&phys,sizeof(Memory),PAGE_SIZE,MAP_PHYS_ALLOC));
+	if(_mem == NULL)
+		_dev.fail("Unable to allocate DMA memory");
+	_memPhys = phys;
+	memset(_mem,0,sizeof(Memory));
+
+	usemcrt(&_freeCmds,_depth);
+	for(size_t i = 0; i < _depth; ++i) {
+		_cmds[i].next = _cmdFree;
+		_cmdFree = _cmds + i;
+	}
+
+	_dev.ready();
+
+	// read the partition table
+	uint8_t mbr[SEC_SIZE];
+	if(readPolled(0,mbr,1))
+		part_fillPartitions(_partTable,mbr);
+	else
+		print("Unable to read partition table");
+
+	print("%Lu sectors, block size %zu, depth %zu, %zu segments, %s%s",
+		_sectors,_blkSize,_depth,_segs,indirect() ? "indirect" : "direct",
+		readonly() ? ", read-only" : "");
+}
+
+void BlkDev::start() {
+	if(startthread(irqThread,this) < 0)
+		error("Unable to start interrupt-thread");
+}
+
+int BlkDev::irqThread(void *arg) {
+	BlkDev *dev = reinterpret_cast<BlkDev*>(arg);
+	while(1) {
+		semdown(dev->_dev.irqsem());
+
+		// the interrupt might be shared. reading the ISR acknowledges it.
+		if(dev->_dev.isr() & VirtIO::ISR_QUEUE)
+			dev->handleIntr();
+	}
+	return 0;
+}
+
+bool BlkDev::readPolled(uint64_t lba,void *buffer,size_t secCount) {
+	VirtQueue::Buffer bufs[MAX_SEGS + 2];
+	size_t count = secCount * SEC_SIZE;
+	Cmd *cmd = allocCmd();
+	size_t idx = cmd - _cmds;
+
+	size_t segs;
+	bool bounced;
+	bool res = false;
+	if(setupSegs(idx,NULL,count,bufs + 1,&segs,&bounced) == count) {
+		cmd->req = NULL;
+		enqueue(cmd,T_IN,lba,bufs,segs);
+
+		std::lock_guard<std::mutex> guard(_mutex);
+		_queue->disableIntrs();
+		_queue->kick();
+		for(int i = 0; i < CMD_TIMEOUT; ++i) {
+			uint32_t len;
+			if(_queue->get(&len) == cmd) {
+				res = _mem->status[idx] == S_OK;
+				break;
+			}
+			usleep(1000);
+		}
+		_queue->enableIntrs();
+	}
+
+	if(res)
+		memcpy(buffer,_mem->bounce[idx],count);
+	freeCmd(cmd);
+	return res;
+}
+
+void BlkDev::submit(Request *req,void *buf,uint64_t lba,size_t count) {
+	VirtQueue::Buffer bufs[MAX_SEGS + 2];
+	uint8_t *cur = reinterpret_cast<uint8_t*>(buf);
+	bool write = req->op == Request::OP_WRITE;
+
+	if(req->err == 0 && write && readonly())
+		req->err = -EROFS;
+	if(req->err == 0)
+		req->count = count;
+	while(req->err == 0 && count > 0) {
+		Cmd *cmd = allocCmd();
+		size_t idx = cmd - _cmds;
+
+		bool bounced;
+		size_t segs;
+		size_t amount = setupSegs(idx,cur,count,bufs + 1,&segs,&bounced);
+		if(bounced && write)
+			memcpy(_mem->bounce[idx],cur,amount);
+
+		cmd->req = req;
+		cmd->copyDst = bounced && !write ? cur : NULL;
+		cmd->copyLen = amount;
+		get(req);
+		enqueue(cmd,write ? T_OUT : T_IN,lba,bufs,segs);
+
+		cur += amount;
+		lba += amount / SEC_SIZE;
+		count -= amount;
+	}
+
+	// notify the device once for all commands of this request
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		_queue->kick();
+	}
+	put(req,true);
+}
+
+size_t BlkDev::setupSegs(size_t cmd,void *buf,size_t count,VirtQueue::Buffer *bufs,size_t *segs,
+		bool *bounced) {
+	uintptr_t virt = reinterpret_cast<uintptr_t>(buf);
+
+	// if possible, let the device access the buffer of the client directly. this requires a
+	// locked region; the shared memory of the clients and our own memory is locked.
+	if(buf) {
+		uintptr_t pages[MAX_SEGS];
+		uintptr_t start = esc::Util::round_page_dn(virt);
+		size_t pageCount = esc::Util::min(
+			(esc::Util::round_page_up(virt + count) - start) / PAGE_SIZE,MAX_SEGS);
+		if(virt2phys(reinterpret_cast<void*>(start),pages,pageCount) == 0) {
+			uint64_t segEnd = 0;
+			size_t n = 0,total = 0;
+			count = esc::Util::min(count,pageCount * PAGE_SIZE - (virt - start));
+			for(size_t i = 0; i < pageCount && total < count; ++i) {
+				size_t off = i == 0 ? virt - start : 0;
+				uint64_t phys = (uint64_t)pages[i] + off;
+				size_t amount = esc::Util::min((size_t)PAGE_SIZE - off,count - total);
+
+				// merge physically contiguous pages
+				if(n > 0 && phys == segEnd && (!_sizeMax || bufs[n - 1].len + amount <= _sizeMax))
+					bufs[n - 1].len += amount;
+				else if(n < _segs) {
+					bufs[n].phys = phys;
+					bufs[n].len = amount;
+					bufs[n].write = false;
+					n++;
+				}
+				else
+					break;
+				segEnd = phys + amount;
+				total += amount;
+			}
+
+			// we can only transfer whole sectors
+			size_t trim = total % SEC_SIZE;
+			while(n > 0 && trim > 0) {
+				if(bufs[n - 1].len > trim) {
+					bufs[n - 1].len -= trim;
+					break;
+				}
+				trim -= bufs[n - 1].len;
+				n--;
+			}
+			total -= total % SEC_SIZE;
+
+			if(total > 0) {
+				*bounced = false;
+				*segs = n;
+				return total;
+			}
+		}
+	}
+
+	// use the bounce buffer of the command
+	bufs[0].phys = _memPhys + offsetof(Memory,bounce) + cmd * BOUNCE_SIZE;
+	bufs[0].len = esc::Util::min(count,BOUNCE_SIZE);
+	bufs[0].write = false;
+	*bounced = true;
+	*segs = 1;
+	return bufs[0].len;
+}
+
+void BlkDev::enqueue(Cmd *cmd,uint type,uint64_t lba,VirtQueue::Buffer *bufs,size_t segs) {
+	size_t idx = cmd - _cmds;
+	Header *hdr = _mem->headers + idx;
+	hdr->type = type;
+	hdr->ioprio = 0;
+	hdr->sector = lba;
+	_mem->status[idx] = S_IOERR;
+
+	// the header is read by the device, the status is written and the data depends on <type>
+	bufs[0].phys = _memPhys + offsetof(Memory,headers) + idx * sizeof(Header);
+	bufs[0].len = sizeof(Header);
+	bufs[0].write = false;
+	for(size_t i = 1; i <= segs; ++i)
+		bufs[i].write = type == T_IN;
+	bufs[segs + 1].phys = _memPhys + offsetof(Memory,status) + idx;
+	bufs[segs + 1].len = 1;
+	bufs[segs + 1].write = true;
+
+	std::lock_guard<std::mutex> guard(_mutex);
+	A_UNUSED bool res;
+	if(indirect()) {
+		uint64_t table = _memPhys + offsetof(Memory,tables) + idx * sizeof(_mem->tables[0]);
+		res = _queue->addIndirect(bufs,segs + 2,_mem->tables[idx],table,cmd);
+	}
+	else
+		res = _queue->add(bufs,segs + 2,cmd);
+	// we have reserved enough descriptors for every command
+	assert(res);
+}
+
+void BlkDev::handleIntr() {
+	while(1) {
+		Cmd *done = NULL;
+		bool empty = false;
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			// we don't need interrupts while we're processing the used ring anyway
+			_queue->disableIntrs();
+
+			uint32_t len;
+			Cmd *cmd;
+			while((cmd = reinterpret_cast<Cmd*>(_queue->get(&len))) != NULL) {
+				cmd->next = done;
+				done = cmd;
+			}
+			if(done == NULL)
+				empty = _queue->enableIntrs();
+		}
+
+		while(done) {
+			Cmd *next = done->next;
+			complete(done);
+			done = next;
+		}
+		if(empty)
+			break;
+	}
+}
+
+BlkDev::Cmd *BlkDev::allocCmd() {
+	// if we have to wait, make sure that the device knows about the commands in the queue
+	if(!usemtrydown(&_freeCmds)) {
+		{
+			std::lock_guard<std::mutex> guard(_mutex);
+			_queue->kick();
+		}
+		usemdown(&_freeCmds);
+	}
+
+	std::lock_guard<std::mutex> guard(_mutex);
+	Cmd *cmd = _cmdFree;
+	_cmdFree = cmd->next;
+	return cmd;
+}
+
+void BlkDev::freeCmd(Cmd *cmd) {
+	cmd->req = NULL;
+	{
+		std::lock_guard<std::mutex> guard(_mutex);
+		cmd->next = _cmdFree;
+		_cmdFree = cmd;
+	}
+	usemup(&_freeCmds);
+}
+
+void BlkDev::complete(Cmd *cmd) {
+	size_t idx = cmd - _cmds;
+	Request *req = cmd->req;
+	bool success = _mem->status[idx] == S_OK;
+	if(success && cmd->copyDst)
+		memcpy(cmd->copyDst,_mem->bounce[idx],cmd->copyLen);
+	if(!success)
+		print("Command %zu failed with status %u",idx,_mem->status[idx]);
+
+	freeCmd(cmd);
+	put(req,success);
+}
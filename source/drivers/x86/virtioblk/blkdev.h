@@ -0,0 +1,191 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/ipc/clientdevice.h>
+#include <esc/proto/pci.h>
+#include <sys/common.h>
+#include <sys/messages.h>
+#include <sys/sync.h>
+#include <memory>
+#include <mutex>
+
+#include "../ata/partition.h"
+#include "../blk/disk.h"
+#include "../virtio/virtio.h"
+#include "../virtio/virtqueue.h"
+
+/**
+ * A virtio block device. Every command is a chain of a header, the data buffers and a status byte
+ * in the request queue. If the device supports indirect descriptors, each chain occupies only
+ * one descriptor in the queue, so that we can have many commands with many buffers in flight.
+ * As for AHCI, submit() does not wait for the completion, but the interrupt thread sends the
+ * reply. It processes the used ring with disabled interrupts until it is empty.
+ */
+class BlkDev : public BlockDisk {
+	static const size_t MAX_CMDS		= 32;
+	/* the max. number of data buffers per command */
+	static const size_t MAX_SEGS		= 64;
+	/* the size of the bounce buffer per command */
+	static const size_t BOUNCE_SIZE		= 4096;
+	static const size_t SEC_SIZE		= 512;
+	static const int CMD_TIMEOUT		= 3000;	/* ms */
+
+	enum {
+		F_SIZE_MAX			= 1 << 1,	/* max. size of a buffer is in size_max */
+		F_SEG_MAX			= 1 << 2,	/* max. number of buffers is in seg_max */
+		F_RO				= 1 << 5,	/* the device is read-only */
+		F_BLK_SIZE			= 1 << 6,	/* the block size is in blk_size */
+	};
+
+	enum {
+		CFG_CAPACITY		= 0x00,		/* number of 512 byte sectors (64 bit) */
+		CFG_SIZE_MAX		= 0x08,
+		CFG_SEG_MAX			= 0x0C,
+		CFG_BLK_SIZE		= 0x14,
+	};
+
+	enum {
+		T_IN				= 0,
+		T_OUT				= 1,
+	};
+
+	enum {
+		S_OK				= 0,
+		S_IOERR				= 1,
+		S_UNSUPP			= 2,
+	};
+
+	struct Header {
+		uint32_t type;
+		uint32_t ioprio;
+		uint64_t sector;
+	} A_PACKED;
+
+	struct Cmd {
+		Request *req;
+		/* the destination for the data in the bounce buffer, if it's a read via bounce buffer */
+		void *copyDst;
+		size_t copyLen;
+		Cmd *next;
+	};
+
+	/* the memory that is accessed by the device */
+	struct Memory {
+		VirtQueue::Desc tables[MAX_CMDS][MAX_SEGS + 2];
+		Header headers[MAX_CMDS];
+		uint8_t status[MAX_CMDS];
+		uint8_t bounce[MAX_CMDS][BOUNCE_SIZE] A_ALIGNED(4096);
+	};
+
+public:
+	/**
+	 * Initializes the given virtio block device and reads its partition table.
+	 *
+	 * @param pci the PCI device
+	 * @param dev the PCI device of the virtio device
+	 */
+	explicit BlkDev(esc::PCI &pci,const esc::PCI::Device &dev);
+
+	virtual size_t secSize() const override {
+		return SEC_SIZE;
+	}
+	/**
+	 * @return the number of sectors of the disk
+	 */
+	uint64_t sectors() const {
+		return _sectors;
+	}
+	/**
+	 * @return the block size the device prefers
+	 */
+	size_t blockSize() const {
+		return _blkSize;
+	}
+	/**
+	 * @return the number of commands that can be in flight
+	 */
+	size_t depth() const {
+		return _depth;
+	}
+	/**
+	 * @return the max. number of data buffers per command
+	 */
+	size_t segments() const {
+		return _segs;
+	}
+	/**
+	 * @return whether indirect descriptors are used
+	 */
+	bool indirect() const {
+		return _dev.features() & VirtIO::F_RING_INDIRECT;
+	}
+	/**
+	 * @return whether the device is read-only
+	 */
+	bool readonly() const {
+		return _dev.features() & F_RO;
+	}
+	/**
+	 * @return the partition table
+	 */
+	sPartition *partitions() {
+		return _partTable;
+	}
+
+	/**
+	 * Starts the interrupt thread
+	 */
+	void start();
+
+	/**
+	 * Puts the commands for the given request into the queue and notifies the device once.
+	 * Blocks only if there are no free commands.
+	 */
+	virtual void submit(Request *req,void *buf,uint64_t lba,size_t count) override;
+
+private:
+	static int irqThread(void *arg);
+
+	bool readPolled(uint64_t lba,void *buffer,size_t secCount);
+	size_t setupSegs(size_t cmd,void *buf,size_t count,VirtQueue::Buffer *bufs,size_t *segs,
+		bool *bounced);
+	void enqueue(Cmd *cmd,uint type,uint64_t lba,VirtQueue::Buffer *bufs,size_t segs);
+
+	void handleIntr();
+	Cmd *allocCmd();
+	void freeCmd(Cmd *cmd);
+	void complete(Cmd *cmd);
+
+	VirtIO _dev;
+	VirtQueue *_queue;
+	Memory *_mem;
+	uintptr_t _memPhys;
+	uint64_t _sectors;
+	size_t _blkSize;
+	size_t _sizeMax;
+	size_t _segs;
+	size_t _depth;
+	sPartition _partTable[PARTITION_COUNT];
+	std::mutex _mutex;
+	tUserSem _freeCmds;
+	Cmd *_cmdFree;
+	Cmd _cmds[MAX_CMDS];
+};
@@ -0,0 +1,148 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/ipc/clientdevice.h>
+#include <esc/ipc/ipcstream.h>
+#include <esc/proto/pci.h>
+#include <sys/common.h>
+#include <sys/driver.h>
+#include <sys/io.h>
+#include <sys/messages.h>
+#include <sys/mman.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../blk/partdevice.h"
+#include "blkdev.h"
+
+using namespace esc;
+
+static const size_t MAX_DISKS	= 4;
+
+static void createVFSEntry(BlkDev *disk,sPartition *part,const char *name) {
+	char path[SSTRLEN("/sys/dev/vda1") + 1];
+	snprintf(path,sizeof(path),"/sys/dev/%s",name);
+
+	FILE *f = fopen(path,"w");
+	if(f == NULL) {
+		printe("Unable to open '%s'",path);
+		return;
+	}
+
+	if(part == NULL) {
+		fprintf(f,"%-15s%s\n","Type:","virtio");
+		fprintf(f,"%-15s%Lu\n","Sectors:",disk->sectors());
+		fprintf(f,"%-15s%zu\n","SectorSize:",disk->secSize());
+		fprintf(f,"%-15s%zu\n","BlockSize:",disk->blockSize());
+		fprintf(f,"%-15s%zu\n","QueueDepth:",disk->depth());
+		fprintf(f,"%-15s%zu\n","Segments:",disk->segments());
+		fprintf(f,"%-15s%d\n","Indirect:",disk->indirect());
+		fprintf(f,"%-15s%d\n","ReadOnly:",disk->readonly());
+	}
+	else {
+		fprintf(f,"%-15s%zu\n","Start:",part->start);
+		fprintf(f,"%-15s%zu\n","Sectors:",part->size);
+	}
+	fclose(f);
+}
+
+static int drive_thread(void *arg) {
+	BlockPartitionDevice *dev = reinterpret_cast<BlockPartitionDevice*>(arg);
+	dev->bindto(gettid());
+	dev->loop();
+	return 0;
+}
+
+int main(int argc,char **argv) {
+	if(argc < 2)
+		error("Usage: %s <wait>",argv[0]);
+
+	std::vector<BlkDev*> disks;
+	{
+		PCI pci("/dev/pci");
+		PCI::Device dev;
+		for(size_t i = 0; i < MAX_DISKS; ++i) {
+			/* virtio-blk devices identify themselves as SCSI controllers */
+			if(!VirtIO::find(pci,VirtIO::DEV_BLOCK,0x01,0x00,i,dev))
+				break;
+			print("Found virtio block device (%d.%d.%d): vendorId %x, deviceId %x, rev %x",
+				dev.bus,dev.dev,dev.func,dev.vendorId,dev.deviceId,dev.revId);
+			disks.push_back(new BlkDev(pci,dev));
+		}
+	}
+
+	/* register a device for every partition */
+	std::vector<BlockPartitionDevice*> devs;
+	char name[SSTRLEN("vda1") + 1];
+	char path[MAX_PATH_LEN];
+	for(size_t i = 0; i < disks.size(); ++i) {
+		snprintf(name,sizeof(name),"vd%c",(char)('a' + i));
+		createVFSEntry(disks[i],NULL,name);
+
+		for(size_t p = 0; p < PARTITION_COUNT; p++) {
+			sPartition *part = disks[i]->partitions() + p;
+			if(!part->present)
+				continue;
+
+			snprintf(name + SSTRLEN("vda"),sizeof(name) - SSTRLEN("vda"),"%zu",p + 1);
+			snprintf(path,sizeof(path),"/dev/%s",name);
+			try {
+				devs.push_back(new BlockPartitionDevice(disks[i],part,path,0770));
+				print("Registered device '%s' (disk %zu, partition %zu)",name,i,p + 1);
+				createVFSEntry(disks[i],part,name);
+			}
+			catch(const std::exception &) {
+				printe("Disk %zu, Partition %zu: Unable to register device '%s'",i,p + 1,name);
+			}
+		}
+
+		disks[i]->start();
+	}
+
+	/* flush prints */
+	fflush(stdout);
+
+	/* we're ready now, so create a dummy-vfs-node that tells fs that all devices are registered */
+	FILE *f = fopen(argv[1],"w");
+	if(f)
+		fclose(f);
+
+	/* start drive threads */
+	for(size_t i = 1; i < devs.size(); i++) {
+		if(startthread(drive_thread,devs[i]) < 0)
+			error("Unable to start thread");
+	}
+
+	/* mlock all regions to prevent that we're swapped out */
+	if(mlockall() < 0)
+		error("Unable to mlock regions");
+
+	if(devs.size() > 0)
+		drive_thread(devs[0]);
+	else
+		print("No devices. Exiting");
+
+	for(size_t i = 0; i < devs.size(); i++)
+		delete devs[i];
+	return EXIT_SUCCESS;
+}
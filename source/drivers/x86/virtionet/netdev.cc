@@ -0,0 +1,191 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/util.h>
+#include <sys/common.h>
+#include <sys/mman.h>
+#include <sys/sync.h>
+#include <sys/thread.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "netdev.h"
+
+VirtIONet::VirtIONet(esc::PCI &pci,const esc::PCI::Device &nic)
+		: NICDriver(), _dev(pci,nic,"virtio-net"), _rxq(), _txq(), _bufs(), _bufsPhys(),
+		  _rxCount(), _txCount(), _txFree(), _txFreeCount(), _mac(), _handler() {
+	static_assert(sizeof(Header) == 10,"Header has the wrong size");
+
+	uint32_t features = _dev.negotiate(F_MAC | F_STATUS);
+	if(~features & F_MAC)
+		_dev.fail("The device has no MAC address");
+
+	uint8_t mac[esc::NIC::MAC::LEN];
+	for(size_t i = 0; i < sizeof(mac); ++i)
+		mac[i] = _dev.config8(CFG_MAC + i);
+	_mac = esc::NIC::MAC(mac);
+
+	// every buffer needs two descriptors: one for the header and one for the frame
+	_rxq = new VirtQueue(&_dev,QUEUE_RX);
+	_txq = new VirtQueue(&_dev,QUEUE_TX);
+	_rxCount = esc::Util::min(RX_BUF_COUNT,_rxq->size() / 2);
+	_txCount = esc::Util::min(TX_BUF_COUNT,_txq->size() / 2);
+	if(_rxCount == 0 || _txCount == 0)
+		_dev.fail("The queues are too small");
+
+	// create buffers in contiguous physical memory
+	uintptr_t phys = 0;
+	_bufs = reinterpret_cast<Buffers*>(mmapphys(&phys,sizeof(Buffers),PAGE_SIZE,MAP_PHYS_ALLOC));
+	if(_bufs == NULL)
+		_dev.fail("Unable to allocate DMA memory");
+	_bufsPhys = phys;
+	memset(_bufs,0,sizeof(Buffers));
+
+	for(size_t i = 0; i < _txCount; ++i)
+		_txFree[_txFreeCount++] = i;
+	// we reclaim sent buffers when we need them
+	_txq->disableIntrs();
+
+	for(size_t i = 0; i < _rxCount; ++i)
+		fillRx(i);
+
+	_dev.ready();
+	_rxq->kick();
+
+	if(features & F_STATUS)
+		print("Link is %s",(_dev.config16(CFG_STATUS) & LINK_UP) ? "up" : "down");
+	VDBG1("Using %zu receive and %zu transmit buffers",_rxCount,_txCount);
+}
+
+void VirtIONet::fillRx(size_t idx) {
+	VirtQueue::Buffer bufs[2];
+	bufs[0].phys = physOf(_bufs->rx[idx]);
+	bufs[0].len = sizeof(Header);
+	bufs[0].write = true;
+	bufs[1].phys = physOf(_bufs->rx[idx] + DATA_OFF);
+	bufs[1].len = BUF_SIZE - DATA_OFF;
+	bufs[1].write = true;
+	A_UNUSED bool res = _rxq->add(bufs,ARRAY_SIZE(bufs),reinterpret_cast<void*>(idx + 1));
+	assert(res);
+}
+
+void VirtIONet::reclaimTx() {
+	uint32_t len;
+	void *cookie;
+	while((cookie = _txq->get(&len)) != NULL)
+		_txFree[_txFreeCount++] = reinterpret_cast<uintptr_t>(cookie) - 1;
+}
+
+ssize_t VirtIONet::send(const void *packet,size_t size) {
+	assert(size <= mtu());
+
+	if(_txFreeCount == 0) {
+		// start the transmission of the packets we have so far and wait until there is space
+		flush();
+		for(int i = 0; ; ++i) {
+			reclaimTx();
+			if(_txFreeCount > 0)
+				break;
+			if(i >= TX_TIMEOUT) {
+				VDBG1("No free buffers");
+				return -EBUSY;
+			}
+			usleep(1000);
+		}
+	}
+
+	size_t idx = _txFree[--_txFreeCount];
+	uint8_t *buf = _bufs->tx[idx];
+	// we use no offloading, so that the header is always zero
+	memset(buf,0,sizeof(Header));
+	memcpy(buf + DATA_OFF,packet,size);
+
+	VirtQueue::Buffer bufs[2];
+	bufs[0].phys = physOf(buf);
+	bufs[0].len = sizeof(Header);
+	bufs[0].write = false;
+	bufs[1].phys = physOf(buf + DATA_OFF);
+	bufs[1].len = size;
+	bufs[1].write = false;
+	A_UNUSED bool res = _txq->add(bufs,ARRAY_SIZE(bufs),reinterpret_cast<void*>(idx + 1));
+	assert(res);
+	VDBG2("TX %zu: %zu bytes",idx,size);
+	return size;
+}
+
+void VirtIONet::flush() {
+	_txq->kick();
+	// reclaim what the device has already sent, so that the next send doesn't need to
+	reclaimTx();
+}
+
+void VirtIONet::receive() {
+	size_t received = 0;
+	while(1) {
+		// we don't need interrupts while we're processing the used ring anyway
+		_rxq->disableIntrs();
+
+		uint32_t len;
+		void *cookie;
+		while((cookie = _rxq->get(&len)) != NULL) {
+			size_t idx = reinterpret_cast<uintptr_t>(cookie) - 1;
+			VDBG2("RX %zu: %u bytes",idx,len);
+
+			// read data into packet; if the ring is full, the packet is dropped
+			if(len > sizeof(Header)) {
+				size_t size = esc::Util::min((size_t)len - sizeof(Header),FRAME_SIZE);
+				Packet *pkt = alloc(size);
+				if(pkt) {
+					memcpy(pkt->data,_bufs->rx[idx] + DATA_OFF,size);
+					insert(pkt);
+					received++;
+				}
+			}
+
+			fillRx(idx);
+		}
+
+		// hand all buffers back to the device at once
+		_rxq->kick();
+		if(_rxq->enableIntrs())
+			break;
+	}
+
+	// notify the device once for all received packets
+	if(received > 0)
+		(*_handler)();
+}
+
+int VirtIONet::irqThread(void *ptr) {
+	VirtIONet *net = reinterpret_cast<VirtIONet*>(ptr);
+	while(1) {
+		semdown(net->_dev.irqsem());
+
+		// the interrupt might be shared. reading the ISR acknowledges it.
+		uint8_t isr = net->_dev.isr();
+		if(isr & VirtIO::ISR_QUEUE)
+			net->receive();
+		if(isr & VirtIO::ISR_CONFIG) {
+			if(net->_dev.features() & F_STATUS)
+				print("Link is %s",(net->_dev.config16(CFG_STATUS) & LINK_UP) ? "up" : "down");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,123 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <esc/ipc/nicdevice.h>
+#include <esc/proto/nic.h>
+#include <esc/proto/pci.h>
+#include <sys/common.h>
+#include <sys/thread.h>
+#include <functor.h>
+
+#include "../virtio/virtio.h"
+#include "../virtio/virtqueue.h"
+
+/**
+ * A virtio network device. Each packet is a chain of the virtio-net header and the frame. The
+ * receive queue is kept filled with buffers, which are handed back to the device with one
+ * notification per interrupt. Transmissions are only put into the queue by send() and started
+ * by flush(), i.e., once per write request of the client, which is a whole batch of packets if
+ * the client uses batching. We don't need interrupts for the transmit queue at all, because the
+ * sent buffers are reclaimed as soon as we need them again.
+ */
+class VirtIONet : public esc::NICDriver {
+	enum {
+		F_MAC				= 1 << 5,	/* the MAC address is in the config */
+		F_STATUS			= 1 << 16,	/* the link status is in the config */
+	};
+
+	enum {
+		CFG_MAC				= 0x00,
+		CFG_STATUS			= 0x06,
+	};
+
+	enum {
+		LINK_UP				= 1 << 0,
+	};
+
+	enum {
+		QUEUE_RX			= 0,
+		QUEUE_TX			= 1,
+	};
+
+	static const size_t RX_BUF_COUNT	= 128;
+	static const size_t TX_BUF_COUNT	= 128;
+	static const size_t BUF_SIZE		= 2048;
+	/* the offset of the frame in the buffer; the header precedes it */
+	static const size_t DATA_OFF		= 16;
+	static const size_t FRAME_SIZE		= 1514;
+	static const int TX_TIMEOUT			= 100;	/* ms */
+
+	struct Header {
+		uint8_t flags;
+		uint8_t gsoType;
+		uint16_t hdrLen;
+		uint16_t gsoSize;
+		uint16_t csumStart;
+		uint16_t csumOffset;
+	} A_PACKED;
+
+	struct Buffers {
+		uint8_t rx[RX_BUF_COUNT][BUF_SIZE];
+		uint8_t tx[TX_BUF_COUNT][BUF_SIZE];
+	};
+
+public:
+	explicit VirtIONet(esc::PCI &pci,const esc::PCI::Device &nic);
+
+	void start(std::Functor<void> *handler) {
+		_handler = handler;
+		if(startthread(irqThread,this) < 0)
+			error("Unable to start receive-thread");
+	}
+
+	virtual esc::NIC::MAC mac() const {
+		return _mac;
+	}
+	virtual ulong mtu() const {
+		return FRAME_SIZE;
+	}
+	virtual ssize_t send(const void *packet,size_t size);
+	virtual void flush();
+
+private:
+	static int irqThread(void *ptr);
+
+	void receive();
+	void fillRx(size_t idx);
+	void reclaimTx();
+
+	uint64_t physOf(const void *virt) const {
+		return _bufsPhys + (reinterpret_cast<uintptr_t>(virt) - reinterpret_cast<uintptr_t>(_bufs));
+	}
+
+	VirtIO _dev;
+	VirtQueue *_rxq;
+	VirtQueue *_txq;
+	Buffers *_bufs;
+	uintptr_t _bufsPhys;
+	size_t _rxCount;
+	size_t _txCount;
+	/* the indices of the free transmit buffers */
+	size_t _txFree[TX_BUF_COUNT];
+	size_t _txFreeCount;
+	esc::NIC::MAC _mac;
+	std::Functor<void> *_handler;
+};
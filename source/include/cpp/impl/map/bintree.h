@@ -29,7 +29,8 @@
 #include <stddef.h>
 #include <utility>
 
-// Note: algorithms are based on http://en.wikipedia.org/wiki/Binary_search_tree
+// Note: algorithms are based on http://en.wikipedia.org/wiki/Red%E2%80%93black_tree and
+// "Introduction to Algorithms" (Cormen et al.)
 
 namespace std {
 	template<class Key,class T,class Cmp>
@@ -40,8 +41,10 @@ namespace std {
 	class const_bintree_iterator;
 
 	/**
-	 * A binary search tree with sorted keys (defined by the compare-object). This is used for
-	 * the map-implementation.
+	 * A red-black tree with sorted keys (defined by the compare-object). This is used for
+	 * the map-implementation. Besides the tree, the nodes are linked in ascending order, so that
+	 * the iterators can walk through them in constant time. The root is the right child of _head.
+	 * Iterators stay valid until the element they point to is erased.
 	 */
 	template<class Key,class T,class Cmp = less<Key> >
 	class bintree {
@@ -97,16 +100,18 @@ namespace std {
 			_head.next(&_foot);
 			_foot.prev(&_head);
 			for(const_iterator it = c.begin(); it != c.end(); ++it)
-				insert(it->first,it->second);
+				insert(end(),it->first,it->second);
 		}
 		/**
 		 * Assignment-operator
 		 */
 		bintree& operator =(const bintree& c) {
-			clear();
-			_cmp = c._cmp;
-			for(const_iterator it = c.begin(); it != c.end(); ++it)
-				insert(it->first,it->second);
+			if(&c != this) {
+				clear();
+				_cmp = c._cmp;
+				for(const_iterator it = c.begin(); it != c.end(); ++it)
+					insert(end(),it->first,it->second);
+			}
 			return *this;
 		}
 		/**
@@ -209,15 +214,35 @@ namespace std {
 		 * @return a iterator, pointing to the inserted element
 		 */
 		iterator insert(const Key& k,const T& v,bool replace = true) {
-			return do_insert(_head.right(),k,v,replace);
+			bintree_node<Key,T,Cmp>* node = root();
+			bintree_node<Key,T,Cmp>* parent = &_head;
+			bool left = false;
+			while(node != nullptr) {
+				parent = node;
+				if(_cmp(k,node->key())) {
+					left = true;
+					node = node->left();
+				}
+				else if(_cmp(node->key(),k)) {
+					left = false;
+					node = node->right();
+				}
+				// equal, so just replace the value
+				else {
+					if(replace)
+						node->value(v);
+					return iterator(node);
+				}
+			}
+			return link(parent,left,k,v);
 		}
 		iterator insert(const pair<Key,T>& p,bool replace = true) {
 			return insert(p.first,p.second,replace);
 		}
 		/**
 		 * Inserts the key <k> with value <v> into the tree and gives the insert-algorithm a hint
-		 * with <pos>. I.e. it tries to start at this node, if possible, which can speed up
-		 * the insert a lot.
+		 * with <pos>. If <k> belongs directly before <pos>, no search is required, which makes
+		 * inserting presorted elements at end() a lot faster.
 		 *
 		 * @param pos the position where to start
 		 * @param k the key
@@ -227,15 +252,20 @@ namespace std {
 		 */
 		iterator insert(iterator pos,const Key& k,const T& v,bool replace = true) {
 			bintree_node<Key,T,Cmp>* node = pos.node();
-			// head and foot are not allowed
-			if(node == &_head || node == &_foot)
-				node = _head.right();
-			else {
-				// while the parent is less than k, move upwards
-				while(node->parent() && _cmp(k,node->parent()->key()))
-					node = node->parent();
+			if(node != &_head) {
+				bintree_node<Key,T,Cmp>* before = node->prev();
+				if((node == &_foot || _cmp(k,node->key())) &&
+						(before == &_head || _cmp(before->key(),k))) {
+					// if they are neighbors, either <before> has no right or <node> no left child
+					if(before != &_head && before->right() == nullptr)
+						return link(before,false,k,v);
+					if(node != &_foot)
+						return link(node,true,k,v);
+					// the tree is empty
+					return link(&_head,false,k,v);
+				}
 			}
-			return do_insert(node,k,v,replace);
+			return insert(k,v,replace);
 		}
 
 		/**
@@ -245,18 +275,10 @@ namespace std {
 		 * @return the iterator at the position of the found key; end() if not found
 		 */
 		iterator find(const Key& k) {
-			bintree_node<Key,T,Cmp>* node = _head.right();
-			while(node != nullptr) {
-				// less?
-				if(_cmp(k,node->key()))
-					node = node->left();
-				else if(k == node->key())
-					return iterator(node);
-				else
-					node = node->right();
-			}
-			// not found
-			return end();
+			iterator it = lower_bound(k);
+			if(it.node() == &_foot || _cmp(k,it->first))
+				return end();
+			return it;
 		}
 		const_iterator find(const Key& k) const {
 			iterator it = const_cast<bintree*>(this)->find(k);
@@ -270,22 +292,20 @@ namespace std {
 		 * @return the iterator (end() if not found)
 		 */
 		iterator lower_bound(const key_type &x) {
-			bintree_node<Key,T,Cmp>* node = _head.right();
+			bintree_node<Key,T,Cmp>* res = &_foot;
+			bintree_node<Key,T,Cmp>* node = root();
 			while(node != nullptr) {
-				if(_cmp(x,node->key())) {
-					if(!node->left() || !_cmp(x,node->left()->key()))
-						return iterator(node);
+				if(!_cmp(node->key(),x)) {
+					res = node;
 					node = node->left();
 				}
-				else if(x == node->key())
-					return iterator(node);
 				else
 					node = node->right();
 			}
-			return end();
+			return iterator(res);
 		}
 		const_iterator lower_bound(const key_type &x) const {
-			iterator it = lower_bound(x);
+			iterator it = const_cast<bintree*>(this)->lower_bound(x);
 			return const_iterator(it.node());
 		}
 		/**
@@ -295,22 +315,20 @@ namespace std {
 		 * @return the iterator (end() if not found)
 		 */
 		iterator upper_bound(const key_type &x) {
-			bintree_node<Key,T,Cmp>* node = _head.right();
+			bintree_node<Key,T,Cmp>* res = &_foot;
+			bintree_node<Key,T,Cmp>* node = root();
 			while(node != nullptr) {
 				if(_cmp(x,node->key())) {
-					if(!node->left() || !_cmp(x,node->left()->key()))
-						return iterator(node);
+					res = node;
 					node = node->left();
 				}
-				else if(x == node->key())
-					return iterator(node->next());
 				else
 					node = node->right();
 			}
-			return end();
+			return iterator(res);
 		}
 		const_iterator upper_bound(const key_type &x) const {
-			iterator it = upper_bound(x);
+			iterator it = const_cast<bintree*>(this)->upper_bound(x);
 			return const_iterator(it.node());
 		}
 
@@ -321,10 +339,11 @@ namespace std {
 		 * @return true if erased
 		 */
 		bool erase(const Key& k) {
-			// don't even try it when _elCount is 0
-			if(_elCount > 0)
-				return do_erase(_head.right(),k);
-			return false;
+			iterator it = find(k);
+			if(it.node() == &_foot)
+				return false;
+			do_erase(it.node());
+			return true;
 		}
 		/**
 		 * Removes the element at given position
@@ -332,8 +351,7 @@ namespace std {
 		 * @param it the iterator that points to the element to erase
 		 */
 		void erase(iterator it) {
-			bintree_node<Key,T,Cmp>* node = it.node();
-			do_erase(node);
+			do_erase(it.node());
 		}
 		/**
 		 * Removes the range [<first> .. <last>)
@@ -342,15 +360,11 @@ namespace std {
 		 * @param last the end of the range (exclusive)
 		 */
 		void erase(iterator first,iterator last) {
-			/* note that we have to run to the node each time because deleted nodes might be reused for
-			 * other nodes. that is, we can't simply iterator through the sequence and delete every
-			 * node. doing so might free nodes twice. */
-			difference_type i = distance(begin(),first);
-			difference_type num = distance(first,last);
-			while(num-- > 0) {
-				iterator it = begin();
-				advance(it,i);
-				do_erase(it.node());
+			// erasing a node does not move other nodes, so that the iterators remain valid
+			while(first != last) {
+				bintree_node<Key,T,Cmp>* node = first.node();
+				++first;
+				do_erase(node);
 			}
 		}
 		/**
@@ -370,145 +384,280 @@ namespace std {
 		}
 
 	private:
+		bintree_node<Key,T,Cmp>* root() const {
+			return _head.right();
+		}
+		static bool is_red(const bintree_node<Key,T,Cmp>* n) {
+			return n && n->red();
+		}
 		/**
-		 * Does the actual inserting, starting at <node>
+		 * Creates a node for <k> and <v> and inserts it as the left or right child of <parent>,
+		 * which has to be free. Afterwards, the tree is rebalanced.
 		 *
-		 * @param node the start-node
+		 * @param parent the parent node (&_head if the tree is empty)
+		 * @param left whether to insert it as left child
 		 * @param k the key
 		 * @param v the value
-		 * @param replace whether to replace existing elements
 		 * @return the insert-position
 		 */
-		iterator do_insert(bintree_node<Key,T,Cmp>* node,const Key& k,const T& v,bool replace) {
-			bool left = false;
-			bintree_node<Key,T,Cmp>* prev = node ? node->parent() : nullptr;
-			while(node != nullptr) {
-				prev = node;
-				// less?
-				if(_cmp(k,node->key())) {
-					left = true;
-					node = node->left();
-				}
-				// equal, so just replace the value
-				else if(k == node->key()) {
-					if(replace)
-						node->value(v);
-					return iterator(node);
-				}
-				else {
-					left = false;
-					node = node->right();
-				}
-			}
-
-			// node is null, so create a new node
-			node = new bintree_node<Key,T,Cmp>(k,nullptr,nullptr);
+		iterator link(bintree_node<Key,T,Cmp>* parent,bool left,const Key& k,const T& v) {
+			bintree_node<Key,T,Cmp>* node = new bintree_node<Key,T,Cmp>(k,nullptr,nullptr);
 			node->value(v);
-			if(!prev)
-				prev = &_head;
-			node->parent(prev);
+			node->parent(parent);
+			node->red(true);
 
 			// insert into tree
 			if(left)
-				prev->left(node);
+				parent->left(node);
 			else
-				prev->right(node);
+				parent->right(node);
 
 			// insert into sequence
-			// note that its always directly behind or before the found node when we want to keep
+			// note that its always directly behind or before the parent when we want to keep
 			// the keys in ascending order!
 			if(left) {
-				// insert before prev
-				prev->prev()->next(node);
-				node->prev(prev->prev());
-				prev->prev(node);
-				node->next(prev);
+				// insert before parent
+				parent->prev()->next(node);
+				node->prev(parent->prev());
+				parent->prev(node);
+				node->next(parent);
 			}
 			else {
-				// insert behind prev
-				node->next(prev->next());
-				node->prev(prev);
-				prev->next()->prev(node);
-				prev->next(node);
+				// insert behind parent
+				node->next(parent->next());
+				node->prev(parent);
+				parent->next()->prev(node);
+				parent->next(node);
 			}
 
+			insert_fixup(node);
 			_elCount++;
 			return iterator(node);
 		}
 		/**
-		 * Finds the node with the minimum key in the subtree of <n>.
+		 * Restores the red-black properties after <n> has been inserted as a red node
 		 *
 		 * @param n the node
-		 * @return the node with the minimum key
 		 */
-		bintree_node<Key,T,Cmp>* find_min(bintree_node<Key,T,Cmp>* n) {
-			bintree_node<Key,T,Cmp>* current = n;
-			while(current->left())
-				current = current->left();
-			return current;
+		void insert_fixup(bintree_node<Key,T,Cmp>* n) {
+			// the only violation can be a red node with a red parent
+			while(n != root() && n->parent()->red()) {
+				// the parent is red and therefore not the root
+				bintree_node<Key,T,Cmp>* p = n->parent();
+				bintree_node<Key,T,Cmp>* g = p->parent();
+				if(p == g->left()) {
+					bintree_node<Key,T,Cmp>* u = g->right();
+					if(is_red(u)) {
+						p->red(false);
+						u->red(false);
+						g->red(true);
+						n = g;
+					}
+					else {
+						if(n == p->right()) {
+							rotate_left(p);
+							p = n;
+						}
+						p->red(false);
+						g->red(true);
+						rotate_right(g);
+						break;
+					}
+				}
+				else {
+					bintree_node<Key,T,Cmp>* u = g->left();
+					if(is_red(u)) {
+						p->red(false);
+						u->red(false);
+						g->red(true);
+						n = g;
+					}
+					else {
+						if(n == p->left()) {
+							rotate_right(p);
+							p = n;
+						}
+						p->red(false);
+						g->red(true);
+						rotate_left(g);
+						break;
+					}
+				}
+			}
+			root()->red(false);
 		}
 		/**
-		 * Replaces <n> with <newnode>. Deletes <n> when done
+		 * Removes the given node and rebalances the tree
 		 *
 		 * @param n the node
-		 * @param newnode the new node
 		 */
-		void replace_in_parent(bintree_node<Key,T,Cmp>* n,bintree_node<Key,T,Cmp>* newnode) {
-			bintree_node<Key,T,Cmp>* parent = n->parent();
+		void do_erase(bintree_node<Key,T,Cmp>* n) {
+			bintree_node<Key,T,Cmp>* child;
+			bintree_node<Key,T,Cmp>* parent;
+			bool red;
+
 			// erase out of the sequence
 			n->prev()->next(n->next());
 			n->next()->prev(n->prev());
-			// replace in parent
-			if(parent) {
-				if(n == parent->left())
-					parent->left(newnode);
-				else
-					parent->right(newnode);
+
+			if(n->left() && n->right()) {
+				// move the successor to the position of <n>. we relink the nodes instead of copying
+				// the data so that iterators to the successor stay valid
+				bintree_node<Key,T,Cmp>* succ = find_min(n->right());
+				red = succ->red();
+				child = succ->right();
+				if(succ->parent() == n)
+					parent = succ;
+				else {
+					parent = succ->parent();
+					parent->left(child);
+					if(child)
+						child->parent(parent);
+					succ->right(n->right());
+					n->right()->parent(succ);
+				}
+				succ->left(n->left());
+				n->left()->parent(succ);
+				replace_in_parent(n,succ);
+				succ->red(n->red());
 			}
-			if(newnode)
-				newnode->parent(parent);
+			else {
+				child = n->left() ? n->left() : n->right();
+				parent = n->parent();
+				red = n->red();
+				replace_in_parent(n,child);
+			}
+
+			// removing a black node changes the black-height of one path
+			if(!red)
+				erase_fixup(child,parent);
 			delete n;
+			_elCount--;
 		}
 		/**
-		 * The recursive erase-method
+		 * Restores the red-black properties after a black node has been removed. <n> is the node
+		 * that took its place and carries an extra black.
 		 *
-		 * @param n the current node
-		 * @param k the key to erase
-		 */
-		bool do_erase(bintree_node<Key,T,Cmp>* n,const Key& k) {
-			if(n) {
-				if(_cmp(k,n->key()))
-					return do_erase(n->left(),k);
-				else if(k != n->key())
-					return do_erase(n->right(),k);
+		 * @param n the node (may be null)
+		 * @param parent the parent of <n>
+		 */
+		void erase_fixup(bintree_node<Key,T,Cmp>* n,bintree_node<Key,T,Cmp>* parent) {
+			while(n != root() && !is_red(n)) {
+				// the sibling can't be null, because its subtree contains at least one black node
+				if(n == parent->left()) {
+					bintree_node<Key,T,Cmp>* w = parent->right();
+					if(w->red()) {
+						w->red(false);
+						parent->red(true);
+						rotate_left(parent);
+						w = parent->right();
+					}
+					if(!is_red(w->left()) && !is_red(w->right())) {
+						w->red(true);
+						n = parent;
+						parent = n->parent();
+					}
+					else {
+						if(!is_red(w->right())) {
+							w->left()->red(false);
+							w->red(true);
+							rotate_right(w);
+							w = parent->right();
+						}
+						w->red(parent->red());
+						parent->red(false);
+						w->right()->red(false);
+						rotate_left(parent);
+						n = root();
+					}
+				}
 				else {
-					do_erase(n);
-					return true;
+					bintree_node<Key,T,Cmp>* w = parent->left();
+					if(w->red()) {
+						w->red(false);
+						parent->red(true);
+						rotate_right(parent);
+						w = parent->left();
+					}
+					if(!is_red(w->left()) && !is_red(w->right())) {
+						w->red(true);
+						n = parent;
+						parent = n->parent();
+					}
+					else {
+						if(!is_red(w->left())) {
+							w->right()->red(false);
+							w->red(true);
+							rotate_left(w);
+							w = parent->left();
+						}
+						w->red(parent->red());
+						parent->red(false);
+						w->left()->red(false);
+						rotate_right(parent);
+						n = root();
+					}
 				}
 			}
-			return false;
+			if(n)
+				n->red(false);
 		}
 		/**
-		 * Removes the given node
+		 * Rotates the subtree of <n> to the left, i.e. the right child of <n> becomes its parent
 		 *
 		 * @param n the node
 		 */
-		void do_erase(bintree_node<Key,T,Cmp>* n) {
-			if(n->left() && n->right()) {
-				bintree_node<Key,T,Cmp>* successor = find_min(n->right());
-				n->key(successor->key());
-				n->value(successor->value());
-				replace_in_parent(successor,successor->right());
-			}
-			else if(n->left() || n->right()) {
-				if(n->left())
-					replace_in_parent(n,n->left());
-				else
-					replace_in_parent(n,n->right());
-			}
+		void rotate_left(bintree_node<Key,T,Cmp>* n) {
+			bintree_node<Key,T,Cmp>* r = n->right();
+			n->right(r->left());
+			if(r->left())
+				r->left()->parent(n);
+			replace_in_parent(n,r);
+			r->left(n);
+			n->parent(r);
+		}
+		/**
+		 * Rotates the subtree of <n> to the right, i.e. the left child of <n> becomes its parent
+		 *
+		 * @param n the node
+		 */
+		void rotate_right(bintree_node<Key,T,Cmp>* n) {
+			bintree_node<Key,T,Cmp>* l = n->left();
+			n->left(l->right());
+			if(l->right())
+				l->right()->parent(n);
+			replace_in_parent(n,l);
+			l->right(n);
+			n->parent(l);
+		}
+		/**
+		 * Finds the node with the minimum key in the subtree of <n>.
+		 *
+		 * @param n the node
+		 * @return the node with the minimum key
+		 */
+		bintree_node<Key,T,Cmp>* find_min(bintree_node<Key,T,Cmp>* n) {
+			bintree_node<Key,T,Cmp>* current = n;
+			while(current->left())
+				current = current->left();
+			return current;
+		}
+		/**
+		 * Replaces <n> with <newnode> in the parent of <n>. Does not touch the children of <n>.
+		 *
+		 * @param n the node
+		 * @param newnode the new node (may be null)
+		 */
+		void replace_in_parent(bintree_node<Key,T,Cmp>* n,bintree_node<Key,T,Cmp>* newnode) {
+			bintree_node<Key,T,Cmp>* parent = n->parent();
+			if(parent == &_head)
+				_head.right(newnode);
+			else if(n == parent->left())
+				parent->left(newnode);
 			else
-				replace_in_parent(n,nullptr);
-			_elCount--;
+				parent->right(newnode);
+			if(newnode)
+				newnode->parent(parent);
 		}
 
 	private:
@@ -103,10 +103,11 @@ public:
 	 * @param mode the permissions to set
 	 * @param type the device type
 	 * @param ops the supported operations (DEV_*)
+	 * @param threads the number of threads that handle messages (see Device)
 	 * @throws if the operation failed
 	 */
-	explicit ClientDevice(const char *path,mode_t mode,uint type,uint ops)
-		: Device(path,mode,type,ops | DEV_OPEN), _clients(), _mutex() {
+	explicit ClientDevice(const char *path,mode_t mode,uint type,uint ops,size_t threads = 1)
+		: Device(path,mode,type,ops | DEV_OPEN,threads), _clients(), _mutex() {
 		set(MSG_FILE_OPEN,std::make_memfun(this,&ClientDevice::open));
 		if(ops & DEV_DELEGATE)
 			set(MSG_DEV_DELEGATE,std::make_memfun(this,&ClientDevice::delegate));
@@ -129,6 +130,7 @@ public:
 	 * @return the client with given file-descriptor
 	 */
 	C *operator[](int fd) {
+		std::lock_guard<std::mutex> guard(_mutex);
 		typename map_type::iterator it = _clients.find(fd);
 		return it != _clients.end() ? it->second : NULL;
 	}
@@ -143,6 +145,7 @@ public:
 	 * @throws if the client does not exist
 	 */
 	C *get(int fd) {
+		std::lock_guard<std::mutex> guard(_mutex);
 		typename map_type::iterator it = _clients.find(fd);
 		if(it == _clients.end())
 			VTHROWE("No client with id " << fd,-ENOTFOUND);
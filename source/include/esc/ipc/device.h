@@ -22,14 +22,23 @@
 #include <esc/ipc/ipcstream.h>
 #include <sys/common.h>
 #include <sys/driver.h>
+#include <sys/io.h>
 #include <functor.h>
 #include <map>
+#include <mutex>
 #include <sstream>
+#include <vector>
 
 namespace esc {
 
 /**
- * The base class for all devices
+ * The base class for all devices.
+ *
+ * By default, the thread that calls loop() handles all messages. If more threads are requested,
+ * loop() starts the remaining ones and each new channel is bound to one of them (round robin) after
+ * its open-message has been handled. Thus, the messages of one client are still handled in order
+ * by a single thread, while different clients are served in parallel. Note that the handlers have
+ * to be thread-safe in this case.
  */
 class Device {
 public:
@@ -52,8 +61,10 @@ public:
 	 * @param mode the permissions to set
 	 * @param type the type of device
 	 * @param ops the supported operations (DEV_*)
+	 * @param threads the number of threads that handle messages (including the one calling loop()).
+	 *  the channels are distributed among them on MSG_FILE_OPEN, i.e., it requires DEV_OPEN
 	 */
-	explicit Device(const char *path,mode_t mode,uint type,uint ops);
+	explicit Device(const char *path,mode_t mode,uint type,uint ops,size_t threads = 1);
 	/**
 	 * Closes the device
 	 */
@@ -78,10 +89,12 @@ public:
 		return !_run;
 	}
 	/**
-	 * Stops the device-loop.
+	 * Stops the device-loop. This puts the device into non-blocking mode to wake up all threads that
+	 * are waiting for messages. Thus, it may be called by any thread and from signal handlers.
 	 */
 	void stop() {
 		_run = false;
+		fcntl(_id,F_SETFL,O_NONBLOCK);
 	}
 
 	/**
@@ -94,7 +107,8 @@ public:
 	}
 
 	/**
-	 * Registers the given handler for <op>.
+	 * Registers the given handler for <op>. Note that you should not replace or unregister handlers
+	 * while they might be executed by a different thread.
 	 *
 	 * @param op the operation (message-id)
 	 * @param handler your desired handler
@@ -111,7 +125,8 @@ public:
 
 	/**
 	 * Executes the device-loop, i.e. uses getwork() to get a messages and handles it with the
-	 * appropriate handler.
+	 * appropriate handler. If the device uses multiple threads, they are started first and loop()
+	 * returns as soon as all of them are finished.
 	 */
 	void loop();
 
@@ -124,15 +139,34 @@ public:
 	void handleMsg(msgid_t mid,IPCStream &is);
 
 protected:
+	/**
+	 * Fetches and handles messages until the device is stopped. This is executed by all threads of
+	 * the device.
+	 */
+	virtual void serve();
+
+	/**
+	 * Binds the channel <fd>, which has just been opened, to the next thread of the device.
+	 *
+	 * @param fd the file-descriptor for the channel
+	 */
+	void assign(int fd);
+
 	void reply(IPCStream &is,errcode_t errcode);
 	void close(IPCStream &is) {
 		::close(is.fd());
 	}
 
 private:
+	static int serveThread(void *arg);
+
 	oplist_type _ops;
+	std::mutex _opsMutex;
 	int _id;
 	volatile bool _run;
+	size_t _threads;
+	size_t _next;
+	std::vector<tid_t> _tids;
 };
 
 }
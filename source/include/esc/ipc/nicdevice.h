@@ -24,57 +24,155 @@
 #include <esc/proto/nic.h>
 #include <esc/proto/pci.h>
 #include <sys/common.h>
+#include <assert.h>
 #include <mutex>
 #include <stdlib.h>
+#include <string.h>
 
 namespace esc {
 
+/**
+ * The base class for NIC drivers. Received packets are stored in a preallocated ring buffer,
+ * which is filled by the driver (alloc + insert) and drained by the NICDevice (fetch + release).
+ * Packets are stored contiguously, so that the ring holds many small packets, but at least
+ * MIN_PACKETS packets of maximum size. If the ring is full, received packets are dropped.
+ *
+ * The ring is private to the driver and not shared with the clients. It contains the packets for
+ * all clients, and shared memory in Escape is created by the client and only mapped by the device
+ * (see sharebuf). Thus, the NICDevice copies the packets once from the ring into the client's
+ * shared buffer, which replaces the copy into the message and the copy by the kernel.
+ */
 class NICDriver {
+	/* marks the unused rest at the end of the ring */
+	static const size_t WRAP		= (size_t)-1;
+
 public:
+	/* the default size of the ring and the min. number of max-sized packets in it */
+	static const size_t RING_SIZE	= 256 * 1024;
+	static const size_t MIN_PACKETS	= 4;
+
 	struct Packet {
-		Packet *next;
 		size_t length;
 		uint16_t data[];
 	};
 
-	explicit NICDriver() : _mutex(), _first(), _last() {
+	explicit NICDriver() : _mutex(), _ring(), _size(), _rdpos(), _wrpos(), _dropped() {
 	}
 	virtual ~NICDriver() {
+		free(_ring);
 	}
 
 	virtual esc::NIC::MAC mac() const = 0;
 	virtual ulong mtu() const = 0;
 	virtual ssize_t send(const void *packet,size_t size) = 0;
+	/**
+	 * Is called after a write request, which might have contained a batch of packets, has been
+	 * passed to send(). Drivers that don't start the transmission in send() can do it here.
+	 */
+	virtual void flush() {
+	}
 
-	Packet *fetch() {
+	/**
+	 * Allocates the packet ring. Called by NICDevice.
+	 */
+	void init() {
+		_size = MAX(RING_SIZE,MIN_PACKETS * packetSize(mtu()));
+		_ring = (char*)malloc(_size);
+		if(!_ring)
+			VTHROWE("Unable to allocate packet ring",-ENOMEM);
+	}
+
+	/**
+	 * @return the number of packets that have been dropped because the ring was full
+	 */
+	ulong dropped() const {
+		return _dropped;
+	}
+
+	/**
+	 * Returns space for a packet of <size> bytes in the ring. The packet is not visible to the
+	 * device until insert() has been called.
+	 *
+	 * @param size the packet size
+	 * @return the packet or NULL if the ring is full
+	 */
+	Packet *alloc(size_t size) {
 		std::lock_guard<std::mutex> guard(_mutex);
-		Packet *pkt = NULL;
-		if(_first) {
-			pkt = _first;
-			_first = _first->next;
-			if(!_first)
-				_last = NULL;
+		size_t need = packetSize(size);
+		size_t off = _wrpos % _size;
+		// packets are not split; thus, skip the rest of the ring, if necessary
+		size_t skip = off + need > _size ? _size - off : 0;
+		if(size > mtu() || _wrpos - _rdpos + skip + need > _size) {
+			_dropped++;
+			return NULL;
 		}
+
+		if(skip) {
+			reinterpret_cast<Packet*>(_ring + off)->length = WRAP;
+			_wrpos += skip;
+		}
+		Packet *pkt = reinterpret_cast<Packet*>(_ring + _wrpos % _size);
+		pkt->length = size;
 		return pkt;
 	}
 
+	/**
+	 * Makes the packet that has been returned by alloc() available to the device.
+	 */
 	void insert(Packet *pkt) {
 		std::lock_guard<std::mutex> guard(_mutex);
-		pkt->next = NULL;
-		if(_last)
-			_last->next = pkt;
-		else
-			_first = pkt;
-		_last = pkt;
+		assert((char*)pkt == _ring + _wrpos % _size);
+		_wrpos += packetSize(pkt->length);
+	}
+
+	/**
+	 * @return the oldest received packet or NULL. It stays in the ring until release().
+	 */
+	Packet *fetch() {
+		std::lock_guard<std::mutex> guard(_mutex);
+		if(_rdpos == _wrpos)
+			return NULL;
+		Packet *pkt = reinterpret_cast<Packet*>(_ring + _rdpos % _size);
+		if(pkt->length == WRAP) {
+			_rdpos += _size - _rdpos % _size;
+			if(_rdpos == _wrpos)
+				return NULL;
+			pkt = reinterpret_cast<Packet*>(_ring);
+		}
+		return pkt;
+	}
+
+	/**
+	 * Frees the packet that has been returned by fetch().
+	 */
+	void release(Packet *pkt) {
+		std::lock_guard<std::mutex> guard(_mutex);
+		assert((char*)pkt == _ring + _rdpos % _size);
+		_rdpos += packetSize(pkt->length);
 	}
 
 private:
+	static size_t packetSize(size_t length) {
+		return (sizeof(Packet) + length + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+	}
+
 	std::mutex _mutex;
-	Packet *_first;
-	Packet *_last;
+	char *_ring;
+	size_t _size;
+	size_t _rdpos;
+	size_t _wrpos;
+	ulong _dropped;
 };
 
-class NICDevice : public ClientDevice<> {
+class NICClient : public Client {
+public:
+	explicit NICClient(int f) : Client(f), batch() {
+	}
+
+	bool batch;
+};
+
+class NICDevice : public ClientDevice<NICClient> {
 	struct EthernetHeader {
 		esc::NIC::MAC dst;
 		esc::NIC::MAC src;
@@ -83,16 +181,20 @@ class NICDevice : public ClientDevice<> {
 
 public:
 	explicit NICDevice(const char *path,mode_t mode,NICDriver *driver)
-		: ClientDevice<>(path,mode,DEV_TYPE_CHAR,DEV_CANCEL | DEV_DELEGATE | DEV_READ | DEV_WRITE),
+		: ClientDevice<NICClient>(path,mode,DEV_TYPE_CHAR,DEV_CANCEL | DEV_DELEGATE | DEV_READ | DEV_WRITE),
 		  _requests(std::make_memfun(this,&NICDevice::handleRead)), _mutex(), _driver(driver),
-		  _tmpbuf(new char[_driver->mtu()]) {
+		  _tmpsize(NIC::batchSize(_driver->mtu())), _tmpbuf(new char[_tmpsize]),
+		  _rxbuf(new char[_tmpsize]) {
+		_driver->init();
 		set(MSG_DEV_CANCEL,std::make_memfun(this,&NICDevice::cancel));
 		set(MSG_FILE_READ,std::make_memfun(this,&NICDevice::read));
 		set(MSG_FILE_WRITE,std::make_memfun(this,&NICDevice::write));
 		set(MSG_NIC_GETMAC,std::make_memfun(this,&NICDevice::getMac));
 		set(MSG_NIC_GETMTU,std::make_memfun(this,&NICDevice::getMTU));
+		set(MSG_NIC_BATCH,std::make_memfun(this,&NICDevice::batch));
 	}
 	virtual ~NICDevice() {
+		delete[] _rxbuf;
 		delete[] _tmpbuf;
 	}
 
@@ -125,8 +227,14 @@ private:
 		is << DevCancel::Response(res) << Reply();
 	}
 
+	void batch(IPCStream &is) {
+		NICClient *c = (*this)[is.fd()];
+		c->batch = true;
+		is << errcode_t(0) << Reply();
+	}
+
 	void read(IPCStream &is) {
-		Client *c = (*this)[is.fd()];
+		NICClient *c = (*this)[is.fd()];
 		FileRead::Request r;
 		is >> r;
 
@@ -134,18 +242,21 @@ private:
 		if(r.shmemoff != -1)
 			data = c->shm() + r.shmemoff;
 
-		if(!handleRead(is.fd(),is.msgid(),data,r.count)) {
-			std::lock_guard<std::mutex> guard(_mutex);
+		// the receive routine of the driver might handle the queue meanwhile
+		std::lock_guard<std::mutex> guard(_mutex);
+		if(!handleRead(is.fd(),is.msgid(),data,r.count))
 			_requests.enqueue(Request(is.fd(),is.msgid(),data,r.count));
-		}
 	}
 
 	void write(IPCStream &is) {
+		NICClient *c = (*this)[is.fd()];
 		char *data = _tmpbuf;
 		FileWrite::Request r;
 		is >> r;
 
-		if(r.count > _driver->mtu()) {
+		// batches in shared memory are only limited by its size (which is checked by the kernel)
+		size_t max = !c->batch ? _driver->mtu() : r.shmemoff == -1 ? _tmpsize : r.count;
+		if(r.count > max) {
 			if(r.shmemoff == -1)
 				is >> ReceiveData(NULL,0);
 			is << FileWrite::Response::error(-EINVAL) << Reply();
@@ -155,23 +266,14 @@ private:
 		if(r.shmemoff == -1)
 			is >> ReceiveData(data,r.count);
 		else
-			data = (*this)[is.fd()]->shm() + r.shmemoff;
+			data = c->shm() + r.shmemoff;
 
-		// if it's for ourself, just forward it to our incoming packet list
-		ssize_t res = -ENOMEM;
-		EthernetHeader *eth = reinterpret_cast<EthernetHeader*>(data);
-		if(eth->dst == _driver->mac()) {
-			NICDriver::Packet *pkt = (NICDriver::Packet*)malloc(sizeof(NICDriver::Packet) + r.count);
-			if(pkt) {
-				pkt->length = r.count;
-				memcpy(pkt->data,data,r.count);
-				_driver->insert(pkt);
-				checkPending();
-				res = r.count;
-			}
-		}
+		ssize_t res;
+		if(c->batch)
+			res = sendBatch(data,r.count);
 		else
-			res = _driver->send(data,r.count);
+			res = send(data,r.count);
+		_driver->flush();
 
 		is << FileWrite::Response::result(res) << Reply();
 	}
@@ -184,29 +286,91 @@ private:
 		is << ValueResponse<ulong>::success(_driver->mtu()) << Reply();
 	}
 
+	ssize_t sendBatch(const char *data,size_t count) {
+		size_t pos = 0;
+		while(pos + sizeof(NIC::BatchPacket) <= count) {
+			const NIC::BatchPacket *pkt = reinterpret_cast<const NIC::BatchPacket*>(data + pos);
+			if(pkt->length > _driver->mtu() || pos + NIC::batchSize(pkt->length) > count)
+				return -EINVAL;
+
+			ssize_t res = send(pkt->data,pkt->length);
+			if(res < 0)
+				return res;
+			pos += NIC::batchSize(pkt->length);
+		}
+		return count;
+	}
+
+	ssize_t send(const void *data,size_t count) {
+		// if it's for ourself, just forward it to our incoming packet list
+		const EthernetHeader *eth = reinterpret_cast<const EthernetHeader*>(data);
+		if(eth->dst == _driver->mac()) {
+			NICDriver::Packet *pkt = _driver->alloc(count);
+			if(!pkt)
+				return -ENOMEM;
+			memcpy(pkt->data,data,count);
+			_driver->insert(pkt);
+			checkPending();
+			return count;
+		}
+		return _driver->send(data,count);
+	}
+
+	ssize_t receiveBatch(NICDriver::Packet *pkt,char *data,size_t count) {
+		size_t pos = 0;
+		while(pkt && pos + NIC::batchSize(pkt->length) <= count) {
+			NIC::BatchPacket *bpkt = reinterpret_cast<NIC::BatchPacket*>(data + pos);
+			bpkt->length = pkt->length;
+			memcpy(bpkt->data,pkt->data,pkt->length);
+			pos += NIC::batchSize(pkt->length);
+
+			_driver->release(pkt);
+			pkt = _driver->fetch();
+		}
+
+		// drop the packet if not even the first one fits
+		if(pos == 0) {
+			_driver->release(pkt);
+			return -ENOMEM;
+		}
+		return pos;
+	}
+
 	bool handleRead(int fd,msgid_t mid,char *data,size_t count) {
 		NICDriver::Packet *pkt = _driver->fetch();
 		if(!pkt)
 			return false;
 
-		ssize_t res = count >= pkt->length ? pkt->length : -ENOMEM;
-		if(data && res > 0)
-			memcpy(data,pkt->data,res);
-
 		ulong buffer[IPC_DEF_SIZE / sizeof(ulong)];
 		IPCStream is(fd,buffer,sizeof(buffer),mid);
-		is << FileRead::Response::result(res) << Reply();
-		if(!data && res > 0)
-			is << ReplyData(pkt->data,res);
 
-		free(pkt);
+		NICClient *c = (*this)[fd];
+		if(c && c->batch) {
+			char *buf = data ? data : _rxbuf;
+			ssize_t res = receiveBatch(pkt,buf,data ? count : MIN(count,_tmpsize));
+			is << FileRead::Response::result(res) << Reply();
+			if(!data && res > 0)
+				is << ReplyData(buf,res);
+		}
+		else {
+			ssize_t res = count >= pkt->length ? pkt->length : -ENOMEM;
+			if(data && res > 0)
+				memcpy(data,pkt->data,res);
+
+			is << FileRead::Response::result(res) << Reply();
+			if(!data && res > 0)
+				is << ReplyData(pkt->data,res);
+			_driver->release(pkt);
+		}
 		return true;
 	}
 
 	RequestQueue _requests;
 	std::mutex _mutex;
 	NICDriver *_driver;
+	size_t _tmpsize;
 	char *_tmpbuf;
+	char *_rxbuf;
 };
 
 }
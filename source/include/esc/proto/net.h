@@ -135,6 +135,12 @@ public:
 			VTHROWE("linkMAC(" << link << ")",res);
 		return mac;
 	}
+	void linkLoss(const char *link,uint permille) {
+		errcode_t res;
+		_is << CString(link) << permille << SendReceive(MSG_NET_LINK_LOSS) >> res;
+		if(res < 0)
+			VTHROWE("linkLoss(" << link << "," << permille << ")",res);
+	}
 
 	void routeAdd(const char *link,const IPv4Addr &ip,const IPv4Addr &gw,const IPv4Addr &nm) {
 		errcode_t res;
@@ -35,6 +35,27 @@ public:
 	static const unsigned PCI_CLASS		= 0x02;
 	static const unsigned PCI_SUBCLASS	= 0x00;
 
+	/* the alignment of packets in a batch */
+	static const size_t BATCH_ALIGN		= sizeof(size_t);
+
+	/**
+	 * The header of a packet in a batch. In batch mode, a read transfers as many received packets
+	 * as fit into the buffer and a write sends all packets in the buffer. Each packet is prefixed
+	 * with this header and padded to a multiple of BATCH_ALIGN bytes.
+	 */
+	struct BatchPacket {
+		size_t length;
+		uint8_t data[];
+	};
+
+	/**
+	 * @param length the packet length
+	 * @return the number of bytes the packet occupies in a batch
+	 */
+	static size_t batchSize(size_t length) {
+		return (sizeof(BatchPacket) + length + BATCH_ALIGN - 1) & ~(BATCH_ALIGN - 1);
+	}
+
 	/**
 	 * Represents a MAC address
 	 */
@@ -124,6 +145,19 @@ public:
 		return r.res;
 	}
 
+	/**
+	 * Switches this channel into batch mode (see BatchPacket). Afterwards, reads return a
+	 * sequence of packets and writes expect one.
+	 *
+	 * @throws if the operation failed
+	 */
+	void enableBatch() {
+		errcode_t res;
+		_is << SendReceive(MSG_NIC_BATCH) >> res;
+		if(res < 0)
+			VTHROWE("enableBatch()",res);
+	}
+
 private:
 	IPCStream _is;
 };
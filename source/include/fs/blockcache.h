@@ -19,7 +19,10 @@
 
 #pragma once
 
+#include <esc/vthrow.h>
 #include <sys/common.h>
+#include <sys/sync.h>
+#include <mutex>
 #include <stdio.h>
 
 namespace fs {
@@ -29,17 +32,68 @@ struct CBlock {
 	CBlock *prev;
 	CBlock *next;
 	CBlock *hnext;
+	/* the list of dirty blocks of the shard */
+	CBlock *dprev;
+	CBlock *dnext;
 	size_t blockNo;
 	ushort dirty;
 	ushort refs;
+	/* true while the block is read from disk */
+	ushort loading;
 	/* NULL indicates an unused entry */
 	void *buffer;
 };
 
+/**
+ * The block cache is split into shards, selected by the block number. Each shard has its own
+ * lock, hashmap, LRU list and list of dirty blocks, so that requests for different blocks rarely
+ * contend. flush() writes runs of adjacent dirty blocks with a single writeBlocks() call.
+ *
+ * The shard lock is never held during disk I/O. A block that is read from disk is in the hashmap
+ * and referenced, but marked as loading; others that find it wait for the shard's ioDone semaphore
+ * and look again. A dirty block that is written back is referenced, so that it is not reused, and
+ * removed from the dirty list before the write. If somebody changes it meanwhile, markDirty()
+ * puts it on the dirty list again, so that the change is written later. Note that tpool_lock is a
+ * no-op, i.e., the cache does not serialize the users of a block; writers of the same block have
+ * to be serialized by the file system.
+ */
 class BlockCache {
-	static const size_t HASH_SIZE	= 256;
+	/* the max. number of shards */
+	static const size_t MAX_SHARDS	= 8;
+	/* the min. number of blocks per shard */
+	static const size_t MIN_SHARD	= 64;
+
+	struct Shard {
+		explicit Shard() : lock(), ioDone(), ioWaiters(), hashmap(), hashSize(), oldest(), newest(),
+			free(), dirty(), dirtyCount(), hits(), misses() {
+			if(usemcrt(&ioDone,0) < 0)
+				VTHROW("Unable to create semaphore");
+		}
+		~Shard() {
+			usemdestr(&ioDone);
+		}
+
+		std::mutex lock;
+		/* is up'ed for every waiter when a block has been loaded */
+		tUserSem ioDone;
+		size_t ioWaiters;
+		CBlock **hashmap;
+		size_t hashSize;
+		/* the LRU list of used blocks */
+		CBlock *oldest;
+		CBlock *newest;
+		CBlock *free;
+		/* the dirty blocks in no specific order */
+		CBlock *dirty;
+		size_t dirtyCount;
+		ulong hits;
+		ulong misses;
+	};
 
 public:
+	/* the max. number of blocks that fill() reads at once */
+	static const size_t MAX_FILL	= 32;
+
 	enum {
 		READ	= 0x1,
 		WRITE	= 0x2,
@@ -89,9 +143,7 @@ public:
 	 *
 	 * @param b the block
 	 */
-	void markDirty(CBlock *b) {
-		b->dirty = true;
-	}
+	void markDirty(CBlock *b);
 
 	/**
 	 * Creates a new block-cache-entry for given block-number. Does not read the contents from disk!
@@ -117,13 +169,24 @@ public:
 		return doRequest(blockNo,true,mode);
 	}
 
+	/**
+	 * Reads the blocks <start> .. <start> + <count> - 1 into the cache, as far as they are not
+	 * cached yet. Each run of consecutive blocks that are not in the cache is read with a single
+	 * readBlocks() call. Afterwards, the blocks can be requested as usual.
+	 *
+	 * @param start the first block number
+	 * @param count the number of blocks (at most MAX_FILL)
+	 * @return the number of blocks that have been read from disk
+	 */
+	size_t fill(block_t start,size_t count);
+
 	/**
 	 * Releases the given block
 	 *
 	 * @param b the block
 	 */
 	void release(CBlock *b) {
-		doRelease(b,true);
+		doRelease(b);
 	}
 
 	/**
@@ -150,26 +213,82 @@ private:
 	/**
 	 * Releases the tpool_lock for given block
 	 */
-	void doRelease(CBlock *b,bool unlockAlloc);
+	void doRelease(CBlock *b);
 	/**
 	 * Requests the given block and reads it from disk if desired
 	 */
 	CBlock *doRequest(block_t blockNo,bool doRead,uint mode);
 	/**
-	 * Fetches a block-cache-entry
+	 * @return the shard for given block number
+	 */
+	Shard &getShard(block_t blockNo) {
+		return _shards[blockNo & (_shardCount - 1)];
+	}
+	/**
+	 * @return the hashmap-bucket of <sh> for given block number
+	 */
+	CBlock **getBucket(Shard &sh,block_t blockNo) {
+		return sh.hashmap + ((blockNo / _shardCount) & (sh.hashSize - 1));
+	}
+	/**
+	 * Searches for the given block in the cache. Expects that the shard is locked.
+	 */
+	CBlock *find(Shard &sh,block_t blockNo);
+	/**
+	 * @return true if the given block is in the cache. Locks the shard.
+	 */
+	bool isCached(block_t blockNo);
+	/**
+	 * Fetches an unused block-cache-entry, which is neither in the hashmap nor in the usedlist.
+	 * Expects that the shard is locked. The lock is released while a dirty block is written back.
+	 */
+	CBlock *getBlock(Shard &sh);
+	/**
+	 * Puts the free block-cache-entry <b> as <blockNo> into the hashmap and the usedlist of <sh>.
+	 * Expects that the shard is locked.
+	 */
+	void insert(Shard &sh,CBlock *b,block_t blockNo);
+	/**
+	 * Removes <b> from the hashmap and the usedlist of <sh>. Expects that the shard is locked.
+	 */
+	void remove(Shard &sh,CBlock *b);
+	/**
+	 * Waits until a block of <sh> has been loaded. Expects that the shard is locked and releases
+	 * the lock meanwhile.
+	 */
+	void waitLoaded(Shard &sh);
+	/**
+	 * Marks <b> as loaded and wakes up all waiters. Expects that the shard is locked.
+	 */
+	void loaded(Shard &sh,CBlock *b);
+	/**
+	 * Puts <b> on the dirty list of <sh>. Expects that the shard is locked.
+	 */
+	void addDirty(Shard &sh,CBlock *b);
+	/**
+	 * Removes <b> from the dirty list of <sh>. Expects that the shard is locked.
+	 */
+	void removeDirty(Shard &sh,CBlock *b);
+	/**
+	 * Writes the given blocks, which are sorted by block number, to disk, using one writeBlocks()
+	 * call for each run of adjacent blocks.
 	 */
-	CBlock *getBlock(block_t blockNo);
+	void writeSorted(CBlock **blocks,size_t count);
 
 	size_t _blockCacheSize;
 	size_t _blockSize;
-	CBlock **_hashmap;
-	CBlock *_oldestBlock;
-	CBlock *_newestBlock;
-	CBlock *_freeBlocks;
+	size_t _shardCount;
+	Shard *_shards;
 	CBlock *_blockCache;
 	void *_blockmem;
-	ulong _hits;
-	ulong _misses;
+	/* the area behind the cached blocks, which is used to read/write multiple blocks at once */
+	void *_fillmem;
+	std::mutex _fillLock;
+	/* statistics; updated atomically, because they are not protected by a shard lock */
+	ulong _fills;
+	ulong _filled;
+	ulong _flushes;
+	ulong _flushed;
 };
 
 }
@@ -29,7 +29,8 @@
 namespace fs {
 
 /**
- * The base-class for all filesystems
+ * The base-class for all filesystems. If the FSDevice uses multiple threads, the methods are called
+ * concurrently for different clients. Thus, the filesystem has to protect its state itself.
  */
 template<class F>
 class FileSystem {
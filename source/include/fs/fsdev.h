@@ -32,20 +32,30 @@ template<class F>
 class FileSystem;
 
 struct OpenFile : public esc::Client {
-	explicit OpenFile(int fd) : Client(fd), ino() {
+	explicit OpenFile(int fd) : Client(fd), ino(), nextOffset(), readahead() {
 	}
-	explicit OpenFile(int fd,const fs::User &u,ino_t _ino) : Client(fd), user(u), ino(_ino) {
+	explicit OpenFile(int fd,const fs::User &u,ino_t _ino)
+		: Client(fd), user(u), ino(_ino), nextOffset(), readahead() {
 	}
 
 	fs::User user;
 	ino_t ino;
+	/* the offset at which a sequential read would continue */
+	off_t nextOffset;
+	/* the number of blocks to read ahead, maintained by the file system */
+	size_t readahead;
 };
 
+/**
+ * The device for file systems. If multiple threads are used, the file system is called from all of
+ * them concurrently, so that it has to do the locking itself (see FileSystem).
+ */
 template<class F>
 class FSDevice : public esc::ClientDevice<F> {
 public:
-	explicit FSDevice(FileSystem<F> *fs,const char *fsDev)
-		: esc::ClientDevice<F>(fsDev,0700,DEV_TYPE_FS,DEV_OPEN | DEV_READ | DEV_WRITE | DEV_CLOSE | DEV_DELEGATE),
+	explicit FSDevice(FileSystem<F> *fs,const char *fsDev,size_t threads = 1)
+		: esc::ClientDevice<F>(fsDev,0700,DEV_TYPE_FS,DEV_OPEN | DEV_READ | DEV_WRITE | DEV_CLOSE | DEV_DELEGATE,
+		                       threads),
 		  _fs(fs), _clients(0) {
 		this->set(MSG_FILE_OPEN,std::make_memfun(this,&FSDevice::devopen));
 		this->set(MSG_FILE_CLOSE,std::make_memfun(this,&FSDevice::devclose),false);
@@ -71,34 +81,14 @@ public:
 		_fs->sync();
 	}
 
-	void loop() {
-		ulong buf[IPC_DEF_SIZE / sizeof(ulong)];
-		while(1) {
-			msgid_t mid;
-			int fd = getwork(this->id(),&mid,buf,sizeof(buf),this->isStopped() ? GW_NOBLOCK : 0);
-			if(EXPECT_FALSE(fd < 0)) {
-				if(fd != -EINTR) {
-					/* no requests anymore and we should shutdown? */
-					if(this->isStopped())
-						break;
-					printe("getwork failed");
-				}
-				continue;
-			}
-
-			esc::IPCStream is(fd,buf,sizeof(buf),mid);
-			this->handleMsg(mid,is);
-		}
-	}
-
 	void devopen(esc::IPCStream &is) {
-		_clients++;
+		__sync_fetch_and_add(&_clients,1);
 		is << esc::FileOpen::Response::success(0) << esc::Reply();
 	}
 
 	void devclose(esc::IPCStream &is) {
 		::close(is.fd());
-		if(--_clients == 0)
+		if(__sync_sub_and_fetch(&_clients,1) == 0)
 			this->stop();
 	}
 
@@ -280,6 +270,29 @@ public:
 		is << esc::FSTruncate::Response(res) << esc::Reply();
 	}
 
+protected:
+	virtual void serve() override {
+		ulong buf[IPC_DEF_SIZE / sizeof(ulong)];
+		while(1) {
+			msgid_t mid;
+			int fd = getwork(this->id(),&mid,buf,sizeof(buf),this->isStopped() ? GW_NOBLOCK : 0);
+			if(EXPECT_FALSE(fd < 0)) {
+				if(fd != -EINTR) {
+					/* no requests anymore and we should shutdown? */
+					if(this->isStopped())
+						break;
+					printe("getwork failed");
+				}
+				continue;
+			}
+
+			esc::IPCStream is(fd,buf,sizeof(buf),mid);
+			this->handleMsg(mid,is);
+			if(EXPECT_FALSE((mid & 0xFFFF) == MSG_FILE_OPEN))
+				this->assign(fd);
+		}
+	}
+
 private:
 	void handleInfoRead(esc::IPCStream &is,const esc::FileRead::Request &r) {
 		FILE *str = fopendyn();
@@ -20,12 +20,86 @@
 #pragma once
 
 #include <sys/common.h>
+#include <sys/sync.h>
+
+enum {
+	PTHREAD_MUTEX_NORMAL,
+	PTHREAD_MUTEX_RECURSIVE,
+	PTHREAD_MUTEX_DEFAULT = PTHREAD_MUTEX_NORMAL,
+};
+
+/* returned by pthread_barrier_wait for exactly one of the threads */
+#define PTHREAD_BARRIER_SERIAL_THREAD		-1
 
 typedef uint32_t pthread_key_t;
-typedef int pthread_mutex_t;
 typedef int pthread_t;
 typedef long pthread_once_t;
 typedef int pthread_mutexattr_t;
+typedef int pthread_condattr_t;
+typedef int pthread_rwlockattr_t;
+typedef int pthread_barrierattr_t;
+
+#if defined(__eco32__)
+/* eco32 has no atomic instructions. thus, the state of the primitives is protected by a global
+ * lock and threads block on kernel-semaphores, which are created on the first use to support the
+ * static initializers. */
+typedef struct {
+	/* the semaphore to block on; -1 if not created yet */
+	volatile int sem;
+	int locked;
+	int waiters;
+	int type;
+	/* the owner and the number of locks, for recursive mutexes */
+	pthread_t owner;
+	uint count;
+} pthread_mutex_t;
+
+typedef struct {
+	volatile int sem;
+	int waiters;
+} pthread_cond_t;
+#else
+/* all primitives are based on futexes, so that they don't need any kernel-object and only call
+ * the kernel if they have to block or wake somebody up. */
+typedef struct {
+	/* 0 = unlocked, 1 = locked, 2 = locked and there might be waiters */
+	volatile long value;
+	int type;
+	/* the owner and the number of locks, for recursive mutexes */
+	pthread_t owner;
+	uint count;
+} pthread_mutex_t;
+
+typedef struct {
+	/* incremented on every signal; the waiters wait on it as a futex */
+	volatile long seq;
+	volatile long waiters;
+} pthread_cond_t;
+#endif
+
+typedef tRWLock pthread_rwlock_t;
+
+typedef struct {
+	/* incremented whenever the barrier opens; the waiters wait on it as a futex */
+	volatile long seq;
+	volatile long count;
+	long total;
+} pthread_barrier_t;
+
+typedef volatile long pthread_spinlock_t;
+
+#define PTHREAD_ONCE_INIT					0
+#if defined(__eco32__)
+#	define PTHREAD_MUTEX_INITIALIZER			{-1,0,0,PTHREAD_MUTEX_NORMAL,-1,0}
+#	define PTHREAD_RECURSIVE_MUTEX_INITIALIZER	{-1,0,0,PTHREAD_MUTEX_RECURSIVE,-1,0}
+#	define PTHREAD_COND_INITIALIZER			{-1,0}
+#	define PTHREAD_RWLOCK_INITIALIZER			{-1,0,0,{1,0,-1}}
+#else
+#	define PTHREAD_MUTEX_INITIALIZER			{0,PTHREAD_MUTEX_NORMAL,-1,0}
+#	define PTHREAD_RECURSIVE_MUTEX_INITIALIZER	{0,PTHREAD_MUTEX_RECURSIVE,-1,0}
+#	define PTHREAD_COND_INITIALIZER			{0,0}
+#	define PTHREAD_RWLOCK_INITIALIZER			{0,0,0}
+#endif
 
 #if defined(__cplusplus)
 extern "C" {
@@ -33,15 +107,49 @@ extern "C" {
 
 int pthread_key_create(pthread_key_t * key,void (*f)(void*));
 int pthread_key_delete(pthread_key_t key);
+pthread_t pthread_self(void);
+int pthread_equal(pthread_t t1,pthread_t t2);
 int pthread_cancel(pthread_t thread);
 int pthread_once(pthread_once_t *control,void (*init)(void));
 void* pthread_getspecific(pthread_key_t key);
 int pthread_setspecific(pthread_key_t key,void* data);
+
+int pthread_mutexattr_init(pthread_mutexattr_t *attr);
+int pthread_mutexattr_destroy(pthread_mutexattr_t *attr);
+int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr,int *type);
+int pthread_mutexattr_settype(pthread_mutexattr_t *attr,int type);
+
 int pthread_mutex_init(pthread_mutex_t *mutex,const pthread_mutexattr_t *attr);
 int pthread_mutex_lock(pthread_mutex_t *mutex);
+int pthread_mutex_trylock(pthread_mutex_t *mutex);
 int pthread_mutex_unlock(pthread_mutex_t *mutex);
 int pthread_mutex_destroy(pthread_mutex_t *mutex);
 
+int pthread_cond_init(pthread_cond_t *cond,const pthread_condattr_t *attr);
+int pthread_cond_wait(pthread_cond_t *cond,pthread_mutex_t *mutex);
+int pthread_cond_signal(pthread_cond_t *cond);
+int pthread_cond_broadcast(pthread_cond_t *cond);
+int pthread_cond_destroy(pthread_cond_t *cond);
+
+int pthread_rwlock_init(pthread_rwlock_t *rwlock,const pthread_rwlockattr_t *attr);
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock);
+int pthread_rwlock_destroy(pthread_rwlock_t *rwlock);
+
+int pthread_barrier_init(pthread_barrier_t *barrier,const pthread_barrierattr_t *attr,
+	unsigned count);
+int pthread_barrier_wait(pthread_barrier_t *barrier);
+int pthread_barrier_destroy(pthread_barrier_t *barrier);
+
+int pthread_spin_init(pthread_spinlock_t *lock,int pshared);
+int pthread_spin_lock(pthread_spinlock_t *lock);
+int pthread_spin_trylock(pthread_spinlock_t *lock);
+int pthread_spin_unlock(pthread_spinlock_t *lock);
+int pthread_spin_destroy(pthread_spinlock_t *lock);
+
 #if defined(__cplusplus)
 }
 #endif
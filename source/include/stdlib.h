@@ -230,6 +230,16 @@ void *realloc(void *addr,size_t size);
  */
 void *memalign(size_t align,size_t size);
 
+/**
+ * Allocates memory of <size> bytes with alignment <align> and stores the address in <memptr>.
+ *
+ * @param memptr where to store the address
+ * @param align the alignment (a power of two and a multiple of sizeof(void*))
+ * @param size the number of bytes
+ * @return 0 on success, EINVAL if <align> is invalid or ENOMEM if there is not enough memory
+ */
+int posix_memalign(void **memptr,size_t align,size_t size);
+
 /**
  * Note that the heap does increase the data-pages of the process as soon as it's required and
  * does not decrease them. So the free-space may increase during runtime!
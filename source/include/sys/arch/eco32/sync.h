@@ -22,13 +22,15 @@
 #include <sys/common.h>
 
 static inline int usemcrt(tUserSem *sem,long val) {
-	sem->value = 1;
+	sem->value = val;
+	sem->waiters = 0;
 	sem->sem = semcrt(val);
 	return sem->sem;
 }
 
 static inline void usemdown(tUserSem *sem) {
-	/* TODO eco32 has no atomic compare and swap instruction or similar :/ */
+	/* TODO eco32 has no atomic compare and swap instruction or similar :/
+	 * thus, we can't use futexes here, but always use the kernel-semaphore */
 	IGNSIGS(semdown(sem->sem));
 }
 
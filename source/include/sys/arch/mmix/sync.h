@@ -24,25 +24,41 @@
 
 static inline int usemcrt(tUserSem *sem,long val) {
 	sem->value = val;
-	sem->sem = semcrt(0);
-	return sem->sem;
+	sem->waiters = 0;
+	return 0;
 }
 
 static inline void usemdown(tUserSem *sem) {
-	/* 1 means free, <= 0 means taken */
-	if(atomic_add(&sem->value,-1) <= 0)
-		IGNSIGS(semdown(sem->sem));
+	while(1) {
+		long val = sem->value;
+		if(val > 0) {
+			if(atomic_cmpnswap(&sem->value,val,val - 1))
+				break;
+		}
+		else {
+			/* announce us, so that usemup() knows that it has to wake somebody up. the kernel
+			 * checks again whether it's still zero */
+			atomic_add(&sem->waiters,+1);
+			futexwait(&sem->value,0);
+			atomic_add(&sem->waiters,-1);
+		}
+	}
 }
 
 static inline bool usemtrydown(tUserSem *sem) {
-	return atomic_add(&sem->value,-1) > 0;
+	long val;
+	while((val = sem->value) > 0) {
+		if(atomic_cmpnswap(&sem->value,val,val - 1))
+			return true;
+	}
+	return false;
 }
 
 static inline void usemup(tUserSem *sem) {
-	if(atomic_add(&sem->value,+1) < 0)
-		semup(sem->sem);
+	atomic_add(&sem->value,+1);
+	if(sem->waiters > 0)
+		futexwake(&sem->value,false);
 }
 
-static inline void usemdestr(tUserSem *sem) {
-	semdestr(sem->sem);
+static inline void usemdestr(A_UNUSED tUserSem *sem) {
 }
@@ -97,6 +97,8 @@ A_CHECKRET static inline int createchan(int dev,uint perm) {
  * For drivers: Looks whether a client wants to be served. If not and GW_NOBLOCK is not provided
  * it waits until a client should be served. if not and GW_NOBLOCK is enabled, it returns an error.
  * If a client wants to be served, the message is fetched from him and a file-descriptor is returned.
+ * If the device has been put into non-blocking mode via fcntl(fd,F_SETFL,O_NONBLOCK), it behaves as
+ * if GW_NOBLOCK was given. Doing so wakes up all threads that are currently waiting in getwork().
  * Note that you may be interrupted by a signal!
  *
  * @param fd the device fd
@@ -112,6 +112,7 @@ enum {
 	/* NIC */
 	MSG_NIC_GETMAC					= 1100,	/* get the MAC address of a NIC */
 	MSG_NIC_GETMTU					= 1101,	/* get the MTU of a NIC */
+	MSG_NIC_BATCH					= 1102,	/* transfer multiple packets per read/write */
 
 	/* network */
 	MSG_NET_LINK_ADD				= 1200,	/* adds a link */
@@ -124,6 +125,7 @@ enum {
 	MSG_NET_ROUTE_GET				= 1207,	/* gets the destination for an IP address */
 	MSG_NET_ARP_ADD					= 1208,	/* resolves an IP address and puts it into the ARP table */
 	MSG_NET_ARP_REM					= 1209,	/* removes an IP address from the ARP table */
+	MSG_NET_LINK_LOSS				= 1210,	/* sets the artificial packet loss of a link */
 
 	/* socket */
 	MSG_SOCK_CONNECT				= 1300,	/* connects a socket to the other endpoint */
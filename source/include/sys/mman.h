@@ -40,6 +40,8 @@ enum {
 	MAP_POPULATE		= 32UL,		/* fault-in all pages at the beginning */
 	MAP_NOSWAP			= 64UL,		/* if not enough memory for the mapping, don't swap but fail */
 	MAP_FIXED			= 128UL,	/* put the region exactly at the given address */
+	MAP_RANDOM			= 4096UL,	/* the region is accessed randomly, i.e. don't read ahead */
+	MAP_SEQUENTIAL		= 8192UL,	/* the region is accessed sequentially, i.e. read ahead a lot */
 
 	MAP_PHYS_ALLOC		= 0,		/* allocate physical memory */
 	MAP_PHYS_MAP		= 1,		/* map the specified physical memory */
@@ -113,6 +115,20 @@ static inline int mattr(uintptr_t phys,size_t bytes,int attr) {
 	return syscall3(SYSCALL_MATTR,phys,bytes,attr);
 }
 
+/**
+ * Determines the physical addresses of the pages <addr> .. <addr> + <count> * PAGE_SIZE - 1. The
+ * pages have to be in one locked region (see mlock), so that they can be used for DMA. Only root
+ * may do that, because physical addresses help to attack the system.
+ *
+ * @param addr the virtual address (page aligned)
+ * @param phys the array of <count> physical addresses to fill
+ * @param count the number of pages
+ * @return 0 on success
+ */
+static inline int virt2phys(const void *addr,uintptr_t *phys,size_t count) {
+	return syscall3(SYSCALL_VIRT2PHYS,(ulong)addr,(ulong)phys,count);
+}
+
 /**
  * Changes the protection of the region denoted by the given address.
  *
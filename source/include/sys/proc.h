@@ -38,9 +38,7 @@ extern char **environ;
 /**
  * @return the process-id
  */
-static inline pid_t getpid(void) {
-	return syscall0(SYSCALL_PID);
-}
+pid_t getpid(void);
 
 /**
  * @return the parent-pid of the current process
@@ -29,20 +29,37 @@ enum {
 };
 
 typedef struct {
+	// the value of the semaphore. threads wait on it as a futex
+	volatile long value;
+	// the number of threads that are about to wait
+	volatile long waiters;
+#if defined(__eco32__)
+	// eco32 has no atomic instructions and therefore blocks on a kernel-semaphore
 	int sem;
-	long value;
+#endif
 } tUserSem;
 
+#if defined(__eco32__)
 typedef struct {
-	// semaphore for blocking
+	// semaphore for blocking; -1 if not created yet
 	int sem;
 	// -1 if somebody writes, >0 if we're reading
-	volatile int count;
+	volatile long count;
 	// the number of waiters
-	int waits;
+	long waits;
 	// for accessing the members of this structure
 	tUserSem mutex;
 } tRWLock;
+#else
+typedef struct {
+	// -1 if somebody writes, >0 if we're reading. threads wait on it as a futex
+	volatile long count;
+	// the number of writers that want to have the lock
+	volatile long writers;
+	// the number of threads that are about to wait
+	volatile long waits;
+} tRWLock;
+#endif
 
 #if defined(__cplusplus)
 extern "C" {
@@ -90,10 +107,36 @@ static inline void semdestr(int id) {
 	syscall1(SYSCALL_SEMDESTROY,id);
 }
 
+/**
+ * Lets the current thread wait until somebody calls futexwake() for <addr>, if *<addr> is still
+ * equal to <val>. The check and the wait are atomic with respect to futexwake(). Futexes are
+ * identified by the physical address, so that they work across processes in shared memory.
+ * Note that the wait might end spuriously, so that the caller has to check the condition again.
+ *
+ * @param addr the address of the futex (long-aligned)
+ * @param val the expected value
+ * @return 0 if waked up, -EWOULDBLOCK if *<addr> != <val>, -EINTR if a signal arrived or
+ *  another negative error-code
+ */
+static inline int futexwait(volatile long *addr,long val) {
+	return syscall2(SYSCALL_FUTEXWAIT,(ulong)addr,val);
+}
+
+/**
+ * Wakes up one or all threads that wait on the futex <addr>.
+ *
+ * @param addr the address of the futex (long-aligned)
+ * @param all whether all threads should be waked up
+ * @return 0 on success
+ */
+static inline int futexwake(volatile long *addr,bool all) {
+	return syscall2(SYSCALL_FUTEXWAKE,(ulong)addr,all);
+}
+
 /**
  * Initializes a user-semaphore, which is optimized for the non-contention case. In most cases, the
- * up/down operation will only perform a atomic increment/decrement and only in the contention-case
- * a kernel-semaphore is used for blocking. That is, the implementation is based on sem*.
+ * up/down operation will only perform an atomic operation in user space and only in the
+ * contention-case, futexwait() and futexwake() are used for blocking.
  *
  * @param sem the semaphore
  * @param val the initial value
@@ -134,7 +177,9 @@ static inline void usemdestr(tUserSem *sem);
 
 /**
  * Creates a readers-writer lock. Multiply readers can use the lock in parallel, while a writer
- * always has to be alone.
+ * always has to be alone. Like user-semaphores, it is based on futexes and only calls the kernel
+ * in the contention-case (except on eco32, which uses kernel-semaphores). Waiting writers are
+ * preferred over new readers.
  *
  * @param l the lock
  * @return 0 on success
@@ -149,6 +194,15 @@ int rwcrt(tRWLock *l);
  */
 void rwreq(tRWLock *l,int op);
 
+/**
+ * Tries to request the given readers-writer-lock for <op>, without blocking.
+ *
+ * @param l the lock
+ * @param op the operation (RW_READ or RW_WRITE)
+ * @return true if the lock has been taken
+ */
+bool rwtryreq(tRWLock *l,int op);
+
 /**
  * Releases the given readers-writer-lock again for <op>.
  *
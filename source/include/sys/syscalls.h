@@ -114,6 +114,9 @@ enum {
 	SYSCALL_UTIME,
 	SYSCALL_TRUNCATE,
 	SYSCALL_SYMLINK,
+	SYSCALL_VIRT2PHYS,
+	SYSCALL_FUTEXWAIT,
+	SYSCALL_FUTEXWAKE,
 #	ifdef __x86__
 	SYSCALL_REQIOPORTS,
 	SYSCALL_RELIOPORTS,
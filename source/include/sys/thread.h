@@ -34,9 +34,7 @@ extern "C" {
 /**
  * @return the id of the current thread
  */
-static inline tid_t gettid(void) {
-	return syscall0(SYSCALL_GETTID);
-}
+tid_t gettid(void);
 
 /**
  * Starts a new thread
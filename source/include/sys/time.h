@@ -40,11 +40,7 @@ static inline uint64_t rdtsc(void);
  * @param tsc the TSC value
  * @return the number of microseconds
  */
-static inline uint64_t tsctotime(uint64_t tsc) {
-	uint64_t tmp = tsc;
-	syscall1(SYSCALL_TSCTOTIME,(ulong)&tmp);
-	return tmp;
-}
+uint64_t tsctotime(uint64_t tsc);
 
 /**
  * Determines the number of cycles for the given number of microseconds
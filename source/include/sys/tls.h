@@ -20,6 +20,7 @@
 #pragma once
 
 #include <sys/common.h>
+#include <sys/vdso.h>
 #include <assert.h>
 
 #if defined(__x86__)
@@ -30,7 +31,7 @@
 #	include <sys/arch/mmix/tls.h>
 #endif
 
-#define MAX_TLS_ENTRIES		4
+#define MAX_TLS_ENTRIES		8
 
 #if defined(__cplusplus)
 extern "C" {
@@ -45,7 +46,7 @@ extern long __tls_num;
  * @return the value
  */
 static inline ulong tlsget(size_t idx) {
-	ulong *tls = *(ulong**)stack_top(2);
+	ulong *tls = *(ulong**)stack_top(STACK_TOP_TLS);
 	assert(idx < (size_t)__tls_num);
 	return tls[idx];
 }
@@ -64,7 +65,7 @@ size_t tlsadd(void);
  * @param val the value
  */
 static inline void tlsset(size_t idx,ulong val) {
-	ulong *tls = *(ulong**)stack_top(2);
+	ulong *tls = *(ulong**)stack_top(STACK_TOP_TLS);
 	assert(idx < (size_t)__tls_num);
 	tls[idx] = val;
 }
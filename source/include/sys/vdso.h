@@ -0,0 +1,47 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/common.h>
+
+/* the slots at the top of each user-stack (see stack_top()) */
+#define STACK_TOP_ERRNO			1
+#define STACK_TOP_TLS			2
+#define STACK_TOP_TID			3
+#define STACK_TOP_PID			4
+#define STACK_TOP_VDSO			5
+
+/* the clock-fields in sVDSOData are valid */
+#define VDSO_CLOCK				0x1
+
+/**
+ * The data in the vDSO page, which is maintained by the kernel and mapped read-only into every
+ * process. The kernel increments <seq> before and after every update, so that readers can detect
+ * concurrent updates: they have to retry if <seq> is odd or has changed while reading.
+ */
+typedef struct {
+	volatile uint32_t seq;
+	uint32_t flags;
+	/* the TSC value and the unix-timestamp at boot */
+	uint64_t bootTSC;
+	uint64_t bootTime;
+	/* the number of TSC ticks per microsecond */
+	uint64_t tscPerUs;
+} sVDSOData;
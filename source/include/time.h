@@ -65,9 +65,7 @@ clock_t clock(void);
  * @param tv the destination
  * @return 0 on success
  */
-static inline int gettimeofday(struct timeval *tv) {
-	return syscall1(SYSCALL_GETTOD,(ulong)tv);
-}
+int gettimeofday(struct timeval *tv);
 
 /**
  * Calculates the difference in seconds between time1 and time2.
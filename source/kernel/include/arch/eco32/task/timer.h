@@ -49,6 +49,10 @@ inline void TimerBase::getTimeval(struct timeval *tv) {
 	tv->tv_usec = time % 1000;
 }
 
+inline uint64_t TimerBase::getUptime() {
+	return elapsedUsecs;
+}
+
 inline void TimerBase::archInit() {
 	uint *regs = (uint*)Timer::TIMER_BASE;
 	/* set frequency */
@@ -63,6 +67,10 @@ inline void Timer::ackIntrpt() {
 	regs[REG_CTRL] = CTRL_IEN;
 }
 
+inline void TimerBase::archProgram(A_UNUSED uint64_t deadline) {
+	/* we only have a periodic timer */
+}
+
 inline uint64_t TimerBase::cyclesToTime(uint64_t cycles) {
 	return cycles / (CPU::getSpeed() / 1000000);
 }
@@ -37,3 +37,9 @@ inline void UEnvBase::handleSignal(Thread *t,IntrptStackFrame *stack) {
 	if(Signals::checkAndStart(t,&sig,&handler))
 		UEnv::startSignalHandler(t,stack,sig,handler);
 }
+
+inline void UEnvBase::setThreadInfo(Thread *t) {
+	ulong *top;
+	t->getStackRange(NULL,(uintptr_t*)&top,0);
+	writeThreadInfo(t,top);
+}
@@ -123,6 +123,11 @@ inline frameno_t PageDirBase::getFrameNo(uintptr_t virt) const {
 	return PTE_FRAMENO(pte);
 }
 
+inline bool PageDirBase::testAndClearAccessed(A_UNUSED uintptr_t virt) {
+	/* not supported by the hardware */
+	return false;
+}
+
 inline uintptr_t PageDirBase::getAccess(frameno_t frame) {
 	return frame * PAGE_SIZE | DIR_MAP_AREA;
 }
@@ -37,6 +37,7 @@
 #define PTE_NOTSUPER				0
 #define PTE_GLOBAL					0
 #define PTE_NO_EXEC					0
+#define PTE_ACCESSED				0		/* not supported by the hardware */
 
 /*
  * PTE:
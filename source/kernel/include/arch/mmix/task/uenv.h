@@ -37,3 +37,10 @@ inline void UEnvBase::handleSignal(Thread *t,A_UNUSED IntrptStackFrame *stack) {
 	if(Signals::checkAndStart(t,&sig,&handler))
 		UEnv::startSignalHandler(t,sig,handler);
 }
+
+inline void UEnvBase::setThreadInfo(Thread *t) {
+	/* the slots are at the top of the software-stack */
+	ulong *top;
+	t->getStackRange(NULL,(uintptr_t*)&top,1);
+	writeThreadInfo(t,top);
+}
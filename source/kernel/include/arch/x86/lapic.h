@@ -121,7 +121,12 @@ public:
 		write(REG_TASK_PRIO,0x10);
 		write(REG_TIMER_DCR,0x3);	// set divider to 16
 	}
-	static void enableTimer();
+	/**
+	 * Enables the timer in one-shot mode
+	 *
+	 * @param tscDeadline whether to use the TSC-deadline mode
+	 */
+	static void enableOneShotTimer(bool tscDeadline);
 
 	static void sendIPITo(cpuid_t id,uint8_t vector) {
 		writeIPI(id << 24,ICR_DESTSHORT_NO | ICR_LEVEL_ASSERT |
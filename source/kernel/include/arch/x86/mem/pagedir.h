@@ -56,8 +56,28 @@ class PageDir : public PageDirBase {
 		uintptr_t _end;
 	};
 
+#if defined(__x86_64__)
+	/* the number of PCIDs each CPU uses for the page-directories (PCID 0 is not used) */
+	static const size_t PCID_COUNT		= 16;
+	/* don't flush the TLB-entries of the PCID when loading CR3 */
+	static const uintptr_t CR3_NOFLUSH	= 1UL << 63;
+
+	struct PCIDSlot {
+		const PageDir *pdir;
+		ulong gen;
+	};
+	struct PCIDState {
+		PCIDSlot slots[PCID_COUNT];
+		size_t next;
+	};
+#endif
+
 public:
-	explicit PageDir() : PageDirBase(), freeKStack(), lock(), pts() {
+	explicit PageDir() : PageDirBase(), freeKStack(), lock(), pts()
+#if defined(__x86_64__)
+		, tlbGen()
+#endif
+	{
 	}
 
 	PageTables *getPageTables() {
@@ -73,6 +93,37 @@ public:
 	 */
 	static void enableNXE();
 
+#if defined(__x86_64__)
+	/**
+	 * Allocates the PCID-state for all CPUs and enables PCIDs on the BSP, if supported.
+	 */
+	static void initPCID();
+
+	/**
+	 * Enables PCIDs on the current CPU, if supported. Has to be called on every AP.
+	 */
+	static void enablePCID();
+#endif
+
+	/**
+	 * Determines the value for CR3 to switch to this page-directory on CPU <cpu>. On x86_64, each
+	 * CPU assigns PCIDs to the page-directories it runs, so that their TLB-entries survive the
+	 * switch. They are only flushed if this page-directory has been changed in the meantime.
+	 *
+	 * @param cpu the current CPU
+	 * @return the value for CR3
+	 */
+	uintptr_t getCR3(cpuid_t cpu);
+
+	/**
+	 * Invalidates the TLB-entries for <count> pages at <virt> on all other CPUs. The current CPU
+	 * has already done that for itself, if this is the current page-directory.
+	 *
+	 * @param virt the virtual address
+	 * @param count the number of pages
+	 */
+	void shootdown(uintptr_t virt,size_t count);
+
 	/**
 	* Creates a kernel-stack at an unused address.
 	*
@@ -101,11 +152,23 @@ private:
 	uintptr_t freeKStack;
 	SpinLock lock;
 	PageTables pts;
+#if defined(__x86_64__)
+	/* incremented on every change that requires a TLB-flush */
+	ulong tlbGen;
+
+	static PCIDState *pcids;
+#endif
 
 	static uintptr_t freeAreaAddr;
 	static uint8_t sharedPtbls[][PAGE_SIZE];
 };
 
+#if !defined(__x86_64__)
+inline uintptr_t PageDir::getCR3(A_UNUSED cpuid_t cpu) {
+	return getPhysAddr();
+}
+#endif
+
 inline void PageTables::flushAddr(uintptr_t addr,bool wasPresent) {
 	if(wasPresent)
 		asm volatile ("invlpg (%0)" : : "r" (addr));
@@ -145,6 +208,11 @@ inline frameno_t PageDirBase::getFrameNo(uintptr_t virt) const {
 	return pdir->pts.getFrameNo(virt);
 }
 
+inline bool PageDirBase::testAndClearAccessed(uintptr_t virt) {
+	PageDir *pdir = static_cast<PageDir*>(this);
+	return pdir->pts.testAndClearAccessed(virt);
+}
+
 inline void PageDirBase::zeroToUser(void *dst,size_t count) {
 	PageDir::setWriteProtection(false);
 	memclear(dst,count);
@@ -56,8 +56,16 @@ private:
 	static uint64_t bootTSC;
 	static time_t bootTime;
 	static uint64_t cpuMhz;
+	/* whether the LAPIC-timer uses the TSC-deadline mode */
+	static bool tscDeadline;
+	/* the frequency of the LAPIC-timer in Hz */
+	static uint64_t lapicHz;
 };
 
+inline uint64_t TimerBase::getUptime() {
+	return cyclesToTime(CPU::rdtsc() - Timer::bootTSC);
+}
+
 inline void TimerBase::getTimeval(struct timeval *tv) {
 	uint64_t tsc = CPU::rdtsc();
 	uint64_t usecs = cyclesToTime(tsc - Timer::bootTSC);
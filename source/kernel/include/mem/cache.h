@@ -28,6 +28,12 @@ class OStream;
 class Cache {
 	Cache() = delete;
 
+	/* the number of size-classes */
+	static const size_t CACHE_COUNT		= 11;
+	/* the max. number of objects and bytes in a per-CPU magazine */
+	static const size_t MAG_SIZE		= 32;
+	static const size_t MAG_BYTES		= 16 * 1024;
+
 	struct Entry {
 		const size_t objSize;
 		size_t totalObjs;
@@ -35,7 +41,31 @@ class Cache {
 		void *freeList;
 	};
 
+	/**
+	 * A magazine holds free objects of one size-class for one CPU. Thus, allocations and frees
+	 * can usually be served without touching the shared freelists. Its lock is only taken by
+	 * the owning CPU (except during the startup of the APs, where they might use the magazines
+	 * of the BSP) and is therefore practically never contended.
+	 */
+	struct Magazine {
+		SpinLock lock;
+		size_t count;
+		void *objs[MAG_SIZE];
+		ulong hits;
+		ulong misses;
+	};
+
+	struct CPUCache {
+		Magazine mags[CACHE_COUNT];
+	};
+
 public:
+	/**
+	 * Creates the per-CPU magazines. Before that, all requests are served by the shared
+	 * freelists.
+	 */
+	static void init();
+
 	/**
 	 * Allocates <size> bytes from the cache
 	 *
@@ -111,12 +141,21 @@ public:
 
 private:
 	static size_t totalObjSize(size_t sz);
+	static size_t magCapacity(size_t objSize);
+	static Magazine *getMagazine(size_t i);
+	static size_t getMagazineObjs(size_t i);
 	static void printBar(OStream &os,size_t mem,size_t maxMem,size_t total,size_t free);
 	static void *get(Entry *c,size_t i);
+	static ulong *getArea(Entry *c,size_t i);
+	static void putArea(Entry *c,ulong *area);
+	static void refill(Entry *c,size_t i,Magazine *m);
+	static void drain(Entry *c,Magazine *m,size_t count);
 
 #if DEBUGGING
 	static bool aafEnabled;
 #endif
 	static SpinLock lock;
-	static Entry caches[];
+	static Entry caches[CACHE_COUNT];
+	static CPUCache *cpuCaches;
+	static size_t cpuCount;
 };
@@ -19,21 +19,20 @@
 
 #pragma once
 
-#include <esc/col/slist.h>
+#include <mem/physmem.h>
 #include <task/proc.h>
 #include <common.h>
+#include <spinlock.h>
 
+/**
+ * Copy-on-write keeps the number of users of a shared frame in the frame metadata of PhysMem.
+ * Thus, all operations are O(1) and don't need to allocate memory. The frames are protected by
+ * a fixed number of locks, which are selected by the frame-number.
+ */
 class CopyOnWrite {
 	CopyOnWrite() = delete;
 
-	struct Entry : public esc::SListItem {
-		explicit Entry(frameno_t frameNo) : esc::SListItem(), frameNumber(frameNo), refCount(0) {
-		}
-		frameno_t frameNumber;
-		size_t refCount;
-	};
-
-	static const size_t HEAP_SIZE	= 64;
+	static const size_t LOCK_COUNT	= 64;
 
 public:
 	/**
@@ -64,22 +63,25 @@ public:
 	static size_t remove(frameno_t frameNo,bool *foundOther);
 
 	/**
-	 * Note that this is intended for debugging or similar only! (not very efficient)
-	 *
 	 * @return the number of different frames that are in the cow-list
 	 */
-	static size_t getFrmCount();
+	static size_t getFrmCount() {
+		return frameCount;
+	}
 
 	/**
-	 * Prints the cow-list
+	 * Prints the cow-list. Note that this walks through the metadata of all frames.
 	 *
 	 * @param os the output-stream
 	 */
 	static void print(OStream &os);
 
 private:
-	static Entry *getByFrame(frameno_t frameNo,bool dec);
+	static SpinLock *getLock(frameno_t frameNo) {
+		return locks + (frameNo % LOCK_COUNT);
+	}
+	static PhysMem::Frame *release(frameno_t frameNo);
 
-	static esc::SList<Entry> frames[];
-	static SpinLock lock;
+	static SpinLock locks[];
+	static size_t frameCount;
 };
@@ -47,10 +47,13 @@ enum {
 
 class PageDir;
 class OStream;
+class TLBBatch;
 
 class PageDirBase {
+	friend class TLBBatch;
+
 protected:
-	explicit PageDirBase() {
+	explicit PageDirBase() : tlbBatch() {
 	}
 
 public:
@@ -181,6 +184,15 @@ public:
 	 */
 	frameno_t getFrameNo(uintptr_t virt) const;
 
+	/**
+	 * Determines whether the given page has been accessed since the last call and resets that
+	 * information. This is used to find pages that have not been used recently.
+	 *
+	 * @param virt the virtual address
+	 * @return true if it has been accessed (always false if the hardware does not track that)
+	 */
+	bool testAndClearAccessed(uintptr_t virt);
+
 	/**
 	 * Clones <count> pages at <virtSrc> to <virtDst> from <this> into <dst>. That means
 	 * the flags and frames are copied. Additionally, if <share> is false all present pages will
@@ -230,6 +242,16 @@ public:
 	 * @param parts the parts to print
 	 */
 	void print(OStream &os,uint parts) const;
+
+	/**
+	 * @return the TLBBatch that is currently active for this page-directory (or NULL)
+	 */
+	TLBBatch *getTLBBatch() const {
+		return tlbBatch;
+	}
+
+private:
+	TLBBatch *tlbBatch;
 };
 
 #if defined(__x86__)
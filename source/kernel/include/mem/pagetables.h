@@ -22,6 +22,7 @@
 #include <mem/physmem.h>
 #include <mem/layout.h>
 #include <assert.h>
+#include <atomic.h>
 #include <common.h>
 #include <cppsupport.h>
 
@@ -221,6 +222,24 @@ public:
 		return PTE_FRAMENO(*pte) + (virt - base) / PAGE_SIZE;
 	}
 
+	/**
+	 * Determines whether the given page has been accessed since the last call and resets that
+	 * information. Note that the TLB is not flushed, i.e. accesses via cached translations are
+	 * not noticed. If the hardware does not track accesses, it always returns false.
+	 *
+	 * @param virt the virtual address
+	 * @return true if it has been accessed
+	 */
+	bool testAndClearAccessed(uintptr_t virt) {
+		uintptr_t base;
+		pte_t *pte = getPTE(virt,&base);
+		if(!PTE_ACCESSED || !pte || !(*pte & PTE_ACCESSED))
+			return false;
+		/* the CPU might set the dirty bit concurrently */
+		Atomic::fetch_and_and(pte,~(pte_t)PTE_ACCESSED);
+		return true;
+	}
+
 	/**
 	 * Clones <count> pages at <virtSrc> to <virtDst> from <this> into <dst>. That means
 	 * the flags and frames are copied. Additionally, if <share> is false all present pages will
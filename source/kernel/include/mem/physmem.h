@@ -59,15 +59,25 @@ class PhysMem {
 	static const size_t BITS_PER_BMWORD				= sizeof(tBitmap) * 8;
 	static const ulong KERNEL_MEM_PERCENT			= 20;
 	static const ulong KERNEL_MEM_MIN				= 750;
-	static const ulong MAX_SWAP_AT_ONCE				= 10;
 	static const ulong SWAPIN_JOB_COUNT				= 64;
-	/* the amount of memory at which we should start to set the region-timestamp */
-	static const size_t REG_TS_BEGIN				= 4 * 1024 * PAGE_SIZE;
+	/* the number of user frames each CPU keeps and how many are moved to/from the stack at once */
+	static const size_t FRAME_CACHE_SIZE			= 64;
+	static const size_t FRAME_CACHE_BATCH			= 32;
 
 	static const int OPEN_RETRIES					= 1000;
 
+	struct FrameCache {
+		SpinLock lock;
+		size_t count;
+		frameno_t frames[FRAME_CACHE_SIZE];
+		ulong refills;
+		ulong drains;
+	};
+
 public:
 	static const frameno_t INVALID_FRAME			= -1;
+	/* the max. number of pages that are swapped out at once */
+	static const ulong MAX_SWAP_AT_ONCE				= 64;
 
 	enum MemType {
 		CONT	= 1,
@@ -84,11 +94,36 @@ public:
 		MATTR_WC	= 1 << 0,
 	};
 
+	/**
+	 * The metadata of a physical frame. There is one entry for every frame up to the highest
+	 * available one, so that it can be found in O(1) by the frame-number.
+	 * Swapping keeps its state elsewhere, because a swapped-out page has no frame: the swap-block
+	 * of a page is stored in its Region and the SwapMap counts the users of each swap-block. The
+	 * reclaimer takes the accessed-bits from the page tables. ShFiles maps files to processes and
+	 * does not refer to frames either.
+	 */
+	struct Frame {
+		enum {
+			/* the frame is shared copy-on-write (refs is the number of users) */
+			COW		= 1 << 0,
+		};
+
+		uint32_t refs;
+		uint16_t flags;
+		/* the number of threads that wait on a futex in this frame (see Futex) */
+		uint16_t waiters;
+	};
+
 	/**
 	 * Initializes the memory-management
 	 */
 	static void init();
 
+	/**
+	 * Initializes the per-CPU frame caches. Has to be done after SMP::init().
+	 */
+	static void initCPUCaches();
+
 	/**
 	 * @return the total amount of memory
 	 */
@@ -115,6 +150,14 @@ public:
 	 */
 	static int setAttributes(uintptr_t addr,size_t size,uint attr);
 
+	/**
+	 * @param frame the frame-number
+	 * @return the metadata of the given frame or NULL if the frame is not managed by us
+	 */
+	static Frame *getFrame(frameno_t frame) {
+		return frame < frameCount ? frames + frame : NULL;
+	}
+
 	/**
 	 * @return the number of bytes used for the mm-stack
 	 */
@@ -136,13 +179,6 @@ public:
 	 */
 	static size_t getFreeFrames(uint types);
 
-	/**
-	 * Determines whether the region-timestamp should be set (depending on the still available memory)
-	 *
-	 * @return true if so
-	 */
-	static bool shouldSetRegTimestamp();
-
 	/**
 	 * Allocates <count> contiguous frames from the MM-bitmap
 	 *
@@ -185,6 +221,17 @@ public:
 	 */
 	static frameno_t allocate(FrameType type);
 
+	/**
+	 * Allocates up to <count> user frames at once. They are taken from the cache of the current CPU
+	 * and, if that is not sufficient, from the stack. Assumes that the frames have been announced
+	 * with reserve() first.
+	 *
+	 * @param count the number of frames
+	 * @param frames the array to store the frame-numbers in
+	 * @return the number of allocated frames
+	 */
+	static size_t allocate(size_t count,frameno_t *frames);
+
 	/**
 	 * Frees the given frame
 	 *
@@ -240,6 +287,14 @@ private:
 	static frameno_t allocFrame(bool forceLower);
 	static void freeFrame(frameno_t frame);
 	static size_t getFreeDef();
+	static size_t getFreeUser();
+	static frameno_t allocUserFrame();
+	static bool isCacheable(frameno_t frame);
+	static FrameCache *getFrameCache();
+	static size_t getCachedFrames();
+	static void refill(FrameCache *fc,size_t count);
+	static void drain(FrameCache *fc,size_t count);
+	static void flushCaches();
 	static void markRangeUsed(uintptr_t from,uintptr_t to,bool used);
 	static void doMarkRangeUsed(uintptr_t from,uintptr_t to,bool used);
 	static void markUsed(frameno_t frame,bool used);
@@ -249,6 +304,10 @@ private:
 
 	static size_t totalMem;
 
+	/* the metadata for all frames below frameCount */
+	static Frame *frames;
+	static size_t frameCount;
+
 	/* the bitmap for the frames of the lowest few MB; 0 = free, 1 = used */
 	static tBitmap *bitmap;
 	static uintptr_t bitmapStart;
@@ -261,6 +320,10 @@ private:
 	static StackFrames upper;
 	static SpinLock defLock;
 
+	/* per-CPU caches of user frames; lock order: cache, defLock */
+	static FrameCache *frameCaches;
+	static size_t cpuCount;
+
 	static bool initialized;
 
 	/* for swapping */
@@ -279,11 +342,3 @@ private:
 	static SwapInJob *siJobEnd;
 	static size_t jobWaiters;
 };
-
-inline bool PhysMem::shouldSetRegTimestamp() {
-	if(!swapEnabled)
-		return false;
-
-	LockGuard<SpinLock> g(&defLock);
-	return getFreeDef() * PAGE_SIZE < REG_TS_BEGIN;
-}
@@ -41,6 +41,8 @@ enum {
 	RF_NOFREE			= 512UL,	/* means that the memory should not be free'd on release */
 	RF_WRITABLE			= 1024UL,
 	RF_EXECUTABLE		= 2048UL,
+	RF_RANDOM			= 4096UL,	/* don't read ahead on page-faults */
+	RF_SEQUENTIAL		= 8192UL,	/* always read ahead as much as possible */
 };
 
 class OStream;
@@ -48,6 +50,10 @@ class VirtMem;
 class OpenFile;
 
 class Region : public CacheAllocatable {
+	/* the min. and max. number of pages that are loaded at once from the file */
+	static const size_t RA_MIN		= 4;
+	static const size_t RA_MAX		= 32;
+
 public:
 	typedef esc::ISList<VirtMem*>::iterator iterator;
 
@@ -143,16 +149,6 @@ public:
 	size_t getPageCount() const {
 		return pfSize;
 	}
-	/**
-	 * @return the timestamp of last usage (for swapping)
-	 */
-	uint64_t getTimestamp() const {
-		return timestamp;
-	}
-	void setTimestamp(uint64_t ts) {
-		timestamp = ts;
-	}
-
 	/**
 	 * @return the flags of the given page
 	 */
@@ -163,6 +159,18 @@ public:
 		pageFlags[page] = flags;
 	}
 
+	/**
+	 * Determines the number of pages that should be loaded from the file for a page-fault at
+	 * page <page> and updates the readahead-state. If the faults hit the region sequentially,
+	 * the window grows up to RA_MAX pages, otherwise it falls back to RA_MIN pages. RF_RANDOM
+	 * and RF_SEQUENTIAL override that.
+	 * Expects that the region is locked.
+	 *
+	 * @param page the page that has been accessed
+	 * @return the max. number of pages to load, beginning at <page>
+	 */
+	size_t readahead(size_t page);
+
 	/**
 	 * @return begin/end for the virtmem objects that use this region
 	 */
@@ -254,7 +262,9 @@ private:
 	off_t offset;
 	size_t loadCount;
 	size_t byteCount;
-	uint64_t timestamp;
+	/* the page at which we expect the next fault and the current readahead-window */
+	size_t raNext;
+	size_t raWindow;
 	size_t pfSize;			/* size of pageFlags */
 	ulong *pageFlags;		/* flags for each page; upper bits: swap-block, if swapped */
 	esc::ISList<VirtMem*> vms;
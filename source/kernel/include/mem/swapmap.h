@@ -25,14 +25,14 @@
 #include <lockguard.h>
 #include <spinlock.h>
 
+/**
+ * Manages the blocks of the swap-device. The reference count of a block is the number of regions
+ * whose page is stored in it. It is kept per block, not in PhysMem::Frame, because swapped-out
+ * pages have no frame.
+ */
 class SwapMap {
 	SwapMap() = delete;
 
-	struct Block {
-		uint refCount;
-		Block *next;
-	};
-
 public:
 	static const ulong INVALID 	= 0xFFFFFFFF;
 
@@ -49,7 +49,19 @@ public:
 	 *
 	 * @return the starting block on the swap-device or INVALID if no free space is left
 	 */
-	static ulong alloc();
+	static ulong alloc() {
+		size_t count = 1;
+		return alloc(&count);
+	}
+
+	/**
+	 * Allocates up to <*count> contiguous blocks on the swap-device. The search starts behind the
+	 * last allocation, so that consecutive allocations are likely to be adjacent on the device.
+	 *
+	 * @param count the max. number of blocks; will be set to the number of allocated blocks
+	 * @return the first block or INVALID if no free space is left
+	 */
+	static ulong alloc(size_t *count);
 
 	/**
 	 * Increases the references of the given block
@@ -95,19 +107,21 @@ public:
 private:
 	static size_t totalBlocks;
 	static size_t freeBlocks;
-	static Block *swapBlocks;
-	static Block *freeList;
+	/* the number of references for each block; 0 = free */
+	static uint *refCounts;
+	/* where to start searching for free blocks */
+	static size_t nextBlock;
 	static SpinLock lock;
 };
 
 inline void SwapMap::incRefs(ulong block) {
 	LockGuard<SpinLock> g(&lock);
-	assert(block < totalBlocks && swapBlocks[block].refCount > 0);
-	swapBlocks[block].refCount++;
+	assert(block < totalBlocks && refCounts[block] > 0);
+	refCounts[block]++;
 }
 
 inline bool SwapMap::isUsed(ulong block) {
 	LockGuard<SpinLock> g(&lock);
 	assert(block < totalBlocks);
-	return swapBlocks[block].refCount > 0;
+	return refCounts[block] > 0;
 }
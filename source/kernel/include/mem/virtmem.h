@@ -51,9 +51,12 @@ enum {
 	MAP_FIXED			= 128UL,
 	MAP_NOMAP			= 256UL,		/* kernel-intern */
 	MAP_NOFREE			= RF_NOFREE,	/* kernel-intern */
+	MAP_RANDOM			= RF_RANDOM,
+	MAP_SEQUENTIAL		= RF_SEQUENTIAL,
 
 	MAP_USER_FLAGS		= MAP_SHARED | MAP_GROWABLE | MAP_GROWSDOWN | MAP_STACK |
- 							MAP_LOCKED | MAP_POPULATE | MAP_NOSWAP | MAP_FIXED,
+ 							MAP_LOCKED | MAP_POPULATE | MAP_NOSWAP | MAP_FIXED |
+ 							MAP_RANDOM | MAP_SEQUENTIAL,
 };
 
 enum {
@@ -71,6 +74,9 @@ class VirtMem : public esc::SListItem {
 	friend class ProcBase;
 
 public:
+	/* the max. number of pages that are written to or read from the swap-device at once */
+	static const size_t SWAP_CLUSTER	= 16;
+
 	/**
 	 * Tries to handle a page-fault for the given address. That means, loads a page on demand, zeros
 	 * it on demand, handles copy-on-write or swapping.
@@ -82,7 +88,9 @@ public:
 	static int pagefault(uintptr_t addr,bool write);
 
 	/**
-	 * Swaps <count> pages out. It searches for the best suited page to swap out.
+	 * Swaps <count> pages out. A clock-hand walks over the pages of all regions and chooses the
+	 * pages that have not been accessed since it passed them the last time. Runs of such pages
+	 * are written to consecutive swap-blocks with a single write.
 	 *
 	 * @param file the file to write to
 	 * @param count the number of pages to swap out
@@ -90,27 +98,20 @@ public:
 	static void swapOut(OpenFile *file,size_t count);
 
 	/**
-	 * Swaps the page at given address of the given process in.
+	 * Swaps the page at given address of the given process in. The neighbouring pages are swapped
+	 * in as well, if they are stored in the neighbouring swap-blocks.
 	 *
 	 * @param file the file to write to
 	 * @param t the thread that wants to swap the page in (and has reserved the frame to do so)
 	 * @param addr the address of the page to swap in
-	 * @return true on success
-	 */
-	static bool swapIn(OpenFile *file,Thread *t,uintptr_t addr);
-
-	/**
-	 * Sets the timestamp for all regions that are used by the given thread
-	 *
-	 * @param t the thread
-	 * @param timestamp the timestamp to set
+	 * @return the number of pages that have been swapped in
 	 */
-	static void setTimestamp(Thread *t,uint64_t timestamp);
+	static size_t swapIn(OpenFile *file,Thread *t,uintptr_t addr);
 
 	explicit VirtMem(Proc *p)
 		: proc(p), pagedir(), ownFrames(), sharedFrames(), swapped(), freeStackAddr(),
-		  dataAddr(), freemap(FREE_AREA_BEGIN,FREE_AREA_END - FREE_AREA_BEGIN), regtree(this),
-		  peakOwnFrames(), peakSharedFrames(), swapCount() {
+		  dataAddr(), vdsoAddr(), freemap(FREE_AREA_BEGIN,FREE_AREA_END - FREE_AREA_BEGIN), regtree(this),
+		  peakOwnFrames(), peakSharedFrames(), swapCount(), faultsAvoided() {
 	}
 
 	/**
@@ -159,6 +160,12 @@ public:
 	size_t getSwapCount() const {
 		return swapCount;
 	}
+	/**
+	 * @return the number of page-faults that have been avoided by loading multiple pages at once
+	 */
+	ulong getFaultsAvoided() const {
+		return faultsAvoided;
+	}
 
 	/**
 	 * Adds a region for physical memory mapped into the virtual memory (e.g. for vga text-mode or DMA).
@@ -171,6 +178,21 @@ public:
 	 */
 	uintptr_t mapphys(uintptr_t *phys,size_t bCount,size_t align,int flags);
 
+	/**
+	 * Maps the vDSO page read-only into the virtual memory. The region is shared and survives
+	 * fork, but is removed on exec as all other regions.
+	 *
+	 * @return 0 on success or a negative error-code
+	 */
+	int mapVDSO();
+
+	/**
+	 * @return the address of the vDSO-region or 0 if it isn't mapped
+	 */
+	uintptr_t getVDSOAddr() const {
+		return vdsoAddr;
+	}
+
 	/**
 	 * Maps a region to this VM.
 	 *
@@ -227,6 +249,35 @@ public:
 	 */
 	size_t getMemUsage(size_t *pages) const;
 
+	/**
+	 * Determines the frames of the pages <virt> .. <virt> + <count> * PAGE_SIZE - 1. The pages
+	 * have to be in one locked region, so that the frames can't change afterwards.
+	 *
+	 * @param virt the virtual address (page aligned)
+	 * @param frames the array of <count> frames to fill
+	 * @param count the number of pages
+	 * @return 0 on success
+	 */
+	int getFrames(uintptr_t virt,frameno_t *frames,size_t count);
+
+	/**
+	 * Makes the page at <virt> present and writable, resolving copy-on-write if necessary, and
+	 * keeps this VM and the region locked until releaseFrame() is called. Thus, the frame can't
+	 * change in the meantime. This has to be the VM of the current process.
+	 *
+	 * @param virt the virtual address
+	 * @param frame will be set to the frame-number
+	 * @return 0 on success
+	 */
+	int acquireFrame(uintptr_t virt,frameno_t *frame);
+
+	/**
+	 * Releases the locks that acquireFrame() has acquired for <virt>.
+	 *
+	 * @param virt the virtual address
+	 */
+	void releaseFrame(uintptr_t virt);
+
 	/**
 	 * Gets the region at given address
 	 *
@@ -294,6 +345,28 @@ public:
 	 */
 	int join(uintptr_t srcAddr,VirtMem *dst,VMRegion **nvm,uintptr_t *dstVirt,ulong flags);
 
+	/**
+	 * Loans the frames of the <count> pages starting at the page-aligned address <addr> to the
+	 * kernel, instead of copying their content. The pages are marked copy-on-write, so that the
+	 * owner gets its own copy as soon as it writes to them. Fails if the pages are not present,
+	 * belong to a shared region or are not accessible via the direct-mapped area.
+	 *
+	 * @param addr the virtual address of the first page
+	 * @param count the number of pages
+	 * @param frames the array to store the frame-numbers in
+	 * @return 0 on success or the negative error-code
+	 */
+	int loanPages(uintptr_t addr,size_t count,frameno_t *frames);
+
+	/**
+	 * Gives the frames back that have been loaned by loanPages(). Frames that are not used by
+	 * anybody else anymore are free'd.
+	 *
+	 * @param frames the frames
+	 * @param count the number of frames
+	 */
+	static void releaseLoan(const frameno_t *frames,size_t count);
+
 	/**
 	 * Clones all regions of this virtmem (current) into the destination-virtmem
 	 *
@@ -384,11 +457,14 @@ private:
 		peakOwnFrames = ownFrames;
 		peakSharedFrames = sharedFrames;
 		swapCount = 0;
+		faultsAvoided = 0;
 	}
 
-	static Region *getLRURegion();
-	static ssize_t getPgIdxForSwap(const Region *reg);
-	static void setSwappedOut(Region *reg,size_t index);
+	static size_t reclaim(size_t count,size_t *clusters);
+	static size_t reclaimRegion(Region *reg,size_t page,size_t max,size_t *pages,size_t *clusters);
+	static bool isReclaimable(Region *reg,size_t page);
+	static bool isSwappedTo(const Region *reg,size_t page,ulong block);
+	static void setSwappedOut(Region *reg,size_t index,size_t count);
 	static void setSwappedIn(Region *reg,size_t index,frameno_t frameNo);
 
 	int lockRegion(VMRegion *vm,int flags);
@@ -398,7 +474,8 @@ private:
 	void doUnmap(VMRegion *vm);
 	size_t doGrow(VMRegion *vm,ssize_t amount);
 	int demandLoad(VMRegion *vm,uintptr_t addr);
-	int loadFromFile(VMRegion *vm,uintptr_t addr,size_t loadCount);
+	int loadFromFile(VMRegion *vm,uintptr_t addr);
+	void mapLoaded(VMRegion *vm,uintptr_t offset,frameno_t frame);
 	uintptr_t findFreeStack(size_t byteCount,ulong rflags);
 	bool isOccupied(uintptr_t start,uintptr_t end) const;
 	uintptr_t getFirstUsableAddr() const;
@@ -438,6 +515,8 @@ private:
 	uintptr_t freeStackAddr;
 	/* address of the data-region; required for chgsize */
 	uintptr_t dataAddr;
+	/* address of the vDSO-region; 0 if it isn't mapped */
+	uintptr_t vdsoAddr;
 	/* area-map for the free area */
 	VMFreeMap freemap;
 	/* the regions */
@@ -446,4 +525,11 @@ private:
 	ulong peakOwnFrames;
 	ulong peakSharedFrames;
 	ulong swapCount;
+	/* the number of page-faults that have been avoided by loading multiple pages at once */
+	ulong faultsAvoided;
+
+	/* the position of the clock-hand for swapping */
+	static VirtMem *clockVM;
+	static Region *clockReg;
+	static size_t clockPage;
 };
@@ -172,6 +172,7 @@ private:
 	static int mattr(Thread *t,IntrptStackFrame *stack);
 	static int mlock(Thread *t,IntrptStackFrame *stack);
 	static int mlockall(Thread *t,IntrptStackFrame *stack);
+	static int virt2phys(Thread *t,IntrptStackFrame *stack);
 
 	// proc
 	static int getpid(Thread *t,IntrptStackFrame *stack);
@@ -204,6 +205,8 @@ private:
 	static int semcrtirq(Thread *t,IntrptStackFrame *stack);
 	static int semop(Thread *t,IntrptStackFrame *stack);
 	static int semdestr(Thread *t,IntrptStackFrame *stack);
+	static int futexwait(Thread *t,IntrptStackFrame *stack);
+	static int futexwake(Thread *t,IntrptStackFrame *stack);
 
 	// other
 	static int init(Thread *t,IntrptStackFrame *stack);
@@ -41,15 +41,13 @@ public:
 	};
 
 	/**
-	 * Loads the program at given path from fs into the user-space
+	 * Loads the program at given path from fs into the user-space and maps the vDSO.
 	 *
 	 * @param file the executable to load
 	 * @param info various information about the loaded program
 	 * @return 0 on success
 	 */
-	static int load(OpenFile *file,StartupInfo *info) {
-		return doLoad(file,TYPE_PROG,info);
-	}
+	static int load(OpenFile *file,StartupInfo *info);
 
 	/**
 	 * Architecture-specific finish-actions when loading from file. DO NOT call it directly!
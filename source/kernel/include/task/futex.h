@@ -0,0 +1,70 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <common.h>
+
+class Thread;
+
+/**
+ * Futexes let threads wait until the long at a user address changes. A futex is identified by the
+ * physical address of the long, so that threads of different processes can use futexes in shared
+ * memory. While a thread waits on a futex, the frame of it is neither swapped out nor changed by
+ * copy-on-write without waking the thread. In user space, waits can always end spuriously.
+ */
+class Futex {
+	Futex() = delete;
+
+public:
+	/**
+	 * Lets <t> wait on the futex at <addr>, if it still has the value <val>. The check and the
+	 * wait are atomic with respect to wake().
+	 *
+	 * @param t the current thread
+	 * @param addr the address of the futex (long-aligned)
+	 * @param val the expected value
+	 * @return 0 if it has been waked up, -EWOULDBLOCK if the value differs, -EINTR if it has
+	 *  been interrupted or another negative error-code
+	 */
+	static int wait(Thread *t,USER long *addr,long val);
+
+	/**
+	 * Wakes up one or all threads that wait on the futex at <addr>.
+	 *
+	 * @param t the current thread
+	 * @param addr the address of the futex (long-aligned)
+	 * @param all whether all threads should be waked up
+	 * @return 0 on success
+	 */
+	static int wake(Thread *t,USER long *addr,bool all);
+
+	/**
+	 * Wakes up all threads that wait on a futex in the given frame. This is used if the frame
+	 * does no longer belong to the address the threads wait on.
+	 *
+	 * @param frame the frame-number
+	 */
+	static void wakeupFrame(frameno_t frame);
+
+private:
+	static evobj_t getKey(frameno_t frame,USER long *addr) {
+		return frame * PAGE_SIZE + ((uintptr_t)addr & (PAGE_SIZE - 1));
+	}
+};
@@ -36,7 +36,8 @@ enum {
 	EV_SWAP_FREE,
 	EV_THREAD_DIED,
 	EV_CHILD_DIED,
-	EV_COUNT = EV_CHILD_DIED,
+	EV_FUTEX,
+	EV_COUNT = EV_FUTEX,
 };
 
 class Thread;
@@ -74,11 +75,31 @@ public:
 	static void wakeup(uint event,evobj_t object,bool all = true);
 
 	/**
-	 * @return the current ready-mask. 1 bit per priority.
+	 * Wakes up all threads that wait for given event and an object in <begin> .. <end> - 1.
+	 * This walks through all wait-queues and should therefore only be used in rare cases.
+	 *
+	 * @param event the event
+	 * @param begin the first object
+	 * @param end the end of the object range
+	 * @return the number of waked up threads
 	 */
-	static ulong getReadyMask() {
-		return readyMask;
-	}
+	static size_t wakeupRange(uint event,evobj_t begin,evobj_t end);
+
+	/**
+	 * Returns the lock that CPU <cpu> has to hold while it switches from one thread to another.
+	 * As long as it is held, no other CPU steals threads from the run-queue of <cpu>, because
+	 * the state of the previous thread might not be saved yet.
+	 *
+	 * @param cpu the CPU
+	 * @return the switch-lock
+	 */
+	static SpinLock *getSwitchLock(cpuid_t cpu);
+
+	/**
+	 * @param cpu the CPU
+	 * @return the current ready-mask of the run-queue of <cpu>. 1 bit per priority.
+	 */
+	static ulong getReadyMask(cpuid_t cpu);
 
 	/**
 	 * Blocks the given thread
@@ -101,6 +122,13 @@ public:
 	 */
 	static void print(OStream &os);
 
+	/**
+	 * Prints the length, steal- and stolen-count of each per-CPU run-queue
+	 *
+	 * @param os the output-stream
+	 */
+	static void printQueueStats(OStream &os);
+
 	/**
 	 * Prints the event-lists
 	 *
@@ -115,6 +143,16 @@ public:
 	static const char *getEventName(uint event);
 
 private:
+	struct RunQueue;
+
+	struct WaitQueue {
+		SpinLock lock;
+		esc::DList<Thread> list;
+	};
+
+	/* the number of wait-queues; has to be a power of 2 */
+	static const size_t WAITQUEUE_COUNT	= 256;
+
 	/**
 	 * Adds the given thread as an idle-thread to the scheduler
 	 *
@@ -160,28 +198,60 @@ private:
 	 */
 	static void removeThread(Thread *t);
 
-	static void enqueue(Thread *t);
-	static void dequeue(Thread *t);
+	/**
+	 * Locks the run-queue the given thread belongs to. Since the thread might be migrated to
+	 * another run-queue until we have the lock, this is repeated until it is stable.
+	 *
+	 * @param t the thread
+	 * @return the locked run-queue
+	 */
+	static RunQueue *lockQueue(Thread *t);
+
+	/**
+	 * Locks the wait-queue the given thread is in (if any) and afterwards its run-queue. This is
+	 * required to remove the thread from its wait-queue.
+	 *
+	 * @param t the thread
+	 * @param wq will be set to the locked wait-queue (NULL if it doesn't wait)
+	 * @return the locked run-queue
+	 */
+	static RunQueue *lockThread(Thread *t,WaitQueue **wq);
+	static void unlockThread(RunQueue *rq,WaitQueue *wq);
+
+	/**
+	 * @param event the event
+	 * @param object the object
+	 * @return the wait-queue for given event and object
+	 */
+	static WaitQueue *getWaitQueue(uint event,evobj_t object) {
+		/* objects are usually aligned, so that we skip the lower bits */
+		size_t hash = (object >> 4) ^ (object >> 12) ^ (event * 31);
+		return waitQueues + (hash & (WAITQUEUE_COUNT - 1));
+	}
+
+	/**
+	 * Wakes up the thread(s) that wait for exactly <event> and <object>.
+	 *
+	 * @return true if a thread has been waked up
+	 */
+	static bool wakeupQueue(uint event,evobj_t object,bool all);
+
+	/**
+	 * Tries to steal a ready thread from the run-queue of another CPU
+	 *
+	 * @param cpu the CPU that wants to steal
+	 * @return the thread or NULL
+	 */
+	static Thread *steal(cpuid_t cpu);
+
+	static void enqueue(RunQueue *rq,Thread *t);
+	static void dequeue(RunQueue *rq,Thread *t);
+	static Thread *dequeueFirst(RunQueue *rq,Thread *old);
 	static void removeFromEventlist(Thread *t);
 	static bool setReadyState(Thread *t);
 	static void print(OStream &os,esc::DList<Thread> *q);
 
-	static SpinLock lock;
-	static ulong readyMask;
-	static esc::DList<Thread> rdyQueues[];
-	static esc::DList<Thread> evlists[EV_COUNT];
-	static size_t rdyCount;
-	static Thread **idleThreads;
+	static WaitQueue waitQueues[];
+	/* one run-queue per CPU */
+	static RunQueue *runQueues;
 };
-
-inline void Sched::block(Thread *t) {
-	assert(t != NULL);
-	LockGuard<SpinLock> g(&lock);
-	setBlocked(t);
-}
-
-inline void Sched::unblock(Thread *t) {
-	assert(t != NULL);
-	LockGuard<SpinLock> g(&lock);
-	setReady(t);
-}
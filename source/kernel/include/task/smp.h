@@ -22,6 +22,7 @@
 #include <esc/col/slist.h>
 #include <task/thread.h>
 #include <common.h>
+#include <spinlock.h>
 
 /* the IPIs we can send */
 #define IPI_WORK			51
@@ -34,20 +35,34 @@
 
 class Sched;
 class OStream;
+class TLBBatch;
 
 class SMPBase {
 	friend class Sched;
 	friend class ThreadBase;
+	friend class TLBBatch;
 
 	SMPBase() = delete;
 
 public:
 	typedef void (*callback_func)();
 
+	/* the max. number of ranges that are flushed individually */
+	static const size_t MAX_FLUSH_RANGES	= 8;
+	/* the max. number of pages that are flushed individually; above, the whole TLB is flushed */
+	static const size_t MAX_FLUSH_PAGES		= 32;
+
+	/* a range of pages whose TLB-entries should be invalidated */
+	struct FlushRange {
+		uintptr_t addr;
+		size_t pages;
+	};
+
 	struct CPU : public esc::SListItem {
 		explicit CPU(uint8_t id,bool bootstrap,uint8_t ready)
 			: esc::SListItem(), id(id), bootstrap(bootstrap), ready(ready), curCycles(), lastCycles(),
-			  lastTotal(), lastUpdate(), callback(), thread() {
+			  lastTotal(), lastUpdate(), callback(), thread(), flushLock(), flushAll(), flushPages(),
+			  flushCount(), flushRanges() {
 		}
 
 		uint8_t id;
@@ -59,6 +74,12 @@ public:
 		uint64_t lastUpdate;
 		callback_func callback;
 		Thread *thread;
+		/* the TLB-flushes that other CPUs have requested for this one */
+		SpinLock flushLock;
+		bool flushAll;
+		size_t flushPages;
+		size_t flushCount;
+		FlushRange flushRanges[MAX_FLUSH_RANGES];
 	};
 
 	typedef esc::SList<CPU>::iterator iterator;
@@ -131,12 +152,40 @@ public:
 	 */
 	static void wakeupCPU();
 
+	/**
+	 * Wakes up CPU <id>, if it is idling, because a thread has been put into its run-queue.
+	 * Otherwise, another idling CPU is woken up, so that it can steal the thread.
+	 *
+	 * @param id the CPU-id
+	 */
+	static void wakeupCPU(cpuid_t id);
+
 	/**
 	 * If there is any CPU that uses the given pagedir, it is flushed
 	 *
 	 * @param pdir the pagedir
 	 */
-	static void flushTLB(PageDir *pdir);
+	static void flushTLB(PageDir *pdir) {
+		flushTLB(pdir,NULL,0);
+	}
+
+	/**
+	 * Invalidates the TLB-entries for the given ranges on all other CPUs that use the given
+	 * pagedir. Each CPU gets at most one IPI, which flushes the ranges page by page or the whole
+	 * TLB, if there are too many pages. If a TLBBatch is active for <pdir>, the ranges are added to
+	 * it instead.
+	 *
+	 * @param pdir the pagedir
+	 * @param ranges the ranges (NULL = flush everything)
+	 * @param count the number of ranges
+	 */
+	static void flushTLB(PageDir *pdir,const FlushRange *ranges,size_t count);
+
+	/**
+	 * Performs the TLB-flushes that other CPUs have requested for the current CPU. This is called
+	 * by the IPI-handler.
+	 */
+	static void doFlushTLB();
 
 	/**
 	 * Calls the callback for CPU <id>
@@ -234,6 +283,8 @@ private:
 	}
 
 	static CPU *getCPUById(cpuid_t id);
+	static void sendFlushRequests(PageDir *pdir,const FlushRange *ranges,size_t count);
+	static void sendFlushRequest(CPU *cpu,const FlushRange *ranges,size_t count);
 
 	static bool enabled;
 	static esc::SList<CPU> cpuList;
@@ -249,6 +300,64 @@ private:
 #	include <arch/mmix/task/smp.h>
 #endif
 
+/**
+ * Collects the ranges of a page-directory whose TLB-entries have to be invalidated on other CPUs
+ * while it exists. All of them are flushed with a single IPI per CPU at the end. This is intended
+ * for operations that change many pages, one after another.
+ */
+class TLBBatch {
+public:
+	/**
+	 * Starts a batch for the given page-directory
+	 *
+	 * @param pdir the page-directory
+	 */
+	explicit TLBBatch(PageDir *pdir);
+
+	/**
+	 * Flushes the collected ranges and ends the batch
+	 */
+	~TLBBatch();
+
+	/**
+	 * @return the thread that started the batch
+	 */
+	const Thread *getOwner() const {
+		return _owner;
+	}
+
+	/**
+	 * Adds the given range to the batch
+	 *
+	 * @param addr the virtual address
+	 * @param pages the number of pages
+	 */
+	void add(uintptr_t addr,size_t pages);
+
+	/**
+	 * Lets the batch flush the whole TLB of the other CPUs
+	 */
+	void addAll() {
+		_all = true;
+	}
+
+	/**
+	 * Invalidates the TLB-entries for the collected ranges on other CPUs
+	 */
+	void flush();
+
+private:
+	TLBBatch(const TLBBatch&) = delete;
+	TLBBatch &operator=(const TLBBatch&) = delete;
+
+	PageDir *_pdir;
+	const Thread *_owner;
+	bool _active;
+	bool _all;
+	size_t _count;
+	SMPBase::FlushRange _ranges[SMPBase::MAX_FLUSH_RANGES];
+};
+
 inline void SMPBase::setReady(cpuid_t id) {
 	assert(cpus[id]);
 	cpus[id]->ready = true;
@@ -74,6 +74,7 @@ class ThreadBase : public esc::DListItem {
 	friend class Signals;
 	friend class Event;
 	friend class Terminator;
+	friend class TimerBase;
 
 	struct Stats {
 		/* number of microseconds of runtime this thread has got so far */
@@ -309,12 +310,12 @@ public:
 	}
 
 	/**
-	 * Tests whether there are other threads with a higher priority than this one.
+	 * Tests whether there are other threads on our CPU with a higher priority than this one.
 	 *
 	 * @return true if so
 	 */
 	bool haveHigherPrio() {
-		ulong mask = Sched::getReadyMask();
+		ulong mask = Sched::getReadyMask(cpu);
 		return mask & ~((1UL << (priority + 1)) - 1);
 	}
 
@@ -431,6 +432,7 @@ public:
 	 * Reserves <count> frames for this thread. That means, it swaps in memory, if
 	 * necessary and <swap> is true, allocates that frames and stores them in the thread.
 	 * You can get them later with getFrame(). You can free not needed frames with discardFrames().
+	 * If it fails, the frames that have been reserved previously are kept.
 	 *
 	 * @param count the number of frames to reserve
 	 * @param swap whether to swap or just return false if there is not enough
@@ -572,6 +574,8 @@ protected:
 	/* the next state it will receive on context-switch */
 	uint8_t newState;
 	cpuid_t cpu;
+	/* the CPU whose run-queue this thread belongs to */
+	cpuid_t runQueue;
 	/* the stack-region(s) for this thread */
 	VMRegion *stackRegions[STACK_REG_COUNT];
 	/* thread-directory in VFS */
@@ -584,6 +588,8 @@ protected:
 	 * reserved for this thread and have not yet been used */
 	esc::ISList<frameno_t> reqFrames;
 	Stats stats;
+	/* the entry in the timer wheel, if the thread sleeps */
+	TimerBase::Listener timer;
 
 private:
 	static esc::DList<ListItem> threads;
@@ -24,34 +24,71 @@
 #include <time.h>
 
 class OStream;
+class Thread;
 
+/**
+ * The timer keeps the sleeping threads in a hierarchical timer wheel per CPU. Each level has
+ * WHEEL_SLOTS slots; a slot on level l covers WHEEL_SLOTS^l microseconds. Listeners are put on the
+ * level on which their expiry time differs from the current time of the wheel and are moved to the
+ * lower levels as the time approaches. Thus, sleeps are microsecond-granular and the number of
+ * sleeping threads is unbounded, because every thread has its own listener.
+ *
+ * If the architecture supports it, the timer runs in one-shot mode: each CPU programs its timer
+ * for the next expiring listener or the end of the time-slice, whatever comes first. Otherwise, a
+ * periodic timer is used and all listeners are put on the wheel of CPU 0.
+ */
 class TimerBase {
+	friend class Timer;
+
 	TimerBase() = delete;
 
-	/* an entry in the listener-list */
+public:
+	/* an entry in the timer wheel. every thread has one */
 	struct Listener {
+		explicit Listener() : next(), pprev(), expires(), tid(), cpu(), block() {
+		}
+
+		Listener *next;
+		/* points to the previous next-pointer; NULL if not in the wheel */
+		Listener **pprev;
+		/* the time in microseconds since boot */
+		uint64_t expires;
 		tid_t tid;
-		/* difference to the previous listener */
-		time_t time;
+		/* the CPU whose wheel contains the listener */
+		cpuid_t cpu;
 		/* if true, the thread is blocked during that time. otherwise it can run and will not be waked
 		 * up, but gets a signal (SIGALRM) */
 		bool block;
-		Listener *next;
+	};
+
+private:
+	static const size_t WHEEL_BITS		= 6;
+	static const size_t WHEEL_SLOTS		= 1 << WHEEL_BITS;
+	static const size_t WHEEL_LEVELS	= 6;
+
+	struct Wheel {
+		SpinLock lock;
+		/* the time up to which the wheel has been processed */
+		uint64_t now;
+		/* a bitmap of the non-empty slots for each level */
+		uint64_t pending[WHEEL_LEVELS];
+		Listener *slots[WHEEL_LEVELS][WHEEL_SLOTS];
 	};
 
 	struct PerCPU {
-		/* total elapsed milliseconds */
-		time_t elapsedMsecs;
-		time_t lastResched;
+		Wheel wheel;
+		/* the time for which the timer is programmed (NO_DEADLINE if none) */
+		uint64_t deadline;
+		uint64_t lastResched;
 		size_t timerIntrpts;
 	};
 
-	static const size_t LISTENER_COUNT		= 1024;
+	static const uint64_t NO_DEADLINE	= ~0ULL;
 
 public:
-	/* timer period = 5ms */
+	/* timer period = 5ms, if the timer runs periodically */
 	static const unsigned FREQUENCY_DIV		= 200;
-	/* time-slice for a thread (60ms) */
+	/* time-slice for a thread (20ms) */
 	static const unsigned TIMESLICE			= ((1000 / FREQUENCY_DIV) * 4);
 
 	/**
@@ -59,6 +96,13 @@ public:
 	 */
 	static void init();
 
+	/**
+	 * @return true if the timer runs in one-shot mode
+	 */
+	static bool isTickless() {
+		return tickless;
+	}
+
 	/**
 	 * @return the number of timer-interrupts so far
 	 */
@@ -67,12 +111,17 @@ public:
 	}
 
 	/**
-	 * @return the kernel-internal timestamp; starts from zero, in milliseconds, increased by timer-irq
+	 * @return the kernel-internal timestamp; starts from zero, in milliseconds
 	 */
 	static time_t getRuntime() {
-		return perCPU[0].elapsedMsecs;
+		return getUptime() / 1000;
 	}
 
+	/**
+	 * @return the number of microseconds since boot
+	 */
+	static uint64_t getUptime();
+
 	/**
 	 * @return the UNIX timestamp
 	 */
@@ -100,15 +149,15 @@ public:
 	static uint64_t timeToCycles(uint us);
 
 	/**
-	 * Puts the given thread to sleep for the given number of milliseconds
+	 * Puts the given thread to sleep for the given number of microseconds
 	 *
 	 * @param tid the thread-id
-	 * @param msecs the number of milliseconds to wait
+	 * @param usecs the number of microseconds to wait
 	 * @param block whether to block the thread or not (if so, it will be waked up, otherwise it gets
 	 *  SIGALRM)
 	 * @return 0 on success
 	 */
-	static int sleepFor(tid_t tid,time_t msecs,bool block);
+	static int sleepFor(tid_t tid,uint64_t usecs,bool block);
 
 	/**
 	 * Removes the given thread from the timer
@@ -117,6 +166,16 @@ public:
 	 */
 	static void removeThread(tid_t tid);
 
+	/**
+	 * Starts a new time-slice on the given CPU. This is called on every thread-switch. In one-shot
+	 * mode, the timer is programmed for the end of the time-slice, unless <idle> is true. In this
+	 * case, the CPU is only interrupted for the next listener.
+	 *
+	 * @param cpu the current CPU
+	 * @param idle whether the CPU switches to its idle-thread
+	 */
+	static void startSlice(cpuid_t cpu,bool idle);
+
 	/**
 	 * Handles a timer-interrupt
 	 *
@@ -136,14 +195,24 @@ private:
 	 * Inits the architecture-dependent part of the timer
 	 */
 	static void archInit();
+	/**
+	 * Programs the timer of the current CPU to fire at <deadline> (in microseconds since boot).
+	 * Only used in one-shot mode.
+	 */
+	static void archProgram(uint64_t deadline);
+
+	static void program(cpuid_t cpu,uint64_t deadline);
+	static void enqueue(Wheel &w,Listener *l);
+	static void dequeue(Wheel &w,Listener *l);
+	static uint64_t nextEvent(const Wheel &w);
+	static bool expire(Wheel &w,uint64_t now);
+	static void printWheel(OStream &os,const Wheel &w);
 
-	static SpinLock lock;
+	static bool tickless;
 	static PerCPU *perCPU;
 	static time_t lastRuntimeUpdate;
-	static Listener listenObjs[LISTENER_COUNT];
-	static Listener *freeList;
-	/* processes that should be waked up to a specified time */
-	static Listener *listener;
+	/* the elapsed time, counted by CPU 0 in periodic mode, for architectures without a cycle-counter */
+	static uint64_t elapsedUsecs;
 };
 
 #if defined(__x86__)
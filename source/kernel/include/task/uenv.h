@@ -69,7 +69,16 @@ public:
 	 */
 	static void *setupThread(const void *arg,uintptr_t tentryPoint) asm("uenv_setupThread");
 
+	/**
+	 * Stores the thread-id, process-id and the vDSO-address of the given thread at the top of its
+	 * user-stack, where libc reads them from. This has to be done again in the child of fork.
+	 *
+	 * @param t the current thread
+	 */
+	static void setThreadInfo(Thread *t);
+
 protected:
+	static void writeThreadInfo(Thread *t,ulong *top);
 	static ulong *initProcStack(int argc,int envc,const char *args,size_t argsSize);
 	static ulong *initThreadStack(const void *arg,uintptr_t entry);
 	static char **copyArgs(int argc,const char *&args,ulong *&sp);
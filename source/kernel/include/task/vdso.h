@@ -0,0 +1,57 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#pragma once
+
+#include <sys/vdso.h>
+#include <common.h>
+
+/**
+ * The vDSO is a single page that is maintained by the kernel and mapped read-only into every
+ * process (see VirtMem::mapVDSO()). It publishes the clock base and the TSC frequency so that
+ * libc can answer time queries without entering the kernel.
+ */
+class VDSO {
+	VDSO() = delete;
+
+public:
+	/**
+	 * Allocates and clears the vDSO page
+	 */
+	static void init();
+
+	/**
+	 * @return the frame that contains the vDSO data
+	 */
+	static frameno_t getFrame() {
+		return frame;
+	}
+
+	/**
+	 * Publishes the given clock base. Readers that run concurrently will retry.
+	 *
+	 * @param bootTSC the TSC value at boot
+	 * @param bootTime the unix-timestamp at boot
+	 * @param tscPerUs the number of TSC ticks per microsecond
+	 */
+	static void setClock(uint64_t bootTSC,uint64_t bootTime,uint64_t tscPerUs);
+
+private:
+	static frameno_t frame;
+};
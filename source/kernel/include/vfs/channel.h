@@ -30,6 +30,8 @@ class VFSChannel : public VFSNode {
 
 	struct Message : public esc::SListItem {
 		static const size_t MAX_SIZE	= 256 * 1024;
+		/* page-aligned payloads of at least this size are loaned instead of copied */
+		static const size_t LOAN_SIZE	= 4 * PAGE_SIZE;
 
 		static void *operator new(size_t size, size_t msgSize) {
 			return Cache::alloc(size + msgSize);
@@ -38,11 +40,29 @@ class VFSChannel : public VFSNode {
 			Cache::free(ptr);
 		}
 
-		explicit Message(size_t _length) : esc::SListItem(), id(), length(_length) {
+		explicit Message(size_t _length,bool _loaned = false)
+			: esc::SListItem(), id(), length(_length), loaned(_loaned) {
 		}
+		~Message();
+
+		/**
+		 * @return the frames of the sender, if the payload is loaned
+		 */
+		frameno_t *frames() {
+			return reinterpret_cast<frameno_t*>(this + 1);
+		}
+
+		/**
+		 * Copies the payload to <dst>.
+		 *
+		 * @param dst the destination buffer
+		 * @return 0 on success
+		 */
+		int copyTo(USER void *dst);
 
 		msgid_t id;
 		size_t length;
+		bool loaned;
 	};
 
 public:
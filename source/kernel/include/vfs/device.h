@@ -82,12 +82,20 @@ public:
 	void chanRemoved(const VFSChannel *chan);
 
 	/**
-	 * Searches for a channel of this device-node that should be served
+	 * Searches for a channel of this device-node that should be served. If <file> has been put into
+	 * non-blocking mode, it behaves as if GW_NOBLOCK was given.
 	 *
+	 * @param file the device file
 	 * @param flags the flags (GW_*)
 	 * @return the fd for the channel to retrieve a message from or a an error if there is none
 	 */
-	int getWork(uint flags);
+	int getWork(const OpenFile *file,uint flags);
+
+	/**
+	 * Wakes up all threads that are waiting in getWork() for this device, so that they notice that
+	 * the device file has been put into non-blocking mode.
+	 */
+	void wakeupWorkers();
 
 	/**
 	 * Sends the given message to the channel <chan>, which belongs to this device.
@@ -117,6 +125,7 @@ private:
 	int getClientFd(tid_t tid);
 
 	static uint buildMode(uint type);
+	static int createMsg(VFSChannel::Message **msg,USER const void *data,size_t size);
 	static VFSChannel::Message *getMsg(esc::SList<VFSChannel::Message> *list,msgid_t mid,ushort flags);
 
 	/* the process that receives the file descriptors */
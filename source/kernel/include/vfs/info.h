@@ -57,6 +57,7 @@ class VFSInfo {
 	static void virtMemReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 	static void cpuReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 	static void statsReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
+	static void schedReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 	static void memUsageReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 	static void selfLinkReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
 	static void pidLinkReadCallback(VFSNode *node,size_t *dataSize,void **buffer);
@@ -77,6 +78,7 @@ public:
 	GEN_INFO_FILECLASS(VirtMemFile,"virtmem",virtMemReadCallback);
 	GEN_INFO_FILECLASS(CPUFile,"cpu",cpuReadCallback);
 	GEN_INFO_FILECLASS(StatsFile,"stats",statsReadCallback);
+	GEN_INFO_FILECLASS(SchedFile,"sched",schedReadCallback);
 	GEN_INFO_FILECLASS(MemUsageFile,"memusage",memUsageReadCallback);
 	GEN_INFO_FILECLASS(SelfLinkFile,"",selfLinkReadCallback);
 	GEN_INFO_FILECLASS(PidLinkFile,"",pidLinkReadCallback);
@@ -31,6 +31,7 @@
 #include <task/terminator.h>
 #include <task/thread.h>
 #include <task/timer.h>
+#include <task/vdso.h>
 #include <task/uenv.h>
 #include <vfs/node.h>
 #include <vfs/openfile.h>
@@ -53,6 +54,9 @@ static const BootTask tasks[] = {
 	{"Preinit processes...",Proc::preinit},
 	{"Initializing dynarray...",DynArray::init},
 	{"Initializing SMP...",SMP::init},
+	{"Initializing per-CPU caches...",Cache::init},
+	{"Initializing per-CPU frame caches...",PhysMem::initCPUCaches},
+	{"Initializing vDSO...",VDSO::init},
 	{"Initializing timer...",Timer::init},
 	{"Initializing VFS...",VFS::init},
 	{"Initializing scheduler...",Sched::init},
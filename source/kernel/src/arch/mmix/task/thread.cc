@@ -197,8 +197,6 @@ void ThreadBase::doSwitch() {
 	/* switch thread */
 	if(EXPECT_TRUE(n->getTid() != old->getTid())) {
 		setRunning(n);
-		if(EXPECT_FALSE(PhysMem::shouldSetRegTimestamp()))
-			VirtMem::setTimestamp(n,cycles);
 
 		/* if we still have a temp-stack, copy the contents to our real stack and free the
 		 * temp-stack */
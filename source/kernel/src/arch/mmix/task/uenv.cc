@@ -90,6 +90,12 @@ bool UEnvBase::setupProc(int argc,int envc,const char *args,A_UNUSED size_t args
 	 * +------------------+
 	 * |        TLS       | (pointer to the actual TLS)
 	 * +------------------+
+	 * |        tid       |
+	 * +------------------+
+	 * |        pid       |
+	 * +------------------+
+	 * |       vDSO       |
+	 * +------------------+
 	 * |     arguments    |
 	 * |        ...       |
 	 * +------------------+
@@ -120,8 +126,9 @@ bool UEnvBase::setupProc(int argc,int envc,const char *args,A_UNUSED size_t args
 	/* get software-stack */
 	t->getStackRange(NULL,(uintptr_t*)&ssp,1);
 
-	/* space for errno and TLS */
-	ssp -= 3;
+	/* space for errno, TLS, tid, pid and vDSO */
+	writeThreadInfo(t,ssp);
+	ssp -= 6;
 
 	/* copy arguments on the user-stack */
 	char **argv = copyArgs(argc,args,ssp);
@@ -156,6 +163,12 @@ void *UEnvBase::setupThread(const void *arg,uintptr_t tentryPoint) {
 	 * +------------------+
 	 * |        TLS       | (pointer to the actual TLS)
 	 * +------------------+
+	 * |        tid       |
+	 * +------------------+
+	 * |        pid       |
+	 * +------------------+
+	 * |       vDSO       |
+	 * +------------------+
 	 * |     stack-end    |  used for UNSAVE
 	 * +------------------+
 	 *
@@ -200,8 +213,9 @@ void *UEnvBase::setupThread(const void *arg,uintptr_t tentryPoint) {
 	/* get software-stack */
 	t->getStackRange(NULL,(uintptr_t*)&ssp,1);
 
-	/* space for errno and TLS */
-	ssp -= 3;
+	/* space for errno, TLS, tid, pid and vDSO */
+	writeThreadInfo(t,ssp);
+	ssp -= 6;
 
 	/* store location to UNSAVE from and the thread-argument */
 	UserAccess::writeVar(ssp,sinfo.stackBegin);
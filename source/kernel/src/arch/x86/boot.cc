@@ -40,6 +40,7 @@
 #include <task/terminator.h>
 #include <task/thread.h>
 #include <task/timer.h>
+#include <task/vdso.h>
 #include <task/uenv.h>
 #include <vfs/file.h>
 #include <vfs/node.h>
@@ -73,10 +74,16 @@ static const BootTask tasks[] = {
 	{"Initializing ACPI...",ACPI::init},
 	{"Initializing SMP...",SMP::init},
 	{"Initializing GDT for BSP...",GDT::initBSP},
+	{"Initializing per-CPU caches...",Cache::init},
+	{"Initializing per-CPU frame caches...",PhysMem::initCPUCaches},
 	{"Initializing CPU...",CPU::detect},
+#if defined(__x86_64__)
+	{"Initializing PCIDs...",PageDir::initPCID},
+#endif
 	{"Initializing MTRRs...",MTRR::init},
 	{"Initializing FPU...",FPU::init},
 	{"Initializing RTC...",RTC::init},
+	{"Initializing vDSO...",VDSO::init},
 	{"Initializing timer...",Timer::init},
 	{"Initializing VFS...",VFS::init},
 	{"Initializing scheduler...",Sched::init},
@@ -44,9 +44,12 @@ void LAPIC::init() {
 	}
 }
 
-void LAPIC::enableTimer() {
-	setTimer((CPU::getBusSpeed() / TIMER_DIVIDER) / Timer::FREQUENCY_DIV);
-	setLVT(REG_LVT_TIMER,Interrupts::IRQ_LAPIC,ICR_DELMODE_FIXED,UNMASKED,MODE_PERIODIC);
+void LAPIC::enableOneShotTimer(bool tscDeadline) {
+	setTimer(0);
+	setLVT(REG_LVT_TIMER,Interrupts::IRQ_LAPIC,ICR_DELMODE_FIXED,UNMASKED,
+		tscDeadline ? MODE_TSCDEADLINE : MODE_ONESHOT);
+	/* the write to the LVT has to be finished before we write the deadline-MSR */
+	asm volatile ("mfence" : : : "memory");
 }
 
 void LAPIC::writeIPI(uint32_t high,uint32_t low) {
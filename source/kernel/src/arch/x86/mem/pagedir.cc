@@ -136,7 +136,7 @@ int PageDirBase::clone(PageDir *dst,uintptr_t virtSrc,uintptr_t virtDst,size_t c
 	PageDir *pdir = static_cast<PageDir*>(this);
 	int res = pdir->pts.clone(&dst->pts,virtSrc,virtDst,count,share);
 	if(res >= 0)
-		SMP::flushTLB(pdir);
+		pdir->shootdown(virtSrc,count);
 	return res;
 }
 
@@ -146,7 +146,7 @@ int PageDirBase::map(uintptr_t virt,size_t count,PageTables::Allocator &alloc,ui
 	if(res < 0)
 		return res;
 	if(res == 1)
-		SMP::flushTLB(pdir);
+		pdir->shootdown(virt,count);
 	return 0;
 }
 
@@ -154,5 +154,17 @@ void PageDirBase::unmap(uintptr_t virt,size_t count,PageTables::Allocator &alloc
 	PageDir *pdir = static_cast<PageDir*>(this);
 	int res = pdir->pts.unmap(virt,count,alloc);
 	if(res == 1)
-		SMP::flushTLB(pdir);
+		pdir->shootdown(virt,count);
+}
+
+void PageDir::shootdown(uintptr_t virt,size_t count) {
+#if defined(__x86_64__)
+	/* CPUs that have cached entries for this page-directory under a PCID have to flush them
+	 * when switching to it the next time. note that this is a full barrier as well */
+	Atomic::fetch_and_add(&tlbGen,+1);
+#endif
+	SMP::FlushRange range;
+	range.addr = virt & ~(PAGE_SIZE - 1);
+	range.pages = count;
+	SMP::flushTLB(this,&range,1);
 }
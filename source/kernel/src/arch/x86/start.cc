@@ -105,6 +105,9 @@ uintptr_t smpstart(uintptr_t *usp) {
 void apstart() {
 	/* before we do anything, enable NXE if necessary. otherwise we can't use the pagetables */
 	PageDir::enableNXE();
+#if defined(__x86_64__)
+	PageDir::enablePCID();
+#endif
 	/* store the running thread for our temp-stack again, because we might need it in gdt_init_ap
 	 * for example */
 	Thread::setRunning(Thread::getById(0));
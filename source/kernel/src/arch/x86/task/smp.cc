@@ -29,6 +29,7 @@
 #include <common.h>
 #include <config.h>
 #include <cpu.h>
+#include <lockguard.h>
 #include <log.h>
 #include <spinlock.h>
 #include <string.h>
@@ -154,6 +155,33 @@ void SMPBase::ensureTLBFlushed() {
 	}
 }
 
+void SMPBase::doFlushTLB() {
+	CPU *cpu = cpus[getCurId()];
+	FlushRange ranges[MAX_FLUSH_RANGES];
+	size_t count;
+	bool all;
+	{
+		/* take the requests, so that new ones lead to a new IPI */
+		LockGuard<SpinLock> g(&cpu->flushLock);
+		all = cpu->flushAll;
+		count = cpu->flushCount;
+		if(!all)
+			memcpy(ranges,cpu->flushRanges,count * sizeof(FlushRange));
+		cpu->flushAll = false;
+		cpu->flushCount = 0;
+		cpu->flushPages = 0;
+	}
+
+	if(all)
+		PageDir::flushTLB();
+	else {
+		for(size_t i = 0; i < count; ++i) {
+			for(size_t j = 0; j < ranges[i].pages; ++j)
+				PageTables::flushAddr(ranges[i].addr + j * PAGE_SIZE,true);
+		}
+	}
+}
+
 void SMP::apIsRunning() {
 	smpLock.down();
 	cpuid_t phys = LAPIC::getId();
@@ -24,8 +24,6 @@
 #include <task/thread.h>
 #include <common.h>
 
-static SpinLock switchLock;
-
 int ThreadBase::initArch(Thread *t) {
 	t->kernelStack = t->getProc()->getPageDir()->createKernelStack();
 	t->fpuState = NULL;
@@ -129,31 +127,32 @@ void ThreadBase::finishThreadStart(A_UNUSED Thread *t,Thread *nt,const void *arg
 }
 
 void Thread::initialSwitch() {
-	switchLock.down();
 	cpuid_t cpu = GDT::getCPUId();
+	SpinLock *switchLock = Sched::getSwitchLock(cpu);
+	switchLock->down();
 	Thread *cur = Sched::perform(NULL,cpu);
 	cur->stats.schedCount++;
-	if(PhysMem::shouldSetRegTimestamp())
-		VirtMem::setTimestamp(cur,Timer::getRuntime());
 	GDT::prepareRun(cpu,true,cur);
 	cur->setCPU(cpu);
+	Timer::startSlice(cpu,cur->getFlags() & T_IDLE);
 	FPU::lockFPU();
 	cur->stats.cycleStart = CPU::rdtsc();
-	Thread::resume(cur->getProc()->getPageDir()->getPhysAddr(),&cur->saveArea,&switchLock);
+	Thread::resume(cur->getProc()->getPageDir()->getCR3(cpu),&cur->saveArea,switchLock);
 }
 
 void ThreadBase::doSwitch() {
 	Thread *old = Thread::getRunning();
+	cpuid_t cpu = old->getCPU();
 	/* lock this, because Sched::perform() may make us ready and we can't be chosen by another CPU
 	 * until we've really switched the thread (kernelstack, ...) */
-	switchLock.down();
+	SpinLock *switchLock = Sched::getSwitchLock(cpu);
+	switchLock->down();
 
 	/* update runtime-stats */
 	uint64_t cycles = CPU::rdtsc();
 	uint64_t runtime = cycles - old->stats.cycleStart;
 	old->stats.runtime += runtime;
 	old->stats.curCycleCount += runtime;
-	cpuid_t cpu = old->getCPU();
 
 	/* choose a new thread to run */
 	Thread *n = Sched::perform(old,cpu);
@@ -161,8 +160,6 @@ void ThreadBase::doSwitch() {
 
 	/* switch thread */
 	if(EXPECT_TRUE(n->getTid() != old->getTid())) {
-		if(EXPECT_FALSE(PhysMem::shouldSetRegTimestamp()))
-			VirtMem::setTimestamp(n,cycles);
 		GDT::prepareRun(cpu,n->getProc() != old->getProc(),n);
 		if(cpu != n->getCPU()) {
 			FPU::initSaveState(n);
@@ -172,19 +169,21 @@ void ThreadBase::doSwitch() {
 
 		/* some stats for SMP */
 		SMP::schedule(cpu,n,cycles);
+		Timer::startSlice(cpu,n->getFlags() & T_IDLE);
 
 		/* lock the FPU so that we can save the FPU-state for the previous process as soon
 		 * as this one wants to use the FPU */
 		FPU::lockFPU();
 
 		n->stats.cycleStart = CPU::rdtsc();
-		uintptr_t pdir = n->getProc() == old->getProc() ? 0 : n->getProc()->getPageDir()->getPhysAddr();
+		uintptr_t pdir = n->getProc() == old->getProc() ? 0 : n->getProc()->getPageDir()->getCR3(cpu);
 		if(!Thread::save(&old->saveArea))
-			Thread::resume(pdir,&n->saveArea,&switchLock);
+			Thread::resume(pdir,&n->saveArea,switchLock);
 	}
 	else {
 		SMP::schedule(cpu,n,cycles);
+		Timer::startSlice(cpu,n->getFlags() & T_IDLE);
 		n->stats.cycleStart = CPU::rdtsc();
-		switchLock.up();
+		switchLock->up();
 	}
 }
@@ -23,8 +23,10 @@
 #include <arch/x86/pit.h>
 #include <arch/x86/ports.h>
 #include <arch/x86/rtc.h>
+#include <esc/util.h>
 #include <task/smp.h>
 #include <task/timer.h>
+#include <task/vdso.h>
 #include <common.h>
 #include <config.h>
 #include <cpu.h>
@@ -33,23 +35,52 @@
 uint64_t Timer::bootTSC = 0;
 time_t Timer::bootTime = 0;
 uint64_t Timer::cpuMhz;
+bool Timer::tscDeadline = false;
+uint64_t Timer::lapicHz = 0;
 
 void TimerBase::archInit() {
 	Timer::bootTSC = CPU::rdtsc();
 	Timer::bootTime = RTC::getTime();
+	/* let userspace compute the time on its own */
+	VDSO::setClock(Timer::bootTSC,Timer::bootTime,Timer::cpuMhz);
+}
+
+void TimerBase::archProgram(uint64_t deadline) {
+	if(Timer::tscDeadline) {
+		/* zero disarms the timer; a deadline in the past fires immediately */
+		uint64_t tsc = deadline == NO_DEADLINE ? 0 : Timer::bootTSC + Timer::cpuMhz * deadline;
+		CPU::setMSR(CPU::MSR_IA32_TSC_DEADLINE,tsc);
+	}
+	else if(deadline == NO_DEADLINE)
+		LAPIC::setTimer(0);
+	else {
+		/* limit it to one second to prevent overflows; we'll reprogram it then */
+		uint64_t now = getUptime();
+		uint64_t usecs = deadline > now ? esc::Util::min(deadline - now,(uint64_t)1000000) : 0;
+		uint64_t ticks = (usecs * Timer::lapicHz) / 1000000;
+		/* zero would stop the timer */
+		LAPIC::setTimer(esc::Util::max(esc::Util::min(ticks,(uint64_t)0xFFFFFFFF),(uint64_t)1));
+	}
 }
 
 void Timer::start(bool isBSP) {
 	if(!Config::get(Config::FORCE_PIT) && LAPIC::isAvailable()) {
-		Log::get().writef("CPU %d uses LAPIC as timer device\n",SMP::getCurId());
 		if(isBSP) {
 			/* mask it as well */
 			if(IOAPIC::enabled())
 				IOAPIC::mask(IOAPIC::irqToGsi(Interrupts::IRQ_PIT - Interrupts::IRQ_MASTER_BASE));
 			else
 				PIC::mask(Interrupts::IRQ_PIT - Interrupts::IRQ_MASTER_BASE);
+
+			tickless = true;
+			tscDeadline = CPU::hasFeature(CPU::BASIC,CPU::FEAT_TSCDEADLINE);
+			lapicHz = CPU::getBusSpeed() / LAPIC::TIMER_DIVIDER;
 		}
-		LAPIC::enableTimer();
+		Log::get().writef("CPU %d uses LAPIC as one-shot timer device (%s)\n",SMP::getCurId(),
+			tscDeadline ? "TSC-deadline" : "counter");
+		LAPIC::enableOneShotTimer(tscDeadline);
+		/* program the timer for the first time */
+		startSlice(SMP::getCurId(),false);
 	}
 	else if(isBSP) {
 		Log::get().writef("CPU %d uses PIT as timer device\n",SMP::getCurId());
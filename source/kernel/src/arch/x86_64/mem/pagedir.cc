@@ -17,10 +17,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <mem/cache.h>
 #include <mem/pagedir.h>
 #include <task/proc.h>
+#include <task/smp.h>
 #include <assert.h>
+#include <atomic.h>
 #include <common.h>
+#include <util.h>
 
 static const size_t SHARED_AREA_SIZE	= KFREE_AREA + KFREE_AREA_SIZE - KHEAP_START;
 static const ulong SHPT_COUNT			= 1 + (DIR_MAP_AREA_SIZE / PD_SIZE) +
@@ -31,6 +35,7 @@ static const ulong SHPT_COUNT			= 1 + (DIR_MAP_AREA_SIZE / PD_SIZE) +
 extern void *proc0TLPD;
 /* we can't allocate any frames at the beginning. so put the shared-pagetables in bss */
 uint8_t PageDir::sharedPtbls[SHPT_COUNT][PAGE_SIZE] A_ALIGNED(PAGE_SIZE);
+PageDir::PCIDState *PageDir::pcids = NULL;
 
 void PageDirBase::init() {
 	size_t shpt = 0;
@@ -80,6 +85,50 @@ void PageDir::enableNXE() {
 	}
 }
 
+void PageDir::initPCID() {
+	if(!CPU::hasFeature(CPU::BASIC,CPU::FEAT_PCID))
+		return;
+
+	pcids = (PCIDState*)Cache::calloc(SMP::getCPUCount(),sizeof(PCIDState));
+	if(!pcids)
+		Util::panic("Unable to allocate PCID-state");
+	enablePCID();
+}
+
+void PageDir::enablePCID() {
+	/* the PCID-state is allocated by the BSP, if supported */
+	if(pcids)
+		CPU::setCR4(CPU::getCR4() | CPU::CR4_PCIDE);
+}
+
+uintptr_t PageDir::getCR3(cpuid_t cpu) {
+	uintptr_t root = getPhysAddr();
+	if(!pcids)
+		return root;
+
+	/* read the generation before we switch; if it changes afterwards, we get an IPI */
+	ulong gen = Atomic::fetch_and_add(&tlbGen,0);
+	PCIDState *state = pcids + cpu;
+	size_t i;
+	for(i = 0; i < PCID_COUNT; ++i) {
+		if(state->slots[i].pdir == this)
+			break;
+	}
+
+	/* still up to date? then keep the TLB-entries */
+	if(i < PCID_COUNT && state->slots[i].gen == gen)
+		return root | (i + 1) | CR3_NOFLUSH;
+
+	/* otherwise, (re)use the slot and let the CPU flush the entries of this PCID */
+	if(i == PCID_COUNT) {
+		i = state->next;
+		state->next = (state->next + 1) % PCID_COUNT;
+	}
+	state->slots[i].pdir = this;
+	state->slots[i].gen = gen;
+	return root | (i + 1);
+}
+
 int PageDirBase::cloneKernelspace(PageDir *dst,tid_t tid) {
 	Thread *t = Thread::getById(tid);
 	PageDir *cur = Proc::getCurPageDir();
@@ -118,6 +167,15 @@ void PageDirBase::destroy() {
 	/* unmap kernel-stacks */
 	PageTables::KStackAllocator alloc;
 	pdir->unmap(KSTACK_AREA,KSTACK_AREA_SIZE / PAGE_SIZE,alloc);
+	/* the address of this page-dir might be reused, so forget all PCIDs for it */
+	if(PageDir::pcids) {
+		for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
+			for(size_t j = 0; j < PageDir::PCID_COUNT; ++j) {
+				if(PageDir::pcids[i].slots[j].pdir == pdir)
+					PageDir::pcids[i].slots[j].pdir = NULL;
+			}
+		}
+	}
 	/* free page-dir */
 	PhysMem::free(pdir->pts.getRoot() >> PAGE_BITS,PhysMem::KERN);
 }
@@ -20,6 +20,7 @@
 #include <mem/cache.h>
 #include <mem/kheap.h>
 #include <mem/pagedir.h>
+#include <task/smp.h>
 #include <assert.h>
 #include <common.h>
 #include <log.h>
@@ -33,12 +34,16 @@
 #endif
 
 #define GUARD_MAGIC			0xCAFEBABE
+/* replaces GUARD_MAGIC in the header of free objects to detect double frees */
+#define FREE_MAGIC			0xDEADBEEF
 #define MIN_OBJ_COUNT		8
 #define SIZE_THRESHOLD		128
 #define HEAP_THRESHOLD		512
 
 SpinLock Cache::lock;
-Cache::Entry Cache::caches[] = {
+Cache::CPUCache *Cache::cpuCaches = NULL;
+size_t Cache::cpuCount = 0;
+Cache::Entry Cache::caches[CACHE_COUNT] = {
 	{16,0,0,NULL},
 	{32,0,0,NULL},
 	{64,0,0,NULL},
@@ -55,6 +60,39 @@ Cache::Entry Cache::caches[] = {
 bool Cache::aafEnabled = false;
 #endif
 
+void Cache::init() {
+	size_t count = SMP::getCPUCount();
+	CPUCache *ccs = (CPUCache*)calloc(count,sizeof(CPUCache));
+	if(!ccs)
+		Util::panic("Unable to allocate per-CPU caches");
+	cpuCount = count;
+	cpuCaches = ccs;
+}
+
+size_t Cache::magCapacity(size_t objSize) {
+	/* don't keep too many of the large objects per CPU */
+	size_t cap = MAG_BYTES / objSize;
+	if(cap > MAG_SIZE)
+		return MAG_SIZE;
+	return cap < 2 ? 2 : cap;
+}
+
+Cache::Magazine *Cache::getMagazine(size_t i) {
+	cpuid_t cpu = SMP::getCurId();
+	if(EXPECT_FALSE(!cpuCaches || cpu >= cpuCount))
+		return NULL;
+	return cpuCaches[cpu].mags + i;
+}
+
+size_t Cache::getMagazineObjs(size_t i) {
+	size_t count = 0;
+	if(cpuCaches) {
+		for(size_t c = 0; c < cpuCount; ++c)
+			count += cpuCaches[c].mags[i].count;
+	}
+	return count;
+}
+
 size_t Cache::totalObjSize(size_t sz) {
 	/* ensure that all objects are 16 bytes aligned, thus, use 16 bytes before and behind. */
 	return sz + sizeof(uint64_t) * 4;
@@ -98,6 +136,7 @@ A_NOASAN void *Cache::realloc(void *p,size_t size) {
 		return alloc(size);
 
 	ulong *area = (ulong*)((uintptr_t)p - 16);
+	vassert(area[1] != FREE_MAGIC,"Realloc of free object %p",p);
 	/* if the guard is not ours, perhaps it has been allocated on the fallback-heap */
 	if(area[1] != GUARD_MAGIC)
 		return KHeap::realloc(p,size);
@@ -127,6 +166,7 @@ A_NOASAN void Cache::free(void *p) {
 	}
 #endif
 
+	vassert(area[1] != FREE_MAGIC,"Duplicate free of %p",p);
 	/* if the guard is not ours, perhaps it has been allocated on the fallback-heap */
 	if(area[1] != GUARD_MAGIC) {
 		KHeap::free(p);
@@ -140,14 +180,53 @@ A_NOASAN void Cache::free(void *p) {
 	/* check guard */
 	assert(area[(objSize / sizeof(ulong)) + (16 / sizeof(ulong))] == GUARD_MAGIC);
 
-	/* put on freelist */
+	/* put it into our magazine, if possible. the size-class stays intact in this case */
 	Entry *c = caches + area[0];
+	area[1] = FREE_MAGIC;
+	Magazine *m = getMagazine(area[0]);
+	if(EXPECT_TRUE(m)) {
+		LockGuard<SpinLock> g(&m->lock);
+		size_t cap = magCapacity(c->objSize);
+		/* if it's full, give the older half back to the shared freelist */
+		if(EXPECT_FALSE(m->count >= cap))
+			drain(c,m,cap / 2);
+		m->objs[m->count++] = area;
+		return;
+	}
+
+	/* put on freelist */
 	LockGuard<SpinLock> g(&lock);
+	putArea(c,area);
+}
+
+A_NOASAN void Cache::putArea(Entry *c,ulong *area) {
 	area[0] = (ulong)c->freeList;
+	area[1] = FREE_MAGIC;
 	c->freeList = area;
 	c->freeObjs++;
 }
 
+void Cache::refill(Entry *c,size_t i,Magazine *m) {
+	/* fetch half a magazine at once to take the shared lock only once */
+	size_t count = magCapacity(c->objSize) / 2;
+	LockGuard<SpinLock> g(&lock);
+	while(count-- > 0) {
+		ulong *area = getArea(c,i);
+		if(!area)
+			break;
+		m->objs[m->count++] = area;
+	}
+}
+
+A_NOASAN void Cache::drain(Entry *c,Magazine *m,size_t count) {
+	LockGuard<SpinLock> g(&lock);
+	/* give back the least recently freed ones, because they are the coldest */
+	for(size_t j = 0; j < count; ++j)
+		putArea(c,(ulong*)m->objs[j]);
+	memmove(m->objs,m->objs + count,(m->count - count) * sizeof(void*));
+	m->count -= count;
+}
+
 size_t Cache::getOccMem() {
 	size_t count = 0;
 	for(size_t i = 0; i < ARRAY_SIZE(caches); i++)
@@ -157,8 +236,10 @@ size_t Cache::getOccMem() {
 
 size_t Cache::getUsedMem() {
 	size_t count = 0;
-	for(size_t i = 0; i < ARRAY_SIZE(caches); i++)
-		count += (caches[i].totalObjs - caches[i].freeObjs) * totalObjSize(caches[i].objSize);
+	for(size_t i = 0; i < ARRAY_SIZE(caches); i++) {
+		size_t free = caches[i].freeObjs + getMagazineObjs(i);
+		count += (caches[i].totalObjs - free) * totalObjSize(caches[i].objSize);
+	}
 	return count;
 }
 
@@ -173,9 +254,30 @@ void Cache::print(OStream &os) {
 	os.writef("Total: %zu bytes\n",total);
 	for(size_t i = 0; i < ARRAY_SIZE(caches); i++) {
 		size_t mem = caches[i].totalObjs * totalObjSize(caches[i].objSize);
-		os.writef("Cache %zu [size=%zu, total=%zu, free=%zu, pages=%zu]:\n",i,caches[i].objSize,
-				caches[i].totalObjs,caches[i].freeObjs,BYTES_2_PAGES(mem));
-		printBar(os,mem,maxMem,caches[i].totalObjs,caches[i].freeObjs);
+		size_t free = caches[i].freeObjs + getMagazineObjs(i);
+		os.writef("Cache %zu [size=%zu, total=%zu, free=%zu, inmags=%zu, pages=%zu]:\n",
+				i,caches[i].objSize,caches[i].totalObjs,free,free - caches[i].freeObjs,
+				BYTES_2_PAGES(mem));
+		printBar(os,mem,maxMem,caches[i].totalObjs,free);
+	}
+
+	for(size_t c = 0; c < cpuCount; c++) {
+		ulong hits = 0,misses = 0;
+		for(size_t i = 0; i < CACHE_COUNT; i++) {
+			hits += cpuCaches[c].mags[i].hits;
+			misses += cpuCaches[c].mags[i].misses;
+		}
+		ulong total = hits + misses;
+		os.writef("CPU %zu: hits=%lu, misses=%lu, hitrate=%lu%%\n",
+				c,hits,misses,total ? (hits * 100) / total : 0);
+		for(size_t i = 0; i < CACHE_COUNT; i++) {
+			const Magazine *m = cpuCaches[c].mags + i;
+			total = m->hits + m->misses;
+			if(total > 0) {
+				os.writef("\t%5zu: objs=%2zu, hits=%lu, misses=%lu, hitrate=%lu%%\n",
+					caches[i].objSize,m->count,m->hits,m->misses,(m->hits * 100) / total);
+			}
+		}
 	}
 }
 
@@ -192,7 +294,32 @@ void Cache::printBar(OStream &os,size_t mem,size_t maxMem,size_t total,size_t fr
 }
 
 A_NOASAN void *Cache::get(Entry *c,size_t i) {
-	LockGuard<SpinLock> g(&lock);
+	ulong *area;
+	Magazine *m = getMagazine(i);
+	if(EXPECT_TRUE(m)) {
+		LockGuard<SpinLock> g(&m->lock);
+		if(EXPECT_FALSE(m->count == 0)) {
+			m->misses++;
+			refill(c,i,m);
+			if(m->count == 0)
+				return NULL;
+		}
+		else
+			m->hits++;
+		/* the objects in the magazine are already prepared, except for the guard */
+		area = (ulong*)m->objs[--m->count];
+		area[1] = GUARD_MAGIC;
+	}
+	else {
+		LockGuard<SpinLock> g(&lock);
+		area = getArea(c,i);
+		if(area == NULL)
+			return NULL;
+	}
+	return (void*)((uintptr_t)area + 16);
+}
+
+A_NOASAN ulong *Cache::getArea(Entry *c,size_t i) {
 	if(EXPECT_FALSE(!c->freeList)) {
 		size_t pageCount = BYTES_2_PAGES(MIN_OBJ_COUNT * c->objSize);
 		size_t bytes = pageCount * PAGE_SIZE;
@@ -226,5 +353,5 @@ A_NOASAN void *Cache::get(Entry *c,size_t i) {
 	area[1] = GUARD_MAGIC;
 	area[(c->objSize / sizeof(ulong)) + (16 / sizeof(ulong))] = GUARD_MAGIC;
 	c->freeObjs--;
-	return (void*)((uintptr_t)area + 16);
+	return area;
 }
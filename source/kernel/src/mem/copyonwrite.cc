@@ -18,29 +18,30 @@
  */
 
 #include <esc/util.h>
-#include <mem/cache.h>
 #include <mem/copyonwrite.h>
 #include <mem/pagedir.h>
+#include <mem/physmem.h>
+#include <task/futex.h>
 #include <task/proc.h>
 #include <assert.h>
+#include <atomic.h>
 #include <common.h>
 #include <spinlock.h>
-#include <string.h>
 #include <util.h>
 #include <video.h>
 
-esc::SList<CopyOnWrite::Entry> CopyOnWrite::frames[HEAP_SIZE];
-SpinLock CopyOnWrite::lock;
+SpinLock CopyOnWrite::locks[LOCK_COUNT];
+size_t CopyOnWrite::frameCount = 0;
 
 size_t CopyOnWrite::pagefault(uintptr_t address,frameno_t frameNumber) {
-	LockGuard<SpinLock> g(&lock);
+	LockGuard<SpinLock> g(getLock(frameNumber));
 	/* find the cow-entry */
-	Entry *cow = getByFrame(frameNumber,true);
+	PhysMem::Frame *cow = release(frameNumber);
 	vassert(cow != NULL,"No COW entry for frame %#x and address %p",frameNumber,address);
 
 	/* if there is another process who wants to get the frame, we make a copy for us */
 	/* otherwise we keep the frame for ourself */
-	if(cow->refCount == 0) {
+	if(cow->refs == 0) {
 		PageTables::NoAllocator noalloc;
 		PageDir::mapToCur(address,1,noalloc,PG_PRESENT | PG_WRITABLE);
 	}
@@ -51,66 +52,57 @@ size_t CopyOnWrite::pagefault(uintptr_t address,frameno_t frameNumber) {
 	}
 
 	/* copy? */
-	if(cow->refCount > 0)
+	if(cow->refs > 0) {
 		PageDir::copyFromFrame(frameNumber,(void*)(esc::Util::round_page_dn(address)));
-	else
-		delete cow;
+		/* futex-waiters might have waited on our address, which is now in a different frame */
+		if(cow->waiters > 0)
+			Futex::wakeupFrame(frameNumber);
+	}
 	return 1;
 }
 
 bool CopyOnWrite::add(frameno_t frameNo) {
-	LockGuard<SpinLock> g(&lock);
-	Entry *cow = getByFrame(frameNo,false);
-	if(!cow) {
-		cow = new Entry(frameNo);
-		if(cow == NULL)
-			return false;
-		frames[frameNo % HEAP_SIZE].append(cow);
+	PhysMem::Frame *cow = PhysMem::getFrame(frameNo);
+	if(!cow)
+		return false;
+
+	LockGuard<SpinLock> g(getLock(frameNo));
+	if(cow->refs++ == 0) {
+		cow->flags |= PhysMem::Frame::COW;
+		Atomic::fetch_and_add(&frameCount,+1);
 	}
-	cow->refCount++;
 	return true;
 }
 
 size_t CopyOnWrite::remove(frameno_t frameNo,bool *foundOther) {
-	LockGuard<SpinLock> g(&lock);
+	LockGuard<SpinLock> g(getLock(frameNo));
 	/* find the cow-entry */
-	Entry *cow = getByFrame(frameNo,true);
+	PhysMem::Frame *cow = release(frameNo);
 	vassert(cow != NULL,"For frameNo %#x",frameNo);
 
-	*foundOther = cow->refCount > 0;
-	if(cow->refCount == 0)
-		delete cow;
+	*foundOther = cow->refs > 0;
 	return 1;
 }
 
-size_t CopyOnWrite::getFrmCount() {
-	LockGuard<SpinLock> g(&lock);
-	size_t count = 0;
-	for(size_t i = 0; i < HEAP_SIZE; i++)
-		count += frames[i].length();
-	return count;
-}
-
 void CopyOnWrite::print(OStream &os) {
 	os.writef("COW-Frames: (%zu frames)\n",getFrmCount());
-	for(size_t i = 0; i < HEAP_SIZE; i++) {
-		os.writef("\t%zu:\n",i);
-		for(auto it = frames[i].cbegin(); it != frames[i].cend(); ++it)
-			os.writef("\t\t%#x (%zu refs)\n",it->frameNumber,it->refCount);
+	for(frameno_t f = 0; ; ++f) {
+		const PhysMem::Frame *frame = PhysMem::getFrame(f);
+		if(!frame)
+			break;
+		if(frame->flags & PhysMem::Frame::COW)
+			os.writef("\t%#x (%u refs)\n",f,frame->refs);
 	}
 }
 
-CopyOnWrite::Entry *CopyOnWrite::getByFrame(frameno_t frameNo,bool dec) {
-	esc::SList<Entry> *list = frames + (frameNo % HEAP_SIZE);
-	Entry *p = NULL;
-	for(auto it = list->begin(); it != list->end(); p = &*it, ++it) {
-		if(it->frameNumber == frameNo) {
-			if(dec) {
-				if(--it->refCount == 0)
-					list->removeAt(p,&*it);
-			}
-			return &*it;
-		}
+PhysMem::Frame *CopyOnWrite::release(frameno_t frameNo) {
+	PhysMem::Frame *cow = PhysMem::getFrame(frameNo);
+	if(!cow || !(cow->flags & PhysMem::Frame::COW))
+		return NULL;
+
+	if(--cow->refs == 0) {
+		cow->flags &= ~PhysMem::Frame::COW;
+		Atomic::fetch_and_add(&frameCount,-1);
 	}
-	return NULL;
+	return cow;
 }
@@ -19,6 +19,7 @@
 
 #include <esc/ipc/ipcbuf.h>
 #include <esc/util.h>
+#include <mem/cache.h>
 #include <mem/pagedir.h>
 #include <mem/physmem.h>
 #include <mem/physmemareas.h>
@@ -26,6 +27,7 @@
 #include <mem/virtmem.h>
 #include <sys/messages.h>
 #include <task/proc.h>
+#include <task/smp.h>
 #include <task/thread.h>
 #include <vfs/openfile.h>
 #include <vfs/vfs.h>
@@ -51,6 +53,10 @@
 
 size_t PhysMem::totalMem = 0;
 
+/* the metadata for all frames */
+PhysMem::Frame *PhysMem::frames = NULL;
+size_t PhysMem::frameCount = 0;
+
 /* the bitmap for the frames of the lowest few MB; 0 = free, 1 = used */
 tBitmap *PhysMem::bitmap;
 uintptr_t PhysMem::bitmapStart;
@@ -63,6 +69,10 @@ PhysMem::StackFrames PhysMem::lower;
 PhysMem::StackFrames PhysMem::upper;
 SpinLock PhysMem::defLock;
 
+/* per-CPU caches of user frames */
+PhysMem::FrameCache *PhysMem::frameCaches = NULL;
+size_t PhysMem::cpuCount = 0;
+
 bool PhysMem::initialized = false;
 
 /* for swapping */
@@ -144,8 +154,10 @@ void PhysMem::init() {
 
 	/* determine which of the memory areas becomes lower and which upper memory */
 	size_t lowerPages = 0,upperPages = 0;
+	uintptr_t memEnd = bitmapStart + BITMAP_PAGE_COUNT * PAGE_SIZE;
 	for(const PhysMemAreas::MemArea *area = PhysMemAreas::get(); area != NULL; area = area->next) {
 		uintptr_t aend = area->addr + area->size;
+		memEnd = esc::Util::max(memEnd,aend);
 		if(area->addr >= lowerStart() || aend < lowerStart())
 			lowerPages += (esc::Util::min(lowerEnd(),aend) - area->addr) / PAGE_SIZE;
 		if(aend > lowerEnd())
@@ -164,6 +176,12 @@ void PhysMem::init() {
 		upper.frames = upper.begin;
 	}
 
+	/* the frame metadata covers everything up to the highest available frame */
+	frameCount = memEnd / PAGE_SIZE;
+	size_t frmPages = BYTES_2_PAGES(frameCount * sizeof(Frame));
+	frames = (Frame*)PageDir::makeAccessible(0,frmPages);
+	memclear(frames,frmPages * PAGE_SIZE);
+
 	/* now mark the remaining memory as free on stack */
 	for(const PhysMemAreas::MemArea *area = PhysMemAreas::get(); area != NULL; area = area->next)
 		markRangeUsed(area->addr,area->addr + area->size,false);
@@ -194,13 +212,22 @@ void PhysMem::init() {
 	}
 }
 
+void PhysMem::initCPUCaches() {
+	size_t count = SMP::getCPUCount();
+	FrameCache *fcs = (FrameCache*)Cache::calloc(count,sizeof(FrameCache));
+	if(!fcs)
+		Util::panic("Unable to allocate per-CPU frame caches");
+	cpuCount = count;
+	frameCaches = fcs;
+}
+
 size_t PhysMem::getFreeFrames(uint types) {
 	/* no lock; just intended for debugging and information */
 	size_t count = 0;
 	if(types & CONT)
 		count += freeCont;
 	if(types & DEF)
-		count += getFreeDef();
+		count += getFreeDef() + getCachedFrames();
 	return count;
 }
 
@@ -245,14 +272,24 @@ void PhysMem::freeContiguous(frameno_t first,size_t count) {
 
 bool PhysMem::reserve(size_t frameCount,bool swap) {
 	defLock.down();
-	size_t free = getFreeDef();
 	uframes += frameCount;
 	/* enough user-memory available? */
-	if(free >= frameCount && free - frameCount >= kframes + cframes) {
+	if(getFreeUser() >= frameCount) {
 		defLock.up();
 		return true;
 	}
 
+	/* give the frames in the per-CPU caches back to the stack and try again */
+	if(getCachedFrames() > 0) {
+		defLock.up();
+		flushCaches();
+		defLock.down();
+		if(getFreeUser() >= frameCount) {
+			defLock.up();
+			return true;
+		}
+	}
+
 	/* swapping not possible? */
 	Thread *t = Thread::getRunning();
 	if(!swap || !swapEnabled || !swapperThread || t->getTid() == swapperThread->getTid()) {
@@ -269,10 +306,11 @@ bool PhysMem::reserve(size_t frameCount,bool swap) {
 		t->wait(EV_SWAP_FREE,0);
 		defLock.up();
 		Thread::switchNoSigs();
+		/* frames that have been freed in the meantime might sit in the per-CPU caches */
+		flushCaches();
 		defLock.down();
-		free = getFreeDef();
 	}
-	while(free - (kframes + cframes) < frameCount);
+	while(getFreeUser() < frameCount);
 	defLock.up();
 	return true;
 }
@@ -323,8 +361,11 @@ frameno_t PhysMem::allocate(FrameType type) {
 			case KERN:
 				/* if there are no kframes anymore, take away a few uframes */
 				if(kframes == 0) {
+					/* the per-CPU caches can't be flushed here, because we hold defLock. thus,
+					 * only the frames on the stack count and there might be less than cframes */
 					size_t free = lower.frames - lower.begin;
-					kframes = (free - cframes) / (100 / KERNEL_MEM_PERCENT);
+					if(free > cframes)
+						kframes = (free - cframes) / (100 / KERNEL_MEM_PERCENT);
 				}
 				if(kframes > 0) {
 					kframes--;
@@ -333,10 +374,10 @@ frameno_t PhysMem::allocate(FrameType type) {
 				break;
 
 			default:
-				if(getFreeDef() > (kframes + cframes)) {
+				frame = allocUserFrame();
+				if(frame != PhysMem::INVALID_FRAME) {
 					assert(uframes > 0);
 					uframes--;
-					frame = allocFrame(false);
 				}
 				break;
 		}
@@ -345,7 +386,60 @@ frameno_t PhysMem::allocate(FrameType type) {
 	return frame;
 }
 
+size_t PhysMem::allocate(size_t count,frameno_t *frames) {
+	FrameCache *fc = getFrameCache();
+	if(EXPECT_FALSE(fc == NULL)) {
+		size_t i;
+		for(i = 0; i < count; ++i) {
+			if((frames[i] = allocate(USR)) == PhysMem::INVALID_FRAME)
+				break;
+		}
+		return i;
+	}
+
+	LockGuard<SpinLock> g(&fc->lock);
+	size_t n = 0,cached;
+	{
+		LockGuard<SpinLock> dg(&defLock);
+		/* take what the cache can't provide directly from the stack */
+		while(count - n > fc->count) {
+			frameno_t frm = allocUserFrame();
+			if(frm == PhysMem::INVALID_FRAME)
+				break;
+			frames[n++] = frm;
+		}
+		cached = esc::Util::min(count - n,fc->count);
+		assert(uframes >= n + cached);
+		uframes -= n + cached;
+
+		/* refill the cache while we hold the lock anyway */
+		if(fc->count - cached < FRAME_CACHE_BATCH / 2)
+			refill(fc,FRAME_CACHE_BATCH);
+	}
+
+	for(; cached > 0; --cached)
+		frames[n++] = fc->frames[--fc->count];
+	printAllocFree("[A] %zu frames ",n);
+	return n;
+}
+
 void PhysMem::free(frameno_t frame,FrameType type) {
+	/* a frame that is still shared copy-on-write has other users */
+	assert(frame >= frameCount || !(frames[frame].flags & Frame::COW));
+
+	/* user frames go to the cache of the current CPU, if possible */
+	if(type == USR && isCacheable(frame)) {
+		FrameCache *fc = getFrameCache();
+		if(EXPECT_TRUE(fc != NULL)) {
+			LockGuard<SpinLock> g(&fc->lock);
+			printAllocFree("[F] %x 1 ",frame);
+			if(fc->count == FRAME_CACHE_SIZE)
+				drain(fc,FRAME_CACHE_BATCH);
+			fc->frames[fc->count++] = frame;
+			return;
+		}
+	}
+
 	LockGuard<SpinLock> g(&defLock);
 	printAllocFree("[F] %x 1 ",frame);
 	if(type == CRIT)
@@ -411,7 +505,7 @@ void PhysMem::swapper() {
 			goto error;
 		}
 
-		Timer::sleepFor(swapperThread->getTid(),10,true);
+		Timer::sleepFor(swapperThread->getTid(),10 * 1000,true);
 		Thread::switchAway();
 	}
 
@@ -439,16 +533,24 @@ void PhysMem::swapper() {
 	defLock.down();
 	while(1) {
 		SwapInJob *job;
-		size_t free = getFreeDef();
+		/* don't swap out if the frames in the per-CPU caches suffice */
+		if(getFreeUser() < uframes && getCachedFrames() > 0) {
+			defLock.up();
+			flushCaches();
+			defLock.down();
+		}
+
 		/* swapping out is more important than swapping in */
-		if((free - (kframes + cframes)) < uframes) {
-			size_t amount = esc::Util::min(static_cast<size_t>(MAX_SWAP_AT_ONCE),
-				uframes - (free - (kframes + cframes)));
+		size_t free = getFreeUser();
+		if(free < uframes) {
+			size_t amount = esc::Util::min(static_cast<size_t>(MAX_SWAP_AT_ONCE),uframes - free);
 			swapping = true;
 			defLock.up();
 
 			VirtMem::swapOut(swapFile,amount);
 			swappedOut += amount;
+			/* the frames have been freed to the cache of this CPU; make them visible to others */
+			flushCaches();
 
 			defLock.down();
 			swapping = false;
@@ -462,8 +564,7 @@ void PhysMem::swapper() {
 			swapping = true;
 			defLock.up();
 
-			if(VirtMem::swapIn(swapFile,job->thread,job->addr))
-				swappedIn++;
+			swappedIn += VirtMem::swapIn(swapFile,job->thread,job->addr);
 
 			defLock.down();
 			job->thread->unblock();
@@ -471,7 +572,7 @@ void PhysMem::swapper() {
 			swapping = false;
 		}
 
-		if(getFreeDef() - (kframes + cframes) >= uframes) {
+		if(getFreeUser() >= uframes) {
 			/* we may receive new work now */
 			swapperThread->wait(EV_SWAP_WORK,0);
 			defLock.up();
@@ -492,6 +593,12 @@ void PhysMem::print(OStream &os) {
 	const char *dev = Config::getStr(Config::SWAP_DEVICE);
 	os.writef("Default: %zu\n",getFreeDef());
 	os.writef("Contiguous: %zu\n",freeCont);
+	os.writef("Frame metadata: %zu frames (%zu KiB)\n",frameCount,(frameCount * sizeof(Frame)) / 1024);
+	os.writef("Cached: %zu\n",getCachedFrames());
+	for(size_t i = 0; i < cpuCount; ++i) {
+		os.writef("\tCPU %zu: %2zu of %zu frames (%lu refills, %lu drains)\n",
+			i,frameCaches[i].count,FRAME_CACHE_SIZE,frameCaches[i].refills,frameCaches[i].drains);
+	}
 	os.writef("Swap-Device: %s\n",dev ? dev : "-none-");
 	os.writef("Swap enabled: %d\n",swapEnabled);
 	os.writef("CFrames: %zu\n",cframes);
@@ -543,6 +650,72 @@ size_t PhysMem::getFreeDef() {
 	return (lower.frames - lower.begin) + (upper.frames - upper.begin);
 }
 
+size_t PhysMem::getFreeUser() {
+	/* the frames on the stack that are not reserved for the kernel */
+	size_t free = getFreeDef();
+	return free > kframes + cframes ? free - (kframes + cframes) : 0;
+}
+
+frameno_t PhysMem::allocUserFrame() {
+	/* leave the frames on the stack that are reserved for the kernel */
+	if(getFreeUser() > 0)
+		return allocFrame(false);
+	return PhysMem::INVALID_FRAME;
+}
+
+bool PhysMem::isCacheable(frameno_t frame) {
+	/* only frames that are managed by the stack */
+	return frame >= bitmapStartFrame() + BITMAP_PAGE_COUNT;
+}
+
+PhysMem::FrameCache *PhysMem::getFrameCache() {
+	cpuid_t cpu = SMP::getCurId();
+	if(EXPECT_FALSE(!frameCaches || cpu >= cpuCount))
+		return NULL;
+	return frameCaches + cpu;
+}
+
+size_t PhysMem::getCachedFrames() {
+	/* no lock; the counts are only used as a hint */
+	size_t count = 0;
+	for(size_t i = 0; i < cpuCount; ++i)
+		count += frameCaches[i].count;
+	return count;
+}
+
+void PhysMem::refill(FrameCache *fc,size_t count) {
+	/* assumes that fc->lock and defLock are held */
+	count = esc::Util::min(count,FRAME_CACHE_SIZE - fc->count);
+	/* leave the reserved frames on the stack. otherwise, we might take the frames that a thread on
+	 * a different CPU has reserved, so that its allocation would fail */
+	size_t free = getFreeUser();
+	count = esc::Util::min(count,free > uframes ? free - uframes : 0);
+	for(; count > 0; --count) {
+		frameno_t frm = allocUserFrame();
+		if(frm == PhysMem::INVALID_FRAME)
+			break;
+		fc->frames[fc->count++] = frm;
+	}
+	fc->refills++;
+}
+
+void PhysMem::drain(FrameCache *fc,size_t count) {
+	/* assumes that fc->lock is held */
+	LockGuard<SpinLock> g(&defLock);
+	count = esc::Util::min(count,fc->count);
+	for(; count > 0; --count)
+		freeFrame(fc->frames[--fc->count]);
+	fc->drains++;
+}
+
+void PhysMem::flushCaches() {
+	for(size_t i = 0; i < cpuCount; ++i) {
+		LockGuard<SpinLock> g(&frameCaches[i].lock);
+		if(frameCaches[i].count > 0)
+			drain(frameCaches + i,frameCaches[i].count);
+	}
+}
+
 void PhysMem::markRangeUsed(uintptr_t from,uintptr_t to,bool used) {
 	doMarkRangeUsed(from,to,used);
 }
@@ -54,13 +54,13 @@
 Region::Region(OpenFile *f,size_t bCount,size_t lCount,size_t off,ulong pgFlags,
                ulong _flags,bool &success)
 		: flags(_flags), file(f), offset(off), loadCount(lCount), byteCount(bCount),
-		  timestamp(0), pfSize(), pageFlags(), vms(), lock() {
+		  raNext(), raWindow(), pfSize(), pageFlags(), vms(), lock() {
 	init(pgFlags,success);
 }
 
 Region::Region(const Region &reg,VirtMem *vm,bool &success)
 		: flags(reg.flags), file(reg.file), offset(reg.offset), loadCount(reg.loadCount),
-		  byteCount(reg.byteCount), timestamp(0), pfSize(), pageFlags(), vms(), lock() {
+		  byteCount(reg.byteCount), raNext(), raWindow(), pfSize(), pageFlags(), vms(), lock() {
 	assert(!(flags & RF_SHAREABLE));
 	init(-1,success);
 	if(!success)
@@ -191,7 +191,6 @@ void Region::print(OStream &os,uintptr_t virt) const {
 		file->print(os);
 		os.writef("\n");
 	}
-	os.writef("\tTimestamp: %Lu\n",timestamp);
 	os.writef("\tProcesses: ");
 	for(auto it = vms.cbegin(); it != vms.cend(); ++it)
 		os.writef("%d ",(*it)->getProc()->getPid());
@@ -206,13 +205,28 @@ void Region::print(OStream &os,uintptr_t virt) const {
 	}
 }
 
+size_t Region::readahead(size_t page) {
+	if(flags & RF_RANDOM)
+		return 1;
+	if(flags & RF_SEQUENTIAL)
+		raWindow = RA_MAX;
+	/* if the last window has been consumed sequentially, double it */
+	else if(raWindow && page == raNext)
+		raWindow = esc::Util::min(raWindow * 2,(size_t)RA_MAX);
+	else
+		raWindow = RA_MIN;
+	raNext = page + raWindow;
+	return raWindow;
+}
+
 void Region::printFlags(OStream &os) const {
-	os.writef("%c%c%c%c%c%c%c",
+	os.writef("%c%c%c%c%c%c%c%c",
 		(flags & RF_WRITABLE) ? 'W' : 'w',
 		(flags & RF_EXECUTABLE) ? 'X' : 'x',
 		(flags & RF_GROWABLE) ? 'G' : 'g',
 		(flags & RF_SHAREABLE) ? 'S' : 's',
 		(flags & RF_LOCKED) ? 'L' : 'l',
 		(flags & RF_GROWS_DOWN) ? 'D' : 'd',
-		(flags & RF_NOFREE) ? 'f' : 'F');
+		(flags & RF_NOFREE) ? 'f' : 'F',
+		(flags & RF_RANDOM) ? 'R' : ((flags & RF_SEQUENTIAL) ? 'Q' : '-'));
 }
@@ -32,48 +32,45 @@
 
 size_t SwapMap::totalBlocks = 0;
 size_t SwapMap::freeBlocks = 0;
-SwapMap::Block *SwapMap::swapBlocks = NULL;
-SwapMap::Block *SwapMap::freeList = NULL;
+uint *SwapMap::refCounts = NULL;
+size_t SwapMap::nextBlock = 0;
 SpinLock SwapMap::lock;
 
 bool SwapMap::init(size_t swapSize) {
 	totalBlocks = swapSize / PAGE_SIZE;
 	freeBlocks = totalBlocks;
-	swapBlocks = (Block*)Cache::alloc(totalBlocks * sizeof(Block));
-	if(swapBlocks == NULL)
-		return false;
-
-	/* build freelist */
-	freeList = swapBlocks + 0;
-	swapBlocks[0].refCount = 0;
-	swapBlocks[0].next = NULL;
-	for(size_t i = 1; i < totalBlocks; i++) {
-		swapBlocks[i].next = freeList;
-		swapBlocks[i].refCount = 0;
-		freeList = swapBlocks + i;
-	}
-	return true;
+	nextBlock = 0;
+	refCounts = (uint*)Cache::calloc(totalBlocks,sizeof(uint));
+	return refCounts != NULL;
 }
 
-ulong SwapMap::alloc() {
+ulong SwapMap::alloc(size_t *count) {
 	LockGuard<SpinLock> g(&lock);
-	if(!freeList)
+	if(freeBlocks == 0)
 		return INVALID;
-	Block *block = freeList;
-	freeList = freeList->next;
-	block->refCount = 1;
-	freeBlocks--;
-	return block - swapBlocks;
+
+	/* next-fit: take the first free block behind the last allocation and as many of its
+	 * successors as are free */
+	size_t start = nextBlock;
+	while(refCounts[start] != 0) {
+		if(++start == totalBlocks)
+			start = 0;
+	}
+
+	size_t n = 0;
+	while(n < *count && start + n < totalBlocks && refCounts[start + n] == 0)
+		refCounts[start + n++] = 1;
+	freeBlocks -= n;
+	nextBlock = start + n == totalBlocks ? 0 : start + n;
+	*count = n;
+	return start;
 }
 
 void SwapMap::free(ulong block) {
 	LockGuard<SpinLock> g(&lock);
-	assert(block < totalBlocks);
-	if(--swapBlocks[block].refCount == 0) {
-		swapBlocks[block].next = freeList;
-		freeList = swapBlocks + block;
+	assert(block < totalBlocks && refCounts[block] > 0);
+	if(--refCounts[block] == 0)
 		freeBlocks++;
-	}
 }
 
 void SwapMap::print(OStream &os) {
@@ -82,11 +79,10 @@ void SwapMap::print(OStream &os) {
 	os.writef("Free: %zu blocks (%zu KiB)\n",freeBlocks,(freeBlocks * PAGE_SIZE) / 1024);
 	os.writef("Used:");
 	for(size_t i = 0; i < totalBlocks; i++) {
-		Block *block = swapBlocks + i;
-		if(block->refCount > 0) {
+		if(refCounts[i] > 0) {
 			if(c % 8 == 0)
 				os.writef("\n ");
-			os.writef("%5u[%u] ",i,block->refCount);
+			os.writef("%5u[%u] ",i,refCounts[i]);
 			c++;
 		}
 	}
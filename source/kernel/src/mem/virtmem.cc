@@ -28,6 +28,7 @@
 #include <task/proc.h>
 #include <task/smp.h>
 #include <task/thread.h>
+#include <task/vdso.h>
 #include <vfs/openfile.h>
 #include <vfs/vfs.h>
 #include <assert.h>
@@ -49,7 +50,21 @@
 
 #define DEBUG_SWAP			0
 
-static uint8_t buffer[PAGE_SIZE];
+/* a run of pages that is written to consecutive swap-blocks */
+struct SwapCluster {
+	ulong block;
+	size_t count;
+	frameno_t *frames;
+};
+
+static uint8_t buffer[VirtMem::SWAP_CLUSTER * PAGE_SIZE];
+/* the clusters of the current swap-out batch and their frames */
+static SwapCluster swapClusters[PhysMem::MAX_SWAP_AT_ONCE];
+static frameno_t swapFrames[PhysMem::MAX_SWAP_AT_ONCE];
+
+VirtMem *VirtMem::clockVM = NULL;
+Region *VirtMem::clockReg = NULL;
+size_t VirtMem::clockPage = 0;
 
 void VirtMem::acquire() const {
 	proc->lock(PLOCK_PROG);
@@ -131,6 +146,28 @@ errorRel:
 	return 0;
 }
 
+int VirtMem::mapVDSO() {
+	/* the frame belongs to the kernel; never free it, swap it out or make it writable */
+	VMRegion *vm;
+	int res = map(0,PAGE_SIZE,0,PROT_READ,MAP_SHARED | MAP_NOFREE | MAP_LOCKED | MAP_NOMAP,NULL,0,&vm);
+	if(res < 0)
+		return res;
+
+	acquire();
+	PageTables::RangeAllocator alloc(VDSO::getFrame());
+	res = getPageDir()->map(vm->virt(),1,alloc,PG_PRESENT);
+	if(res < 0) {
+		release();
+		unmap(vm);
+		return res;
+	}
+	addOwn(alloc.pageTables());
+	addShared(1);
+	vdsoAddr = vm->virt();
+	release();
+	return 0;
+}
+
 int VirtMem::map(uintptr_t *addr,size_t length,size_t loadCount,int prot,int flags,OpenFile *f,
                  off_t offset,VMRegion **vmreg) {
 	int res;
@@ -299,6 +336,8 @@ int VirtMem::protect(uintptr_t addr,ulong flags) {
 		/* the region may be mapped to a different virtual address */
 		VMRegion *mpreg = (*mp)->regtree.getByReg(vmreg->reg);
 		assert(mpreg != NULL);
+		/* send only one flush-request to each CPU that uses this page-dir */
+		TLBBatch batch((*mp)->getPageDir());
 		for(size_t i = 0; i < pgcount; i++) {
 			/* determine flags; we can't always mark it present.. */
 			uint mapFlags = 0;
@@ -391,115 +430,251 @@ int VirtMem::populatePages(VMRegion *vm,size_t count) {
 
 void VirtMem::swapOut(OpenFile *file,size_t count) {
 	while(count > 0) {
-		Region *reg = getLRURegion();
-		if(reg == NULL)
+		size_t clusters = 0;
+		size_t pages = reclaim(esc::Util::min(count,(size_t)PhysMem::MAX_SWAP_AT_ONCE),&clusters);
+		if(pages == 0)
 			Util::panic("No pages to swap out");
 
-		/* the list of processes may have changed in the meantime; we can't swap out in this case */
-		while(count > 0) {
-			/* get page to swap out */
-			ssize_t index = getPgIdxForSwap(reg);
-			if(index < 0)
-				break;
+		/* all pages of the batch are unmapped in all processes now. ensure that all CPUs have
+		 * flushed their TLB, so that nobody can still access them. if someone tries, he will cause
+		 * a page-fault and will wait until the swapper has handled it, i.e. after this batch */
+		SMP::ensureTLBFlushed();
 
-			/* get VM-region of first process */
-			VirtMem *vm = *reg->vmbegin();
-			VMRegion *vmreg = vm->regtree.getByReg(reg);
+		/* write them out without holding any locks, so that the processes can continue */
+		for(size_t i = 0; i < clusters; ++i) {
+			SwapCluster *c = swapClusters + i;
+			/* copy to a temporary buffer because we can't use the temp-area when switching threads */
+			for(size_t j = 0; j < c->count; ++j) {
+				PageDir::copyFromFrame(c->frames[j],buffer + j * PAGE_SIZE);
+				PhysMem::free(c->frames[j],PhysMem::USR);
+			}
 
-			/* find swap-block */
-			ulong block = SwapMap::alloc();
-			assert(block != SwapMap::INVALID);
+			sassert(file->seek(c->block * PAGE_SIZE,SEEK_SET) >= 0);
+			sassert(file->write(buffer,c->count * PAGE_SIZE) == (ssize_t)(c->count * PAGE_SIZE));
+		}
+		count -= pages;
+	}
+}
 
-			/* get the frame first, because the page has to be present */
-			frameno_t frameNo = vm->getPageDir()->getFrameNo(vmreg->virt() + index * PAGE_SIZE);
+size_t VirtMem::reclaim(size_t count,size_t *clusters) {
+	size_t pages = 0;
+	VMTree *first = VMTree::reqTree();
+
+	/* continue at the clock-hand, if the process still exists */
+	VMTree *tree = first;
+	while(tree != NULL && tree->getVM() != clockVM)
+		tree = tree->getNext();
+	if(tree == NULL) {
+		tree = first;
+		clockReg = NULL;
+	}
 
-#if DEBUG_SWAP
-			Log::get().writef("OUT: %d of region %x (frame %#x, block %d)\n",index,vmreg->reg,frameNo,block);
-			for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
-				VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
-				Log::get().writef("\tProcess %d:%s -> page %p\n",(*mp)->getProc()->getPid(),
-						(*mp)->getProc()->getProgram(),mpreg->virt() + index * PAGE_SIZE);
+	/* the first round might only clear the accessed-bits, so that we might need a second one.
+	 * since we start in the middle, we have to wrap around up to 3 times for that */
+	int wraps = 0;
+	while(tree != NULL && pages < count && wraps < 3) {
+		VirtMem *vm = tree->getVM();
+		/* we have to try to acquire the mutexes, otherwise we risk a deadlock. suppose that fs has
+		 * to swap out to get more memory. if we want to demand-load something before this
+		 * operation is finished and lock the region for that, the swapper will find this region
+		 * at this place locked. so we have to skip it in this case to be able to continue. */
+		if(vm->tryAquire()) {
+			auto vmreg = tree->begin();
+			size_t page = 0;
+			if(clockReg) {
+				for(auto it = tree->begin(); it != tree->end(); ++it) {
+					if(it->reg == clockReg) {
+						vmreg = it;
+						page = clockPage;
+						break;
+					}
+				}
+				clockReg = NULL;
 			}
-			Log::get().writef("\n");
-#endif
 
-			/* unmap the page in all processes and ensure that all CPUs have flushed their TLB */
-			/* this way we know that nobody can still access the page; if someone tries, he will
-			 * cause a page-fault and will wait until we release the region-mutex */
-			setSwappedOut(reg,index);
-			reg->setSwapBlock(index,block);
-			SMP::ensureTLBFlushed();
+			for(; vmreg != tree->end() && pages < count; ++vmreg) {
+				Region *reg = vmreg->reg;
+				if(!(reg->getFlags() & (RF_LOCKED | RF_NOFREE)) && reg->tryAquire()) {
+					page = reclaimRegion(reg,page,count,&pages,clusters);
+					reg->release();
+					/* remember where to continue next time */
+					if(pages == count) {
+						clockVM = vm;
+						clockReg = reg;
+						clockPage = page;
+					}
+				}
+				page = 0;
+			}
+			vm->release();
+		}
 
-			/* copy to a temporary buffer because we can't use the temp-area when switching threads */
-			PageDir::copyFromFrame(frameNo,buffer);
-			PhysMem::free(frameNo,PhysMem::USR);
+		if(pages < count) {
+			tree = tree->getNext();
+			if(tree == NULL) {
+				tree = first;
+				wraps++;
+			}
+		}
+	}
+	VMTree::relTree();
+	return pages;
+}
+
+size_t VirtMem::reclaimRegion(Region *reg,size_t page,size_t max,size_t *pages,size_t *clusters) {
+	size_t total = BYTES_2_PAGES(reg->getByteCount());
+	while(page < total && *pages < max) {
+		/* collect a run of pages that have not been accessed since we've been here last time */
+		size_t count = 0;
+		bool accessed = false;
+		while(count < SWAP_CLUSTER && *pages + count < max && page + count < total) {
+			if(!isReclaimable(reg,page + count)) {
+				accessed = true;
+				break;
+			}
+			count++;
+		}
+		if(count == 0) {
+			page++;
+			continue;
+		}
 
-			/* write out on disk */
-			sassert(file->seek(block * PAGE_SIZE,SEEK_SET) >= 0);
-			sassert(file->write(buffer,PAGE_SIZE) == PAGE_SIZE);
+		/* if we get less blocks, the remaining pages are taken in the next iteration */
+		size_t run = count;
+		ulong block = SwapMap::alloc(&count);
+		assert(block != SwapMap::INVALID);
+
+		/* get the frames first, because the pages have to be present */
+		VirtMem *vm = *reg->vmbegin();
+		VMRegion *vmreg = vm->regtree.getByReg(reg);
+		SwapCluster *c = swapClusters + (*clusters)++;
+		c->block = block;
+		c->count = count;
+		c->frames = swapFrames + *pages;
+		for(size_t i = 0; i < count; ++i) {
+			c->frames[i] = vm->getPageDir()->getFrameNo(vmreg->virt() + (page + i) * PAGE_SIZE);
+			/* copy-on-write frames are not swapped, because they belong to multiple regions */
+			assert(!PhysMem::getFrame(c->frames[i]) ||
+				!(PhysMem::getFrame(c->frames[i])->flags & PhysMem::Frame::COW));
+		}
 
-			count--;
+#if DEBUG_SWAP
+		Log::get().writef("OUT: %zu..%zu of region %x (block %d)\n",page,page + count - 1,reg,block);
+		for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
+			VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
+			Log::get().writef("\tProcess %d:%s -> page %p\n",(*mp)->getProc()->getPid(),
+					(*mp)->getProc()->getProgram(),mpreg->virt() + page * PAGE_SIZE);
 		}
-		reg->release();
+		Log::get().writef("\n");
+#endif
+
+		/* unmap the pages in all processes. the TLB is flushed for the whole batch afterwards */
+		setSwappedOut(reg,page,count);
+		for(size_t i = 0; i < count; ++i)
+			reg->setSwapBlock(page + i,block + i);
+
+		*pages += count;
+		page += count;
+		/* give the page behind the run a second chance, i.e. don't look at it again now */
+		if(accessed && count == run)
+			page++;
 	}
+	return page;
 }
 
-bool VirtMem::swapIn(OpenFile *file,Thread *t,uintptr_t addr) {
+bool VirtMem::isReclaimable(Region *reg,size_t page) {
+	if(reg->getPageFlags(page) != 0)
+		return false;
+
+	/* clear the accessed-bit in all processes to notice the next access */
+	bool accessed = false;
+	for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
+		VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
+		uintptr_t addr = mpreg->virt() + page * PAGE_SIZE;
+		if(!(*mp)->getPageDir()->isPresent(addr))
+			return false;
+		if((*mp)->getPageDir()->testAndClearAccessed(addr))
+			accessed = true;
+	}
+	if(accessed)
+		return false;
+
+	/* the frame of a futex has to stay the same as long as somebody waits on it */
+	VirtMem *vm = *reg->vmbegin();
+	VMRegion *vmreg = vm->regtree.getByReg(reg);
+	const PhysMem::Frame *frame = PhysMem::getFrame(
+		vm->getPageDir()->getFrameNo(vmreg->virt() + page * PAGE_SIZE));
+	return !frame || frame->waiters == 0;
+}
+
+bool VirtMem::isSwappedTo(const Region *reg,size_t page,ulong block) {
+	return (reg->getPageFlags(page) & PF_SWAPPED) && reg->getSwapBlock(page) == block;
+}
+
+size_t VirtMem::swapIn(OpenFile *file,Thread *t,uintptr_t addr) {
 	VMRegion *vmreg = t->getProc()->getVM()->regtree.getByAddr(addr);
 	if(!vmreg)
-		return false;
+		return 0;
 
+	Region *reg = vmreg->reg;
 	addr &= ~(PAGE_SIZE - 1);
 	size_t index = (addr - vmreg->virt()) / PAGE_SIZE;
 
 	/* not swapped anymore? so probably another process has already swapped it in */
-	if(!(vmreg->reg->getPageFlags(index) & PF_SWAPPED))
-		return false;
+	if(!(reg->getPageFlags(index) & PF_SWAPPED))
+		return 0;
 
-	ulong block = vmreg->reg->getSwapBlock(index);
+	/* read the neighbouring pages as well, if they are in the neighbouring swap-blocks. the
+	 * thread holds the region-lock, so that we can safely touch them */
+	ulong block = reg->getSwapBlock(index);
+	size_t total = BYTES_2_PAGES(reg->getByteCount());
+	size_t first = index, count = 1;
+	while(count < SWAP_CLUSTER && first > 0 && block > index - first &&
+			isSwappedTo(reg,first - 1,block - (index - first) - 1)) {
+		first--;
+		count++;
+	}
+	while(count < SWAP_CLUSTER && first + count < total &&
+			isSwappedTo(reg,first + count,block + (first + count - index)))
+		count++;
+
+	/* the thread has reserved the frame for its page; we need frames for the others. but we can't
+	 * swap to get them, of course */
+	Thread *cur = Thread::getRunning();
+	if(count > 1 && !cur->reserveFrames(count - 1,false)) {
+		first = index;
+		count = 1;
+	}
 
 	/* read into buffer (note that we can use the same for swap-in and swap-out because its both
 	 * done by the swapper-thread) */
-	sassert(file->seek(block * PAGE_SIZE,SEEK_SET) >= 0);
-	sassert(file->read(buffer,PAGE_SIZE) == PAGE_SIZE);
+	sassert(file->seek((block - (index - first)) * PAGE_SIZE,SEEK_SET) >= 0);
+	sassert(file->read(buffer,count * PAGE_SIZE) == (ssize_t)(count * PAGE_SIZE));
 
-	/* copy into a new frame */
-	frameno_t frame = t->getFrame();
-	PageDir::copyToFrame(frame,buffer);
+	for(size_t i = 0; i < count; ++i) {
+		size_t page = first + i;
+		ulong pblock = reg->getSwapBlock(page);
+
+		/* copy into a new frame */
+		frameno_t frame = page == index ? t->getFrame() : cur->getFrame();
+		PageDir::copyToFrame(frame,buffer + i * PAGE_SIZE);
 
 #if DEBUG_SWAP
-	Log::get().writef("IN: %d of region %x (frame %#x, block %d)\n",index,vmreg->reg,frame,block);
-	for(auto mp = vmreg->reg->vmbegin(); mp != vmreg->reg->vmend(); ++mp) {
-		VMRegion *mpreg = (*mp)->regtree.getByReg(vmreg->reg);
-		Log::get().writef("\tProcess %d:%s -> page %p\n",(*mp)->getProc()->getPid(),
-				(*mp)->getProc()->getProgram(),mpreg->virt() + index * PAGE_SIZE);
-	}
-	Log::get().writef("\n");
+		Log::get().writef("IN: %d of region %x (frame %#x, block %d)\n",page,reg,frame,pblock);
+		for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
+			VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
+			Log::get().writef("\tProcess %d:%s -> page %p\n",(*mp)->getProc()->getPid(),
+					(*mp)->getProc()->getProgram(),mpreg->virt() + page * PAGE_SIZE);
+		}
+		Log::get().writef("\n");
 #endif
 
-	/* mark as not-swapped and map into all affected processes */
-	setSwappedIn(vmreg->reg,index,frame);
-	/* free swap-block */
-	SwapMap::free(block);
-	return true;
-}
-
-void VirtMem::setTimestamp(Thread *t,uint64_t timestamp) {
-	/* ignore setting the timestamp if the process is currently locked; its not that critical and
-	 * we can't wait for the mutex here because this is called from Thread::switchAway() and the wait
-	 * for the mutex would call that as well */
-	VirtMem *vm = t->getProc()->getVM();
-	if(vm->tryAquire()) {
-		for(size_t i = 0; i < STACK_REG_COUNT; i++) {
-			if(t->getStackRegion(i))
-				t->getStackRegion(i)->reg->setTimestamp(timestamp);
-		}
-		for(auto reg = vm->regtree.begin(); reg != vm->regtree.end(); ++reg) {
-			if(!(reg->reg->getFlags() & RF_STACK))
-				reg->reg->setTimestamp(timestamp);
-		}
-		vm->release();
+		/* mark as not-swapped and map into all affected processes */
+		setSwappedIn(reg,page,frame);
+		/* free swap-block */
+		SwapMap::free(pblock);
 	}
+	return count;
 }
 
 size_t VirtMem::getMemUsage(size_t *pages) const {
@@ -532,6 +707,70 @@ void VirtMem::getRegRange(VMRegion *vm,uintptr_t *start,uintptr_t *end,bool lock
 		release();
 }
 
+int VirtMem::getFrames(uintptr_t virt,frameno_t *frames,size_t count) {
+	int res = 0;
+	acquire();
+	VMRegion *vm = regtree.getByAddr(virt);
+	if(vm == NULL)
+		res = -ENXIO;
+	/* the frames of unlocked regions might change at any time (swapping, cow, ...) */
+	else if(!(vm->reg->getFlags() & RF_LOCKED))
+		res = -EPERM;
+	else if(virt + count * PAGE_SIZE > vm->virt() + vm->reg->getByteCount())
+		res = -EINVAL;
+	else {
+		for(size_t i = 0; i < count; ++i) {
+			uintptr_t addr = virt + i * PAGE_SIZE;
+			if(!getPageDir()->isPresent(addr)) {
+				res = -EFAULT;
+				break;
+			}
+			frames[i] = getPageDir()->getFrameNo(addr);
+		}
+	}
+	release();
+	return res;
+}
+
+int VirtMem::acquireFrame(uintptr_t virt,frameno_t *frame) {
+	Thread *t = Thread::getRunning();
+	assert(t->getProc()->getVM() == this);
+
+	/* we might need a frame for copy-on-write or to swap the page in */
+	if(!t->reserveFrames(1))
+		return -ENOMEM;
+
+	acquire();
+	VMRegion *vm = regtree.getByAddr(virt);
+	if(vm == NULL || !(vm->reg->getFlags() & RF_WRITABLE)) {
+		release();
+		t->discardFrames();
+		return -EFAULT;
+	}
+
+	vm->reg->acquire();
+	int res = 0;
+	size_t page = (virt - vm->virt()) / PAGE_SIZE;
+	if(vm->reg->getPageFlags(page) != 0 || !getPageDir()->isPresent(virt))
+		res = doPagefault(virt,vm,true);
+	t->discardFrames();
+	if(res == 0 && !getPageDir()->isPresent(virt))
+		res = -EFAULT;
+	if(res < 0) {
+		vm->reg->release();
+		release();
+		return res;
+	}
+	*frame = getPageDir()->getFrameNo(virt);
+	return 0;
+}
+
+void VirtMem::releaseFrame(uintptr_t virt) {
+	VMRegion *vm = regtree.getByAddr(virt);
+	vm->reg->release();
+	release();
+}
+
 int VirtMem::getRegRange(uintptr_t virt,uintptr_t *start,uintptr_t *end) {
 	int res = 0;
 	acquire();
@@ -663,6 +902,9 @@ void VirtMem::doUnmap(VMRegion *vm) {
 	size_t pcount = BYTES_2_PAGES(vm->reg->getByteCount());
 	sassert(vm->reg->remFrom(this));
 	PageTables::NoAllocator alloc;
+	/* the vDSO-region is shared with other processes */
+	if(vm->virt() == vdsoAddr)
+		vdsoAddr = 0;
 	if(vm->reg->refCount() == 0) {
 		uintptr_t virt = vm->virt();
 		/* first, write the content of the memory back to the file, if necessary */
@@ -849,6 +1091,82 @@ errProc:
 	return res;
 }
 
+int VirtMem::loanPages(uintptr_t addr,size_t count,frameno_t *frames) {
+	PageTables::NoAllocator alloc;
+	int res = -EFAULT;
+	size_t i = 0;
+	acquire();
+	VMRegion *vm = regtree.getByAddr(addr);
+	if(!vm || addr + count * PAGE_SIZE > vm->virt() + vm->reg->getByteCount()) {
+		release();
+		return -EFAULT;
+	}
+
+	vm->reg->acquire();
+	/* frames of shared regions can change behind our back and the ones of RF_NOFREE regions
+	 * don't belong to us */
+	if(vm->reg->getFlags() & (RF_SHAREABLE | RF_NOFREE))
+		goto error;
+
+	{
+		size_t first = (addr - vm->virt()) / PAGE_SIZE;
+		uint mapFlags = PG_PRESENT;
+		if(vm->reg->getFlags() & RF_EXECUTABLE)
+			mapFlags |= PG_EXECUTABLE;
+		/* the pages are write-protected on the other CPUs before we leave this block */
+		TLBBatch batch(getPageDir());
+		for(; i < count; i++) {
+			uintptr_t virt = addr + i * PAGE_SIZE;
+			ulong pflags = vm->reg->getPageFlags(first + i);
+			/* the page has to be present */
+			if(pflags & (PF_DEMANDLOAD | PF_SWAPPED))
+				goto error;
+
+			/* the receiver copies directly out of the frame, which might cause page-faults. thus,
+			 * we can't use the temporary mapping for it */
+			frames[i] = getPageDir()->getFrameNo(virt);
+			if(frames[i] * PAGE_SIZE >= DIR_MAP_AREA_SIZE)
+				goto error;
+
+			/* one reference for the loan */
+			if(!CopyOnWrite::add(frames[i]))
+				goto error;
+			/* and one for us, if not already done; the next write will give us a copy */
+			if(!(pflags & PF_COPYONWRITE)) {
+				if(!CopyOnWrite::add(frames[i])) {
+					bool other;
+					CopyOnWrite::remove(frames[i],&other);
+					goto error;
+				}
+				vm->reg->setPageFlags(first + i,pflags | PF_COPYONWRITE);
+				addShared(1);
+				addOwn(-1);
+				/* can't fail because of NoAllocator and because the page-table is present */
+				sassert(getPageDir()->map(virt,1,alloc,mapFlags) == 0);
+			}
+		}
+	}
+	res = 0;
+
+error:
+	/* the pages stay copy-on-write; we get the frames back as soon as we write to them */
+	if(res < 0)
+		releaseLoan(frames,i);
+	vm->reg->release();
+	release();
+	return res;
+}
+
+void VirtMem::releaseLoan(const frameno_t *frames,size_t count) {
+	for(size_t i = 0; i < count; i++) {
+		bool other;
+		CopyOnWrite::remove(frames[i],&other);
+		/* if the owner has already written to it or has unmapped it, the frame is ours */
+		if(!other)
+			PhysMem::free(frames[i],PhysMem::USR);
+	}
+}
+
 int VirtMem::cloneAll(VirtMem *dst) {
 	Thread *t = Thread::getRunning();
 	VMTree::iterator vm;
@@ -865,6 +1183,7 @@ int VirtMem::cloneAll(VirtMem *dst) {
 	}
 
 	dst->dataAddr = dataAddr;
+	dst->vdsoAddr = vdsoAddr;
 
 	for(vm = regtree.begin(); vm != regtree.end(); ++vm) {
 		/* just clone the tls- and stack-region of the current thread */
@@ -1136,6 +1455,8 @@ const char *VirtMem::getRegName(const VMRegion *vm) const {
 	const char *name = "";
 	if(vm->virt() == dataAddr)
 		name = "data";
+	else if(vm->virt() == vdsoAddr)
+		name = "vdso";
 	else if(vm->reg->getFlags() & RF_STACK)
 		name = "stack";
 	else if(vm->reg->getFlags() & RF_NOFREE)
@@ -1207,103 +1528,118 @@ void VirtMem::print(OStream &os) const {
 }
 
 int VirtMem::demandLoad(VMRegion *vm,uintptr_t addr) {
-	int res;
-
-	/* calculate the number of bytes to load and zero */
-	size_t loadCount = 0, zeroCount;
+	/* load from file. this zeros the rest of the last page, too */
 	uintptr_t offset = addr - vm->virt();
 	if(offset < vm->reg->getLoadCount())
-		loadCount = esc::Util::min((size_t)PAGE_SIZE,(size_t)(vm->reg->getLoadCount() - offset));
-	zeroCount = esc::Util::min((size_t)PAGE_SIZE,(size_t)(vm->reg->getByteCount() - offset)) - loadCount;
-
-	/* load from file */
-	if(loadCount)
-		res = loadFromFile(vm,addr,loadCount);
-	else
-		res = 0;
+		return loadFromFile(vm,addr);
 
-	/* zero the rest, if necessary */
-	if(res == 0 && zeroCount) {
+	/* zero the page, if necessary */
+	size_t zeroCount = esc::Util::min((size_t)PAGE_SIZE,(size_t)(vm->reg->getByteCount() - offset));
+	if(zeroCount) {
 		/* do the memclear before the mapping to ensure that it's ready when the first CPU sees it */
-		frameno_t frame = loadCount ? Proc::getCurPageDir()->getFrameNo(addr)
-									: Thread::getRunning()->getFrame();
+		frameno_t frame = Thread::getRunning()->getFrame();
 		uintptr_t frameAddr = PageDir::getAccess(frame);
-		memclear((void*)(frameAddr + loadCount),zeroCount);
+		memclear((void*)frameAddr,zeroCount);
 		PageDir::removeAccess(frame);
-		/* if the pages weren't present so far, map them into every process that has this region */
-		if(!loadCount) {
-			uint mapFlags = PG_PRESENT;
-			if(vm->reg->getFlags() & RF_WRITABLE)
-				mapFlags |= PG_WRITABLE;
-			/* this doesn't seem to make a lot of sense but is necessary for initloader */
-			if(vm->reg->getFlags() & RF_EXECUTABLE)
-				mapFlags |= PG_EXECUTABLE;
-			for(auto mp = vm->reg->vmbegin(); mp != vm->reg->vmend(); ++mp) {
-				/* the region may be mapped to a different virtual address */
-				PageTables::RangeAllocator alloc(frame);
-				VMRegion *mpreg = (*mp)->regtree.getByReg(vm->reg);
-				/* can't fail */
-				sassert((*mp)->getPageDir()->map(mpreg->virt() + offset,1,alloc,mapFlags) == 0);
-				if(vm->reg->getFlags() & RF_SHAREABLE)
-					(*mp)->addShared(1);
-				else
-					(*mp)->addOwn(1);
-			}
-		}
+		/* map it into every process that has this region */
+		mapLoaded(vm,offset,frame);
+	}
+	return 0;
+}
+
+void VirtMem::mapLoaded(VMRegion *vm,uintptr_t offset,frameno_t frame) {
+	uint mapFlags = PG_PRESENT;
+	if(vm->reg->getFlags() & RF_WRITABLE)
+		mapFlags |= PG_WRITABLE;
+	/* this doesn't seem to make a lot of sense but is necessary for initloader */
+	if(vm->reg->getFlags() & RF_EXECUTABLE)
+		mapFlags |= PG_EXECUTABLE;
+	for(auto mp = vm->reg->vmbegin(); mp != vm->reg->vmend(); ++mp) {
+		/* the region may be mapped to a different virtual address */
+		PageTables::RangeAllocator alloc(frame);
+		VMRegion *mpreg = (*mp)->regtree.getByReg(vm->reg);
+		/* can't fail */
+		sassert((*mp)->getPageDir()->map(mpreg->virt() + offset,1,alloc,mapFlags) == 0);
+		if(vm->reg->getFlags() & RF_SHAREABLE)
+			(*mp)->addShared(1);
+		else
+			(*mp)->addOwn(1);
 	}
-	return res;
 }
 
-int VirtMem::loadFromFile(VMRegion *vm,uintptr_t addr,size_t loadCount) {
-	uint mapFlags;
-	frameno_t frame;
+int VirtMem::loadFromFile(VMRegion *vm,uintptr_t addr) {
+	Region *reg = vm->reg;
+	uintptr_t offset = addr - vm->virt();
+	size_t page = offset / PAGE_SIZE;
+	size_t total;
 	void *tempBuf;
+
+	/* determine the number of pages to load at once. we can only take the following pages that
+	 * come from the file and have not been loaded yet. note that all pages of the region are
+	 * mapped into every process that uses the region, once they are loaded. thus, there are no
+	 * neighbouring pages we could simply map here. */
+	size_t count = 1;
+	size_t max = reg->readahead(page);
+	while(count < max && offset + count * PAGE_SIZE < reg->getLoadCount() &&
+			reg->getPageFlags(page + count) == PF_DEMANDLOAD)
+		count++;
+
+	/* the frame for the faulting page has been reserved by the caller. we hold the region-lock,
+	 * so that we can't swap to get the others. if that's not possible, just load one page. */
+	if(count > 1 && !Thread::getRunning()->reserveFrames(count - 1,false))
+		count = 1;
+
 	/* note that we currently ignore that the file might have changed in the meantime */
 	ssize_t err;
-	off_t pos = vm->reg->getOffset() + (addr - vm->virt());
-	if((err = vm->reg->getFile()->seek(pos,SEEK_SET)) < 0)
+	if((err = reg->getFile()->seek(reg->getOffset() + offset,SEEK_SET)) < 0)
 		goto error;
 
 	/* first read into a temp-buffer because we can't mark the page as present until
 	 * its read from disk. and we can't use a temporary mapping when switching
 	 * threads. */
-	tempBuf = Cache::alloc(PAGE_SIZE);
+	total = esc::Util::min(count * PAGE_SIZE,(size_t)(reg->getLoadCount() - offset));
+	tempBuf = Cache::alloc(total);
+	if(tempBuf == NULL && count > 1) {
+		count = 1;
+		total = esc::Util::min((size_t)PAGE_SIZE,total);
+		tempBuf = Cache::alloc(total);
+	}
 	if(tempBuf == NULL) {
 		err = -ENOMEM;
 		goto error;
 	}
-	err = vm->reg->getFile()->read(tempBuf,loadCount);
-	if(err != (ssize_t)loadCount) {
+	err = reg->getFile()->read(tempBuf,total);
+	if(err != (ssize_t)total) {
 		if(err >= 0)
 			err = -ENOMEM;
 		goto errorFree;
 	}
 
-	/* copy into frame */
-	frame = PageDir::demandLoad(tempBuf,loadCount,vm->reg->getFlags());
+	for(size_t i = 0; i < count; ++i) {
+		uintptr_t pgoff = offset + i * PAGE_SIZE;
+		size_t loadCount = esc::Util::min((size_t)PAGE_SIZE,total - i * PAGE_SIZE);
+		size_t zeroCount = esc::Util::min((size_t)PAGE_SIZE,
+			(size_t)(reg->getByteCount() - pgoff)) - loadCount;
+
+		/* copy into frame and zero the rest, if necessary */
+		frameno_t frame = PageDir::demandLoad((char*)tempBuf + i * PAGE_SIZE,loadCount,reg->getFlags());
+		if(zeroCount) {
+			uintptr_t frameAddr = PageDir::getAccess(frame);
+			memclear((void*)(frameAddr + loadCount),zeroCount);
+			PageDir::removeAccess(frame);
+		}
 
-	/* free resources not needed anymore */
-	Cache::free(tempBuf);
+		/* map into all pagedirs */
+		mapLoaded(vm,pgoff,frame);
 
-	/* map into all pagedirs */
-	{
-		mapFlags = PG_PRESENT;
-		if(vm->reg->getFlags() & RF_WRITABLE)
-			mapFlags |= PG_WRITABLE;
-		if(vm->reg->getFlags() & RF_EXECUTABLE)
-			mapFlags |= PG_EXECUTABLE;
-		for(auto mp = vm->reg->vmbegin(); mp != vm->reg->vmend(); ++mp) {
-			PageTables::RangeAllocator alloc(frame);
-			/* the region may be mapped to a different virtual address */
-			VMRegion *mpreg = (*mp)->regtree.getByReg(vm->reg);
-			/* can't fail */
-			sassert((*mp)->getPageDir()->map(mpreg->virt() + (addr - vm->virt()),1,alloc,mapFlags) == 0);
-			if(vm->reg->getFlags() & RF_SHAREABLE)
-				(*mp)->addShared(1);
-			else
-				(*mp)->addOwn(1);
-		}
+		/* the caller clears the flag for the faulting page */
+		if(i > 0)
+			reg->setPageFlags(page + i,reg->getPageFlags(page + i) & ~PF_DEMANDLOAD);
 	}
+	faultsAvoided += count - 1;
+
+	/* free resources not needed anymore */
+	Cache::free(tempBuf);
 	return 0;
 
 errorFree:
@@ -1314,83 +1650,21 @@ error:
 	return err;
 }
 
-Region *VirtMem::getLRURegion() {
-	Region *lru = NULL;
-	uint64_t ts = (uint64_t)-1;
-	VMTree *tree = VMTree::reqTree();
-	for(; tree != NULL; tree = tree->getNext()) {
-		/* same as below; we have to try to acquire the mutex, otherwise we risk a deadlock */
-		if(tree->getVM()->tryAquire()) {
-			for(auto vm = tree->cbegin(); vm != tree->cend(); ++vm) {
-				size_t count = 0;
-				if(vm->reg->getTimestamp() >= ts)
-					continue;
-
-				/* we can't block here because otherwise we risk a deadlock. suppose that fs has to
-				 * swap out to get more memory. if we want to demand-load something before this operation
-				 * is finished and lock the region for that, the swapper will find this region at this
-				 * place locked. so we have to skip it in this case to be able to continue. */
-				if(vm->reg->tryAquire()) {
-					/* skip locked regions */
-					if(~vm->reg->getFlags() & RF_LOCKED) {
-						size_t pages = BYTES_2_PAGES(vm->reg->getByteCount());
-						for(size_t j = 0; j < pages; j++) {
-							if(!(vm->reg->getPageFlags(j) & (PF_SWAPPED | PF_COPYONWRITE | PF_DEMANDLOAD))) {
-								count++;
-								break;
-							}
-						}
-					}
-					if(count > 0) {
-						if(lru)
-							lru->release();
-						ts = vm->reg->getTimestamp();
-						lru = vm->reg;
-					}
-					else
-						vm->reg->release();
-				}
-			}
-			tree->getVM()->release();
-		}
-	}
-	VMTree::relTree();
-	return lru;
-}
-
-ssize_t VirtMem::getPgIdxForSwap(const Region *reg) {
-	size_t pages = BYTES_2_PAGES(reg->getByteCount());
-	size_t count = 0;
-	for(size_t i = 0; i < pages; i++) {
-		if(!(reg->getPageFlags(i) & (PF_SWAPPED | PF_COPYONWRITE | PF_DEMANDLOAD)))
-			count++;
-	}
-	if(count > 0) {
-		size_t index = Util::rand() % count;
-		for(size_t i = 0; i < pages; i++) {
-			if(!(reg->getPageFlags(i) & (PF_SWAPPED | PF_COPYONWRITE | PF_DEMANDLOAD))) {
-				if(index-- == 0)
-					return i;
-			}
-		}
-	}
-	return -1;
-}
-
-void VirtMem::setSwappedOut(Region *reg,size_t index) {
+void VirtMem::setSwappedOut(Region *reg,size_t index,size_t count) {
 	uintptr_t offset = index * PAGE_SIZE;
 	PageTables::NoAllocator alloc;
-	reg->setPageFlags(index,reg->getPageFlags(index) | PF_SWAPPED);
+	for(size_t i = 0; i < count; ++i)
+		reg->setPageFlags(index + i,reg->getPageFlags(index + i) | PF_SWAPPED);
 	for(auto mp = reg->vmbegin(); mp != reg->vmend(); ++mp) {
 		/* the region may be mapped to a different virtual address */
 		VMRegion *mpreg = (*mp)->regtree.getByReg(reg);
 		/* can't fail */
-		sassert((*mp)->getPageDir()->map(mpreg->virt() + offset,1,alloc,0) == 0);
+		sassert((*mp)->getPageDir()->map(mpreg->virt() + offset,count,alloc,0) == 0);
 		if(reg->getFlags() & RF_SHAREABLE)
-			(*mp)->addShared(-1);
+			(*mp)->addShared(-(long)count);
 		else
-			(*mp)->addOwn(-1);
-		(*mp)->addSwap(1);
+			(*mp)->addOwn(-(long)count);
+		(*mp)->addSwap(count);
 	}
 }
 
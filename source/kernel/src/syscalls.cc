@@ -123,6 +123,9 @@ const Syscalls::handler_func Syscalls::syscalls[] = {
 	utime,
 	truncate,
 	symlink,
+	virt2phys,
+	futexwait,
+	futexwake,
 #if defined(__x86__)
 	reqports,
 	relports,
@@ -17,6 +17,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <esc/util.h>
 #include <mem/kheap.h>
 #include <mem/pagedir.h>
 #include <mem/virtmem.h>
@@ -167,6 +168,38 @@ int Syscalls::mlockall(Thread *t,IntrptStackFrame *stack) {
 	SYSC_RESULT(stack,res);
 }
 
+int Syscalls::virt2phys(Thread *t,IntrptStackFrame *stack) {
+	uintptr_t virt = SYSC_ARG1(stack);
+	uintptr_t *phys = (uintptr_t*)SYSC_ARG2(stack);
+	size_t count = SYSC_ARG3(stack);
+	frameno_t frames[32];
+
+	/* physical addresses are only meant for drivers, which run as root */
+	if(EXPECT_FALSE(t->getProc()->getUid() != ROOT_UID))
+		SYSC_ERROR(stack,-EPERM);
+	if(EXPECT_FALSE(count == 0 || (virt & (PAGE_SIZE - 1))))
+		SYSC_ERROR(stack,-EINVAL);
+	if(EXPECT_FALSE(count > ~(size_t)0 / PAGE_SIZE ||
+			!PageDir::isInUserSpace((uintptr_t)phys,count * sizeof(uintptr_t))))
+		SYSC_ERROR(stack,-EFAULT);
+
+	/* do it in chunks to not need a heap-allocation */
+	while(count > 0) {
+		size_t amount = esc::Util::min(count,ARRAY_SIZE(frames));
+		int res = t->getProc()->getVM()->getFrames(virt,frames,amount);
+		if(EXPECT_FALSE(res < 0))
+			SYSC_ERROR(stack,res);
+		for(size_t i = 0; i < amount; ++i) {
+			if(EXPECT_FALSE(UserAccess::writeVar(phys + i,(uintptr_t)(frames[i] * PAGE_SIZE)) < 0))
+				SYSC_ERROR(stack,-EFAULT);
+		}
+		virt += amount * PAGE_SIZE;
+		phys += amount;
+		count -= amount;
+	}
+	SYSC_SUCCESS(stack,0);
+}
+
 int Syscalls::mattr(A_UNUSED Thread *t,IntrptStackFrame *stack) {
 	uintptr_t phys = (uintptr_t)SYSC_ARG1(stack);
 	size_t bytes = SYSC_ARG2(stack);
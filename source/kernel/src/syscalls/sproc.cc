@@ -112,6 +112,9 @@ int Syscalls::setgroups(Thread *t,IntrptStackFrame *stack) {
 
 int Syscalls::fork(A_UNUSED Thread *t,IntrptStackFrame *stack) {
 	int res = Proc::clone(0);
+	/* the child has a copy of our stack, so that it would see our ids */
+	if(res == 0)
+		UEnv::setThreadInfo(Thread::getRunning());
 	SYSC_RESULT(stack,res);
 }
 
@@ -20,6 +20,7 @@
 #include <mem/cache.h>
 #include <mem/pagedir.h>
 #include <task/filedesc.h>
+#include <task/futex.h>
 #include <task/proc.h>
 #include <task/sched.h>
 #include <task/sems.h>
@@ -72,16 +73,14 @@ int Syscalls::alarm(Thread *t,IntrptStackFrame *stack) {
 	/* ensure that we're not already in the list */
 	Timer::removeThread(t->getTid());
 
-	/* TODO support microseconds */
-	int res = Timer::sleepFor(t->getTid(),usecs / 1000,false);
+	int res = Timer::sleepFor(t->getTid(),usecs,false);
 	SYSC_RESULT(stack,res);
 }
 
 int Syscalls::sleep(Thread *t,IntrptStackFrame *stack) {
 	time_t usecs = SYSC_ARG1(stack);
 
-	/* TODO support microseconds */
-	int res = Timer::sleepFor(t->getTid(),usecs / 1000,true);
+	int res = Timer::sleepFor(t->getTid(),usecs,true);
 	if(EXPECT_FALSE(res < 0))
 		SYSC_ERROR(stack,res);
 
@@ -181,3 +180,29 @@ int Syscalls::semdestr(Thread *t,IntrptStackFrame *stack) {
 	Sems::destroy(t->getProc(),sem);
 	SYSC_SUCCESS(stack,0);
 }
+
+int Syscalls::futexwait(Thread *t,IntrptStackFrame *stack) {
+	long *addr = (long*)SYSC_ARG1(stack);
+	long val = (long)SYSC_ARG2(stack);
+
+	if(EXPECT_FALSE((uintptr_t)addr & (sizeof(long) - 1)))
+		SYSC_ERROR(stack,-EINVAL);
+	if(EXPECT_FALSE(!PageDir::isInUserSpace((uintptr_t)addr,sizeof(long))))
+		SYSC_ERROR(stack,-EFAULT);
+
+	int res = Futex::wait(t,addr,val);
+	SYSC_RESULT(stack,res);
+}
+
+int Syscalls::futexwake(Thread *t,IntrptStackFrame *stack) {
+	long *addr = (long*)SYSC_ARG1(stack);
+	bool all = (bool)SYSC_ARG2(stack);
+
+	if(EXPECT_FALSE((uintptr_t)addr & (sizeof(long) - 1)))
+		SYSC_ERROR(stack,-EINVAL);
+	if(EXPECT_FALSE(!PageDir::isInUserSpace((uintptr_t)addr,sizeof(long))))
+		SYSC_ERROR(stack,-EFAULT);
+
+	int res = Futex::wake(t,addr,all);
+	SYSC_RESULT(stack,res);
+}
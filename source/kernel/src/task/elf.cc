@@ -34,6 +34,18 @@
 #include <util.h>
 #include <video.h>
 
+int ELF::load(OpenFile *file,StartupInfo *info) {
+	int res = doLoad(file,TYPE_PROG,info);
+	if(res < 0)
+		return res;
+
+	/* without the vDSO, libc falls back to syscalls. so, it's not fatal if that fails */
+	Proc *p = Thread::getRunning()->getProc();
+	if(p->getVM()->mapVDSO() < 0)
+		Log::get().writef("[LOADER] Unable to map vDSO into process %d\n",p->getPid());
+	return 0;
+}
+
 int ELF::doLoad(OpenFile *file,int type,StartupInfo *info) {
 	Thread *t = Thread::getRunning();
 	Proc *p = t->getProc();
@@ -0,0 +1,81 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <mem/physmem.h>
+#include <mem/useraccess.h>
+#include <mem/virtmem.h>
+#include <task/futex.h>
+#include <task/proc.h>
+#include <task/sched.h>
+#include <task/thread.h>
+#include <atomic.h>
+#include <common.h>
+#include <errno.h>
+
+int Futex::wait(Thread *t,USER long *addr,long val) {
+	VirtMem *vm = t->getProc()->getVM();
+	frameno_t frame;
+	int res = vm->acquireFrame((uintptr_t)addr,&frame);
+	if(res < 0)
+		return res;
+
+	/* wake() needs the region-lock as well. thus, nobody can wake us up between the check and
+	 * the wait and the frame stays the same until we're in the wait-queue */
+	long cur;
+	PhysMem::Frame *f = PhysMem::getFrame(frame);
+	if(f == NULL)
+		res = -EINVAL;
+	else if((res = UserAccess::readVar(&cur,addr)) == 0 && cur != val)
+		res = -EWOULDBLOCK;
+	if(res < 0) {
+		vm->releaseFrame((uintptr_t)addr);
+		return res;
+	}
+
+	/* prevent that the frame is swapped out while we're waiting */
+	Atomic::fetch_and_add(&f->waiters,+1);
+	Sched::wait(t,EV_FUTEX,getKey(frame,addr));
+	vm->releaseFrame((uintptr_t)addr);
+
+	Thread::switchAway();
+	Atomic::fetch_and_add(&f->waiters,-1);
+	return t->hasSignal() ? -EINTR : 0;
+}
+
+int Futex::wake(Thread *t,USER long *addr,bool all) {
+	VirtMem *vm = t->getProc()->getVM();
+	frameno_t frame;
+	int res = vm->acquireFrame((uintptr_t)addr,&frame);
+	if(res < 0)
+		return res;
+
+	/* the common case is that nobody waits */
+	PhysMem::Frame *f = PhysMem::getFrame(frame);
+	if(f == NULL)
+		res = -EINVAL;
+	else if(f->waiters > 0)
+		Sched::wakeup(EV_FUTEX,getKey(frame,addr),all);
+	vm->releaseFrame((uintptr_t)addr);
+	return res;
+}
+
+void Futex::wakeupFrame(frameno_t frame) {
+	evobj_t begin = frame * PAGE_SIZE;
+	Sched::wakeupRange(EV_FUTEX,begin,begin + PAGE_SIZE);
+}
@@ -854,6 +854,7 @@ void ProcBase::print(OStream &os) const {
 	os.writef("\tMemPeak: own=%lu, shared=%lu, swapped=%lu\n",
 	           virtmem.getPeakOwnFrames() + getKMemUsage(),
 	           virtmem.getPeakSharedFrames(),virtmem.getSwapCount());
+	os.writef("\tFaultsAvoided: %lu\n",virtmem.getFaultsAvoided());
 	os.writef("\tRunStats: runtime=%lu, scheds=%lu, syscalls=%lu\n",
 	           stats.totalRuntime,stats.totalScheds,stats.totalSyscalls);
 	os.pushIndent();
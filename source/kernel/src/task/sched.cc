@@ -41,110 +41,232 @@
  * the beginning and end. Therefore we can dequeue the first, prepend, append and remove a thread
  * in O(1). Additionally the number of threads is limited by the kernel-heap (i.e. we don't need
  * a static storage of nodes for the linked list; we use the threads itself)
+ *
+ * Every CPU has its own run-queue with its own lock and ready-mask. A thread belongs to exactly
+ * one run-queue (Thread::runQueue) and its state is protected by the lock of that queue. Woken
+ * up threads are put back into the queue of the CPU they ran on last. A CPU whose queue is empty
+ * steals a thread from the fullest queue of the other CPUs, before it falls back to idling.
+ *
+ * Threads that wait for an event are put into one of the wait-queues, which are hashed by event
+ * and object. Thus, a wakeup only needs to look at the threads that wait for the same bucket.
+ * Threads that wait for any object (object = 0) are put into the bucket for (event,0), which is
+ * always checked in addition. Each wait-queue has its own lock. If both the lock of a wait-queue
+ * and of a run-queue are needed, the wait-queue has to be locked first.
  */
 
-SpinLock Sched::lock;
-ulong Sched::readyMask = 0;
-esc::DList<Thread> Sched::rdyQueues[MAX_PRIO + 1];
-esc::DList<Thread> Sched::evlists[EV_COUNT];
-size_t Sched::rdyCount;
-Thread **Sched::idleThreads;
+struct Sched::RunQueue {
+	SpinLock lock;
+	SpinLock switchLock;
+	/* 1 bit per priority */
+	ulong readyMask;
+	size_t count;
+	esc::DList<Thread> queues[MAX_PRIO + 1];
+	Thread *idle;
+	/* the number of threads this CPU has stolen from others and others have stolen from it */
+	ulong steals;
+	ulong stolen;
+};
+
+Sched::WaitQueue Sched::waitQueues[WAITQUEUE_COUNT];
+Sched::RunQueue *Sched::runQueues;
 
 void Sched::init() {
-	idleThreads = (Thread**)Cache::calloc(SMP::getCPUCount(),sizeof(Thread*));
-	if(!idleThreads)
-		Util::panic("Unable to allocate idle-threads array");
-	rdyCount = 0;
+	runQueues = (RunQueue*)Cache::calloc(SMP::getCPUCount(),sizeof(RunQueue));
+	if(!runQueues)
+		Util::panic("Unable to allocate run-queues");
 }
 
 void Sched::addIdleThread(Thread *t) {
-	LockGuard<SpinLock> g(&lock);
 	for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
-		if(idleThreads[i] == NULL) {
-			idleThreads[i] = t;
+		LockGuard<SpinLock> g(&runQueues[i].lock);
+		if(runQueues[i].idle == NULL) {
+			runQueues[i].idle = t;
 			break;
 		}
 	}
 }
 
-void Sched::enqueue(Thread *t) {
+SpinLock *Sched::getSwitchLock(cpuid_t cpu) {
+	return &runQueues[cpu].switchLock;
+}
+
+ulong Sched::getReadyMask(cpuid_t cpu) {
+	return runQueues[cpu].readyMask;
+}
+
+Sched::RunQueue *Sched::lockQueue(Thread *t) {
+	while(1) {
+		RunQueue *rq = runQueues + t->runQueue;
+		rq->lock.down();
+		/* the thread might have been stolen by another CPU in the meantime */
+		if(EXPECT_TRUE(rq == runQueues + t->runQueue))
+			return rq;
+		rq->lock.up();
+	}
+}
+
+Sched::RunQueue *Sched::lockThread(Thread *t,WaitQueue **wq) {
+	while(1) {
+		WaitQueue *q = t->event ? getWaitQueue(t->event,t->evobject) : NULL;
+		if(q)
+			q->lock.down();
+		RunQueue *rq = lockQueue(t);
+		/* now the event can't change anymore. if it did in the meantime, try again */
+		WaitQueue *cur = t->event ? getWaitQueue(t->event,t->evobject) : NULL;
+		if(EXPECT_TRUE(cur == q)) {
+			*wq = q;
+			return rq;
+		}
+		rq->lock.up();
+		if(q)
+			q->lock.up();
+	}
+}
+
+void Sched::unlockThread(RunQueue *rq,WaitQueue *wq) {
+	rq->lock.up();
+	if(wq)
+		wq->lock.up();
+}
+
+void Sched::enqueue(RunQueue *rq,Thread *t) {
 	uint8_t prio = t->getPriority();
-	rdyQueues[prio].append(t);
-	readyMask |= 1UL << prio;
-	rdyCount++;
+	rq->queues[prio].append(t);
+	rq->readyMask |= 1UL << prio;
+	rq->count++;
 }
 
-void Sched::dequeue(Thread *t) {
+void Sched::dequeue(RunQueue *rq,Thread *t) {
 	uint8_t prio = t->getPriority();
-	rdyQueues[prio].remove(t);
-	if(rdyQueues[prio].length() == 0)
-		readyMask &= ~(1UL << prio);
-	rdyCount--;
+	rq->queues[prio].remove(t);
+	if(rq->queues[prio].length() == 0)
+		rq->readyMask &= ~(1UL << prio);
+	rq->count--;
+}
+
+Thread *Sched::dequeueFirst(RunQueue *rq,Thread *old) {
+	for(ssize_t i = MAX_PRIO; i >= 0; i--) {
+		if(!(rq->readyMask & (1UL << i)))
+			continue;
+
+		Thread *t = rq->queues[i].removeFirst();
+		/* if its the old thread again and we have more ready threads, don't take this one again.
+		 * because we assume that Thread::switchAway() has been called for a reason. therefore, it
+		 * should be better to take a thread with a lower priority than taking the same again */
+		if(rq->count > 1 && t == old) {
+			rq->queues[i].append(t);
+			continue;
+		}
+		if(rq->queues[i].length() == 0)
+			rq->readyMask &= ~(1UL << i);
+		rq->count--;
+		return t;
+	}
+	return NULL;
+}
+
+Thread *Sched::steal(cpuid_t cpu) {
+	/* search for the fullest run-queue without locking them; it's just a heuristic */
+	RunQueue *victim = NULL;
+	size_t max = 0;
+	for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
+		if(i != cpu && runQueues[i].count > max) {
+			victim = runQueues + i;
+			max = victim->count;
+		}
+	}
+	if(!victim)
+		return NULL;
+
+	/* if the victim is currently switching threads, leave it alone. otherwise we might take the
+	 * thread it's switching away from before its state has been saved */
+	if(!victim->switchLock.tryDown())
+		return NULL;
+
+	victim->lock.down();
+	Thread *t = dequeueFirst(victim,NULL);
+	if(t) {
+		/* change the state while holding the lock of the old queue and move it afterwards to
+		 * our queue. everybody who tries to lock the thread will notice that and retry */
+		t->setState(Thread::RUNNING);
+		t->setNewState(Thread::READY);
+		t->runQueue = cpu;
+		victim->stolen++;
+	}
+	victim->lock.up();
+	victim->switchLock.up();
+	if(!t)
+		return NULL;
+
+	/* only we change that counter */
+	runQueues[cpu].steals++;
+	return t;
 }
 
 Thread *Sched::perform(Thread *old,cpuid_t cpu) {
-	LockGuard<SpinLock> g(&lock);
+	RunQueue *rq = runQueues + cpu;
 	/* give the old thread a new state */
-	if(old) {
-		if(old->getFlags() & T_IDLE)
-			old->setState(Thread::BLOCKED);
-		else {
-			vassert(old->getState() == Thread::RUNNING,"State %d",old->getState());
-
-			/* we have to check for a signal here, because otherwise we might miss it */
-			/* (scenario: cpu0 unblocks t1 for signal, cpu1 runs t1 and blocks itself) */
-			if(old->getNewState() != Thread::ZOMBIE && old->hasSignal()) {
-				/* we have to reset the newstate in this case and remove us from event */
-				old->setNewState(Thread::READY);
-				old->waitstart = 0;
-				removeFromEventlist(old);
-				return old;
-			}
-
-			old->setState(old->getNewState());
-			if(old->getNewState() == Thread::READY) {
-				assert(old->event == 0);
-				enqueue(old);
-			}
+	if(old && !(old->getFlags() & T_IDLE)) {
+		/* we have to check for a signal here, because otherwise we might miss it */
+		/* (scenario: cpu0 unblocks t1 for signal, cpu1 runs t1 and blocks itself) */
+		/* nobody else can set the newstate to zombie or reset the signal, so that we can check
+		 * that before we acquire the locks */
+		if(old->getNewState() != Thread::ZOMBIE && old->hasSignal()) {
+			WaitQueue *wq;
+			lockThread(old,&wq);
+			/* we have to reset the newstate in this case and remove us from event */
+			old->setNewState(Thread::READY);
+			old->waitstart = 0;
+			removeFromEventlist(old);
+			unlockThread(rq,wq);
+			return old;
 		}
 	}
 
-	/* get new thread */
 	Thread *t;
-	for(ssize_t i = MAX_PRIO; i >= 0; i--) {
-		t = rdyQueues[i].removeFirst();
-		if(t) {
-			/* if its the old thread again and we have more ready threads, don't take this one again.
-			 * because we assume that Thread::switchAway() has been called for a reason. therefore, it
-			 * should be better to take a thread with a lower priority than taking the same again */
-			if(rdyCount > 1 && t == old) {
-				rdyQueues[i].append(t);
-				continue;
+	{
+		LockGuard<SpinLock> g(&rq->lock);
+		if(old) {
+			if(old->getFlags() & T_IDLE)
+				old->setState(Thread::BLOCKED);
+			else {
+				vassert(old->getState() == Thread::RUNNING,"State %d",old->getState());
+				assert(old->runQueue == cpu);
+
+				old->setState(old->getNewState());
+				if(old->getNewState() == Thread::READY) {
+					assert(old->event == 0);
+					enqueue(rq,old);
+				}
 			}
-			if(rdyQueues[i].length() == 0)
-				readyMask &= ~(1UL << i);
-			rdyCount--;
-			break;
+		}
+
+		/* get new thread */
+		t = dequeueFirst(rq,old);
+		if(t) {
+			t->setState(Thread::RUNNING);
+			t->setNewState(Thread::READY);
 		}
 	}
+
+	/* if there is nothing to do for us, help the others */
+	if(t == NULL)
+		t = steal(cpu);
+
 	if(t == NULL) {
 		/* choose an idle-thread */
-		t = idleThreads[cpu];
+		t = rq->idle;
 		t->setState(Thread::RUNNING);
 	}
-	else {
-		t->setState(Thread::RUNNING);
-		t->setNewState(Thread::READY);
-	}
 
 	/* if there is another thread ready, check if we have another cpu that we can start for it */
-	if(rdyCount > 0)
+	if(rq->count > 0)
 		SMP::wakeupCPU();
 	return t;
 }
 
 void Sched::adjustPrio(Thread *t,uint64_t total) {
-	LockGuard<SpinLock> g(&lock);
+	RunQueue *rq = lockQueue(t);
 	/* if it is still blocked, add the time to the blocked time */
 	if(t->waitstart > 0) {
 		uint64_t now = CPU::rdtsc();
@@ -175,10 +297,10 @@ void Sched::adjustPrio(Thread *t,uint64_t total) {
 	if(t->stats.blocked < BAD_BLOCK_TIME(total)) {
 		if(t->getPriority() > 0) {
 			if(t->getState() == Thread::READY)
-				dequeue(t);
+				dequeue(rq,t);
 			t->setPriority(t->getPriority() - 1);
 			if(t->getState() == Thread::READY)
-				enqueue(t);
+				enqueue(rq,t);
 		}
 		t->prioGoodCnt = 0;
 	}
@@ -188,10 +310,10 @@ void Sched::adjustPrio(Thread *t,uint64_t total) {
 			/* but don't do that immediately, but only if it happened multiple times */
 			if(++t->prioGoodCnt == PRIO_FORGIVE_CNT) {
 				if(t->getState() == Thread::READY)
-					dequeue(t);
+					dequeue(rq,t);
 				t->setPriority(t->getPriority() + 1);
 				if(t->getState() == Thread::READY)
-					enqueue(t);
+					enqueue(rq,t);
 				t->prioGoodCnt = 0;
 			}
 		}
@@ -199,39 +321,93 @@ void Sched::adjustPrio(Thread *t,uint64_t total) {
 
 	/* reset blocked time */
 	t->stats.blocked = 0;
+	rq->lock.up();
 }
 
 void Sched::wait(Thread *t,uint event,evobj_t object) {
-	LockGuard<SpinLock> g(&lock);
-	assert(t->event == 0);
 	assert(Thread::getRunning() == t);
+	WaitQueue *wq = event ? getWaitQueue(event,object) : NULL;
+	if(wq)
+		wq->lock.down();
+	RunQueue *rq = lockQueue(t);
+	assert(t->event == 0);
 	t->event = event;
 	t->evobject = object;
 	setBlocked(t);
-	if(event)
-		evlists[event - 1].append(t);
+	if(wq)
+		wq->list.append(t);
+	unlockThread(rq,wq);
 }
 
 void Sched::wakeup(uint event,evobj_t object,bool all) {
 	assert(event >= 1 && event <= EV_COUNT);
-	esc::DList<Thread> *list = evlists + event - 1;
-	LockGuard<SpinLock> g(&lock);
-	for(auto it = list->begin(); it != list->end(); ) {
+	/* first the threads that wait for exactly this object and afterwards the ones that wait for
+	 * any object of this event */
+	if(wakeupQueue(event,object,all) && !all)
+		return;
+	if(object != 0)
+		wakeupQueue(event,0,all);
+}
+
+bool Sched::wakeupQueue(uint event,evobj_t object,bool all) {
+	bool found = false;
+	WaitQueue *wq = getWaitQueue(event,object);
+	LockGuard<SpinLock> g(&wq->lock);
+	for(auto it = wq->list.begin(); it != wq->list.end(); ) {
 		auto old = it++;
-		assert(old->event == event);
-		if(old->evobject == 0 || old->evobject == object) {
+		/* there might be others in the same bucket */
+		if(old->event == event && old->evobject == object) {
+			RunQueue *rq = lockQueue(&*old);
 			removeFromEventlist(&*old);
 			setReady(&*old);
+			rq->lock.up();
+			found = true;
 			if(!all)
 				break;
 		}
 	}
+	return found;
+}
+
+size_t Sched::wakeupRange(uint event,evobj_t begin,evobj_t end) {
+	size_t count = 0;
+	for(size_t i = 0; i < WAITQUEUE_COUNT; i++) {
+		WaitQueue *wq = waitQueues + i;
+		LockGuard<SpinLock> g(&wq->lock);
+		for(auto it = wq->list.begin(); it != wq->list.end(); ) {
+			auto old = it++;
+			if(old->event == event && old->evobject >= begin && old->evobject < end) {
+				RunQueue *rq = lockQueue(&*old);
+				removeFromEventlist(&*old);
+				setReady(&*old);
+				rq->lock.up();
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+void Sched::block(Thread *t) {
+	assert(t != NULL);
+	RunQueue *rq = lockQueue(t);
+	setBlocked(t);
+	rq->lock.up();
+}
+
+void Sched::unblock(Thread *t) {
+	assert(t != NULL);
+	/* we might need to remove it from the event-list */
+	WaitQueue *wq;
+	RunQueue *rq = lockThread(t,&wq);
+	setReady(t);
+	unlockThread(rq,wq);
 }
 
 void Sched::removeFromEventlist(Thread *t) {
 	if(t->event) {
 		/* important: remove it first from the event-list and set event to 0 */
-		evlists[t->event - 1].remove(t);
+		getWaitQueue(t->event,t->evobject)->list.remove(t);
 		t->event = 0;
 	}
 }
@@ -251,7 +427,9 @@ void Sched::setReady(Thread *t) {
 	}
 	else if(setReadyState(t)) {
 		assert(t->event == 0);
-		enqueue(t);
+		/* put it back to the CPU it ran on last, because its caches are probably still warm */
+		enqueue(runQueues + t->runQueue,t);
+		SMP::wakeupCPU(t->runQueue);
 	}
 }
 
@@ -265,7 +443,7 @@ void Sched::setBlocked(Thread *t) {
 			break;
 		case Thread::READY:
 			t->setState(Thread::BLOCKED);
-			dequeue(t);
+			dequeue(runQueues + t->runQueue,t);
 			break;
 		default:
 			vassert(false,"Invalid state for setBlocked (%d)",t->getState());
@@ -275,7 +453,8 @@ void Sched::setBlocked(Thread *t) {
 }
 
 void Sched::removeThread(Thread *t) {
-	LockGuard<SpinLock> g(&lock);
+	WaitQueue *wq;
+	RunQueue *rq = lockThread(t,&wq);
 	switch(t->getState()) {
 		case Thread::RUNNING:
 			break;
@@ -283,7 +462,7 @@ void Sched::removeThread(Thread *t) {
 			removeFromEventlist(t);
 			break;
 		case Thread::READY:
-			dequeue(t);
+			dequeue(rq,t);
 			break;
 		default:
 			/* TODO threads can die during swap, right? */
@@ -291,6 +470,7 @@ void Sched::removeThread(Thread *t) {
 			break;
 	}
 	t->setNewState(Thread::ZOMBIE);
+	unlockThread(rq,wq);
 }
 
 bool Sched::setReadyState(Thread *t) {
@@ -310,26 +490,46 @@ bool Sched::setReadyState(Thread *t) {
 }
 
 void Sched::print(OStream &os) {
-	os.writef("Ready queues:\n");
-	for(size_t i = 0; i < ARRAY_SIZE(rdyQueues); i++) {
-		os.writef("\t[%d]:\n",i);
-		print(os,rdyQueues + i);
-		os.writef("\n");
+	for(size_t c = 0; c < SMP::getCPUCount(); c++) {
+		RunQueue *rq = runQueues + c;
+		os.writef("Ready queues of CPU %zu (%zu ready, %lu steals, %lu stolen):\n",
+			c,rq->count,rq->steals,rq->stolen);
+		for(size_t i = 0; i < ARRAY_SIZE(rq->queues); i++) {
+			os.writef("\t[%d]:\n",i);
+			print(os,rq->queues + i);
+			os.writef("\n");
+		}
+	}
+}
+
+void Sched::printQueueStats(OStream &os) {
+	for(size_t c = 0; c < SMP::getCPUCount(); c++) {
+		RunQueue *rq = runQueues + c;
+		LockGuard<SpinLock> g(&rq->lock);
+		os.writef("CPU %zu: ready=%zu steals=%lu stolen=%lu\n",c,rq->count,rq->steals,rq->stolen);
 	}
 }
 
 void Sched::printEventLists(OStream &os) {
 	os.writef("Eventlists:\n");
 	for(size_t e = 0; e < EV_COUNT; e++) {
-		esc::DList<Thread> *list = evlists + e;
 		os.writef("\t%s:\n",getEventName(e + 1));
-		for(auto t = list->cbegin(); t != list->cend(); ++t) {
-			os.writef("\t\tthread=%d (%d:%s), object=%x",
-					t->getTid(),t->getProc()->getPid(),t->getProc()->getProgram(),t->evobject);
-			ino_t nodeNo = ((VFSNode*)t->evobject)->getNo();
-			if(VFSNode::isValid(nodeNo))
-				os.writef("(%s)",((VFSNode*)t->evobject)->getPath());
-			os.writef("\n");
+		for(size_t i = 0; i < WAITQUEUE_COUNT; i++) {
+			esc::DList<Thread> *list = &waitQueues[i].list;
+			for(auto t = list->cbegin(); t != list->cend(); ++t) {
+				if(t->event != e + 1)
+					continue;
+
+				os.writef("\t\tthread=%d (%d:%s), object=%x",
+						t->getTid(),t->getProc()->getPid(),t->getProc()->getProgram(),t->evobject);
+				/* futexes are identified by physical addresses */
+				if(t->event != EV_FUTEX) {
+					ino_t nodeNo = ((VFSNode*)t->evobject)->getNo();
+					if(VFSNode::isValid(nodeNo))
+						os.writef("(%s)",((VFSNode*)t->evobject)->getPath());
+				}
+				os.writef("\n");
+			}
 		}
 	}
 }
@@ -344,6 +544,7 @@ const char *Sched::getEventName(uint event) {
 		"SWAP_FREE",
 		"THREAD_DIED",
 		"CHILD_DIED",
+		"FUTEX",
 	};
 	return names[event - 1];
 }
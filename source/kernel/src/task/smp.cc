@@ -25,6 +25,7 @@
 #include <common.h>
 #include <config.h>
 #include <cpu.h>
+#include <lockguard.h>
 #include <log.h>
 #include <string.h>
 #include <util.h>
@@ -105,18 +106,111 @@ void SMPBase::wakeupCPU() {
 	}
 }
 
-void SMPBase::flushTLB(PageDir *pdir) {
+void SMPBase::wakeupCPU(cpuid_t id) {
+	if(cpuCount > 1) {
+		CPU *cpu = cpus[id];
+		if(!cpu->ready || (cpu->thread && !(cpu->thread->getFlags() & T_IDLE)))
+			wakeupCPU();
+		/* if it's us, we'll notice it by ourself */
+		else if(id != getCurId())
+			sendIPI(id,IPI_WORK);
+	}
+}
+
+void SMPBase::flushTLB(PageDir *pdir,const FlushRange *ranges,size_t count) {
 	if(!cpus || cpuCount == 1)
 		return;
 
+	/* just collect them, if we have started a batch. other threads of the process can't wait */
+	TLBBatch *batch = pdir->getTLBBatch();
+	if(batch && batch->getOwner() == Thread::getRunning()) {
+		if(ranges == NULL)
+			batch->addAll();
+		for(size_t i = 0; i < count; ++i)
+			batch->add(ranges[i].addr,ranges[i].pages);
+		return;
+	}
+	sendFlushRequests(pdir,ranges,count);
+}
+
+void SMPBase::sendFlushRequests(PageDir *pdir,const FlushRange *ranges,size_t count) {
 	cpuid_t cur = getCurId();
-	for(auto cpu = cpuList.cbegin(); cpu != cpuList.cend(); ++cpu) {
+	for(auto cpu = cpuList.begin(); cpu != cpuList.end(); ++cpu) {
 		if(cpu->ready && cpu->id != cur) {
 			Thread *t = cpu->thread;
 			if(t && t->getProc()->getPageDir() == pdir)
-				sendIPI(cpu->id,IPI_FLUSH_TLB);
+				sendFlushRequest(&*cpu,ranges,count);
+		}
+	}
+}
+
+void SMPBase::sendFlushRequest(CPU *cpu,const FlushRange *ranges,size_t count) {
+	bool pending;
+	{
+		LockGuard<SpinLock> g(&cpu->flushLock);
+		/* if there is already a request, the CPU will receive the IPI for it anyway */
+		pending = cpu->flushAll || cpu->flushCount > 0;
+		/* flush everything if it's too much */
+		if(ranges == NULL)
+			cpu->flushAll = true;
+		for(size_t i = 0; !cpu->flushAll && i < count; ++i) {
+			if(cpu->flushCount == MAX_FLUSH_RANGES ||
+					cpu->flushPages + ranges[i].pages > MAX_FLUSH_PAGES)
+				cpu->flushAll = true;
+			else {
+				cpu->flushRanges[cpu->flushCount++] = ranges[i];
+				cpu->flushPages += ranges[i].pages;
+			}
 		}
 	}
+	if(!pending)
+		sendIPI(cpu->id,IPI_FLUSH_TLB);
+}
+
+TLBBatch::TLBBatch(PageDir *pdir)
+	: _pdir(pdir), _owner(Thread::getRunning()), _active(), _all(), _count(), _ranges() {
+	/* if somebody else has started a batch, we don't collect anything, but flush immediately */
+	if(pdir->tlbBatch == NULL) {
+		pdir->tlbBatch = this;
+		_active = true;
+	}
+}
+
+TLBBatch::~TLBBatch() {
+	if(_active)
+		_pdir->tlbBatch = NULL;
+	flush();
+}
+
+void TLBBatch::add(uintptr_t addr,size_t pages) {
+	if(_all)
+		return;
+	if(pages > SMPBase::MAX_FLUSH_PAGES) {
+		_all = true;
+		return;
+	}
+	/* merge it with the last one, if they are adjacent */
+	if(_count > 0 && _ranges[_count - 1].addr + _ranges[_count - 1].pages * PAGE_SIZE == addr)
+		_ranges[_count - 1].pages += pages;
+	else if(_count < SMPBase::MAX_FLUSH_RANGES) {
+		_ranges[_count].addr = addr;
+		_ranges[_count].pages = pages;
+		_count++;
+	}
+	else
+		_all = true;
+}
+
+void TLBBatch::flush() {
+	if(!SMP::cpus || SMP::cpuCount == 1)
+		return;
+
+	if(_all)
+		SMP::sendFlushRequests(_pdir,NULL,0);
+	else if(_count > 0)
+		SMP::sendFlushRequests(_pdir,_ranges,_count);
+	_all = false;
+	_count = 0;
 }
 
 void SMPBase::callback(cpuid_t id) {
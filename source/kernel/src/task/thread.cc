@@ -72,8 +72,8 @@ void ThreadBase::relRef(const Thread *t) {
 ThreadBase::ThreadBase(Proc *p,uint8_t flags)
 	: esc::DListItem(), tid(), refs(1), proc(p), sigHandler(), sigmask(), event(), evobject(),
 	  waitstart(), prioGoodCnt(), flags(flags), priority(MAX_PRIO), state(BLOCKED), newState(READY),
-	  cpu(), stackRegions(), threadDir(), threadListItem(static_cast<Thread*>(this)),
-	  signalListItem(static_cast<Thread*>(this)), reqFrames(), stats() {
+	  cpu(), runQueue(), stackRegions(), threadDir(), threadListItem(static_cast<Thread*>(this)),
+	  signalListItem(static_cast<Thread*>(this)), reqFrames(), stats(), timer() {
 	stats.cycleStart = CPU::rdtsc();
 	stats.signal = SIG_COUNT;
 }
@@ -179,17 +179,24 @@ void ThreadBase::updateRuntimes() {
 }
 
 bool ThreadBase::reserveFrames(size_t count,bool swap) {
+	size_t before = reqFrames.length();
 	while(count > 0) {
 		if(!PhysMem::reserve(count,swap)) {
-			discardFrames();
+			/* only give back the frames we've got in this call */
+			while(reqFrames.length() > before)
+				PhysMem::free(reqFrames.removeFirst(),PhysMem::USR);
 			return false;
 		}
-		for(size_t i = count; i > 0; i--) {
-			frameno_t frm = PhysMem::allocate(PhysMem::USR);
-			if(frm == PhysMem::INVALID_FRAME)
+		/* fetch them in batches to keep the time spent in PhysMem low */
+		while(count > 0) {
+			frameno_t frms[16];
+			size_t req = esc::Util::min(count,ARRAY_SIZE(frms));
+			size_t got = PhysMem::allocate(req,frms);
+			for(size_t i = 0; i < got; ++i)
+				reqFrames.append(frms[i]);
+			count -= got;
+			if(got < req)
 				break;
-			reqFrames.append(frm);
-			count--;
 		}
 	}
 	return true;
@@ -214,6 +221,9 @@ int ThreadBase::create(Thread *src,Thread **dst,Proc *p,uint8_t tflags,bool clon
 		t->priority = p->getPriority();
 	}
 
+	/* start on the CPU of our creator; other CPUs will steal it, if they have nothing to do */
+	t->runQueue = src->getCPU();
+
 	/* we don't want to destroy the process first because we have a pointer to it */
 	Proc::getRef(p->getPid());
 
@@ -17,24 +17,22 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <esc/util.h>
 #include <task/proc.h>
 #include <task/sched.h>
 #include <task/smp.h>
 #include <task/timer.h>
+#include <atomic.h>
 #include <common.h>
 #include <errno.h>
 #include <spinlock.h>
 #include <util.h>
 #include <video.h>
 
-/* total elapsed milliseconds */
+bool TimerBase::tickless = false;
 TimerBase::PerCPU *TimerBase::perCPU = NULL;
 time_t TimerBase::lastRuntimeUpdate = 0;
-
-SpinLock TimerBase::lock;
-TimerBase::Listener TimerBase::listenObjs[LISTENER_COUNT];
-TimerBase::Listener *TimerBase::freeList;
-TimerBase::Listener *TimerBase::listener = NULL;
+uint64_t TimerBase::elapsedUsecs = 0;
 
 void TimerBase::init() {
 	archInit();
@@ -43,102 +41,221 @@ void TimerBase::init() {
 	if(!perCPU)
 		Util::panic("Unable to create per-cpu-array");
 
-	/* init objects */
-	listenObjs->next = NULL;
-	freeList = listenObjs;
-	for(size_t i = 1; i < LISTENER_COUNT; i++) {
-		listenObjs[i].next = freeList;
-		freeList = listenObjs + i;
+	uint64_t now = getUptime();
+	for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
+		perCPU[i].wheel.now = now;
+		perCPU[i].deadline = NO_DEADLINE;
 	}
 }
 
-int TimerBase::sleepFor(tid_t tid,time_t msecs,bool block) {
-	LockGuard<SpinLock> g(&lock);
-	Listener *l = freeList;
-	if(l == NULL)
-		return -ENOMEM;
-
-	/* remove from freelist */
-	freeList = freeList->next;
-	/* find place and calculate time */
-	l->tid = tid;
-	time_t msecDiff = 0;
-	Listener *p = NULL;
-	Listener *nl;
-	for(nl = listener; nl != NULL; p = nl, nl = nl->next) {
-		if(msecDiff + nl->time > msecs)
-			break;
-		msecDiff += nl->time;
-	}
+int TimerBase::sleepFor(tid_t tid,uint64_t usecs,bool block) {
+	Thread *t = Thread::getById(tid);
+	Listener *l = &t->timer;
 
-	l->time = msecs - msecDiff;
-	l->block = block;
-	/* insert entry */
-	l->next = nl;
-	if(p)
-		p->next = l;
-	else
-		listener = l;
+	/* a thread can only wait for one point in time */
+	removeThread(tid);
 
-	/* now change time of next one */
-	if(nl)
-		nl->time -= l->time;
+	/* in one-shot mode, every CPU manages its own listeners. otherwise, CPU 0 does it */
+	cpuid_t cpu = tickless ? SMP::getCurId() : 0;
+	uint64_t expires = getUptime() + usecs;
+	{
+		Wheel &w = perCPU[cpu].wheel;
+		LockGuard<SpinLock> g(&w.lock);
+		l->tid = tid;
+		l->cpu = cpu;
+		l->expires = expires;
+		l->block = block;
+		enqueue(w,l);
 
-	/* put process to sleep */
-	if(block)
-		Thread::getById(tid)->block();
+		/* block it while holding the lock; otherwise it might be waked up before */
+		if(block)
+			t->block();
+	}
+
+	/* the timer is programmed for the local CPU, which is the one we have used above */
+	if(tickless && expires < perCPU[cpu].deadline)
+		program(cpu,expires);
 	return 0;
 }
 
 void TimerBase::removeThread(tid_t tid) {
-	LockGuard<SpinLock> g(&lock);
-	Listener *p = NULL;
-	for(Listener *l = listener; l != NULL; p = l, l = l->next) {
-		if(l->tid == tid) {
-			/* increase time of next */
-			if(l->next)
-				l->next->time += l->time;
-			/* remove from list */
-			if(p)
-				p->next = l->next;
-			else
-				listener = l->next;
-			/* put on freelist */
-			l->next = freeList;
-			freeList = l;
-			/* it's not possible to be in the list twice */
-			break;
+	Listener *l = &Thread::getById(tid)->timer;
+	while(l->pprev) {
+		Wheel &w = perCPU[l->cpu].wheel;
+		LockGuard<SpinLock> g(&w.lock);
+		/* it might have expired or moved in the meantime */
+		if(l->pprev && &perCPU[l->cpu].wheel == &w)
+			dequeue(w,l);
+	}
+}
+
+void TimerBase::startSlice(cpuid_t cpu,bool idle) {
+	if(EXPECT_FALSE(!perCPU))
+		return;
+
+	uint64_t now = getUptime();
+	perCPU[cpu].lastResched = now;
+	if(tickless) {
+		uint64_t next;
+		{
+			LockGuard<SpinLock> g(&perCPU[cpu].wheel.lock);
+			next = nextEvent(perCPU[cpu].wheel);
 		}
+		/* the idle-thread doesn't need to be preempted */
+		if(!idle)
+			next = esc::Util::min(next,now + TIMESLICE * 1000);
+		program(cpu,next);
 	}
 }
 
 bool TimerBase::intrpt() {
-	bool res,foundThread = false;
-	time_t timeInc = 1000 / FREQUENCY_DIV;
+	bool res,foundThread;
 	cpuid_t cpu = Thread::getRunning()->getCPU();
+	PerCPU *pc = perCPU + cpu;
+
+	pc->timerIntrpts++;
+	if(!tickless && cpu == 0)
+		elapsedUsecs += 1000000 / FREQUENCY_DIV;
+	uint64_t now = getUptime();
+
+	/* the first CPU that notices that it's time to update the runtimes does it */
+	time_t runtime = now / 1000;
+	time_t lastUpdate = lastRuntimeUpdate;
+	if((runtime - lastUpdate) >= RUNTIME_UPDATE_INTVAL &&
+			Atomic::cmpnswap(&lastRuntimeUpdate,lastUpdate,runtime)) {
+		Thread::updateRuntimes();
+		SMP::updateRuntimes();
+	}
 
-	perCPU[cpu].timerIntrpts++;
-	perCPU[cpu].elapsedMsecs += timeInc;
+	/* look if there are threads to wakeup */
+	{
+		LockGuard<SpinLock> g(&pc->wheel.lock);
+		foundThread = expire(pc->wheel,now);
+	}
 
-	if(cpu == 0) {
-		if((perCPU[cpu].elapsedMsecs - lastRuntimeUpdate) >= RUNTIME_UPDATE_INTVAL) {
-			Thread::updateRuntimes();
-			SMP::updateRuntimes();
-			lastRuntimeUpdate = perCPU[cpu].elapsedMsecs;
+	/* if a process has been waked up or the time-slice is over, reschedule */
+	res = false;
+	if(foundThread || (now - pc->lastResched) >= TIMESLICE * 1000) {
+		pc->lastResched = now;
+		res = true;
+	}
+	/* in one-shot mode, we have to program the timer again. on a reschedule, startSlice() does that */
+	else if(tickless) {
+		uint64_t next;
+		{
+			LockGuard<SpinLock> g(&pc->wheel.lock);
+			next = nextEvent(pc->wheel);
 		}
+		if(~Thread::getRunning()->getFlags() & T_IDLE)
+			next = esc::Util::min(next,pc->lastResched + TIMESLICE * 1000);
+		program(cpu,next);
+	}
+	return res;
+}
+
+void TimerBase::program(cpuid_t cpu,uint64_t deadline) {
+	perCPU[cpu].deadline = deadline;
+	archProgram(deadline);
+}
+
+void TimerBase::enqueue(Wheel &w,Listener *l) {
+	uint64_t expires = esc::Util::max(l->expires,w.now);
+
+	/* use the level of the highest bit-group in which the expiry time differs from now. as the
+	 * higher groups are equal, the slot is processed before the wheel wraps around */
+	uint64_t diff = expires ^ w.now;
+	size_t level = 0;
+	while(level < WHEEL_LEVELS - 1 && (diff >> (WHEEL_BITS * (level + 1))) != 0)
+		level++;
+
+	size_t shift = WHEEL_BITS * level;
+	size_t slot;
+	/* too far in the future? put it in the slot that is processed last and reinsert it then */
+	if((diff >> (WHEEL_BITS * WHEEL_LEVELS)) != 0)
+		slot = ((w.now >> shift) - 1) & (WHEEL_SLOTS - 1);
+	else
+		slot = (expires >> shift) & (WHEEL_SLOTS - 1);
+
+	Listener **head = &w.slots[level][slot];
+	l->next = *head;
+	if(l->next)
+		l->next->pprev = &l->next;
+	l->pprev = head;
+	*head = l;
+	w.pending[level] |= 1ULL << slot;
+}
+
+void TimerBase::dequeue(Wheel &w,Listener *l) {
+	*l->pprev = l->next;
+	if(l->next)
+		l->next->pprev = l->pprev;
+
+	/* was it the last one in the slot? */
+	Listener **first = &w.slots[0][0];
+	if(l->pprev >= first && l->pprev < first + WHEEL_LEVELS * WHEEL_SLOTS && *l->pprev == NULL) {
+		size_t idx = l->pprev - first;
+		w.pending[idx / WHEEL_SLOTS] &= ~(1ULL << (idx % WHEEL_SLOTS));
+	}
+	l->next = NULL;
+	l->pprev = NULL;
+}
+
+uint64_t TimerBase::nextEvent(const Wheel &w) {
+	uint64_t next = NO_DEADLINE;
+	for(size_t level = 0; level < WHEEL_LEVELS; ++level) {
+		uint64_t pending = w.pending[level];
+		if(pending == 0)
+			continue;
+
+		size_t shift = WHEEL_BITS * level;
+		size_t cur = (w.now >> shift) & (WHEEL_SLOTS - 1);
+		uint64_t base = (w.now >> (shift + WHEEL_BITS)) << (shift + WHEEL_BITS);
+		/* the current slot of the higher levels has already been processed */
+		size_t first = level == 0 ? cur : cur + 1;
+		uint64_t later = first < WHEEL_SLOTS ? pending & (~0ULL << first) : 0;
+
+		uint64_t time;
+		if(later)
+			time = base + ((uint64_t)__builtin_ctzll(later) << shift);
+		else
+			time = base + (1ULL << (shift + WHEEL_BITS)) + ((uint64_t)__builtin_ctzll(pending) << shift);
+		next = esc::Util::min(next,time);
+	}
+	return next;
+}
+
+bool TimerBase::expire(Wheel &w,uint64_t now) {
+	bool foundThread = false;
+	for(uint64_t time; (time = nextEvent(w)) <= now; ) {
+		w.now = time;
 
-		/* look if there are threads to wakeup */
-		LockGuard<SpinLock> g(&lock);
-		for(Listener *l = listener; l != NULL; ) {
-			/* stop if we have to continue waiting for this one */
-			/* note that multiple listeners may have l->time = 0 */
-			if(l->time > timeInc) {
-				l->time -= timeInc;
-				break;
+		/* move the listeners of the slots that begin now to the lower levels */
+		for(size_t level = WHEEL_LEVELS - 1; level > 0; --level) {
+			size_t shift = WHEEL_BITS * level;
+			size_t slot = (time >> shift) & (WHEEL_SLOTS - 1);
+			if((time & ((1ULL << shift) - 1)) != 0 || !(w.pending[level] & (1ULL << slot)))
+				continue;
+
+			Listener *l = w.slots[level][slot];
+			w.slots[level][slot] = NULL;
+			w.pending[level] &= ~(1ULL << slot);
+			while(l != NULL) {
+				Listener *next = l->next;
+				enqueue(w,l);
+				l = next;
 			}
+		}
+
+		/* all listeners in the current slot of level 0 are due */
+		size_t slot = time & (WHEEL_SLOTS - 1);
+		Listener *l = w.slots[0][slot];
+		w.slots[0][slot] = NULL;
+		w.pending[0] &= ~(1ULL << slot);
+		while(l != NULL) {
+			Listener *next = l->next;
+			l->next = NULL;
+			l->pprev = NULL;
 
-			timeInc -= l->time;
-			/* wake up thread */
 			Thread *t = Thread::getById(l->tid);
 			if(l->block) {
 				t->unblock();
@@ -146,32 +263,33 @@ bool TimerBase::intrpt() {
 			}
 			else
 				Signals::addSignalFor(t,SIGALRM);
-			/* remove from list */
-			listener = l->next;
-			Listener *tl = l->next;
-			/* put on freelist */
-			l->next = freeList;
-			freeList = l;
-			/* to next */
-			l = tl;
+			l = next;
 		}
 	}
 
-	/* if a process has been waked up or the time-slice is over, reschedule */
-	res = false;
-	if(foundThread || (perCPU[cpu].elapsedMsecs - perCPU[cpu].lastResched) >= TIMESLICE) {
-		perCPU[cpu].lastResched = perCPU[cpu].elapsedMsecs;
-		res = true;
-	}
-	return res;
+	if(w.now < now)
+		w.now = now;
+	return foundThread;
 }
 
 void TimerBase::print(OStream &os) {
-	os.writef("Timer-Listener:\n");
-	time_t time = 0;
-	for(Listener *l = listener; l != NULL; l = l->next) {
-		time += l->time;
-		os.writef("	diff=%u ms, rem=%u ms, thread=%d(%s), block=%d\n",l->time,time,l->tid,
-				Thread::getById(l->tid)->getProc()->getProgram(),l->block);
+	os.writef("Timer-Listener (%s):\n",tickless ? "one-shot" : "periodic");
+	for(size_t i = 0; i < SMP::getCPUCount(); ++i) {
+		LockGuard<SpinLock> g(&perCPU[i].wheel.lock);
+		os.writef("	CPU %zu: now=%Lu us, deadline=%Ld us\n",
+			i,perCPU[i].wheel.now,perCPU[i].deadline);
+		printWheel(os,perCPU[i].wheel);
+	}
+}
+
+void TimerBase::printWheel(OStream &os,const Wheel &w) {
+	for(size_t level = 0; level < WHEEL_LEVELS; ++level) {
+		for(size_t slot = 0; slot < WHEEL_SLOTS; ++slot) {
+			for(Listener *l = w.slots[level][slot]; l != NULL; l = l->next) {
+				os.writef("		level=%zu, slot=%zu, rem=%Ld us, thread=%d(%s), block=%d\n",
+					level,slot,l->expires - w.now,l->tid,
+					Thread::getById(l->tid)->getProc()->getProgram(),l->block);
+			}
+		}
 	}
 }
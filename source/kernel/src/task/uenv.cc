@@ -19,6 +19,7 @@
 
 #include <esc/util.h>
 #include <mem/useraccess.h>
+#include <sys/vdso.h>
 #include <task/proc.h>
 #include <task/uenv.h>
 #include <common.h>
@@ -33,6 +34,12 @@ ulong *UEnvBase::initProcStack(int argc,int envc,const char *args,size_t argsSiz
 	 * +------------------+
 	 * |        TLS       | (pointer to the actual TLS)
 	 * +------------------+
+	 * |        tid       |
+	 * +------------------+
+	 * |        pid       |
+	 * +------------------+
+	 * |       vDSO       |
+	 * +------------------+
 	 * |     arguments    |
 	 * |        ...       |
 	 * +------------------+
@@ -56,8 +63,8 @@ ulong *UEnvBase::initProcStack(int argc,int envc,const char *args,size_t argsSiz
 		totalSize += sizeof(void*) * (argc + 1 + envc + 1);
 	}
 	totalSize = esc::Util::round_up(totalSize,16) + 8;
-	/* finally we need errno, TLS, envc, envv, argc, argv and entryPoint */
-	totalSize += sizeof(ulong) * 7;
+	/* finally we need errno, TLS, tid, pid, vDSO, envc, envv, argc, argv and entryPoint */
+	totalSize += sizeof(ulong) * 10;
 
 	/* get sp */
 	ulong *sp;
@@ -65,8 +72,9 @@ ulong *UEnvBase::initProcStack(int argc,int envc,const char *args,size_t argsSiz
 	if(!PageDir::isInUserSpace((uintptr_t)sp - totalSize,totalSize))
 		return NULL;
 
-	/* space for errno and TLS */
-	sp -= 3;
+	/* space for errno, TLS, tid, pid and vDSO */
+	writeThreadInfo(t,sp);
+	sp -= 6;
 
 	/* copy arguments on the user-stack (4byte space) */
 	char **argv = copyArgs(argc,args,sp);
@@ -95,13 +103,19 @@ ulong *UEnvBase::initThreadStack(const void *arg,uintptr_t entry) {
 	 * +------------------+
 	 * |        TLS       | (pointer to the actual TLS)
 	 * +------------------+
+	 * |        tid       |
+	 * +------------------+
+	 * |        pid       |
+	 * +------------------+
+	 * |       vDSO       |
+	 * +------------------+
 	 * |        arg       |
 	 * +------------------+
 	 * |    entryPoint    |  0 for initial thread, thread-entrypoint for others
 	 * +------------------+
 	 */
 
-	size_t totalSize = 16 + 4 * sizeof(ulong);
+	size_t totalSize = 16 + 7 * sizeof(ulong);
 
 	/* get sp */
 	ulong *sp;
@@ -111,8 +125,9 @@ ulong *UEnvBase::initThreadStack(const void *arg,uintptr_t entry) {
 		A_UNREACHED;
 	}
 
-	/* space for errno and TLS */
-	sp -= 3;
+	/* space for errno, TLS, tid, pid and vDSO */
+	writeThreadInfo(t,sp);
+	sp -= 6;
 
 	/* align it by 16 byte (SSE) */
 	sp = (ulong*)esc::Util::round_dn((uintptr_t)sp,16);
@@ -124,6 +139,12 @@ ulong *UEnvBase::initThreadStack(const void *arg,uintptr_t entry) {
 	return sp;
 }
 
+void UEnvBase::writeThreadInfo(Thread *t,ulong *top) {
+	UserAccess::writeVar(top - STACK_TOP_TID,(ulong)t->getTid());
+	UserAccess::writeVar(top - STACK_TOP_PID,(ulong)t->getProc()->getPid());
+	UserAccess::writeVar(top - STACK_TOP_VDSO,(ulong)t->getProc()->getVM()->getVDSOAddr());
+}
+
 char **UEnvBase::copyArgs(int argc,const char *&args,ulong *&sp) {
 	char **argv = NULL;
 	if(argc > 0) {
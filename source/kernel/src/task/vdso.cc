@@ -0,0 +1,50 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <mem/pagedir.h>
+#include <mem/physmem.h>
+#include <task/vdso.h>
+#include <atomic.h>
+#include <common.h>
+#include <string.h>
+#include <util.h>
+
+frameno_t VDSO::frame = PhysMem::INVALID_FRAME;
+
+void VDSO::init() {
+	frame = PhysMem::allocate(PhysMem::KERN);
+	if(frame == PhysMem::INVALID_FRAME)
+		Util::panic("Not enough memory for the vDSO");
+
+	uintptr_t addr = PageDir::getAccess(frame);
+	memclear((void*)addr,PAGE_SIZE);
+	PageDir::removeAccess(frame);
+}
+
+void VDSO::setClock(uint64_t bootTSC,uint64_t bootTime,uint64_t tscPerUs) {
+	sVDSOData *data = (sVDSOData*)PageDir::getAccess(frame);
+	/* make the sequence number odd while we update the data */
+	Atomic::fetch_and_add(&data->seq,+1);
+	data->bootTSC = bootTSC;
+	data->bootTime = bootTime;
+	data->tscPerUs = tscPerUs;
+	data->flags |= VDSO_CLOCK;
+	Atomic::fetch_and_add(&data->seq,+1);
+	PageDir::removeAccess(frame);
+}
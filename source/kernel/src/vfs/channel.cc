@@ -20,7 +20,9 @@
 #include <esc/ipc/ipcbuf.h>
 #include <esc/proto/file.h>
 #include <esc/proto/device.h>
+#include <esc/util.h>
 #include <mem/cache.h>
+#include <mem/pagedir.h>
 #include <mem/useraccess.h>
 #include <mem/virtmem.h>
 #include <sys/messages.h>
@@ -40,6 +42,28 @@
 #include <string.h>
 #include <video.h>
 
+VFSChannel::Message::~Message() {
+	if(loaned)
+		VirtMem::releaseLoan(frames(),BYTES_2_PAGES(length));
+}
+
+int VFSChannel::Message::copyTo(USER void *dst) {
+	if(EXPECT_TRUE(!loaned))
+		return UserAccess::write(dst,this + 1,length);
+
+	/* copy directly from the frames of the sender; they are always in the direct-mapped area */
+	for(size_t off = 0; off < length; off += PAGE_SIZE) {
+		frameno_t frame = frames()[off / PAGE_SIZE];
+		size_t amount = esc::Util::min(length - off,static_cast<size_t>(PAGE_SIZE));
+		uintptr_t src = PageDir::getAccess(frame);
+		int res = UserAccess::write(static_cast<char*>(dst) + off,reinterpret_cast<void*>(src),amount);
+		PageDir::removeAccess(frame);
+		if(EXPECT_FALSE(res < 0))
+			return res;
+	}
+	return 0;
+}
+
 VFSChannel::VFSChannel(const fs::User &u,VFSNode *p,bool &success)
 		/* permissions are basically irrelevant here since the userland can't open a channel directly. */
 		/* but in order to allow devices to be created by non-root users, give permissions for everyone */
@@ -506,8 +530,8 @@ void VFSChannel::print(OStream &os) const {
 		name,sendList.length(),recvList.length(),closed,handler,fd,shmem ? shmemSize / 1024 : 0);
 	for(size_t i = 0; i < ARRAY_SIZE(lists); i++) {
 		for(auto it = lists[i]->cbegin(); it != lists[i]->cend(); ++it) {
-			os.writef("\t%s id=%u:%u len=%zu\n",i == 0 ? "->" : "<-",
-				it->id >> 16,it->id & 0xFFFF,it->length);
+			os.writef("\t%s id=%u:%u len=%zu%s\n",i == 0 ? "->" : "<-",
+				it->id >> 16,it->id & 0xFFFF,it->length,it->loaned ? " (loaned)" : "");
 		}
 	}
 }
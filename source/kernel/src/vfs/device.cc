@@ -18,9 +18,12 @@
  */
 
 #include <mem/cache.h>
+#include <mem/pagedir.h>
 #include <mem/useraccess.h>
+#include <mem/virtmem.h>
 #include <sys/messages.h>
 #include <task/proc.h>
+#include <task/thread.h>
 #include <vfs/channel.h>
 #include <vfs/device.h>
 #include <vfs/node.h>
@@ -106,7 +109,7 @@ void VFSDevice::bindto(tid_t tid) {
 	closeDir(true);
 }
 
-int VFSDevice::getWork(uint flags) {
+int VFSDevice::getWork(const OpenFile *file,uint flags) {
 	Thread *t = Thread::getRunning();
 	tid_t tid = t->getTid();
 
@@ -114,8 +117,9 @@ int VFSDevice::getWork(uint flags) {
 		{
 			LockGuard<SpinLock> g(&msgLock);
 			int fd = getClientFd(tid);
-			/* if we've found one or we shouldn't block, stop here */
-			if(EXPECT_TRUE(fd >= 0 || (flags & GW_NOBLOCK)))
+			/* if we've found one or we shouldn't block, stop here. note that the file might have
+			 * been put into non-blocking mode while we were waiting */
+			if(EXPECT_TRUE(fd >= 0 || (flags & GW_NOBLOCK) || (file->getFlags() & VFS_NOBLOCK)))
 				return fd >= 0 ? fd : -ENOCLIENT;
 
 			/* wait for a client (accept signals) */
@@ -129,6 +133,12 @@ int VFSDevice::getWork(uint flags) {
 	A_UNREACHED;
 }
 
+void VFSDevice::wakeupWorkers() {
+	/* grab the lock to not race with the threads that are about to wait in getWork() */
+	LockGuard<SpinLock> g(&msgLock);
+	Sched::wakeup(EV_CLIENT,(evobj_t)this);
+}
+
 int VFSDevice::getClientFd(tid_t tid) {
 	/* search for a slot that needs work */
 	bool valid;
@@ -179,8 +189,6 @@ int VFSDevice::send(VFSChannel *chan,ushort flags,msgid_t id,USER const void *da
 
 	if(EXPECT_FALSE(!isAlive()))
 		return -EDESTROYED;
-	if(EXPECT_FALSE(size1 > VFSChannel::Message::MAX_SIZE))
-		return -EINVAL;
 
 	/* devices write to the receive-list (which will be read by other processes) */
 	if(flags & VFS_DEVICE) {
@@ -191,30 +199,12 @@ int VFSDevice::send(VFSChannel *chan,ushort flags,msgid_t id,USER const void *da
 	else
 		list = &chan->sendList;
 
-	/* create message and copy data to it */
-	msg1 = new (size1) VFSChannel::Message(size1);
-	if(EXPECT_FALSE(msg1 == NULL))
-		return -ENOMEM;
-
-	if(EXPECT_TRUE(data1)) {
-		if(EXPECT_FALSE((res = UserAccess::read(msg1 + 1,data1,size1)) < 0))
-			goto errorMsg1;
-	}
-
+	/* create messages and copy (or loan) the data to them */
+	if(EXPECT_FALSE((res = createMsg(&msg1,data1,size1)) < 0))
+		return res;
 	if(EXPECT_FALSE(data2)) {
-		if(EXPECT_FALSE(size2 > VFSChannel::Message::MAX_SIZE)) {
-			res = -EINVAL;
-			goto errorMsg1;
-		}
-
-		msg2 = new (size2) VFSChannel::Message(size2);
-		if(EXPECT_FALSE(msg2 == NULL)) {
-			res = -ENOMEM;
+		if(EXPECT_FALSE((res = createMsg(&msg2,data2,size2)) < 0))
 			goto errorMsg1;
-		}
-
-		if(EXPECT_FALSE((res = UserAccess::read(msg2 + 1,data2,size2)) < 0))
-			goto errorMsg2;
 	}
 
 	{
@@ -267,8 +257,6 @@ int VFSDevice::send(VFSChannel *chan,ushort flags,msgid_t id,USER const void *da
 #endif
 	return id;
 
-errorMsg2:
-	delete msg2;
 errorMsg1:
 	delete msg1;
 	return res;
@@ -344,7 +332,7 @@ ssize_t VFSDevice::receive(VFSChannel *chan,ushort flags,msgid_t *id,USER void *
 
 	/* copy data and id */
 	if(EXPECT_TRUE(data)) {
-		if(EXPECT_FALSE((res = UserAccess::write(data,msg + 1,msg->length)) < 0))
+		if(EXPECT_FALSE((res = msg->copyTo(data)) < 0))
 			return res;
 	}
 	if(EXPECT_TRUE(id))
@@ -355,6 +343,43 @@ ssize_t VFSDevice::receive(VFSChannel *chan,ushort flags,msgid_t *id,USER void *
 	return res;
 }
 
+int VFSDevice::createMsg(VFSChannel::Message **msg,USER const void *data,size_t size) {
+	if(EXPECT_FALSE(size > VFSChannel::Message::MAX_SIZE))
+		return -EINVAL;
+
+	/* large page-aligned payloads are not copied; we borrow the frames of the sender instead */
+	if(data && size >= VFSChannel::Message::LOAN_SIZE && ((uintptr_t)data & (PAGE_SIZE - 1)) == 0 &&
+			PageDir::isInUserSpace((uintptr_t)data,size)) {
+		size_t pages = BYTES_2_PAGES(size);
+		VFSChannel::Message *m = new (pages * sizeof(frameno_t)) VFSChannel::Message(size,true);
+		if(EXPECT_FALSE(m == NULL))
+			return -ENOMEM;
+
+		VirtMem *vm = Thread::getRunning()->getProc()->getVM();
+		if(vm->loanPages((uintptr_t)data,pages,m->frames()) == 0) {
+			*msg = m;
+			return 0;
+		}
+
+		/* not possible, so copy it */
+		m->loaned = false;
+		delete m;
+	}
+
+	*msg = new (size) VFSChannel::Message(size);
+	if(EXPECT_FALSE(*msg == NULL))
+		return -ENOMEM;
+
+	if(EXPECT_TRUE(data)) {
+		int res;
+		if(EXPECT_FALSE((res = UserAccess::read(*msg + 1,data,size)) < 0)) {
+			delete *msg;
+			return res;
+		}
+	}
+	return 0;
+}
+
 VFSChannel::Message *VFSDevice::getMsg(esc::SList<VFSChannel::Message> *list,msgid_t mid,ushort flags) {
 	/* drivers get always the first message */
 	if(flags & VFS_DEVICE)
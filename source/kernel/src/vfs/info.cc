@@ -27,6 +27,7 @@
 #include <mem/virtmem.h>
 #include <task/mntspace.h>
 #include <task/proc.h>
+#include <task/sched.h>
 #include <task/timer.h>
 #include <vfs/file.h>
 #include <vfs/fs.h>
@@ -50,6 +51,7 @@ void VFSInfo::init(VFSNode *sysNode) {
 	VFSNode::release(createObj<MemUsageFile>(kern,sysNode));
 	VFSNode::release(createObj<CPUFile>(kern,sysNode));
 	VFSNode::release(createObj<StatsFile>(kern,sysNode));
+	VFSNode::release(createObj<SchedFile>(kern,sysNode));
 }
 
 void VFSInfo::traceReadCallback(VFSNode *node,size_t *dataSize,void **buffer) {
@@ -106,6 +108,7 @@ void VFSInfo::procReadCallback(VFSNode *node,size_t *dataSize,void **buffer) {
 		"%-16s%lu\n"
 		"%-16s%Lu\n"
 		"%-16s%016Lx\n"
+		"%-16s%lu\n"
 		,
 		"Pid:",p->getPid(),
 		"ParentPid:",p->getParentPid(),
@@ -119,7 +122,8 @@ void VFSInfo::procReadCallback(VFSNode *node,size_t *dataSize,void **buffer) {
 		"Read:",p->getStats().input,
 		"Write:",p->getStats().output,
 		"Runtime:",p->getRuntime(),
-		"Cycles:",p->getStats().lastCycles
+		"Cycles:",p->getStats().lastCycles,
+		"FaultsAvoided:",p->getVM()->getFaultsAvoided()
 	);
 	Proc::relRef(p);
 
@@ -200,12 +204,19 @@ void VFSInfo::statsReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void **b
 		"Threads:",Thread::getCount(),
 		"Interrupts:",Interrupts::getCount(),
 		"CPUCycles:",cycles.val64,
-		"UpTime:",Timer::getIntrptCount() / Timer::FREQUENCY_DIV
+		"UpTime:",Timer::getRuntime() / 1000
 	);
 	*buffer = os.keepString();
 	*dataSize = os.getLength();
 }
 
+void VFSInfo::schedReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void **buffer) {
+	OStringStream os;
+	Sched::printQueueStats(os);
+	*buffer = os.keepString();
+	*dataSize = os.getLength();
+}
+
 void VFSInfo::memUsageReadCallback(A_UNUSED VFSNode *node,size_t *dataSize,void **buffer) {
 	OStringStream os;
 
@@ -59,9 +59,15 @@ int OpenFile::fcntl(uint cmd,int arg) {
 			return flags & VFS_NOBLOCK;
 
 		case F_SETFL: {
-			LockGuard<SpinLock> g(&lock);
-			flags &= VFS_READ | VFS_WRITE | VFS_MSGS | VFS_CREATE | VFS_DEVICE;
-			flags |= arg & VFS_NOBLOCK;
+			{
+				LockGuard<SpinLock> g(&lock);
+				flags &= VFS_READ | VFS_WRITE | VFS_MSGS | VFS_CREATE | VFS_DEVICE;
+				flags |= arg & VFS_NOBLOCK;
+			}
+			/* let the threads that wait for work on this device notice that they shouldn't block */
+			if((flags & (VFS_DEVICE | VFS_NOBLOCK)) == (VFS_DEVICE | VFS_NOBLOCK) &&
+					devNo == VFS_DEV_NO && IS_DEVICE(node->getMode()))
+				static_cast<VFSDevice*>(node)->wakeupWorkers();
 			return 0;
 		}
 
@@ -476,7 +482,7 @@ int OpenFile::getWork(OpenFile *file,uint flags) {
 	if(EXPECT_FALSE(!IS_DEVICE(dev->getMode())))
 		return -EPERM;
 
-	return dev->getWork(flags);
+	return dev->getWork(file,flags);
 }
 
 void OpenFile::print(OStream &os) const {
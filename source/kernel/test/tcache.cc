@@ -19,7 +19,10 @@
 
 #include <mem/cache.h>
 #include <sys/test.h>
+#include <task/smp.h>
+#include <atomic.h>
 #include <common.h>
+#include <string.h>
 #include <video.h>
 
 #include "testutils.h"
@@ -28,6 +31,7 @@
 static void test_cache();
 static void test_cache_1();
 static void test_cache_2();
+static void test_cache_3();
 
 static const uint TEST_COUNT    = 1000;
 static size_t sizes[] = {4,8,16,32,64,128,256,512,1024};
@@ -41,6 +45,7 @@ sTestModule tModCache = {
 static void test_cache() {
 	test_cache_1();
 	test_cache_2();
+	test_cache_3();
 }
 
 static void test_cache_1(void) {
@@ -106,3 +111,57 @@ static void test_cache_2(void) {
 
 	test_caseSucceeded();
 }
+
+static const uint PARALLEL_COUNT = 100;
+static volatile ulong cpusDone;
+static volatile ulong failures;
+
+static void allocOnCPU() {
+	/* the pattern is the CPU-id, so that we notice if two CPUs get the same object */
+	uint8_t pattern = SMP::getCurId() + 1;
+	void *areas[PARALLEL_COUNT];
+	for(size_t s = 0; s < ARRAY_SIZE(sizes); ++s) {
+		for(uint i = 0; i < PARALLEL_COUNT; ++i) {
+			areas[i] = Cache::alloc(sizes[s]);
+			if(areas[i])
+				memset(areas[i],pattern,sizes[s]);
+			else
+				Atomic::fetch_and_add(&failures,+1);
+		}
+		for(uint i = 0; i < PARALLEL_COUNT; ++i) {
+			if(!areas[i])
+				continue;
+			uint8_t *bytes = (uint8_t*)areas[i];
+			for(size_t j = 0; j < sizes[s]; ++j) {
+				if(bytes[j] != pattern) {
+					Atomic::fetch_and_add(&failures,+1);
+					break;
+				}
+			}
+			Cache::free(areas[i]);
+		}
+	}
+	Atomic::fetch_and_add(&cpusDone,+1);
+}
+
+static void test_cache_3(void) {
+	test_caseStart("Parallel malloc+free on all CPUs");
+	checkMemoryBefore(false);
+
+	/* the other CPUs allocate in their IPI-handler, while we do the same here */
+	size_t cpus = 0;
+	for(auto cpu = SMP::begin(); cpu != SMP::end(); ++cpu) {
+		if(cpu->ready)
+			cpus++;
+	}
+	cpusDone = 0;
+	failures = 0;
+	SMP::callbackOthers(allocOnCPU);
+	allocOnCPU();
+	while(cpusDone < cpus)
+		;
+
+	test_assertULInt(failures,0);
+	checkMemoryAfter(false);
+	test_caseSucceeded();
+}
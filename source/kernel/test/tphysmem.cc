@@ -28,6 +28,7 @@
 /* forward declarations */
 static void test_mm();
 static void test_default();
+static void test_bulk();
 static void test_contiguous();
 static void test_contiguous_align();
 static void test_mm_allocate();
@@ -43,6 +44,7 @@ static frameno_t frames[FRAME_COUNT];
 
 static void test_mm() {
 	test_default();
+	test_bulk();
 	test_contiguous();
 	test_contiguous_align();
 }
@@ -58,6 +60,24 @@ static void test_default() {
 	test_caseSucceeded();
 }
 
+static void test_bulk() {
+	test_caseStart("Requesting and freeing %d user frames at once",FRAME_COUNT);
+
+	checkMemoryBefore(false);
+	test_assertTrue(PhysMem::reserve(FRAME_COUNT,false));
+	test_assertSize(PhysMem::allocate(FRAME_COUNT,frames),FRAME_COUNT);
+	for(size_t i = 0; i < FRAME_COUNT; ++i) {
+		test_assertTrue(frames[i] != PhysMem::INVALID_FRAME);
+		for(size_t j = 0; j < i; ++j)
+			test_assertTrue(frames[i] != frames[j]);
+	}
+	for(size_t i = 0; i < FRAME_COUNT; ++i)
+		PhysMem::free(frames[i],PhysMem::USR);
+	checkMemoryAfter(false);
+
+	test_caseSucceeded();
+}
+
 static void test_contiguous() {
 	ssize_t res1,res2,res3,res4;
 
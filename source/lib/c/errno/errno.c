@@ -22,5 +22,5 @@
 #include <errno.h>
 
 int *errno_location(void) {
-	return (int*)stack_top(1);
+	return (int*)stack_top(STACK_TOP_ERRNO);
 }
@@ -47,6 +47,9 @@ extern A_WEAK void sigRetFunc(void);
 extern void initTLS(void);
 extern void initStdio(void);
 extern void initHeap(void);
+#if defined(__eco32__)
+extern void initPthread(void);
+#endif
 
 /**
  * Is called at the very beginning to setup some initial stuff
@@ -144,6 +147,9 @@ uintptr_t __libc_preinit(uintptr_t entryPoint,int argc,char *argv[]) {
 		if(usemcrt(&__libc_sem,1) < 0)
 			error("Unable to create libc lock");
 		initHeap();
+#if defined(__eco32__)
+		initPthread();
+#endif
 		initialized = true;
 	}
 	initTLS();
@@ -22,12 +22,15 @@
 #include <sys/sync.h>
 #include <sys/thread.h>
 #include <sys/tls.h>
+#include <errno.h>
 #include <pthread.h>
+#include <stdlib.h>
 
-#define MAX_LOCKS   4
-
-static long lockCount = 0;
-static tUserSem usems[MAX_LOCKS];
+enum {
+	ONCE_INIT		= PTHREAD_ONCE_INIT,
+	ONCE_RUNNING	= 1,
+	ONCE_DONE		= 2,
+};
 
 int pthread_key_create(pthread_key_t* key,A_UNUSED void (*func)(void*)) {
 	*key = tlsadd();
@@ -38,13 +41,15 @@ int pthread_key_delete(A_UNUSED pthread_key_t key) {
 	return 0;
 }
 
-int pthread_cancel(A_UNUSED pthread_t id) {
-	return 0;
+pthread_t pthread_self(void) {
+	return gettid();
 }
 
-int pthread_once(pthread_once_t *control,void (*init)(void)) {
-	if(atomic_cmpnswap(control,1,2))
-	    (*init)();
+int pthread_equal(pthread_t t1,pthread_t t2) {
+	return t1 == t2;
+}
+
+int pthread_cancel(A_UNUSED pthread_t id) {
 	return 0;
 }
 
@@ -57,23 +62,579 @@ int pthread_setspecific(pthread_key_t key,void* data) {
 	return 0;
 }
 
-int pthread_mutex_init(pthread_mutex_t *mutex,A_UNUSED const pthread_mutexattr_t *attr) {
-	int id = atomic_add(&lockCount,+1);
-	*mutex = id;
-	return usemcrt(usems + id,1);
+int pthread_mutexattr_init(pthread_mutexattr_t *attr) {
+	*attr = PTHREAD_MUTEX_DEFAULT;
+	return 0;
 }
 
-int pthread_mutex_lock(pthread_mutex_t *mutex) {
-	usemdown(usems + *mutex);
+int pthread_mutexattr_destroy(A_UNUSED pthread_mutexattr_t *attr) {
+	return 0;
+}
+
+int pthread_mutexattr_gettype(const pthread_mutexattr_t *attr,int *type) {
+	*type = *attr;
+	return 0;
+}
+
+int pthread_mutexattr_settype(pthread_mutexattr_t *attr,int type) {
+	if(type != PTHREAD_MUTEX_NORMAL && type != PTHREAD_MUTEX_RECURSIVE)
+		return EINVAL;
+	*attr = type;
+	return 0;
+}
+
+#if defined(__eco32__)
+
+/* eco32 has no atomic instructions. thus, we protect the state of all primitives by one lock and
+ * use kernel-semaphores to block. they are created on the first use, so that the static
+ * initializers work. */
+
+static tUserSem pthreadSem;
+
+void initPthread(void);
+
+void initPthread(void) {
+	if(usemcrt(&pthreadSem,1) < 0)
+		error("Unable to create pthread lock");
+}
+
+/* expects that pthreadSem is held */
+static int prepare_sem(volatile int *sem,uint value) {
+	if(*sem < 0)
+		*sem = semcrt(value);
+	return *sem;
+}
+
+int pthread_once(pthread_once_t *control,void (*init)(void)) {
+	usemdown(&pthreadSem);
+	if(*control == ONCE_INIT) {
+		*control = ONCE_RUNNING;
+		usemup(&pthreadSem);
+		(*init)();
+		*control = ONCE_DONE;
+		return 0;
+	}
+	usemup(&pthreadSem);
+
+	/* somebody else is running init; wait until it has finished */
+	while(*control != ONCE_DONE)
+		yield();
 	return 0;
 }
 
+int pthread_mutex_init(pthread_mutex_t *mutex,const pthread_mutexattr_t *attr) {
+	mutex->sem = semcrt(0);
+	mutex->locked = 0;
+	mutex->waiters = 0;
+	mutex->type = attr ? *attr : PTHREAD_MUTEX_DEFAULT;
+	mutex->owner = -1;
+	mutex->count = 0;
+	return mutex->sem < 0 ? ENOMEM : 0;
+}
+
+static int mutex_acquire(pthread_mutex_t *mutex,bool block) {
+	usemdown(&pthreadSem);
+	if(!mutex->locked) {
+		mutex->locked = 1;
+		usemup(&pthreadSem);
+		return 0;
+	}
+	if(!block) {
+		usemup(&pthreadSem);
+		return EBUSY;
+	}
+	if(prepare_sem(&mutex->sem,0) < 0) {
+		usemup(&pthreadSem);
+		return ENOMEM;
+	}
+	mutex->waiters++;
+	usemup(&pthreadSem);
+
+	/* the releasing thread hands the mutex over to us, i.e., locked stays set */
+	IGNSIGS(semdown(mutex->sem));
+	return 0;
+}
+
+static void mutex_release(pthread_mutex_t *mutex) {
+	usemdown(&pthreadSem);
+	if(mutex->waiters > 0) {
+		mutex->waiters--;
+		semup(mutex->sem);
+	}
+	else
+		mutex->locked = 0;
+	usemup(&pthreadSem);
+}
+
+static int mutex_lock(pthread_mutex_t *mutex,bool block) {
+	if(mutex->type == PTHREAD_MUTEX_RECURSIVE) {
+		pthread_t self = gettid();
+		if(mutex->owner == self) {
+			mutex->count++;
+			return 0;
+		}
+		int res = mutex_acquire(mutex,block);
+		if(res != 0)
+			return res;
+		mutex->owner = self;
+		mutex->count = 1;
+		return 0;
+	}
+
+	return mutex_acquire(mutex,block);
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+	return mutex_lock(mutex,true);
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+	return mutex_lock(mutex,false);
+}
+
 int pthread_mutex_unlock(pthread_mutex_t *mutex) {
-	usemup(usems + *mutex);
+	if(mutex->type == PTHREAD_MUTEX_RECURSIVE) {
+		if(mutex->owner != gettid())
+			return EPERM;
+		if(--mutex->count > 0)
+			return 0;
+		mutex->owner = -1;
+	}
+
+	mutex_release(mutex);
 	return 0;
 }
 
 int pthread_mutex_destroy(pthread_mutex_t *mutex) {
-	usemdestr(usems + *mutex);
+	if(mutex->sem >= 0)
+		semdestr(mutex->sem);
+	return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond,A_UNUSED const pthread_condattr_t *attr) {
+	cond->sem = semcrt(0);
+	cond->waiters = 0;
+	return cond->sem < 0 ? ENOMEM : 0;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond,pthread_mutex_t *mutex) {
+	/* announce us while we hold the mutex. the kernel-semaphore remembers a signal that is sent
+	 * before we block on it */
+	usemdown(&pthreadSem);
+	if(prepare_sem(&cond->sem,0) < 0) {
+		usemup(&pthreadSem);
+		return ENOMEM;
+	}
+	cond->waiters++;
+	usemup(&pthreadSem);
+
+	pthread_t owner = mutex->owner;
+	uint count = mutex->count;
+	mutex->owner = -1;
+	mutex_release(mutex);
+
+	IGNSIGS(semdown(cond->sem));
+
+	mutex_acquire(mutex,true);
+	mutex->owner = owner;
+	mutex->count = count;
+	return 0;
+}
+
+static void cond_wake(pthread_cond_t *cond,bool all) {
+	usemdown(&pthreadSem);
+	while(cond->waiters > 0) {
+		cond->waiters--;
+		semup(cond->sem);
+		if(!all)
+			break;
+	}
+	usemup(&pthreadSem);
+}
+
+int pthread_cond_signal(pthread_cond_t *cond) {
+	cond_wake(cond,false);
+	return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+	cond_wake(cond,true);
+	return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t *cond) {
+	if(cond->sem >= 0)
+		semdestr(cond->sem);
+	return 0;
+}
+
+/* creates the lock on the first use, if it has been initialized statically */
+static int rwlock_prepare(pthread_rwlock_t *rwlock) {
+	int res = 0;
+	if(EXPECT_FALSE(rwlock->sem < 0)) {
+		usemdown(&pthreadSem);
+		if(rwlock->sem < 0)
+			res = rwcrt(rwlock) < 0 ? ENOMEM : 0;
+		usemup(&pthreadSem);
+	}
+	return res;
+}
+
+int pthread_rwlock_init(pthread_rwlock_t *rwlock,A_UNUSED const pthread_rwlockattr_t *attr) {
+	return rwcrt(rwlock) < 0 ? ENOMEM : 0;
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) {
+	int res = rwlock_prepare(rwlock);
+	if(res == 0)
+		rwreq(rwlock,RW_READ);
+	return res;
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock) {
+	int res = rwlock_prepare(rwlock);
+	if(res != 0)
+		return res;
+	return rwtryreq(rwlock,RW_READ) ? 0 : EBUSY;
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) {
+	int res = rwlock_prepare(rwlock);
+	if(res == 0)
+		rwreq(rwlock,RW_WRITE);
+	return res;
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock) {
+	int res = rwlock_prepare(rwlock);
+	if(res != 0)
+		return res;
+	return rwtryreq(rwlock,RW_WRITE) ? 0 : EBUSY;
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock) {
+	/* only the writer can see -1 here */
+	rwrel(rwlock,rwlock->count == -1 ? RW_WRITE : RW_READ);
+	return 0;
+}
+
+int pthread_rwlock_destroy(pthread_rwlock_t *rwlock) {
+	if(rwlock->sem >= 0)
+		rwdestr(rwlock);
+	return 0;
+}
+
+int pthread_barrier_init(pthread_barrier_t *barrier,A_UNUSED const pthread_barrierattr_t *attr,
+		unsigned count) {
+	if(count == 0)
+		return EINVAL;
+	barrier->seq = 0;
+	barrier->count = 0;
+	barrier->total = count;
+	return 0;
+}
+
+int pthread_barrier_wait(pthread_barrier_t *barrier) {
+	/* a kernel-semaphore doesn't work here, because the threads of the next round could take the
+	 * wakeups of the current one. thus, wait for seq to change, which is checked by the kernel */
+	usemdown(&pthreadSem);
+	long seq = barrier->seq;
+	if(++barrier->count == barrier->total) {
+		barrier->count = 0;
+		barrier->seq++;
+		usemup(&pthreadSem);
+		futexwake(&barrier->seq,true);
+		return PTHREAD_BARRIER_SERIAL_THREAD;
+	}
+	usemup(&pthreadSem);
+
+	while(barrier->seq == seq)
+		futexwait(&barrier->seq,seq);
+	return 0;
+}
+
+int pthread_barrier_destroy(A_UNUSED pthread_barrier_t *barrier) {
+	return 0;
+}
+
+int pthread_spin_init(pthread_spinlock_t *lock,A_UNUSED int pshared) {
+	*lock = 0;
+	return 0;
+}
+
+int pthread_spin_trylock(pthread_spinlock_t *lock) {
+	int res = EBUSY;
+	usemdown(&pthreadSem);
+	if(*lock == 0) {
+		*lock = 1;
+		res = 0;
+	}
+	usemup(&pthreadSem);
+	return res;
+}
+
+int pthread_spin_lock(pthread_spinlock_t *lock) {
+	/* spinning makes no sense without atomic instructions; so, let the owner continue */
+	while(pthread_spin_trylock(lock) != 0)
+		yield();
 	return 0;
 }
+
+int pthread_spin_unlock(pthread_spinlock_t *lock) {
+	*lock = 0;
+	return 0;
+}
+
+int pthread_spin_destroy(A_UNUSED pthread_spinlock_t *lock) {
+	return 0;
+}
+
+#else
+
+enum {
+	MUTEX_FREE		= 0,
+	MUTEX_LOCKED	= 1,
+	MUTEX_WAITERS	= 2,
+};
+
+static long atomic_xchg(volatile long *ptr,long value) {
+	long old;
+	do
+		old = *ptr;
+	while(!atomic_cmpnswap(ptr,old,value));
+	return old;
+}
+
+int pthread_once(pthread_once_t *control,void (*init)(void)) {
+	if(EXPECT_TRUE(*control == ONCE_DONE))
+		return 0;
+
+	if(atomic_cmpnswap(control,ONCE_INIT,ONCE_RUNNING)) {
+		(*init)();
+		*control = ONCE_DONE;
+		futexwake(control,true);
+	}
+	else {
+		/* somebody else is running init; wait until it has finished */
+		while(*control != ONCE_DONE)
+			futexwait(control,ONCE_RUNNING);
+	}
+	return 0;
+}
+
+int pthread_mutex_init(pthread_mutex_t *mutex,const pthread_mutexattr_t *attr) {
+	mutex->value = MUTEX_FREE;
+	mutex->type = attr ? *attr : PTHREAD_MUTEX_DEFAULT;
+	mutex->owner = -1;
+	mutex->count = 0;
+	return 0;
+}
+
+/* the mutex is based on the one from "Futexes Are Tricky" by Ulrich Drepper: the fast paths need
+ * a single atomic operation and futexwake() is only called if somebody might wait. */
+static void mutex_acquire(pthread_mutex_t *mutex) {
+	if(EXPECT_TRUE(atomic_cmpnswap(&mutex->value,MUTEX_FREE,MUTEX_LOCKED)))
+		return;
+	/* we don't know whether there are other waiters. so, keep it marked */
+	while(atomic_xchg(&mutex->value,MUTEX_WAITERS) != MUTEX_FREE)
+		futexwait(&mutex->value,MUTEX_WAITERS);
+}
+
+static void mutex_release(pthread_mutex_t *mutex) {
+	if(EXPECT_FALSE(atomic_add(&mutex->value,-1) != MUTEX_LOCKED)) {
+		mutex->value = MUTEX_FREE;
+		futexwake(&mutex->value,false);
+	}
+}
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) {
+	if(mutex->type == PTHREAD_MUTEX_RECURSIVE) {
+		pthread_t self = gettid();
+		if(mutex->owner == self) {
+			mutex->count++;
+			return 0;
+		}
+		mutex_acquire(mutex);
+		mutex->owner = self;
+		mutex->count = 1;
+		return 0;
+	}
+
+	mutex_acquire(mutex);
+	return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t *mutex) {
+	if(mutex->type == PTHREAD_MUTEX_RECURSIVE) {
+		pthread_t self = gettid();
+		if(mutex->owner == self) {
+			mutex->count++;
+			return 0;
+		}
+		if(!atomic_cmpnswap(&mutex->value,MUTEX_FREE,MUTEX_LOCKED))
+			return EBUSY;
+		mutex->owner = self;
+		mutex->count = 1;
+		return 0;
+	}
+
+	return atomic_cmpnswap(&mutex->value,MUTEX_FREE,MUTEX_LOCKED) ? 0 : EBUSY;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t *mutex) {
+	if(mutex->type == PTHREAD_MUTEX_RECURSIVE) {
+		if(mutex->owner != gettid())
+			return EPERM;
+		if(--mutex->count > 0)
+			return 0;
+		mutex->owner = -1;
+	}
+
+	mutex_release(mutex);
+	return 0;
+}
+
+int pthread_mutex_destroy(A_UNUSED pthread_mutex_t *mutex) {
+	return 0;
+}
+
+int pthread_cond_init(pthread_cond_t *cond,A_UNUSED const pthread_condattr_t *attr) {
+	cond->seq = 0;
+	cond->waiters = 0;
+	return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond,pthread_mutex_t *mutex) {
+	/* we hold the mutex. thus, a signal that is sent after we've released it changes seq and
+	 * futexwait() returns immediately in this case. */
+	long seq = cond->seq;
+	atomic_add(&cond->waiters,+1);
+
+	pthread_t owner = mutex->owner;
+	uint count = mutex->count;
+	mutex->owner = -1;
+	mutex_release(mutex);
+
+	futexwait(&cond->seq,seq);
+	atomic_add(&cond->waiters,-1);
+
+	/* other threads might have been waked up as well; so, mark the mutex as contended */
+	while(atomic_xchg(&mutex->value,MUTEX_WAITERS) != MUTEX_FREE)
+		futexwait(&mutex->value,MUTEX_WAITERS);
+	mutex->owner = owner;
+	mutex->count = count;
+	return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t *cond) {
+	if(cond->waiters > 0) {
+		atomic_add(&cond->seq,+1);
+		futexwake(&cond->seq,false);
+	}
+	return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t *cond) {
+	if(cond->waiters > 0) {
+		atomic_add(&cond->seq,+1);
+		futexwake(&cond->seq,true);
+	}
+	return 0;
+}
+
+int pthread_cond_destroy(A_UNUSED pthread_cond_t *cond) {
+	return 0;
+}
+
+int pthread_rwlock_init(pthread_rwlock_t *rwlock,A_UNUSED const pthread_rwlockattr_t *attr) {
+	return rwcrt(rwlock);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) {
+	rwreq(rwlock,RW_READ);
+	return 0;
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock) {
+	return rwtryreq(rwlock,RW_READ) ? 0 : EBUSY;
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) {
+	rwreq(rwlock,RW_WRITE);
+	return 0;
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock) {
+	return rwtryreq(rwlock,RW_WRITE) ? 0 : EBUSY;
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock) {
+	/* only the writer can see -1 here */
+	rwrel(rwlock,rwlock->count == -1 ? RW_WRITE : RW_READ);
+	return 0;
+}
+
+int pthread_rwlock_destroy(pthread_rwlock_t *rwlock) {
+	rwdestr(rwlock);
+	return 0;
+}
+
+int pthread_barrier_init(pthread_barrier_t *barrier,A_UNUSED const pthread_barrierattr_t *attr,
+		unsigned count) {
+	if(count == 0)
+		return EINVAL;
+	barrier->seq = 0;
+	barrier->count = 0;
+	barrier->total = count;
+	return 0;
+}
+
+int pthread_barrier_wait(pthread_barrier_t *barrier) {
+	/* nobody can pass the barrier before the last one has arrived. thus, we see the old seq */
+	long seq = barrier->seq;
+	if(atomic_add(&barrier->count,+1) == barrier->total - 1) {
+		/* reset it for the next round first. the others can't start the next round until we've
+		 * changed seq */
+		barrier->count = 0;
+		atomic_add(&barrier->seq,+1);
+		futexwake(&barrier->seq,true);
+		return PTHREAD_BARRIER_SERIAL_THREAD;
+	}
+
+	while(barrier->seq == seq)
+		futexwait(&barrier->seq,seq);
+	return 0;
+}
+
+int pthread_barrier_destroy(A_UNUSED pthread_barrier_t *barrier) {
+	return 0;
+}
+
+int pthread_spin_init(pthread_spinlock_t *lock,A_UNUSED int pshared) {
+	*lock = 0;
+	return 0;
+}
+
+int pthread_spin_lock(pthread_spinlock_t *lock) {
+	while(!atomic_cmpnswap(lock,0,1)) {
+		/* wait until it's free without hammering the cache line */
+		while(*lock)
+			;
+	}
+	return 0;
+}
+
+int pthread_spin_trylock(pthread_spinlock_t *lock) {
+	return atomic_cmpnswap(lock,0,1) ? 0 : EBUSY;
+}
+
+int pthread_spin_unlock(pthread_spinlock_t *lock) {
+	atomic_cmpnswap(lock,1,0);
+	return 0;
+}
+
+int pthread_spin_destroy(A_UNUSED pthread_spinlock_t *lock) {
+	return 0;
+}
+
+#endif
@@ -24,6 +24,7 @@
 
 int __cxa_atexit(void (*f)(void *),void *p,void *d);
 void __cxa_finalize(void *d);
+void destroyHeapCache(void);
 
 int atexit(fExitFunc func) {
 	return __cxa_atexit(func,NULL,NULL);
@@ -31,6 +32,8 @@ int atexit(fExitFunc func) {
 
 void exit(int status) {
 	__cxa_finalize(NULL);
+	/* give the objects in the thread cache back, so that the other threads can use them */
+	destroyHeapCache();
 	_exit(status);
 }
 
@@ -17,17 +17,36 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+
 #include <sys/arch.h>
 #include <sys/common.h>
 #include <sys/conf.h>
 #include <sys/debug.h>
 #include <sys/mman.h>
 #include <sys/sync.h>
+#include <sys/tls.h>
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/**
+ * The heap consists of three layers:
+ * 1. The page heap manages runs of pages, which are taken from big chunks that are mmap'd on
+ *    demand. Free runs are kept in bins by their length and coalesced with their neighbors.
+ *    Which run a page belongs to is stored in a radix tree, the page map, so that free() finds
+ *    the run of an address in O(1) and without locking.
+ * 2. Small allocations (up to SMALL_MAX bytes) are rounded up to one of CLASS_COUNT size classes.
+ *    Each class has a central list of spans, i.e., page runs that are cut into objects of that
+ *    size, and a depot of batches of free objects. Every class has its own lock.
+ * 3. Every thread has a cache with a list of free objects per class, which is stored in a TLS
+ *    slot. Thus, most calls of malloc and free only pop or push an object without any lock. The
+ *    objects are moved between the cache and the central lists in batches.
+ * Large allocations get a run of pages directly and huge allocations get their own mmap'd region,
+ * which is unmapped again on free.
+ */
+
 #if DEBUGGING
 #define DEBUG_ALLOC_N_FREE		0
 #define DEBUG_ALLOC_N_FREE_PID	27	/* -1 = all */
@@ -36,130 +55,640 @@
 #define ROUND_DN(count,align)	((count) & ~((align) - 1))
 #define ROUND_UP(count,align)	(((count) + (align) - 1) & ~((align) - 1))
 
-#define GUARD_MAGIC				0xDEADBEEF
-#define FREE_MAGIC				0xFEEEFEEE
+/* the alignment of all allocations */
+#define ALIGN					16
+/* the max. size of small allocations, which are served by the size classes */
+#define SMALL_MAX				(32 * 1024)
+/* the min. size of allocations that get their own region */
+#define HUGE_MIN				(1024 * 1024)
+/* class 0 is unused; 8 classes up to 128 bytes and 4 classes per power of two from there on */
+#define CLASS_COUNT				41
+/* the size of the spans we aim for, as long as they can hold 8 objects */
+#define SPAN_SIZE				(64 * 1024)
+/* the max. number of bytes that are moved between the thread cache and the central lists at once */
+#define BATCH_SIZE				(64 * 1024)
+#define MAX_BATCH				32
+/* the max. number of batches in the depot of a class */
+#define DEPOT_MAX_BATCHES		8
+/* if a thread cache holds more bytes, it gives half of all its objects back */
+#define CACHE_MAX_SIZE			(1024 * 1024)
 
 #define MIN_MMAP_SIZE			(16 * PAGE_SIZE)
 #define MAX_MMAP_SIZE			(8192 * PAGE_SIZE)
+/* the size of the regions for span descriptors and page map nodes */
+#define META_SIZE				(16 * PAGE_SIZE)
+
+/* runs of less pages are kept in exact bins; the longer ones are in bin 0 */
+#define BIN_COUNT				128
+
+/* the page map is a radix tree with three levels */
+#define PM_BITS					(sizeof(uintptr_t) * 8 - PAGE_BITS)
+#define PM_LEAF_BITS			(PM_BITS / 3)
+#define PM_MID_BITS				(PM_BITS / 3)
+#define PM_ROOT_BITS			(PM_BITS - PM_MID_BITS - PM_LEAF_BITS)
+
+enum {
+	SPAN_UNUSED,				/* the descriptor is not in use */
+	SPAN_FREE,					/* a free run in the page heap */
+	SPAN_SMALL,					/* a run that is cut into objects of one class */
+	SPAN_LARGE,					/* a run for one large allocation */
+	SPAN_HUGE,					/* an mmap'd region for one huge allocation */
+};
 
-#define MIN_AREA_SIZE			PAGE_SIZE
-#define MAX_AREA_SIZE			(64 * PAGE_SIZE)
+/* a run of pages */
+typedef struct sSpan sSpan;
+struct sSpan {
+	uintptr_t start;
+	size_t pages;
+	uint state;
+	uint cls;
+	/* the number of objects in use, including the ones in thread caches and the depot */
+	size_t used;
+	/* the freed objects */
+	void *freeObjs;
+	/* the objects from here on have never been used; we cut them lazily */
+	uintptr_t bump;
+	sSpan *prev;
+	sSpan *next;
+};
 
-/* an area in memory */
-typedef struct sMemArea sMemArea;
-struct sMemArea {
+/* the central lists of a class. objects are linked via their first word and batches in the depot
+ * via the second word of their first object */
+typedef struct {
+	tUserSem lock;
+	sSpan *partial;
+	void *depot;
+	size_t batches;
+	/* the number of free bytes in the spans of this class */
+	size_t freeBytes;
+} sCentral;
+
+typedef struct {
+	void *list;
+	size_t count;
+} sCacheBin;
+
+/* the cache of a thread */
+typedef struct sThreadCache sThreadCache;
+struct sThreadCache {
+	sCacheBin bins[CLASS_COUNT];
+	/* the number of bytes in the cache */
 	size_t size;
-	void *address;
-	sMemArea *next;
+	sThreadCache *prev;
+	sThreadCache *next;
 };
 
 void initHeap(void);
+void destroyHeapCache(void);
+
+/* the class for every multiple of ALIGN up to SMALL_MAX */
+static uint8_t sizeClasses[SMALL_MAX / ALIGN + 1];
+static size_t classSize[CLASS_COUNT];
+static size_t classPages[CLASS_COUNT];
+static size_t classBatch[CLASS_COUNT];
+static sCentral central[CLASS_COUNT];
+
+/* the page heap; everything here is protected by pageSem */
+static tUserSem pageSem;
+static sSpan *freeRuns[BIN_COUNT];
+static size_t freePages = 0;
+/* total number of pages we're using */
+static size_t pageCount = 0;
+/* current allocation sizes */
+static size_t nextSize = MIN_MMAP_SIZE;
+static sSpan *freeSpans = NULL;
+static uintptr_t metaPos = 0;
+static uintptr_t metaEnd = 0;
+/* the caches of all running threads and the ones of exited threads for reuse */
+static sThreadCache *caches = NULL;
+static sThreadCache *freeCaches = NULL;
+
+/* the root of the page map; the nodes are only written with pageSem, but read without lock */
+static void **pageMap;
+static size_t cacheSlot;
+static bool initialized = false;
+
+static size_t getClassSize(size_t cls) {
+	if(cls <= 8)
+		return cls * ALIGN;
+	/* 5/4, 6/4, 7/4 and 8/4 of the previous power of two */
+	size_t k = cls - 9;
+	size_t bits = 7 + k / 4;
+	return (k % 4 + 5) << (bits - 2);
+}
+
+static void *allocMeta(size_t size) {
+	size = ROUND_UP(size,sizeof(ulong) * 2);
+	if(metaPos + size > metaEnd) {
+		size_t msize = MAX(META_SIZE,ROUND_UP(size,PAGE_SIZE));
+		void *res = mmap(NULL,msize,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
+		if(res == NULL)
+			return NULL;
+		metaPos = (uintptr_t)res;
+		metaEnd = metaPos + msize;
+	}
+	void *res = (void*)metaPos;
+	metaPos += size;
+	return res;
+}
+
+static void *allocNode(size_t size) {
+	/* big nodes get their own region, which is demand-zero; so we don't touch it here */
+	if(size > PAGE_SIZE)
+		return mmap(NULL,size,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
+	void *node = allocMeta(size);
+	if(node)
+		memclear(node,size);
+	return node;
+}
+
+static sSpan *allocSpan(void) {
+	sSpan *s = freeSpans;
+	if(s)
+		freeSpans = s->next;
+	else {
+		s = (sSpan*)allocMeta(sizeof(sSpan));
+		if(s == NULL)
+			return NULL;
+	}
+	memclear(s,sizeof(sSpan));
+	return s;
+}
+
+static void freeSpan(sSpan *s) {
+	s->state = SPAN_UNUSED;
+	s->next = freeSpans;
+	freeSpans = s;
+}
+
+static inline sSpan *pmGet(uintptr_t page) {
+	void **mid = (void**)pageMap[page >> (PM_MID_BITS + PM_LEAF_BITS)];
+	if(EXPECT_FALSE(mid == NULL))
+		return NULL;
+	sSpan **leaf = (sSpan**)mid[(page >> PM_LEAF_BITS) & ((1UL << PM_MID_BITS) - 1)];
+	if(EXPECT_FALSE(leaf == NULL))
+		return NULL;
+	return leaf[page & ((1UL << PM_LEAF_BITS) - 1)];
+}
+
+static inline void pmSet(uintptr_t page,sSpan *s) {
+	void **mid = (void**)pageMap[page >> (PM_MID_BITS + PM_LEAF_BITS)];
+	sSpan **leaf = (sSpan**)mid[(page >> PM_LEAF_BITS) & ((1UL << PM_MID_BITS) - 1)];
+	leaf[page & ((1UL << PM_LEAF_BITS) - 1)] = s;
+}
 
 /**
- * Allocates a new page for areas
+ * Creates the page map nodes for <count> pages starting at <page>.
  */
-static bool loadNewAreas(void);
+static bool pmEnsure(uintptr_t page,size_t count) {
+	uintptr_t end = page + count;
+	while(page < end) {
+		void **root = pageMap + (page >> (PM_MID_BITS + PM_LEAF_BITS));
+		if(*root == NULL) {
+			void *mid = allocNode(sizeof(void*) << PM_MID_BITS);
+			if(mid == NULL)
+				return false;
+			*root = mid;
+		}
+		void **mid = (void**)*root + ((page >> PM_LEAF_BITS) & ((1UL << PM_MID_BITS) - 1));
+		if(*mid == NULL) {
+			void *leaf = allocNode(sizeof(sSpan*) << PM_LEAF_BITS);
+			if(leaf == NULL)
+				return false;
+			*mid = leaf;
+		}
+		page = ROUND_DN(page,1UL << PM_LEAF_BITS) + (1UL << PM_LEAF_BITS);
+	}
+	return true;
+}
+
+static inline uintptr_t pageOf(uintptr_t addr) {
+	return addr >> PAGE_BITS;
+}
+
+static inline uintptr_t spanEnd(const sSpan *s) {
+	return s->start + s->pages * PAGE_SIZE;
+}
+
+/* sets the page map entries for the first and last page, which is all we need for lookups of
+ * large allocations and for the coalescing of free runs */
+static void pmSetBounds(sSpan *s) {
+	pmSet(pageOf(s->start),s);
+	pmSet(pageOf(spanEnd(s)) - 1,s);
+}
+
+static void runInsert(sSpan *s) {
+	sSpan **bin = freeRuns + (s->pages < BIN_COUNT ? s->pages : 0);
+	s->state = SPAN_FREE;
+	s->prev = NULL;
+	s->next = *bin;
+	if(*bin)
+		(*bin)->prev = s;
+	*bin = s;
+	freePages += s->pages;
+	pmSetBounds(s);
+}
+
+static void runRemove(sSpan *s) {
+	sSpan **bin = freeRuns + (s->pages < BIN_COUNT ? s->pages : 0);
+	if(s->prev)
+		s->prev->next = s->next;
+	else
+		*bin = s->next;
+	if(s->next)
+		s->next->prev = s->prev;
+	freePages -= s->pages;
+}
 
 /**
- * Allocates new space for alloation
+ * Gives the run <s> back to the page heap and merges it with its free neighbors
  */
-static bool loadNewSpace(size_t size);
+static void runFree(sSpan *s) {
+	/* the page map might contain stale entries for pages in the middle of runs, but never for the
+	 * first and last page of a run. so, a free span that ends at our start is our predecessor */
+	sSpan *prev = pmGet(pageOf(s->start) - 1);
+	if(prev && prev->state == SPAN_FREE && spanEnd(prev) == s->start) {
+		runRemove(prev);
+		s->start = prev->start;
+		s->pages += prev->pages;
+		freeSpan(prev);
+	}
+	sSpan *next = pmGet(pageOf(spanEnd(s)));
+	if(next && next->state == SPAN_FREE && next->start == spanEnd(s)) {
+		runRemove(next);
+		s->pages += next->pages;
+		freeSpan(next);
+	}
+	runInsert(s);
+}
+
+static bool growHeap(size_t pages) {
+	size_t size = MAX(nextSize,pages * PAGE_SIZE);
+	if(nextSize < MAX_MMAP_SIZE)
+		nextSize *= 2;
+
+	sSpan *s = allocSpan();
+	if(s == NULL)
+		return false;
+
+	void *res = mmap(NULL,size,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
+	if(res == NULL) {
+		freeSpan(s);
+		return false;
+	}
+	/* every page might belong to a small span, so that we need all page map nodes */
+	if(!pmEnsure(pageOf((uintptr_t)res),size / PAGE_SIZE)) {
+		munmap(res);
+		freeSpan(s);
+		return false;
+	}
+
+	pageCount += size / PAGE_SIZE;
+	s->start = (uintptr_t)res;
+	s->pages = size / PAGE_SIZE;
+	runFree(s);
+	return true;
+}
+
+static sSpan *findRun(size_t pages) {
+	for(size_t i = pages; i < BIN_COUNT; ++i) {
+		if(freeRuns[i])
+			return freeRuns[i];
+	}
+
+	/* best fit among the long ones */
+	sSpan *best = NULL;
+	for(sSpan *s = freeRuns[0]; s != NULL; s = s->next) {
+		if(s->pages >= pages && (best == NULL || s->pages < best->pages))
+			best = s;
+	}
+	return best;
+}
 
 /**
- * Adds memory areas from given memory.
+ * Allocates a run of <pages> pages. The page map entries of its first and last page are set.
+ * Expects that pageSem is held.
  */
-static void initAreas(void *addr,size_t size);
+static sSpan *allocRun(size_t pages) {
+	sSpan *s = findRun(pages);
+	if(s == NULL) {
+		if(!growHeap(pages))
+			return NULL;
+		s = findRun(pages);
+		assert(s != NULL);
+	}
 
-/* a linked list of free and usable areas. That means the areas have an address and size */
-static sMemArea *usableList = NULL;
-/* a linked list of free but not usable areas. That means the areas have no address and size */
-static sMemArea *freeList = NULL;
-/* total number of pages we're using */
-static size_t pageCount = 0;
-/* current allocation sizes */
-static size_t nextSize = MIN_MMAP_SIZE;
-static size_t nextAreaSize = MIN_AREA_SIZE;
+	if(s->pages > pages) {
+		sSpan *rem = allocSpan();
+		if(rem == NULL)
+			return NULL;
+		runRemove(s);
+		rem->start = s->start + pages * PAGE_SIZE;
+		rem->pages = s->pages - pages;
+		s->pages = pages;
+		runInsert(rem);
+	}
+	else
+		runRemove(s);
 
-/* the lock for the heap */
-static tUserSem heapSem;
-static bool initialized = false;
+	s->state = SPAN_LARGE;
+	s->prev = s->next = NULL;
+	pmSetBounds(s);
+	return s;
+}
 
-void initHeap(void) {
-	if(initialized)
-		return;
+/**
+ * Takes a new span for class <cls> from the page heap. Expects that the lock of the class is held.
+ */
+static sSpan *newSmallSpan(uint cls) {
+	usemdown(&pageSem);
+	sSpan *s = allocRun(classPages[cls]);
+	if(s) {
+		/* objects might be anywhere in the span, so we need all pages in the page map */
+		for(size_t i = 0; i < s->pages; ++i)
+			pmSet(pageOf(s->start) + i,s);
+		s->state = SPAN_SMALL;
+		s->cls = cls;
+		s->used = 0;
+		s->freeObjs = NULL;
+		s->bump = s->start;
+	}
+	usemup(&pageSem);
+	return s;
+}
 
-	if(usemcrt(&heapSem,1) < 0)
-		error("Unable to create heap lock");
-	initialized = true;
+static void listRemove(sSpan **list,sSpan *s) {
+	if(s->prev)
+		s->prev->next = s->next;
+	else
+		*list = s->next;
+	if(s->next)
+		s->next->prev = s->prev;
 }
 
-void *malloc(size_t size) {
-	ulong *begin;
-	sMemArea *area,*prev,*narea;
+static void listAppend(sSpan **list,sSpan *s) {
+	s->prev = NULL;
+	s->next = *list;
+	if(*list)
+		(*list)->prev = s;
+	*list = s;
+}
 
-	if(size == 0)
-		return NULL;
+static inline bool spanIsFull(const sSpan *s,size_t size) {
+	return s->freeObjs == NULL && s->bump + size > spanEnd(s);
+}
 
-	usemdown(&heapSem);
+/**
+ * Takes up to <n> objects of class <cls> from the spans and puts them in a list. Expects that the
+ * lock of the class is held.
+ *
+ * @return the number of objects
+ */
+static size_t spansFetch(uint cls,size_t n,void **list) {
+	sCentral *c = central + cls;
+	size_t size = classSize[cls];
+	size_t count = 0;
+	*list = NULL;
+	while(count < n) {
+		sSpan *s = c->partial;
+		if(s == NULL) {
+			s = newSmallSpan(cls);
+			if(s == NULL)
+				break;
+			c->freeBytes += s->pages * PAGE_SIZE;
+			listAppend(&c->partial,s);
+		}
 
-	/* align and we need 3 ulongs for the guards */
-	size = ROUND_UP(size,sizeof(ulong)) + sizeof(ulong) * 4;
+		while(count < n && !spanIsFull(s,size)) {
+			void **obj;
+			if(s->freeObjs) {
+				obj = (void**)s->freeObjs;
+				s->freeObjs = *obj;
+			}
+			else {
+				obj = (void**)s->bump;
+				s->bump += size;
+			}
+			*obj = *list;
+			*list = obj;
+			s->used++;
+			count++;
+		}
 
-	/* find a suitable area */
-	prev = NULL;
-	area = usableList;
-	while(area != NULL) {
-		if(area->size >= size)
-			break;
-		prev = area;
-		area = area->next;
+		if(spanIsFull(s,size))
+			listRemove(&c->partial,s);
 	}
+	c->freeBytes -= count * size;
+	return count;
+}
 
-	/* no area found? */
-	if(area == NULL) {
-		if(!loadNewSpace(size)) {
-			usemup(&heapSem);
-			return NULL;
+/**
+ * Gives the objects in <list> back to their spans. Spans that become empty are given back to the
+ * page heap. Expects that the lock of the class is held.
+ */
+static void spansRelease(uint cls,void *list) {
+	sCentral *c = central + cls;
+	size_t size = classSize[cls];
+	while(list) {
+		void **obj = (void**)list;
+		list = *obj;
+
+		sSpan *s = pmGet(pageOf((uintptr_t)obj));
+		assert(s && s->state == SPAN_SMALL && s->cls == cls);
+		if(spanIsFull(s,size))
+			listAppend(&c->partial,s);
+		*obj = s->freeObjs;
+		s->freeObjs = obj;
+		c->freeBytes += size;
+
+		if(--s->used == 0) {
+			listRemove(&c->partial,s);
+			c->freeBytes -= s->pages * PAGE_SIZE;
+			usemdown(&pageSem);
+			runFree(s);
+			usemup(&pageSem);
 		}
-		/* we can assume that it fits */
-		area = usableList;
-		/* remove from usable-list */
-		usableList = area->next;
 	}
-	else {
-		/* remove from usable-list */
-		if(prev == NULL)
-			usableList = area->next;
-		else
-			prev->next = area->next;
+}
+
+/**
+ * Fetches a batch of objects of class <cls> for a thread cache.
+ *
+ * @return the number of objects in <list>
+ */
+static size_t centralFetch(uint cls,void **list) {
+	sCentral *c = central + cls;
+	size_t n;
+	usemdown(&c->lock);
+	if(c->depot) {
+		void **batch = (void**)c->depot;
+		c->depot = batch[1];
+		c->batches--;
+		c->freeBytes -= classBatch[cls] * classSize[cls];
+		*list = batch;
+		n = classBatch[cls];
 	}
+	else
+		n = spansFetch(cls,classBatch[cls],list);
+	usemup(&c->lock);
+	return n;
+}
 
-	/* is there space left? */
-	if(size < area->size) {
-		if(freeList == NULL) {
-			if(!loadNewAreas()) {
-				/* TODO we may have changed something... */
-				usemup(&heapSem);
-				return NULL;
-			}
-		}
+/**
+ * Gives the <n> objects in <list> back to the central lists of class <cls>.
+ */
+static void centralRelease(uint cls,void *list,size_t n) {
+	sCentral *c = central + cls;
+	usemdown(&c->lock);
+	/* keep full batches as they are to hand them out again without touching the spans */
+	if(n == classBatch[cls] && c->batches < DEPOT_MAX_BATCHES) {
+		void **batch = (void**)list;
+		batch[1] = c->depot;
+		c->depot = batch;
+		c->batches++;
+		c->freeBytes += n * classSize[cls];
+	}
+	else
+		spansRelease(cls,list);
+	usemup(&c->lock);
+}
+
+/**
+ * Moves <n> objects of class <cls> from the cache <tc> back to the central lists
+ */
+static void cacheFlush(sThreadCache *tc,uint cls,size_t n) {
+	sCacheBin *bin = tc->bins + cls;
+	n = MIN(n,bin->count);
+	if(n == 0)
+		return;
+
+	void **last = (void**)bin->list;
+	for(size_t i = 1; i < n; ++i)
+		last = (void**)*last;
+	void *list = bin->list;
+	bin->list = *last;
+	*last = NULL;
+	bin->count -= n;
+	tc->size -= n * classSize[cls];
+	centralRelease(cls,list,n);
+}
+
+static A_NOINLINE void cacheScavenge(sThreadCache *tc) {
+	for(uint cls = 1; cls < CLASS_COUNT; ++cls)
+		cacheFlush(tc,cls,(tc->bins[cls].count + 1) / 2);
+}
+
+static A_NOINLINE void *cacheRefill(sThreadCache *tc,uint cls) {
+	void **list;
+	size_t n = centralFetch(cls,(void**)&list);
+	if(n == 0)
+		return NULL;
+
+	sCacheBin *bin = tc->bins + cls;
+	bin->list = *list;
+	bin->count = n - 1;
+	tc->size += (n - 1) * classSize[cls];
+	return list;
+}
 
-		/* split the area */
-		narea = freeList;
-		freeList = freeList->next;
-		narea->address = (void*)((uintptr_t)area->address + size);
-		narea->size = area->size - size;
-		area->size = size;
-		/* insert in usable-list */
-		narea->next = usableList;
-		usableList = narea;
+static A_NOINLINE sThreadCache *createCache(ulong *tls) {
+	usemdown(&pageSem);
+	sThreadCache *tc = freeCaches;
+	if(tc)
+		freeCaches = tc->next;
+	else
+		tc = (sThreadCache*)allocMeta(sizeof(sThreadCache));
+	if(tc) {
+		memclear(tc,sizeof(sThreadCache));
+		tc->next = caches;
+		if(caches)
+			caches->prev = tc;
+		caches = tc;
 	}
+	usemup(&pageSem);
+
+	tls[cacheSlot] = (ulong)tc;
+	return tc;
+}
+
+/**
+ * @return the cache of the current thread or NULL if it has no TLS (yet)
+ */
+static inline sThreadCache *getCache(void) {
+	ulong *tls = *(ulong**)stack_top(STACK_TOP_TLS);
+	if(EXPECT_FALSE(tls == NULL))
+		return NULL;
+	sThreadCache *tc = (sThreadCache*)tls[cacheSlot];
+	if(EXPECT_FALSE(tc == NULL))
+		return createCache(tls);
+	return tc;
+}
+
+void initHeap(void) {
+	if(initialized)
+		return;
+
+	if(usemcrt(&pageSem,1) < 0)
+		error("Unable to create heap lock");
+	for(uint cls = 1; cls < CLASS_COUNT; ++cls) {
+		if(usemcrt(&central[cls].lock,1) < 0)
+			error("Unable to create heap lock");
+
+		size_t size = getClassSize(cls);
+		size_t pages = 1;
+		while(pages * PAGE_SIZE < MIN(size * 8,SPAN_SIZE) ||
+				(pages * PAGE_SIZE) % size > (pages * PAGE_SIZE) / 8)
+			pages++;
+		classSize[cls] = size;
+		classPages[cls] = pages;
+		classBatch[cls] = MIN(MAX(BATCH_SIZE / size,2),MAX_BATCH);
+	}
+	assert(classSize[CLASS_COUNT - 1] == SMALL_MAX);
+
+	uint cls = 1;
+	for(size_t i = 0; i < ARRAY_SIZE(sizeClasses); ++i) {
+		while(classSize[cls] < i * ALIGN)
+			cls++;
+		sizeClasses[i] = cls;
+	}
+
+	pageMap = (void**)allocNode(sizeof(void*) << PM_ROOT_BITS);
+	if(pageMap == NULL)
+		error("Unable to create page map");
+	cacheSlot = tlsadd();
+	initialized = true;
+}
+
+void destroyHeapCache(void) {
+	ulong *tls = *(ulong**)stack_top(STACK_TOP_TLS);
+	if(tls == NULL || tls[cacheSlot] == 0)
+		return;
+
+	sThreadCache *tc = (sThreadCache*)tls[cacheSlot];
+	tls[cacheSlot] = 0;
+	for(uint cls = 1; cls < CLASS_COUNT; ++cls) {
+		while(tc->bins[cls].count > 0)
+			cacheFlush(tc,cls,classBatch[cls]);
+	}
+
+	usemdown(&pageSem);
+	if(tc->prev)
+		tc->prev->next = tc->next;
+	else
+		caches = tc->next;
+	if(tc->next)
+		tc->next->prev = tc->prev;
+	tc->next = freeCaches;
+	freeCaches = tc;
+	usemup(&pageSem);
+}
 
 #if DEBUG_ALLOC_N_FREE
+static void traceAlloc(char op,void *addr,size_t size) {
 	if(DEBUG_ALLOC_N_FREE_PID == -1 || getpid() == DEBUG_ALLOC_N_FREE_PID) {
 		size_t i = 0;
 		uintptr_t *trace = getStackTrace();
-		debugf("[A] %x %d ",(char*)area->address + 3,area->size);
+		debugf("[%c] %x %d ",op,addr,size);
 		while(*trace && i++ < 10) {
 			debugf("%x",*trace);
 			if(trace[1])
@@ -168,19 +697,89 @@ void *malloc(size_t size) {
 		}
 		debugf("\n");
 	}
+}
 #endif
 
-	/* add guards */
-	begin = (ulong*)area->address;
-	begin[0] = (ulong)area;
-	begin[1] = size - sizeof(ulong) * 4;
-	begin[2] = GUARD_MAGIC;
-	begin[size / sizeof(ulong) - 1] = GUARD_MAGIC;
-	usemup(&heapSem);
-	return begin + 3;
+static void *allocSmall(uint cls) {
+	sThreadCache *tc = getCache();
+	if(EXPECT_TRUE(tc != NULL)) {
+		sCacheBin *bin = tc->bins + cls;
+		void **obj = (void**)bin->list;
+		if(EXPECT_TRUE(obj != NULL)) {
+			bin->list = *obj;
+			bin->count--;
+			tc->size -= classSize[cls];
+			return obj;
+		}
+		return cacheRefill(tc,cls);
+	}
+
+	/* no TLS yet; take it directly from the spans */
+	void *obj;
+	usemdown(&central[cls].lock);
+	size_t n = spansFetch(cls,1,&obj);
+	usemup(&central[cls].lock);
+	return n ? obj : NULL;
+}
+
+static void *allocHuge(size_t size) {
+	size_t pages = ROUND_UP(size,PAGE_SIZE) / PAGE_SIZE;
+	/* check for overflow */
+	if(pages * PAGE_SIZE < size)
+		return NULL;
+
+	void *res = mmap(NULL,pages * PAGE_SIZE,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
+	if(res == NULL)
+		return NULL;
+
+	usemdown(&pageSem);
+	sSpan *s = allocSpan();
+	if(s == NULL || !pmEnsure(pageOf((uintptr_t)res),1)) {
+		if(s)
+			freeSpan(s);
+		usemup(&pageSem);
+		munmap(res);
+		return NULL;
+	}
+	s->start = (uintptr_t)res;
+	s->pages = pages;
+	s->state = SPAN_HUGE;
+	pmSet(pageOf(s->start),s);
+	usemup(&pageSem);
+	return res;
+}
+
+static void *allocLarge(size_t size) {
+	if(size >= HUGE_MIN)
+		return allocHuge(size);
+
+	usemdown(&pageSem);
+	sSpan *s = allocRun(ROUND_UP(size,PAGE_SIZE) / PAGE_SIZE);
+	usemup(&pageSem);
+	return s ? (void*)s->start : NULL;
+}
+
+void *malloc(size_t size) {
+	void *res;
+	if(size == 0)
+		return NULL;
+
+	if(EXPECT_TRUE(size <= SMALL_MAX))
+		res = allocSmall(sizeClasses[(size + ALIGN - 1) / ALIGN]);
+	else
+		res = allocLarge(size);
+
+#if DEBUG_ALLOC_N_FREE
+	traceAlloc('A',res,size);
+#endif
+	return res;
 }
 
 void *calloc(size_t num,size_t size) {
+	/* check for overflow */
+	if(size != 0 && num > (size_t)-1 / size)
+		return NULL;
+
 	void *a = malloc(num * size);
 	if(a == NULL)
 		return NULL;
@@ -189,284 +788,199 @@ void *calloc(size_t num,size_t size) {
 	return a;
 }
 
-void free(void *addr) {
-	ulong *begin;
-	sMemArea *area,*a,*prev,*next,*nprev,*pprev,*tprev;
+static void freeLarge(sSpan *s) {
+	usemdown(&pageSem);
+	if(s->state == SPAN_HUGE) {
+		pmSet(pageOf(s->start),NULL);
+		munmap((void*)s->start);
+		freeSpan(s);
+	}
+	else
+		runFree(s);
+	usemup(&pageSem);
+}
 
+void free(void *addr) {
 	/* addr may be null */
 	if(addr == NULL)
 		return;
 
-	/* check guards */
-	begin = (ulong*)addr - 3;
-	area = (sMemArea*)begin[0];
-	vassert(begin[0] != FREE_MAGIC,"Duplicate free of %p?",addr);
-	assert(begin[2] == GUARD_MAGIC);
-	assert(begin[begin[1] / sizeof(ulong) + 3] == GUARD_MAGIC);
-
-	usemdown(&heapSem);
-
-	/* mark as free */
-	begin[0] = FREE_MAGIC;
-
-	/* find the previous and next free areas */
-	prev = NULL;
-	next = NULL;
-	tprev = NULL;
-	pprev = NULL;
-	nprev = NULL;
-	a = usableList;
-	while(a != NULL) {
-		if((uintptr_t)a->address + a->size == (uintptr_t)begin) {
-			prev = a;
-			pprev = tprev;
-		}
-		if((uintptr_t)a->address == (uintptr_t)begin + area->size) {
-			next = a;
-			nprev = tprev;
-		}
-		/* do we have both? */
-		if(prev && next)
-			break;
-		tprev = a;
-		a = a->next;
-	}
-
 #if DEBUG_ALLOC_N_FREE
-	if(DEBUG_ALLOC_N_FREE_PID == -1 || getpid() == DEBUG_ALLOC_N_FREE_PID) {
-		size_t i = 0;
-		uintptr_t *trace = getStackTrace();
-		debugf("[F] %x %d ",addr,area->size);
-		while(*trace && i++ < 10) {
-			debugf("%x",*trace);
-			if(trace[1])
-				debugf(" ");
-			trace++;
-		}
-		debugf("\n");
-	}
+	traceAlloc('F',addr,0);
 #endif
 
-	/* see what we have to merge */
-	if(prev && next) {
-		/* merge prev & area & next */
-		area->size += prev->size + next->size;
-		area->address = prev->address;
-		/* remove prev and next from the list */
-		if(nprev)
-			nprev->next = next->next;
-		else
-			usableList = next->next;
-		/* special-case if next is the previous of prev */
-		if(pprev == next) {
-			if(nprev)
-				nprev->next = prev->next;
-			else
-				usableList = prev->next;
-		}
-		else {
-			if(pprev)
-				pprev->next = prev->next;
-			else
-				usableList = prev->next;
+	sSpan *s = pmGet(pageOf((uintptr_t)addr));
+	vassert(s != NULL && (s->state == SPAN_SMALL || s->start == (uintptr_t)addr),
+		"Invalid or duplicate free of %p?",addr);
+
+	if(EXPECT_TRUE(s->state == SPAN_SMALL)) {
+		uint cls = s->cls;
+		sThreadCache *tc = getCache();
+		if(EXPECT_TRUE(tc != NULL)) {
+			sCacheBin *bin = tc->bins + cls;
+			vassert(bin->list != addr,"Duplicate free of %p?",addr);
+			*(void**)addr = bin->list;
+			bin->list = addr;
+			bin->count++;
+			tc->size += classSize[cls];
+			if(EXPECT_FALSE(bin->count > classBatch[cls] * 2))
+				cacheFlush(tc,cls,classBatch[cls]);
+			if(EXPECT_FALSE(tc->size > CACHE_MAX_SIZE))
+				cacheScavenge(tc);
+			return;
 		}
-		/* put area on the usable-list */
-		area->next = usableList;
-		usableList = area;
-		/* put prev and next on the freelist */
-		prev->next = next;
-		next->next = freeList;
-		freeList = prev;
-	}
-	else if(prev) {
-		/* merge preg & area */
-		prev->size += area->size;
-		/* put area on the freelist */
-		area->next = freeList;
-		freeList = area;
-	}
-	else if(next) {
-		/* merge area & next */
-		next->address = area->address;
-		next->size += area->size;
-		/* put area on the freelist */
-		area->next = freeList;
-		freeList = area;
-	}
-	else {
-		/* insert area in usableList */
-		area->next = usableList;
-		usableList = area;
+
+		*(void**)addr = NULL;
+		usemdown(&central[cls].lock);
+		spansRelease(cls,addr);
+		usemup(&central[cls].lock);
+		return;
 	}
 
-	usemup(&heapSem);
+	vassert(s->state == SPAN_LARGE || s->state == SPAN_HUGE,"Duplicate free of %p?",addr);
+	freeLarge(s);
+}
+
+/**
+ * Tries to grow the large allocation <s> in place to <size> bytes
+ */
+static bool growLarge(sSpan *s,size_t size) {
+	size_t pages = ROUND_UP(size,PAGE_SIZE) / PAGE_SIZE;
+	bool res = false;
+	usemdown(&pageSem);
+	sSpan *next = pmGet(pageOf(spanEnd(s)));
+	if(next && next->state == SPAN_FREE && next->start == spanEnd(s) &&
+			s->pages + next->pages >= pages) {
+		size_t extra = pages - s->pages;
+		runRemove(next);
+		if(next->pages > extra) {
+			next->start += extra * PAGE_SIZE;
+			next->pages -= extra;
+			runInsert(next);
+		}
+		else
+			freeSpan(next);
+		s->pages = pages;
+		pmSetBounds(s);
+		res = true;
+	}
+	usemup(&pageSem);
+	return res;
 }
 
 void *realloc(void *addr,size_t size) {
-	ulong *begin;
-	sMemArea *area,*a,*prev;
 	if(addr == NULL)
 		return malloc(size);
 
-	begin = (ulong*)addr - 3;
-	area = (sMemArea*)begin[0];
-	/* check guards */
-	vassert(begin[0] != FREE_MAGIC,"Duplicate free?");
-	assert(begin[2] == GUARD_MAGIC);
-	assert(begin[begin[1] / sizeof(ulong) + 3] == GUARD_MAGIC);
-
-	usemdown(&heapSem);
-
-	/* align and we need 3 ulongs for the guards */
-	size = ROUND_UP(size,sizeof(ulong)) + sizeof(ulong) * 4;
+	sSpan *s = pmGet(pageOf((uintptr_t)addr));
+	vassert(s != NULL && (s->state == SPAN_SMALL || s->start == (uintptr_t)addr) &&
+		s->state != SPAN_FREE,"Invalid realloc of %p",addr);
 
 	/* ignore shrinks */
-	if(size < area->size) {
-		usemup(&heapSem);
+	size_t avail = s->state == SPAN_SMALL ? classSize[s->cls] : s->pages * PAGE_SIZE;
+	if(size <= avail)
 		return addr;
-	}
 
-	a = usableList;
-	prev = NULL;
-	while(a != NULL) {
-		/* found the area behind? */
-		if((uintptr_t)a->address == (uintptr_t)area->address + area->size) {
-			/* if the size of both is big enough we can use them */
-			if(area->size + a->size >= size) {
-				/* space left? */
-				if(size < area->size + a->size) {
-					/* so move the area forward */
-					a->address = (void*)((uintptr_t)area->address + size);
-					a->size = (area->size + a->size) - size;
-				}
-				/* otherwise we don't need a anymore */
-				else {
-					/* remove a from usable-list */
-					if(prev == NULL)
-						usableList = a->next;
-					else
-						prev->next = a->next;
-					/* free a */
-					a->next = freeList;
-					freeList = a;
-				}
-
-				area->size = size;
-				/* reset guards */
-				begin[0] = (ulong)area;
-				begin[1] = size - sizeof(ulong) * 4;
-				begin[2] = GUARD_MAGIC;
-				begin[size / sizeof(ulong) - 1] = GUARD_MAGIC;
-				usemup(&heapSem);
-				return begin + 3;
-			}
-
-			/* makes no sense to continue since we've found the area behind */
-			break;
-		}
-		prev = a;
-		a = a->next;
-	}
-
-	usemup(&heapSem);
+	/* try to extend large allocations in place */
+	if(s->state == SPAN_LARGE && size < HUGE_MIN && growLarge(s,size))
+		return addr;
 
-	/* the areas are not big enough, so allocate a new one */
-	a = malloc(size);
+	void *a = malloc(size);
 	if(a == NULL)
 		return NULL;
 
 	/* copy the old data and free it */
-	memcpy(a,addr,area->size - sizeof(ulong) * 4);
+	memcpy(a,addr,avail);
 	free(addr);
 	return a;
 }
 
-void *memalign(A_UNUSED size_t align,A_UNUSED size_t size) {
-	// TODO unsupported
-	return NULL;
-}
-
-static bool loadNewSpace(size_t size) {
-	size_t orgsize = size;
-	size = MAX(nextSize,size);
-	if(nextSize < MAX_MMAP_SIZE)
-		nextSize *= 2;
-
-	size = ROUND_UP(size,PAGE_SIZE);
-	/* if we need new areas, allocate a page more */
-	if(freeList == NULL)
-		size += nextAreaSize;
+/**
+ * Allocates <size> bytes with an alignment of <align>, which is larger than a page
+ */
+static void *allocAlignedRun(size_t align,size_t size) {
+	size_t pages = ROUND_UP(size,PAGE_SIZE) / PAGE_SIZE;
+	size_t total = pages + align / PAGE_SIZE - 1;
 	/* check for overflow */
-	if(size < orgsize)
-		return false;
-
-	/* allocate the required pages */
-	void *res = mmap(NULL,size,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
-	if(res == NULL)
-		return false;
-
-	pageCount += size / PAGE_SIZE;
-
-	if(freeList == NULL) {
-		initAreas(res,nextAreaSize);
-
-		res = (void*)((char*)res + nextAreaSize);
-		size -= nextAreaSize;
+	if(pages * PAGE_SIZE < size || total < pages || total > ((size_t)-1 >> PAGE_BITS))
+		return NULL;
 
-		if(nextAreaSize < MAX_AREA_SIZE)
-			nextAreaSize *= 2;
+	usemdown(&pageSem);
+	sSpan *head = allocSpan();
+	sSpan *tail = allocSpan();
+	sSpan *s = head && tail ? allocRun(total) : NULL;
+	if(s == NULL) {
+		if(head)
+			freeSpan(head);
+		if(tail)
+			freeSpan(tail);
+		usemup(&pageSem);
+		return NULL;
 	}
 
-	/* take one area from the freelist and put the memory in it */
-	sMemArea *area = freeList;
-	freeList = freeList->next;
-	area->address = res;
-	area->size = size;
-	/* put area in the usable-list */
-	area->next = usableList;
-	usableList = area;
-	return true;
+	/* cut off the pages in front of and behind the aligned part */
+	uintptr_t start = ROUND_UP(s->start,align);
+	head->start = s->start;
+	head->pages = (start - s->start) / PAGE_SIZE;
+	tail->start = start + pages * PAGE_SIZE;
+	tail->pages = s->pages - head->pages - pages;
+	s->start = start;
+	s->pages = pages;
+	pmSetBounds(s);
+	if(head->pages)
+		runFree(head);
+	else
+		freeSpan(head);
+	if(tail->pages)
+		runFree(tail);
+	else
+		freeSpan(tail);
+	usemup(&pageSem);
+	return (void*)start;
 }
 
-static void initAreas(void *addr,size_t size) {
-	sMemArea *area = (sMemArea*)addr;
-	sMemArea *end = area + (size / sizeof(sMemArea));
+void *memalign(size_t align,size_t size) {
+	/* the alignment has to be a power of two */
+	if(align == 0 || (align & (align - 1)) != 0)
+		return NULL;
+	if(align <= ALIGN || size == 0)
+		return malloc(size);
 
-	/* put all areas in the freelist */
-	freeList = area;
-	area->next = NULL;
-	area++;
-	while(area < end) {
-		area->next = freeList;
-		freeList = area;
-		area++;
+	if(align <= PAGE_SIZE) {
+		/* all objects in a span are aligned to the object size, because spans are page aligned */
+		if(size <= SMALL_MAX) {
+			for(uint cls = sizeClasses[(size + ALIGN - 1) / ALIGN]; cls < CLASS_COUNT; ++cls) {
+				if((classSize[cls] & (align - 1)) == 0)
+					return allocSmall(cls);
+			}
+		}
+		/* large and huge allocations are page aligned anyway */
+		return allocLarge(MAX(size,SMALL_MAX + 1));
 	}
+	return allocAlignedRun(align,size);
 }
 
-static bool loadNewAreas(void) {
-	size_t size = MAX(nextAreaSize,PAGE_SIZE);
-	if(nextAreaSize < MAX_AREA_SIZE)
-		nextAreaSize *= 2;
-
-	/* allocate one page for area-structs */
-	void *res = mmap(NULL,size,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
-	if(res == NULL)
-		return false;
-
-	pageCount += size / PAGE_SIZE;
+int posix_memalign(void **memptr,size_t align,size_t size) {
+	if(align == 0 || align % sizeof(void*) != 0 || (align & (align - 1)) != 0)
+		return EINVAL;
+	if(size == 0) {
+		*memptr = NULL;
+		return 0;
+	}
 
-	initAreas(res,size);
-	return true;
+	*memptr = memalign(align,size);
+	return *memptr ? 0 : ENOMEM;
 }
 
 size_t heapspace(void) {
-	sMemArea *area;
 	size_t c = 0;
-	area = usableList;
-	while(area != NULL) {
-		c += area->size;
-		area = area->next;
-	}
+	usemdown(&pageSem);
+	c += freePages * PAGE_SIZE;
+	for(sThreadCache *tc = caches; tc != NULL; tc = tc->next)
+		c += tc->size;
+	usemup(&pageSem);
+	for(uint cls = 1; cls < CLASS_COUNT; ++cls)
+		c += central[cls].freeBytes;
 	return c;
 }
 
@@ -474,22 +988,25 @@ size_t heapspace(void) {
 #if DEBUGGING
 
 void printheap(void) {
-	sMemArea *area;
-
-	printf("PageCount=%d\n",pageCount);
-	printf("UsableList:\n");
-	area = usableList;
-	while(area != NULL) {
-		printf("\t%p: addr=%p, size=0x%x, next=%p\n",area,area->address,area->size,area->next);
-		area = area->next;
+	size_t cacheCount = 0;
+	for(sThreadCache *tc = caches; tc != NULL; tc = tc->next)
+		cacheCount++;
+
+	printf("PageCount=%zu, FreePages=%zu, ThreadCaches=%zu\n",pageCount,freePages,cacheCount);
+	printf("Classes:\n");
+	for(uint cls = 1; cls < CLASS_COUNT; ++cls) {
+		sCentral *c = central + cls;
+		size_t spans = 0;
+		for(sSpan *s = c->partial; s != NULL; s = s->next)
+			spans++;
+		printf("\t%2u: size=%5zu, pages=%2zu, batch=%2zu, partial=%zu, batches=%zu, free=%zu\n",
+			cls,classSize[cls],classPages[cls],classBatch[cls],spans,c->batches,c->freeBytes);
+	}
+	printf("Free runs:\n");
+	for(size_t i = 0; i < BIN_COUNT; ++i) {
+		for(sSpan *s = freeRuns[i]; s != NULL; s = s->next)
+			printf("\t%p: pages=%zu\n",(void*)s->start,s->pages);
 	}
-
-	/*printf("FreeList:\n");
-	area = freeList;
-	while(area != NULL) {
-		printf("\t0x%x: addr=0x%x, size=0x%x, next=0x%x\n",area,area->address,area->size,area->next);
-		area = area->next;
-	}*/
 }
 
 #endif
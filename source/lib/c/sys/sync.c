@@ -17,10 +17,17 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <sys/atomic.h>
 #include <sys/common.h>
 #include <sys/sync.h>
+#include <sys/thread.h>
 #include <assert.h>
 
+#if defined(__eco32__)
+
+/* eco32 has no atomic instructions; thus, we protect the state by a user-semaphore, which is a
+ * kernel-semaphore on eco32, and block on a kernel-semaphore as well */
+
 int rwcrt(tRWLock *l) {
 	int res = usemcrt(&l->mutex,1);
 	if(res < 0)
@@ -70,6 +77,24 @@ void rwreq(tRWLock *l,int op) {
 	usemup(&l->mutex);
 }
 
+bool rwtryreq(tRWLock *l,int op) {
+	bool res = false;
+	assert(op == RW_READ || op == RW_WRITE);
+	usemdown(&l->mutex);
+	if(op == RW_READ) {
+		if(l->count >= 0 && l->waits == 0) {
+			l->count++;
+			res = true;
+		}
+	}
+	else if(l->count == 0) {
+		l->count = -1;
+		res = true;
+	}
+	usemup(&l->mutex);
+	return res;
+}
+
 void rwrel(tRWLock *l,int op) {
 	assert(op == RW_READ || op == RW_WRITE);
 	usemdown(&l->mutex);
@@ -93,3 +118,91 @@ void rwdestr(tRWLock *l) {
 	semdestr(l->sem);
 	usemdestr(&l->mutex);
 }
+
+#else
+
+int rwcrt(tRWLock *l) {
+	l->count = 0;
+	l->writers = 0;
+	l->waits = 0;
+	return 0;
+}
+
+static void rwwait(tRWLock *l,long count) {
+	// store that we're waiting, so that we know that we should wake him up in rwrel(). the kernel
+	// checks again whether count has changed in the meantime.
+	atomic_add(&l->waits,+1);
+	futexwait(&l->count,count);
+	atomic_add(&l->waits,-1);
+}
+
+static void rwwake(tRWLock *l) {
+	// wake up all, because there might be readers and writers among them
+	if(l->waits)
+		futexwake(&l->count,true);
+}
+
+void rwreq(tRWLock *l,int op) {
+	assert(op == RW_READ || op == RW_WRITE);
+	if(op == RW_READ) {
+		while(1) {
+			long count = l->count;
+			// for fairness: if there is a writer waiting, always wait
+			if(count >= 0 && l->writers == 0) {
+				// add us to the readers
+				if(atomic_cmpnswap(&l->count,count,count + 1))
+					break;
+			}
+			// a writer is about to take the lock. we can't wait for count to change, because it
+			// might already be zero again when we're waiting
+			else if(count == 0)
+				yield();
+			else
+				rwwait(l,count);
+		}
+	}
+	else {
+		// announce us to prevent that new readers take the lock
+		atomic_add(&l->writers,+1);
+		// wait until there is no reader and writer anymore and set it to writing-state
+		while(!atomic_cmpnswap(&l->count,0,-1)) {
+			long count = l->count;
+			if(count != 0)
+				rwwait(l,count);
+		}
+		atomic_add(&l->writers,-1);
+	}
+}
+
+bool rwtryreq(tRWLock *l,int op) {
+	assert(op == RW_READ || op == RW_WRITE);
+	if(op == RW_READ) {
+		long count;
+		while((count = l->count) >= 0 && l->writers == 0) {
+			if(atomic_cmpnswap(&l->count,count,count + 1))
+				return true;
+		}
+		return false;
+	}
+	return atomic_cmpnswap(&l->count,0,-1);
+}
+
+void rwrel(tRWLock *l,int op) {
+	assert(op == RW_READ || op == RW_WRITE);
+	if(op == RW_READ) {
+		assert(l->count > 0);
+		// if we're the last reader, the waiting writers can go on
+		if(atomic_add(&l->count,-1) == 1)
+			rwwake(l);
+	}
+	else {
+		assert(l->count == -1);
+		atomic_cmpnswap(&l->count,-1,0);
+		rwwake(l);
+	}
+}
+
+void rwdestr(A_UNUSED tRWLock *l) {
+}
+
+#endif
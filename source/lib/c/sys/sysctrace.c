@@ -128,6 +128,9 @@ const struct Syscall syscalls[] = {
 	{"utime",			"%d,%p"						},
 	{"truncate",		"%d,%u"						},
 	{"symlink",			"%s,%d,%s"					},
+	{"virt2phys",		"%p,%p,%x"					},
+	{"futexwait",		"%p,%d"						},
+	{"futexwake",		"%p,%d"						},
 #if defined(__x86__)
 	{"reqports",   		"%d,%d"						},
 	{"relports",    	"%d,%d"						},
@@ -256,6 +259,7 @@ static const char *netMsgs[] = {
 	"NET_ROUTE_GET",
 	"NET_ARP_ADD",
 	"NET_ARP_REM",
+	"NET_LINK_LOSS",
 };
 
 static const char *sockMsgs[] = {
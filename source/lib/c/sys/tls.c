@@ -31,11 +31,14 @@ long __tls_num = 0;
 void initTLS(void);
 
 void initTLS(void) {
+	/* the heap uses the TLS for the thread cache, if present. so, we have to make sure that it
+	 * doesn't see garbage from a previous thread with the same stack */
+	ulong **ptr = (ulong**)stack_top(STACK_TOP_TLS);
+	*ptr = NULL;
+
 	ulong *tls = calloc(MAX_TLS_ENTRIES,sizeof(ulong));
 	if(!tls)
 		error("Not enough memory for TLS struct");
-
-	ulong **ptr = (ulong**)stack_top(2);
 	*ptr = tls;
 }
 
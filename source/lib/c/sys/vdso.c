@@ -0,0 +1,86 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <sys/tls.h>
+#include <sys/vdso.h>
+#include <time.h>
+
+/* prevents that the compiler moves memory accesses across it. that's enough for the TSC-based
+ * clock, since only x86 publishes it and x86 doesn't reorder loads with other loads. */
+#define compiler_barrier()	__asm__ volatile ("" : : : "memory")
+
+/**
+ * Reads a consistent snapshot of the clock-fields from the vDSO.
+ *
+ * @param data the destination
+ * @return true if the vDSO is available and publishes the clock
+ */
+static bool vdso_readclock(sVDSOData *data) {
+	const sVDSOData *vdso = (const sVDSOData*)*stack_top(STACK_TOP_VDSO);
+	if(EXPECT_FALSE(vdso == NULL))
+		return false;
+
+	uint32_t seq;
+	do {
+		/* an odd sequence number means that the kernel is updating it right now */
+		while((seq = vdso->seq) & 1)
+			;
+		compiler_barrier();
+		data->flags = vdso->flags;
+		data->bootTSC = vdso->bootTSC;
+		data->bootTime = vdso->bootTime;
+		data->tscPerUs = vdso->tscPerUs;
+		compiler_barrier();
+	}
+	while(EXPECT_FALSE(vdso->seq != seq));
+	return data->flags & VDSO_CLOCK;
+}
+
+tid_t gettid(void) {
+	return (tid_t)(ulong)*stack_top(STACK_TOP_TID);
+}
+
+pid_t getpid(void) {
+	return (pid_t)(ulong)*stack_top(STACK_TOP_PID);
+}
+
+int gettimeofday(struct timeval *tv) {
+	sVDSOData data;
+	if(EXPECT_FALSE(!vdso_readclock(&data)))
+		return syscall1(SYSCALL_GETTOD,(ulong)tv);
+
+	uint64_t usecs = (rdtsc() - data.bootTSC) / data.tscPerUs;
+	tv->tv_sec = data.bootTime + usecs / 1000000;
+	tv->tv_usec = usecs % 1000000;
+	return 0;
+}
+
+uint64_t tsctotime(uint64_t tsc) {
+	sVDSOData data;
+	if(EXPECT_FALSE(!vdso_readclock(&data))) {
+		uint64_t tmp = tsc;
+		syscall1(SYSCALL_TSCTOTIME,(ulong)&tmp);
+		return tmp;
+	}
+	return tsc / data.tscPerUs;
+}
@@ -21,11 +21,14 @@
 #include <esc/vthrow.h>
 #include <sys/common.h>
 #include <sys/messages.h>
+#include <sys/thread.h>
+#include <stdio.h>
 
 namespace esc {
 
-Device::Device(const char *path,mode_t mode,uint type,uint ops)
-	: _ops(), _id(createdev(path,mode,type,ops | DEV_CLOSE)), _run(true) {
+Device::Device(const char *path,mode_t mode,uint type,uint ops,size_t threads)
+	: _ops(), _opsMutex(), _id(createdev(path,mode,type,ops | DEV_CLOSE)), _run(true),
+	  _threads(threads > 0 ? threads : 1), _next(0), _tids() {
 	if(_id < 0)
 		VTHROWE("createdev(" << path << ")",_id);
 	set(MSG_FILE_CLOSE,std::make_memfun(this,&Device::close),false);
@@ -42,10 +45,12 @@ Device::~Device() {
 void Device::set(msgid_t op,handler_type *handler,bool rep) {
 	assert(handler != NULL);
 	unset(op);
+	std::lock_guard<std::mutex> guard(_opsMutex);
 	_ops[op] = Handler(handler,rep);
 }
 
 void Device::unset(msgid_t op) {
+	std::lock_guard<std::mutex> guard(_opsMutex);
 	oplist_type::iterator it = _ops.find(op);
 	if(it != _ops.end()) {
 		delete it->second.func;
@@ -54,22 +59,59 @@ void Device::unset(msgid_t op) {
 }
 
 void Device::loop() {
+	/* the calling thread is the first one; it receives the messages for all new channels */
+	_tids.clear();
+	_tids.push_back(gettid());
+	for(size_t i = 1; i < _threads; ++i) {
+		int tid = startthread(serveThread,this);
+		if(tid < 0) {
+			printe("Unable to start device thread");
+			break;
+		}
+		_tids.push_back(tid);
+	}
+
+	serve();
+
+	for(size_t i = 1; i < _tids.size(); ++i)
+		join(_tids[i]);
+}
+
+int Device::serveThread(void *arg) {
+	static_cast<Device*>(arg)->serve();
+	return 0;
+}
+
+void Device::serve() {
 	ulong buf[IPC_DEF_SIZE / sizeof(ulong)];
 	while(_run) {
 		msgid_t mid;
 		int fd = getwork(_id,&mid,buf,sizeof(buf),0);
 		if(EXPECT_FALSE(fd < 0)) {
 			/* just log that it failed. maybe a client has sent a message that was too big */
-			if(fd != -EINTR)
+			if(fd != -EINTR && _run)
 				printe("getwork failed");
 			continue;
 		}
 
 		IPCStream is(fd,buf,sizeof(buf),mid);
 		handleMsg(mid,is);
+		if(EXPECT_FALSE((mid & 0xFFFF) == MSG_FILE_OPEN))
+			assign(fd);
 	}
 }
 
+void Device::assign(int fd) {
+	if(_tids.size() <= 1)
+		return;
+
+	/* only the thread that receives the open-messages distributes the channels */
+	tid_t tid = _tids[_next];
+	_next = (_next + 1) % _tids.size();
+	if(tid != gettid() && ::bindto(fd,tid) < 0)
+		printe("Unable to bind channel %d to thread %d",fd,tid);
+}
+
 void Device::reply(IPCStream &is,errcode_t errcode) {
 	try {
 		is << errcode << Reply();
@@ -80,10 +122,16 @@ void Device::reply(IPCStream &is,errcode_t errcode) {
 }
 
 void Device::handleMsg(msgid_t mid,IPCStream &is) {
-	oplist_type::iterator it = _ops.find(mid & 0xFFFF);
-	Handler &h = (*it).second;
+	Handler h;
+	{
+		std::lock_guard<std::mutex> guard(_opsMutex);
+		oplist_type::iterator it = _ops.find(mid & 0xFFFF);
+		if(EXPECT_TRUE(it != _ops.end()))
+			h = it->second;
+	}
+
 	try {
-		if(EXPECT_FALSE(it == _ops.end()))
+		if(EXPECT_FALSE(h.func == NULL))
 			reply(is,-ENOTSUP);
 		else
 			(*h.func)(is);
@@ -22,216 +22,454 @@
 #include <sys/common.h>
 #include <sys/debug.h>
 #include <sys/thread.h>
+#include <algorithm>
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-#define ALLOC_LOCK	0xF7180000
+#include <string.h>
+#include <vector>
 
 namespace fs {
 
 BlockCache::BlockCache(int fd,size_t blocks,size_t bsize)
-		: _blockCacheSize(blocks), _blockSize(bsize), _hashmap(new CBlock*[HASH_SIZE]()),
-		  _oldestBlock(NULL), _newestBlock(NULL), _freeBlocks(NULL),
-		  _blockCache(new CBlock[blocks]), _blockmem(), _hits(), _misses() {
-	size_t i;
-	CBlock *bentry;
-	if(sharebuf(fd,_blockCacheSize * _blockSize,&_blockmem,0) < 0) {
+		: _blockCacheSize(blocks), _blockSize(bsize), _shardCount(1), _shards(),
+		  _blockCache(new CBlock[blocks]), _blockmem(), _fillmem(), _fillLock(), _fills(), _filled(),
+		  _flushes(), _flushed() {
+	/* we can only share one buffer with the disk driver. thus, put the fill area behind the blocks */
+	if(sharebuf(fd,(_blockCacheSize + MAX_FILL) * _blockSize,&_blockmem,0) < 0) {
 		if(_blockmem == NULL)
 			VTHROW("Unable to create block cache");
 		printe("Unable to share buffer with disk driver");
 	}
-	bentry = _blockCache;
-	for(i = 0; i < _blockCacheSize; i++) {
-		bentry->blockNo = 0;
-		bentry->buffer = (char*)_blockmem + i * _blockSize;
-		bentry->dirty = false;
-		bentry->refs = 0;
-		bentry->prev = (i < _blockCacheSize - 1) ? bentry + 1 : NULL;
-		bentry->next = _freeBlocks;
-		bentry->hnext = NULL;
-		_freeBlocks = bentry;
-		bentry++;
+	_fillmem = (char*)_blockmem + _blockCacheSize * _blockSize;
+
+	/* use a power of 2 as the number of shards, but keep them reasonably large */
+	while(_shardCount < MAX_SHARDS && _blockCacheSize / (_shardCount * 2) >= MIN_SHARD)
+		_shardCount *= 2;
+	_shards = new Shard[_shardCount];
+
+	size_t perShard = _blockCacheSize / _shardCount;
+	for(size_t s = 0; s < _shardCount; ++s) {
+		Shard &sh = _shards[s];
+		/* the last one gets the remaining blocks */
+		size_t first = s * perShard;
+		size_t count = s == _shardCount - 1 ? _blockCacheSize - first : perShard;
+
+		/* about 2 blocks per bucket */
+		sh.hashSize = 1;
+		while(sh.hashSize * 2 < count)
+			sh.hashSize *= 2;
+		sh.hashmap = new CBlock*[sh.hashSize]();
+
+		CBlock *bentry = _blockCache + first;
+		for(size_t i = 0; i < count; i++) {
+			bentry->blockNo = 0;
+			bentry->buffer = (char*)_blockmem + (first + i) * _blockSize;
+			bentry->dirty = false;
+			bentry->refs = 0;
+			bentry->loading = false;
+			bentry->prev = NULL;
+			bentry->next = sh.free;
+			bentry->hnext = NULL;
+			bentry->dprev = bentry->dnext = NULL;
+			sh.free = bentry;
+			bentry++;
+		}
 	}
 }
 
 BlockCache::~BlockCache() {
 	destroybuf(_blockmem);
-	delete[] _hashmap;
+	for(size_t s = 0; s < _shardCount; ++s)
+		delete[] _shards[s].hashmap;
+	delete[] _shards;
 	delete[] _blockCache;
 }
 
+static bool cmpBlocks(const CBlock *a,const CBlock *b) {
+	return a->blockNo < b->blockNo;
+}
+
 void BlockCache::flush() {
-	CBlock *bentry = _newestBlock;
-	while(bentry != NULL) {
-		sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
-		if(bentry->dirty) {
-			acquire(bentry,READ);
-			writeBlocks(bentry->buffer,bentry->blockNo,1);
-			bentry->dirty = false;
-			doRelease(bentry,false);
+	std::vector<CBlock*> dirty;
+
+	/* collect the dirty blocks and keep them referenced, so that they are not reused meanwhile */
+	for(size_t s = 0; s < _shardCount; ++s) {
+		Shard &sh = _shards[s];
+		std::lock_guard<std::mutex> guard(sh.lock);
+		for(CBlock *b = sh.dirty; b != NULL; b = b->dnext) {
+			b->refs++;
+			dirty.push_back(b);
 		}
-		sassert(tpool_unlock(ALLOC_LOCK) == 0);
-		bentry = bentry->next;
+	}
+	if(dirty.empty())
+		return;
+
+	std::sort(dirty.begin(),dirty.end(),cmpBlocks);
+	writeSorted(&dirty[0],dirty.size());
+
+	for(auto it = dirty.begin(); it != dirty.end(); ++it) {
+		Shard &sh = getShard((*it)->blockNo);
+		std::lock_guard<std::mutex> guard(sh.lock);
+		(*it)->refs--;
 	}
 }
 
-void BlockCache::acquire(CBlock *b,A_UNUSED uint mode) {
-	assert(!(mode & WRITE) || b->refs == 0);
-	b->refs++;
-	sassert(tpool_unlock(ALLOC_LOCK) == 0);
+void BlockCache::writeSorted(CBlock **blocks,size_t count) {
+	for(size_t i = 0; i < count; ) {
+		/* determine the run of adjacent blocks */
+		size_t n = 1;
+		while(i + n < count && n < MAX_FILL && blocks[i + n]->blockNo == blocks[i]->blockNo + n)
+			n++;
+
+		/* clean them before the write, so that changes during the write make them dirty again */
+		for(size_t j = 0; j < n; ++j) {
+			Shard &sh = getShard(blocks[i + j]->blockNo);
+			std::lock_guard<std::mutex> guard(sh.lock);
+			removeDirty(sh,blocks[i + j]);
+		}
+
+		bool failed;
+		if(n == 1)
+			failed = writeBlocks(blocks[i]->buffer,blocks[i]->blockNo,1) != 0;
+		else {
+			std::lock_guard<std::mutex> guard(_fillLock);
+			for(size_t j = 0; j < n; ++j)
+				memcpy((char*)_fillmem + j * _blockSize,blocks[i + j]->buffer,_blockSize);
+			failed = writeBlocks(_fillmem,blocks[i]->blockNo,n) != 0;
+		}
+
+		/* keep them dirty to try it again later */
+		if(failed) {
+			for(size_t j = 0; j < n; ++j) {
+				Shard &sh = getShard(blocks[i + j]->blockNo);
+				std::lock_guard<std::mutex> guard(sh.lock);
+				addDirty(sh,blocks[i + j]);
+			}
+		}
+
+		__sync_fetch_and_add(&_flushes,1);
+		__sync_fetch_and_add(&_flushed,n);
+		i += n;
+	}
+}
+
+void BlockCache::markDirty(CBlock *b) {
+	Shard &sh = getShard(b->blockNo);
+	std::lock_guard<std::mutex> guard(sh.lock);
+	addDirty(sh,b);
+}
+
+void BlockCache::addDirty(Shard &sh,CBlock *b) {
+	if(!b->dirty) {
+		b->dirty = true;
+		b->dprev = NULL;
+		b->dnext = sh.dirty;
+		if(sh.dirty)
+			sh.dirty->dprev = b;
+		sh.dirty = b;
+		sh.dirtyCount++;
+	}
+}
+
+void BlockCache::removeDirty(Shard &sh,CBlock *b) {
+	if(!b->dirty)
+		return;
+
+	if(b->dprev)
+		b->dprev->dnext = b->dnext;
+	else
+		sh.dirty = b->dnext;
+	if(b->dnext)
+		b->dnext->dprev = b->dprev;
+	b->dprev = b->dnext = NULL;
+	b->dirty = false;
+	sh.dirtyCount--;
+}
+
+void BlockCache::acquire(A_UNUSED CBlock *b,A_UNUSED uint mode) {
 	sassert(tpool_lock((uint)b,(mode & WRITE) ? LOCK_EXCLUSIVE : 0) == 0);
 }
 
-void BlockCache::doRelease(CBlock *b,bool unlockAlloc) {
-	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
-	assert(b->refs > 0);
-	b->refs--;
-	if(unlockAlloc)
-		sassert(tpool_unlock(ALLOC_LOCK) == 0);
+void BlockCache::doRelease(CBlock *b) {
+	{
+		Shard &sh = getShard(b->blockNo);
+		std::lock_guard<std::mutex> guard(sh.lock);
+		assert(b->refs > 0);
+		b->refs--;
+	}
 	sassert(tpool_unlock((uint)b) == 0);
 }
 
 CBlock *BlockCache::doRequest(block_t blockNo,bool doRead,uint mode) {
-	CBlock *block,*bentry;
+	Shard &sh = getShard(blockNo);
+	CBlock *block;
+	{
+		std::lock_guard<std::mutex> guard(sh.lock);
 
-	/* acquire tpool_lock for getting a block */
-	sassert(tpool_lock(ALLOC_LOCK,LOCK_EXCLUSIVE | LOCK_KEEP) == 0);
+		while(true) {
+			/* search for the block. perhaps it's already in cache */
+			block = find(sh,blockNo);
+			if(block != NULL) {
+				/* somebody else is reading it from disk; wait until that is done and look again */
+				if(block->loading) {
+					waitLoaded(sh);
+					continue;
+				}
 
-	/* search for the block. perhaps it's already in cache */
-	bentry = _hashmap[blockNo % HASH_SIZE];
-	while(bentry != NULL) {
-		if(bentry->blockNo == blockNo) {
-			/* remove from list and put at the beginning of the usedlist because it was
-			 * used most recently */
-			if(bentry->prev != NULL) {
-				/* update oldest */
-				if(_oldestBlock == bentry)
-					_oldestBlock = bentry->prev;
-				/* remove */
-				bentry->prev->next = bentry->next;
-				if(bentry->next)
-					bentry->next->prev = bentry->prev;
-				/* put at the beginning */
-				bentry->prev = NULL;
-				bentry->next = _newestBlock;
-				bentry->next->prev = bentry;
-				_newestBlock = bentry;
+				/* remove from list and put at the beginning of the usedlist because it was
+				 * used most recently */
+				if(block->prev != NULL) {
+					/* update oldest */
+					if(sh.oldest == block)
+						sh.oldest = block->prev;
+					/* remove */
+					block->prev->next = block->next;
+					if(block->next)
+						block->next->prev = block->prev;
+					/* put at the beginning */
+					block->prev = NULL;
+					block->next = sh.newest;
+					block->next->prev = block;
+					sh.newest = block;
+				}
+				/* others might still reference the block (e.g., flush() while writing it to
+				 * disk). we don't wait for them (see the class comment) */
+				block->refs++;
+				sh.hits++;
+				break;
 			}
-			acquire(bentry,mode);
-			_hits++;
-			return bentry;
-		}
-		bentry = bentry->hnext;
-	}
 
-	/* init cached block */
-	block = getBlock(blockNo);
-	block->blockNo = blockNo;
-	block->dirty = false;
-	block->refs = 0;
-
-	/* now read from disk */
-	if(doRead) {
-		/* we need always a write-tpool_lock because we have to read the content into it */
-		acquire(block,WRITE);
-		if(readBlocks(block->buffer,blockNo,1) != 0) {
-			block->blockNo = 0;
-			doRelease(block,true);
-			return NULL;
+			/* get a free cache entry. this might release the lock to write back a dirty block,
+			 * so that somebody else might have fetched the block in the meantime */
+			block = getBlock(sh);
+			if(block == NULL)
+				return NULL;
+			if(find(sh,blockNo) != NULL) {
+				block->next = sh.free;
+				sh.free = block;
+				continue;
+			}
+
+			insert(sh,block,blockNo);
+			block->refs = 1;
+			sh.misses++;
+			if(!doRead)
+				break;
+
+			/* now read from disk. others that find the block meanwhile wait until we're done */
+			block->loading = true;
+			sh.lock.unlock();
+			bool failed = readBlocks(block->buffer,blockNo,1) != 0;
+			sh.lock.lock();
+			loaded(sh,block);
+			if(failed) {
+				/* the content is invalid, so that nobody may find it */
+				remove(sh,block);
+				block->blockNo = 0;
+				block->refs = 0;
+				block->next = sh.free;
+				sh.free = block;
+				return NULL;
+			}
+			break;
 		}
-		doRelease(block,false);
 	}
 
 	acquire(block,mode);
-	_misses++;
 	return block;
 }
 
-CBlock *BlockCache::getBlock(block_t blockNo) {
-	CBlock *block = _freeBlocks;
-	if(block != NULL) {
-		/* remove from freelist and put in usedlist */
-		_freeBlocks = block->next;
-		if(_freeBlocks)
-			_freeBlocks->prev = NULL;
-		/* block->prev is already NULL */
-		block->next = _newestBlock;
-		if(block->next)
-			block->next->prev = block;
-		_newestBlock = block;
-		/* update oldest */
-		if(_oldestBlock == NULL)
-			_oldestBlock = block;
-		/* insert into hashmap */
-		CBlock **list = &_hashmap[blockNo % HASH_SIZE];
-		block->hnext = *list;
-		*list = block;
-		return block;
-	}
+size_t BlockCache::fill(block_t start,size_t count) {
+	size_t total = 0;
+	if(count > MAX_FILL)
+		count = MAX_FILL;
 
-	/* take the oldest one */
-	block = _oldestBlock;
-	assert(block->refs == 0);
-	_oldestBlock = block->prev;
-	_oldestBlock->next = NULL;
-	/* remove from hashmap */
-	bool diffhash = block->blockNo % HASH_SIZE != blockNo % HASH_SIZE;
-	if(diffhash) {
-		CBlock **list = &_hashmap[block->blockNo % HASH_SIZE];
-		CBlock *b = *list, *p = NULL;
-		while(b != NULL) {
-			if(b == block) {
-				if(p)
-					p->hnext = b->hnext;
-				else
-					*list = b->hnext;
-				break;
+	for(size_t i = 0; i < count; ) {
+		/* skip the blocks that are already in the cache */
+		if(isCached(start + i)) {
+			i++;
+			continue;
+		}
+
+		/* determine the run of blocks that are not in the cache */
+		size_t n = 1;
+		while(i + n < count && !isCached(start + i + n))
+			n++;
+
+		/* read them at once and distribute them to cache entries */
+		std::lock_guard<std::mutex> fillGuard(_fillLock);
+		if(readBlocks(_fillmem,start + i,n) != 0)
+			break;
+		for(size_t j = 0; j < n; ++j) {
+			block_t blockNo = start + i + j;
+			Shard &sh = getShard(blockNo);
+			std::lock_guard<std::mutex> guard(sh.lock);
+			/* somebody else might have requested it in the meantime */
+			if(find(sh,blockNo) != NULL)
+				continue;
+
+			CBlock *block = getBlock(sh);
+			if(block == NULL)
+				continue;
+			/* getBlock() might have released the lock */
+			if(find(sh,blockNo) != NULL) {
+				block->next = sh.free;
+				sh.free = block;
+				continue;
 			}
-			p = b;
-			b = b->hnext;
+
+			insert(sh,block,blockNo);
+			block->refs = 0;
+			memcpy(block->buffer,(char*)_fillmem + j * _blockSize,_blockSize);
 		}
+
+		__sync_fetch_and_add(&_fills,1);
+		total += n;
+		i += n;
 	}
-	/* put at beginning of usedlist */
-	block->prev = NULL;
-	block->next = _newestBlock;
-	if(block->next)
-		block->next->prev = block;
-	_newestBlock = block;
-	/* insert into hashmap */
-	if(diffhash) {
-		CBlock **list = &_hashmap[blockNo % HASH_SIZE];
-		block->hnext = *list;
-		*list = block;
+	__sync_fetch_and_add(&_filled,total);
+	return total;
+}
+
+bool BlockCache::isCached(block_t blockNo) {
+	Shard &sh = getShard(blockNo);
+	std::lock_guard<std::mutex> guard(sh.lock);
+	return find(sh,blockNo) != NULL;
+}
+
+CBlock *BlockCache::find(Shard &sh,block_t blockNo) {
+	CBlock *bentry = *getBucket(sh,blockNo);
+	while(bentry != NULL) {
+		if(bentry->blockNo == blockNo)
+			return bentry;
+		bentry = bentry->hnext;
 	}
-	/* if it is dirty we have to write it first to disk */
-	if(block->dirty) {
-		acquire(block,READ);
-		writeBlocks(block->buffer,block->blockNo,1);
-		doRelease(block,false);
+	return NULL;
+}
+
+CBlock *BlockCache::getBlock(Shard &sh) {
+	while(true) {
+		CBlock *block = sh.free;
+		if(block != NULL) {
+			/* remove from freelist */
+			sh.free = block->next;
+			block->dirty = false;
+			return block;
+		}
+
+		/* take the least recently used one that is not in use */
+		block = sh.oldest;
+		while(block != NULL && block->refs > 0)
+			block = block->prev;
+		if(block == NULL) {
+			printe("All blocks of the block cache are in use");
+			return NULL;
+		}
+
+		if(!block->dirty) {
+			remove(sh,block);
+			return block;
+		}
+
+		/* if it is dirty we have to write it first to disk. keep it referenced meanwhile, so
+		 * that it is not reused. afterwards, look again, because things might have changed */
+		block->refs++;
+		removeDirty(sh,block);
+		sh.lock.unlock();
+		bool failed = writeBlocks(block->buffer,block->blockNo,1) != 0;
+		sh.lock.lock();
+		if(failed)
+			addDirty(sh,block);
+		block->refs--;
+		__sync_fetch_and_add(&_flushes,1);
+		__sync_fetch_and_add(&_flushed,1);
+		/* don't try the same block over and over again */
+		if(failed) {
+			printe("Unable to write back block %zu",block->blockNo);
+			return NULL;
+		}
 	}
-	return block;
+}
+
+void BlockCache::insert(Shard &sh,CBlock *b,block_t blockNo) {
+	b->blockNo = blockNo;
+	b->dirty = false;
+
+	/* put at beginning of usedlist */
+	b->prev = NULL;
+	b->next = sh.newest;
+	if(b->next)
+		b->next->prev = b;
+	sh.newest = b;
+	if(sh.oldest == NULL)
+		sh.oldest = b;
+
+	/* insert into hashmap */
+	CBlock **list = getBucket(sh,blockNo);
+	b->hnext = *list;
+	*list = b;
+}
+
+void BlockCache::remove(Shard &sh,CBlock *b) {
+	/* remove from usedlist */
+	if(b->prev)
+		b->prev->next = b->next;
+	else
+		sh.newest = b->next;
+	if(b->next)
+		b->next->prev = b->prev;
+	else
+		sh.oldest = b->prev;
+	b->prev = b->next = NULL;
+
+	/* remove from hashmap */
+	CBlock **list = getBucket(sh,b->blockNo);
+	while(*list != b)
+		list = &(*list)->hnext;
+	*list = b->hnext;
+	b->hnext = NULL;
+}
+
+void BlockCache::waitLoaded(Shard &sh) {
+	sh.ioWaiters++;
+	sh.lock.unlock();
+	usemdown(&sh.ioDone);
+	sh.lock.lock();
+}
+
+void BlockCache::loaded(Shard &sh,CBlock *b) {
+	b->loading = false;
+	/* wake up all waiters; they check again whether their block is there */
+	for(; sh.ioWaiters > 0; sh.ioWaiters--)
+		usemup(&sh.ioDone);
 }
 
 void BlockCache::printStats(FILE *f) {
 	float hitrate;
 	size_t used = 0,dirty = 0;
-	CBlock *bentry = _newestBlock;
-	while(bentry != NULL) {
-		used++;
-		if(bentry->dirty)
-			dirty++;
-		bentry = bentry->next;
+	ulong hits = 0,misses = 0;
+	for(size_t s = 0; s < _shardCount; ++s) {
+		Shard &sh = _shards[s];
+		std::lock_guard<std::mutex> guard(sh.lock);
+		for(CBlock *bentry = sh.newest; bentry != NULL; bentry = bentry->next)
+			used++;
+		dirty += sh.dirtyCount;
+		hits += sh.hits;
+		misses += sh.misses;
 	}
 	fprintf(f,"\tTotal blocks: %zu\n",_blockCacheSize);
+	fprintf(f,"\tShards: %zu (%zu buckets each)\n",_shardCount,_shards[0].hashSize);
 	fprintf(f,"\tUsed blocks: %zu\n",used);
 	fprintf(f,"\tDirty blocks: %zu\n",dirty);
-	fprintf(f,"\tHits: %lu\n",_hits);
-	fprintf(f,"\tMisses: %lu\n",_misses);
-	if(_hits == 0)
+	fprintf(f,"\tHits: %lu\n",hits);
+	fprintf(f,"\tMisses: %lu\n",misses);
+	fprintf(f,"\tFills: %lu (%lu blocks)\n",_fills,_filled);
+	fprintf(f,"\tFlushes: %lu (%lu blocks)\n",_flushes,_flushed);
+	if(hits == 0)
 		hitrate = 0;
 	else
-		hitrate = 100.0f / ((float)(_misses + _hits) / _hits);
+		hitrate = 100.0f / ((float)(misses + hits) / hits);
 	fprintf(f,"\tHitrate: %.3f%%\n",hitrate);
 }
 
@@ -239,14 +477,13 @@ void BlockCache::printStats(FILE *f) {
 
 void BlockCache::print() {
 	size_t i = 0;
-	CBlock *block;
 	printf("Used blocks:\n\t");
-	block = _newestBlock;
-	while(block != NULL) {
-		if(++i % 8 == 0)
-			printf("\n\t");
-		printf("%zu ",block->blockNo);
-		block = block->next;
+	for(size_t s = 0; s < _shardCount; ++s) {
+		for(CBlock *block = _shards[s].newest; block != NULL; block = block->next) {
+			if(++i % 8 == 0)
+				printf("\n\t");
+			printf("%zu ",block->blockNo);
+		}
 	}
 	printf("\n");
 }
@@ -35,6 +35,7 @@
 static void load_library(sSharedLib *dst);
 static sSharedLib *load_addLib(sSharedLib *lib);
 static uintptr_t load_addSeg(int binFd,sElfPHeader *pheader,size_t loadSegNo,bool isLib);
+static void load_setupGnuHash(sSharedLib *l);
 static void load_read(int binFd,off_t offset,void *buffer,size_t count);
 
 void load_doLoad(int binFd,sSharedLib *dst) {
@@ -173,6 +174,7 @@ uintptr_t load_addSegments(void) {
 			l->dynsyms = (sElfSym*)((uintptr_t)l->dynsyms + l->loadAddr);
 		if(l->jmprel)
 			l->jmprel = (sElfRel*)((uintptr_t)l->jmprel + l->loadAddr);
+		load_setupGnuHash(l);
 	}
 	return entryPoint;
 }
@@ -233,6 +235,27 @@ static uintptr_t load_addSeg(int binFd,sElfPHeader *pheader,size_t loadSegNo,boo
 	return (uintptr_t)addr;
 }
 
+static void load_setupGnuHash(sSharedLib *l) {
+	/* layout: nbuckets, symoffset, bloomsize, bloomshift, bloom[bloomsize], buckets[nbuckets],
+	 * chains[] (indexed by symbol - symoffset) */
+	const ElfWord *tbl = (const ElfWord*)load_getDyn(l->dyn,DT_GNU_HASH);
+	l->gnuBuckets = NULL;
+	if(tbl == NULL)
+		return;
+
+	tbl = (const ElfWord*)((uintptr_t)tbl + l->loadAddr);
+	/* the bloom filter size has to be a power of 2 */
+	if(tbl[0] == 0 || tbl[2] == 0 || (tbl[2] & (tbl[2] - 1)) != 0)
+		return;
+	l->gnuNBuckets = tbl[0];
+	l->gnuSymOffset = tbl[1];
+	l->gnuBloomMask = tbl[2] - 1;
+	l->gnuBloomShift = tbl[3];
+	l->gnuBloom = (const ElfAddr*)(tbl + 4);
+	l->gnuBuckets = (const ElfWord*)(l->gnuBloom + tbl[2]);
+	l->gnuChains = l->gnuBuckets + l->gnuNBuckets - l->gnuSymOffset;
+}
+
 static void load_read(int binFd,off_t offset,void *buffer,size_t count) {
 	if(seek(binFd,offset,SEEK_SET) < 0)
 		load_error("Unable to seek to %x",offset);
@@ -17,6 +17,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <sys/atomic.h>
 #include <sys/common.h>
 #include <sys/debug.h>
 #include <sys/elf.h>
@@ -27,8 +28,34 @@
 #include "loader.h"
 #include "lookup.h"
 
-static sElfSym *lookup_byNameIntern(sSharedLib *lib,const char *name,uint32_t hash);
-static uint32_t lookup_getHash(const uint8_t *name);
+/* the number of entries in the resolved-symbol cache (has to be a power of 2) */
+#define CACHE_SIZE		256
+
+typedef struct {
+	uint32_t sysv;
+	uint32_t gnu;
+} sHashes;
+
+typedef struct {
+	uint32_t hash;
+	const char *name;
+	sSharedLib *lib;
+	sElfSym *sym;
+} sCacheEntry;
+
+static sElfSym *lookup_byNameIntern(sSharedLib *lib,const char *name,const sHashes *hashes);
+static sElfSym *lookup_gnuHash(sSharedLib *lib,const char *name,uint32_t hash);
+static sElfSym *lookup_sysvHash(sSharedLib *lib,const char *name,uint32_t hash);
+static bool lookup_cacheGet(sSharedLib *skip,const char *name,uint32_t hash,sCacheEntry *res);
+static void lookup_cachePut(sSharedLib *lib,sElfSym *sym,uint32_t hash);
+static void lookup_getHashes(const uint8_t *name,sHashes *hashes);
+
+/* remembers the global definition of recently resolved symbols, so that a symbol that is
+ * referenced by multiple objects is searched only once. the lookup is done by the lazy resolver
+ * as well, i.e., potentially by multiple threads at once. thus, the cache is protected by a lock,
+ * but we never wait for it: if it is taken, we simply search without the cache. */
+static sCacheEntry cache[CACHE_SIZE];
+static long cacheLock = 0;
 
 #if defined(CALLTRACE_PID)
 static int pid = -1;
@@ -107,14 +134,27 @@ void lookup_tracePop(void) {
 #endif
 
 sElfSym *lookup_byName(sSharedLib *skip,const char *name,uintptr_t *value) {
-	sElfSym *s;
-	uint32_t hash = lookup_getHash((const uint8_t*)name);
+	sCacheEntry entry;
+	sHashes hashes;
+	bool global = true;
+	lookup_getHashes((const uint8_t*)name,&hashes);
+
+	if(lookup_cacheGet(skip,name,hashes.gnu,&entry)) {
+		*value = entry.sym->st_value + entry.lib->loadAddr;
+		return entry.sym;
+	}
+
 	for(sSharedLib *l = libs; l != NULL; l = l->next) {
-		if(l == skip)
+		if(l == skip) {
+			global = false;
 			continue;
-		s = lookup_byNameIntern(l,name,hash);
+		}
+		sElfSym *s = lookup_byNameIntern(l,name,&hashes);
 		if(s) {
 			*value = s->st_value + l->loadAddr;
+			/* if we haven't skipped a library before, it's the global definition */
+			if(global)
+				lookup_cachePut(l,s,hashes.gnu);
 			return s;
 		}
 	}
@@ -122,14 +162,48 @@ sElfSym *lookup_byName(sSharedLib *skip,const char *name,uintptr_t *value) {
 }
 
 sElfSym *lookup_byNameIn(sSharedLib *lib,const char *name,uintptr_t *value) {
-	uint32_t hash = lookup_getHash((const uint8_t*)name);
-	sElfSym *sym = lookup_byNameIntern(lib,name,hash);
+	sHashes hashes;
+	lookup_getHashes((const uint8_t*)name,&hashes);
+	sElfSym *sym = lookup_byNameIntern(lib,name,&hashes);
 	if(sym)
 		*value = sym->st_value + lib->loadAddr;
 	return sym;
 }
 
-static sElfSym *lookup_byNameIntern(sSharedLib *lib,const char *name,uint32_t hash) {
+static sElfSym *lookup_byNameIntern(sSharedLib *lib,const char *name,const sHashes *hashes) {
+	if(lib->gnuBuckets)
+		return lookup_gnuHash(lib,name,hashes->gnu);
+	return lookup_sysvHash(lib,name,hashes->sysv);
+}
+
+static sElfSym *lookup_gnuHash(sSharedLib *lib,const char *name,uint32_t hash) {
+	const size_t bits = sizeof(ElfAddr) * 8;
+	ElfAddr word = lib->gnuBloom[(hash / bits) & lib->gnuBloomMask];
+	ElfAddr mask = ((ElfAddr)1 << (hash % bits)) |
+		((ElfAddr)1 << ((hash >> lib->gnuBloomShift) % bits));
+	/* if not both bits are set, the library definitely doesn't define the symbol */
+	if((word & mask) != mask)
+		return NULL;
+
+	ElfWord symindex = lib->gnuBuckets[hash % lib->gnuNBuckets];
+	if(symindex < lib->gnuSymOffset)
+		return NULL;
+	while(1) {
+		/* the chain contains the hashes with the lowest bit indicating the end of the chain */
+		ElfWord chash = lib->gnuChains[symindex];
+		if(((chash ^ hash) >> 1) == 0) {
+			sElfSym *sym = lib->dynsyms + symindex;
+			if(sym->st_shndx != STN_UNDEF && strcmp(name,lib->dynstrtbl + sym->st_name) == 0)
+				return sym;
+		}
+		if(chash & 1)
+			break;
+		symindex++;
+	}
+	return NULL;
+}
+
+static sElfSym *lookup_sysvHash(sSharedLib *lib,const char *name,uint32_t hash) {
 	ElfWord nhash;
 	ElfWord symindex;
 	sElfSym *sym;
@@ -145,13 +219,38 @@ static sElfSym *lookup_byNameIntern(sSharedLib *lib,const char *name,uint32_t ha
 	return NULL;
 }
 
-static uint32_t lookup_getHash(const uint8_t *name) {
-	uint32_t h = 0,g;
+static bool lookup_cacheGet(sSharedLib *skip,const char *name,uint32_t hash,sCacheEntry *res) {
+	if(!atomic_cmpnswap(&cacheLock,0,1))
+		return false;
+	*res = cache[hash & (CACHE_SIZE - 1)];
+	atomic_cmpnswap(&cacheLock,1,0);
+
+	/* if the global definition is in <skip>, we have to search for the next one */
+	return res->name && res->hash == hash && res->lib != skip && strcmp(res->name,name) == 0;
+}
+
+static void lookup_cachePut(sSharedLib *lib,sElfSym *sym,uint32_t hash) {
+	if(!atomic_cmpnswap(&cacheLock,0,1))
+		return;
+	sCacheEntry *e = cache + (hash & (CACHE_SIZE - 1));
+	e->hash = hash;
+	e->name = lib->dynstrtbl + sym->st_name;
+	e->lib = lib;
+	e->sym = sym;
+	atomic_cmpnswap(&cacheLock,1,0);
+}
+
+static void lookup_getHashes(const uint8_t *name,sHashes *hashes) {
+	uint32_t h = 0,g,gh = 5381;
 	while(*name) {
+		/* GNU hash: h * 33 + c */
+		gh = (gh << 5) + gh + *name;
+		/* SysV hash */
 		h = (h << 4) + *name++;
 		if((g = (h & 0xf0000000)))
 			h ^= g >> 24;
 		h &= ~g;
 	}
-	return h;
+	hashes->sysv = h;
+	hashes->gnu = gh;
 }
@@ -51,6 +51,14 @@ struct sSharedLib {
 	size_t textSize;
 	sElfDyn *dyn;
 	ElfWord *hashTbl;
+	/* the DT_GNU_HASH table, split into its parts; gnuBuckets is NULL if there is none */
+	ElfWord gnuNBuckets;
+	ElfWord gnuSymOffset;
+	ElfWord gnuBloomMask;
+	ElfWord gnuBloomShift;
+	const ElfAddr *gnuBloom;
+	const ElfWord *gnuBuckets;
+	const ElfWord *gnuChains;
 	uint jmprelType;
 	sElfRel *jmprel;
 	sElfSym *dynsyms;
@@ -31,6 +31,7 @@ extern sTestModule tModBintree;
 extern sTestModule tModMap;
 extern sTestModule tModSmartPtr;
 extern sTestModule tModTuple;
+extern sTestModule tModPerf;
 
 int main(void) {
 	test_register(&tModString);
@@ -43,6 +44,7 @@ int main(void) {
 	test_register(&tModMap);
 	test_register(&tModSmartPtr);
 	test_register(&tModTuple);
+	test_register(&tModPerf);
 	test_start();
 	/* flush stdout because cout will be closed before stdout is flushed by exit(). thus, that flush
 	 * will fail because the file has already been closed. */
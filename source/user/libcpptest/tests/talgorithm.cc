@@ -430,5 +430,26 @@ static void test_sort(void) {
 		}
 	}
 
+	{
+		/* large enough to go through partitioning; sorted, reversed and equal input */
+		vector<int> v;
+		for(int i = 0; i < 1000; ++i)
+			v.push_back(i);
+		std::sort(v.begin(),v.end());
+		for(int i = 0; i < 1000; ++i)
+			test_assertInt(v[i],i);
+
+		std::reverse(v.begin(),v.end());
+		std::sort(v.begin(),v.end());
+		for(int i = 0; i < 1000; ++i)
+			test_assertInt(v[i],i);
+
+		for(int i = 0; i < 1000; ++i)
+			v[i] = (i * 7919) % 13;
+		std::sort(v.begin(),v.end());
+		for(int i = 1; i < 1000; ++i)
+			test_assertTrue(v[i - 1] <= v[i]);
+	}
+
 	test_caseSucceeded();
 }
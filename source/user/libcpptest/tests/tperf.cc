@@ -0,0 +1,128 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/test.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace std;
+
+#define COUNT		20000
+
+/* forward declarations */
+static void test_perf(void);
+static void test_mapSorted(void);
+static void test_mapRandom(void);
+static void test_sortSorted(void);
+static void test_sortRandom(void);
+
+/* our test-module */
+sTestModule tModPerf = {
+	"Performance",
+	&test_perf
+};
+
+static void test_perf(void) {
+	test_mapSorted();
+	test_mapRandom();
+	test_sortSorted();
+	test_sortRandom();
+}
+
+static void bench_map(const vector<int> &keys) {
+	map<int,int> m;
+	uint64_t start = rdtsc();
+	for(size_t i = 0; i < keys.size(); ++i)
+		m[keys[i]] = i;
+	uint64_t mid = rdtsc();
+	for(size_t i = 0; i < keys.size(); ++i)
+		test_assertTrue(m.find(keys[i]) != m.end());
+	uint64_t end = rdtsc();
+	test_assertSize(m.size(),keys.size());
+
+	printf("insert: %Lu cycles/op, find: %Lu cycles/op\n",
+		(mid - start) / keys.size(),(end - mid) / keys.size());
+	fflush(stdout);
+}
+
+static void bench_sort(vector<int> &v) {
+	uint64_t start = rdtsc();
+	std::sort(v.begin(),v.end());
+	uint64_t end = rdtsc();
+	for(size_t i = 1; i < v.size(); ++i)
+		test_assertTrue(v[i - 1] <= v[i]);
+
+	printf("sort: %Lu cycles/element\n",(end - start) / v.size());
+	fflush(stdout);
+}
+
+static void test_mapSorted(void) {
+	test_caseStart("Map with %d ascending keys",COUNT);
+
+	vector<int> keys;
+	for(int i = 0; i < COUNT; ++i)
+		keys.push_back(i);
+	bench_map(keys);
+
+	test_caseSucceeded();
+}
+
+static void test_mapRandom(void) {
+	test_caseStart("Map with %d random keys",COUNT);
+
+	srand(0x1234);
+	vector<int> keys;
+	for(int i = 0; i < COUNT; ++i)
+		keys.push_back(i);
+	for(int i = COUNT - 1; i > 0; --i)
+		std::swap(keys[i],keys[rand() % (i + 1)]);
+	bench_map(keys);
+
+	test_caseSucceeded();
+}
+
+static void test_sortSorted(void) {
+	test_caseStart("Sorting %d sorted and reversed elements",COUNT);
+
+	vector<int> v;
+	for(int i = 0; i < COUNT; ++i)
+		v.push_back(i);
+	bench_sort(v);
+	std::reverse(v.begin(),v.end());
+	bench_sort(v);
+
+	test_caseSucceeded();
+}
+
+static void test_sortRandom(void) {
+	test_caseStart("Sorting %d random elements",COUNT);
+
+	srand(0x1234);
+	vector<int> v;
+	for(int i = 0; i < COUNT; ++i)
+		v.push_back(rand());
+	bench_sort(v);
+
+	test_caseSucceeded();
+}
@@ -18,12 +18,18 @@
  */
 
 #include <sys/common.h>
+#include <sys/sync.h>
 #include <sys/test.h>
+#include <sys/thread.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define SINGLE_BYTE_COUNT 10000
+#define THREAD_OBJ_COUNT	1000
+#define THREAD_COUNT		4
 
 /* forward declarations */
 static void test_heap(void);
@@ -35,6 +41,12 @@ static void test_heap_t1v3(void);
 static void test_heap_t1v4(void);
 static void test_heap_t2(void);
 static void test_heap_t3(void);
+static void test_heap_memalign(void);
+static void test_heap_posix_memalign(void);
+static void test_heap_realloc(void);
+static void test_heap_realloc_inplace(void);
+static void test_heap_crossthread(void);
+static void test_heap_threads(void);
 
 /* our test-module */
 sTestModule tModHeap = {
@@ -49,6 +61,12 @@ uint *ptrs[ARRAY_SIZE(sizes)];
 size_t randFree1[] = {7,5,2,0,6,3,4,1};
 size_t randFree2[] = {3,4,1,5,6,0,7,2};
 
+size_t alignments[] = {16,32,64,256,1024,4096,16384,65536};
+size_t alignSizes[] = {1,100,4096,40000};
+
+void *threadObjs[THREAD_OBJ_COUNT];
+tUserSem threadSem;
+
 size_t oldFree, newFree;
 
 static void test_heap(void) {
@@ -59,6 +77,12 @@ static void test_heap(void) {
 		&test_heap_t1v4,
 		&test_heap_t2,
 		&test_heap_t3,
+		&test_heap_memalign,
+		&test_heap_posix_memalign,
+		&test_heap_realloc,
+		&test_heap_realloc_inplace,
+		&test_heap_crossthread,
+		&test_heap_threads,
 	};
 
 	size_t i;
@@ -197,3 +221,188 @@ static void test_heap_t3(void) {
 	}
 	test_check();
 }
+
+/* memalign with alignments up to several pages */
+static void test_heap_memalign(void) {
+	size_t a,s;
+	test_init("memalign");
+	for(a = 0; a < ARRAY_SIZE(alignments); a++) {
+		for(s = 0; s < ARRAY_SIZE(alignSizes); s++) {
+			uchar *p = (uchar*)memalign(alignments[a],alignSizes[s]);
+			test_assertTrue(p != NULL);
+			test_assertUIntPtr((uintptr_t)p & (alignments[a] - 1),0);
+			if(p) {
+				/* write test */
+				p[0] = 1;
+				p[alignSizes[s] - 1] = 2;
+				free(p);
+			}
+		}
+	}
+	/* the alignment has to be a power of two */
+	test_assertPtr(memalign(0,16),NULL);
+	test_assertPtr(memalign(24,16),NULL);
+	test_check();
+}
+
+/* posix_memalign, including the error cases */
+static void test_heap_posix_memalign(void) {
+	size_t a;
+	void *p;
+	test_init("posix_memalign");
+	for(a = 0; a < ARRAY_SIZE(alignments); a++) {
+		p = NULL;
+		test_assertInt(posix_memalign(&p,alignments[a],100),0);
+		test_assertTrue(p != NULL);
+		test_assertUIntPtr((uintptr_t)p & (alignments[a] - 1),0);
+		free(p);
+	}
+
+	/* invalid alignments */
+	test_assertInt(posix_memalign(&p,0,100),EINVAL);
+	test_assertInt(posix_memalign(&p,3,100),EINVAL);
+	test_assertInt(posix_memalign(&p,3 * sizeof(void*),100),EINVAL);
+	test_assertInt(posix_memalign(&p,sizeof(void*) / 2,100),EINVAL);
+
+	/* a size of zero yields NULL */
+	p = (void*)1;
+	test_assertInt(posix_memalign(&p,64,0),0);
+	test_assertPtr(p,NULL);
+	free(p);
+	test_check();
+}
+
+/* realloc has to preserve the data, no matter if it moves the area or not */
+static void test_heap_realloc(void) {
+	size_t size,i;
+	test_init("realloc with growing sizes");
+	uchar *p = (uchar*)malloc(1);
+	if(!test_assertTrue(p != NULL))
+		return;
+	p[0] = 0;
+	for(size = 1; size < 512 * 1024; size *= 2) {
+		uchar *np = (uchar*)realloc(p,size * 2);
+		test_assertTrue(np != NULL);
+		if(!np)
+			break;
+		p = np;
+		for(i = 0; i < size; i++) {
+			if(p[i] != (uchar)i) {
+				test_assertUInt(p[i],(uchar)i);
+				break;
+			}
+		}
+		for(i = size; i < size * 2; i++)
+			p[i] = i;
+	}
+	free(p);
+	test_check();
+}
+
+/* realloc of a large area is done in place, if the pages behind it are free */
+static void test_heap_realloc_inplace(void) {
+	size_t i,size = 64 * 1024;
+	test_init("realloc in place");
+	uchar *p = (uchar*)malloc(size);
+	uchar *q = (uchar*)malloc(size);
+	if(!test_assertTrue(p != NULL && q != NULL)) {
+		free(q);
+		free(p);
+		return;
+	}
+	for(i = 0; i < size; i++)
+		p[i] = i;
+
+	if(q == p + size) {
+		/* free the area behind <p> so that it can grow into it */
+		free(q);
+		q = NULL;
+		test_assertPtr(realloc(p,size * 2),p);
+	}
+	else {
+		tprintf("Areas are not adjacent (%p and %p); skipping in place check\n",p,q);
+		p = (uchar*)realloc(p,size * 2);
+		test_assertTrue(p != NULL);
+	}
+
+	for(i = 0; i < size; i++) {
+		if(p[i] != (uchar)i) {
+			test_assertUInt(p[i],(uchar)i);
+			break;
+		}
+	}
+	free(q);
+	free(p);
+	test_check();
+}
+
+static int test_heap_freeThread(A_UNUSED void *arg) {
+	size_t i;
+	usemdown(&threadSem);
+	for(i = 0; i < THREAD_OBJ_COUNT; i++)
+		free(threadObjs[i]);
+	return 0;
+}
+
+/* objects that are free'd by a different thread go back to the central lists */
+static void test_heap_crossthread(void) {
+	size_t i,j,reused = 0;
+	test_init("Free objects in a different thread");
+	if(usemcrt(&threadSem,0) < 0) {
+		test_caseFailed("Unable to create usem");
+		return;
+	}
+
+	for(i = 0; i < THREAD_OBJ_COUNT; i++) {
+		threadObjs[i] = malloc(sizes[i % ARRAY_SIZE(sizes)]);
+		test_assertTrue(threadObjs[i] != NULL);
+	}
+	test_assertTrue(startthread(test_heap_freeThread,NULL) >= 0);
+	usemup(&threadSem);
+	join(0);
+	usemdestr(&threadSem);
+
+	/* the thread has given its cache back on exit, so that we get the objects again */
+	void **objs = (void**)malloc(sizeof(void*) * THREAD_OBJ_COUNT);
+	if(!test_assertTrue(objs != NULL))
+		return;
+	for(i = 0; i < THREAD_OBJ_COUNT; i++) {
+		objs[i] = malloc(sizes[i % ARRAY_SIZE(sizes)]);
+		for(j = 0; j < THREAD_OBJ_COUNT; j++) {
+			if(objs[i] == threadObjs[j]) {
+				reused++;
+				break;
+			}
+		}
+	}
+	test_assertTrue(reused > 0);
+	for(i = 0; i < THREAD_OBJ_COUNT; i++)
+		free(objs[i]);
+	free(objs);
+	test_check();
+}
+
+static int test_heap_allocThread(A_UNUSED void *arg) {
+	size_t i,j;
+	void **objs = (void**)malloc(sizeof(void*) * THREAD_OBJ_COUNT);
+	if(objs == NULL)
+		return 1;
+	for(j = 0; j < 10; j++) {
+		for(i = 0; i < THREAD_OBJ_COUNT; i++)
+			objs[i] = malloc(sizes[(i + j) % ARRAY_SIZE(sizes)]);
+		for(i = 0; i < THREAD_OBJ_COUNT; i++)
+			free(objs[i]);
+	}
+	free(objs);
+	return 0;
+}
+
+/* alloc and free in multiple threads in parallel */
+static void test_heap_threads(void) {
+	size_t i;
+	test_init("Allocate and free in %d threads",THREAD_COUNT);
+	for(i = 0; i < THREAD_COUNT; i++)
+		test_assertTrue(startthread(test_heap_allocThread,NULL) >= 0);
+	join(0);
+	test_check();
+}
@@ -35,7 +35,7 @@
 static bool run = true;
 
 static void usage(const char *name) {
-	fprintf(stderr,"Usage: %s [--ms <ms>] [-p <perms>] <device> <path> <fs>\n",name);
+	fprintf(stderr,"Usage: %s [--ms <ms>] [-p <perms>] [-o <opt>] <device> <path> <fs>\n",name);
 	fprintf(stderr,"    Creates a child process that executes <fs>. <fs> receives\n");
 	fprintf(stderr,"    the fs-device to create and the device to work with (<device>)\n");
 	fprintf(stderr,"    as command line arguments. Afterwards, mount opens the\n");
@@ -48,6 +48,7 @@ static void usage(const char *name) {
 	fprintf(stderr,"    --ms <ms>:  By default, the current mountspace (/sys/pid/self/ms)\n");
 	fprintf(stderr,"                will be used. This can be overwritten by specifying\n");
 	fprintf(stderr,"                --ms <ms>.\n");
+	fprintf(stderr,"    -o <opt>:   pass <opt> as an option to <fs> (e.g. --icache=256).\n");
 	exit(EXIT_FAILURE);
 }
 
@@ -68,16 +69,18 @@ int main(int argc,char *argv[]) {
 	char devpath[MAX_PATH_LEN];
 	char *mspath = (char*)"/sys/pid/self/ms";
 	char *perms = (char*)"rwx";
+	const char *fsopt = NULL;
 
 	int opt;
 	const struct option longopts[] = {
 		{"ms",		required_argument,	0,	'm'},
 		{0, 0, 0, 0},
 	};
-	while((opt = getopt_long(argc,argv,"p:",longopts,NULL)) != -1) {
+	while((opt = getopt_long(argc,argv,"p:o:",longopts,NULL)) != -1) {
 		switch(opt) {
 			case 'm': mspath = optarg; break;
 			case 'p': perms = optarg; break;
+			case 'o': fsopt = optarg; break;
 			default:
 				usage(argv[0]);
 		}
@@ -124,7 +127,12 @@ int main(int argc,char *argv[]) {
 	if(pid < 0)
 		error("fork failed");
 	if(pid == 0) {
-		const char *args[] = {fs,fsdev,devpath,NULL};
+		const char *args[] = {fs,fsdev,devpath,NULL,NULL};
+		if(fsopt) {
+			args[1] = fsopt;
+			args[2] = fsdev;
+			args[3] = devpath;
+		}
 		execvp(fs,args);
 		error("exec failed");
 	}
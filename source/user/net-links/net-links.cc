@@ -31,6 +31,7 @@ using namespace esc;
 static void usage(const char *name) {
 	serr << "Usage: " << name << " (set|up|down|show) args...\n";
 	serr << "\tset <link> (ip|subnet) <val>  : configures <link>\n";
+	serr << "\tset <link> loss <permille>    : drops <permille> of the packets sent over <link>\n";
 	serr << "\tup <link>                     : enables <link>\n";
 	serr << "\tdown <link>                   : disables <link>\n";
 	serr << "\tshow [<link>]                 : shows all links or <link>\n";
@@ -54,6 +55,11 @@ static void linkSet(Net &net,int argc,char **argv) {
 	if(!link)
 		exitmsg("Link '" << argv[2] << "' not found");
 
+	if(strcmp(argv[3],"loss") == 0) {
+		net.linkLoss(argv[2],atoi(argv[4]));
+		return;
+	}
+
 	Net::IPv4Addr ip;
 	IStringStream is(argv[4]);
 	is >> ip;
@@ -0,0 +1,155 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/arch.h>
+#include <sys/common.h>
+#include <sys/mman.h>
+#include <sys/proc.h>
+#include <sys/sync.h>
+#include <sys/thread.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../modules.h"
+
+#define THREADS			8
+#define ROUNDS			1000
+#define ITEMS			100000
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notFull = PTHREAD_COND_INITIALIZER;
+static pthread_barrier_t barrier;
+static volatile int items = 0;
+static volatile long produced = 0;
+static volatile long consumed = 0;
+static volatile int counters[THREADS];
+
+static int thread_produce(A_UNUSED void *arg) {
+	for(int i = 0; i < ITEMS; ++i) {
+		pthread_mutex_lock(&mutex);
+		while(items == 8)
+			pthread_cond_wait(&notFull,&mutex);
+		items++;
+		produced++;
+		pthread_cond_signal(&notEmpty);
+		pthread_mutex_unlock(&mutex);
+	}
+	return 0;
+}
+
+static int thread_consume(A_UNUSED void *arg) {
+	for(int i = 0; i < ITEMS; ++i) {
+		pthread_mutex_lock(&mutex);
+		while(items == 0)
+			pthread_cond_wait(&notEmpty,&mutex);
+		items--;
+		consumed++;
+		pthread_cond_signal(&notFull);
+		pthread_mutex_unlock(&mutex);
+	}
+	return 0;
+}
+
+static int thread_barrier(void *arg) {
+	int id = (int)(long)arg;
+	for(int i = 0; i < ROUNDS; ++i) {
+		counters[id]++;
+		pthread_barrier_wait(&barrier);
+		/* everybody has to be in the same round now */
+		for(int j = 0; j < THREADS; ++j) {
+			if(counters[j] != i + 1)
+				printe("Thread %d is in round %d instead of %d",j,counters[j],i + 1);
+		}
+		pthread_barrier_wait(&barrier);
+	}
+	return 0;
+}
+
+static void test_condvar(void) {
+	printf("Producer/consumer with condition variables...\n");
+	fflush(stdout);
+	for(int i = 0; i < THREADS / 2; ++i) {
+		if(startthread(thread_produce,NULL) < 0 || startthread(thread_consume,NULL) < 0)
+			error("Unable to start thread");
+	}
+	join(0);
+	if(items != 0 || produced != consumed || produced != THREADS / 2 * ITEMS)
+		printe("Something went wrong: items=%d, produced=%ld, consumed=%ld",items,produced,consumed);
+}
+
+static void test_barrier(void) {
+	printf("Barrier...\n");
+	fflush(stdout);
+	if(pthread_barrier_init(&barrier,NULL,THREADS) != 0)
+		error("Unable to init barrier");
+	for(long i = 0; i < THREADS; ++i) {
+		if(startthread(thread_barrier,(void*)i) < 0)
+			error("Unable to start thread");
+	}
+	join(0);
+	pthread_barrier_destroy(&barrier);
+}
+
+#if !defined(__eco32__)
+static void test_shared(void) {
+	printf("User semaphores in shared memory...\n");
+	fflush(stdout);
+
+	/* the futexes are identified by physical address, so that this works across processes */
+	FILE *tmp = tmpfile();
+	ftruncate(fileno(tmp),PAGE_SIZE);
+	tUserSem *sems = (tUserSem*)mmap(NULL,PAGE_SIZE,PAGE_SIZE,PROT_READ | PROT_WRITE,MAP_SHARED,
+		fileno(tmp),0);
+	if(sems == NULL)
+		error("Unable to mmap shared memory");
+	if(usemcrt(sems + 0,1) < 0 || usemcrt(sems + 1,0) < 0)
+		error("Unable to create usems");
+
+	int pid = fork();
+	if(pid < 0)
+		error("fork failed");
+	for(int i = 0; i < ROUNDS; ++i) {
+		usemdown(sems + (pid == 0 ? 1 : 0));
+		usemup(sems + (pid == 0 ? 0 : 1));
+	}
+	if(pid == 0)
+		exit(EXIT_SUCCESS);
+
+	sExitState state;
+	waitchild(&state,pid,0);
+	if(state.exitCode != 0)
+		printe("Child failed with exitcode %d",state.exitCode);
+	munmap(sems);
+	fclose(tmp);
+}
+#endif
+
+int mod_pthread(A_UNUSED int argc,A_UNUSED char *argv[]) {
+	test_condvar();
+	test_barrier();
+	/* the user semaphores are kernel-semaphores on eco32, which are not in the shared memory */
+#if !defined(__eco32__)
+	test_shared();
+#endif
+	return 0;
+}
@@ -57,6 +57,7 @@ static sTestModule modules[] = {
 	{"matmult",mod_matmult},
 	{"rwlock",mod_rwlock},
 	{"mutex",mod_mutex},
+	{"pthread",mod_pthread},
 	{"zombies",mod_zombies},
 	{"syscalls",mod_syscalls},
 };
@@ -19,6 +19,10 @@
 
 #include <sys/common.h>
 
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
 extern int mod_getpid(int,char**);
 extern int mod_yield(int,char**);
 extern int mod_fork(int,char**);
@@ -36,3 +40,14 @@ extern int mod_chgsize(int,char**);
 extern int mod_pagefault(int,char**);
 extern int mod_heap(int,char**);
 extern int mod_stdio(int,char**);
+extern int mod_wakeup(int,char**);
+extern int mod_netpps(int,char**);
+extern int mod_cowfault(int,char**);
+extern int mod_sleep(int,char**);
+extern int mod_vdso(int,char**);
+extern int mod_tcpput(int,char**);
+extern int mod_iops(int,char**);
+
+#if defined(__cplusplus)
+}
+#endif
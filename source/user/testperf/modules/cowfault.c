@@ -0,0 +1,80 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/arch.h>
+#include <sys/common.h>
+#include <sys/mman.h>
+#include <sys/proc.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+#define DEF_SIZE_MB		32
+
+static void touch(volatile char *addr,size_t pages,const char *name) {
+	uint64_t start = rdtsc();
+	for(size_t i = 0; i < pages; ++i)
+		*(addr + i * PAGE_SIZE) = i;
+	uint64_t end = rdtsc();
+	printf("%-18s: %Lu cycles/page\n",name,(end - start) / pages);
+	fflush(stdout);
+}
+
+int mod_cowfault(int argc,char *argv[]) {
+	size_t mb = DEF_SIZE_MB;
+	if(argc > 2)
+		mb = atoi(argv[2]);
+	size_t pages = (mb * 1024 * 1024) / PAGE_SIZE;
+
+	printf("Fork and touch %zu MiB...\n",mb);
+	fflush(stdout);
+
+	volatile char *addr = mmap(NULL,pages * PAGE_SIZE,0,PROT_READ | PROT_WRITE,MAP_PRIVATE,-1,0);
+	if(!addr) {
+		printe("mmap failed");
+		return EXIT_FAILURE;
+	}
+	touch(addr,pages,"populate");
+
+	uint64_t start = rdtsc();
+	int pid = fork();
+	if(pid == 0) {
+		/* every write causes a copy because the parent still uses the frames */
+		touch(addr,pages,"child (copy)");
+		exit(EXIT_SUCCESS);
+	}
+	else if(pid < 0) {
+		printe("fork failed");
+		return EXIT_FAILURE;
+	}
+	uint64_t end = rdtsc();
+	printf("%-18s: %Lu cycles (%Lu cycles/page)\n","fork",end - start,(end - start) / pages);
+	fflush(stdout);
+
+	waitchild(NULL,-1,0);
+
+	/* now we are the only user; thus, the frames are just made writable again */
+	touch(addr,pages,"parent (reclaim)");
+
+	munmap((void*)addr);
+	return EXIT_SUCCESS;
+}
@@ -19,6 +19,8 @@
 
 #include <sys/common.h>
 #include <sys/proc.h>
+#include <sys/sync.h>
+#include <sys/thread.h>
 #include <sys/time.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,8 +28,13 @@
 
 #include "../modules.h"
 
+#define THREAD_COUNT	4
+
 static const uint TEST_COUNT    = 10000;
+static const uint LARGE_COUNT   = 100;
 static size_t sizes[] = {4,8,16,32,64,128,256,512,1024};
+static size_t largeSizes[] = {64 * 1024,256 * 1024,1024 * 1024,4 * 1024 * 1024};
+static size_t aligns[] = {16,64,256,4096,65536};
 
 static void test1(void) {
 	uint64_t atimes[ARRAY_SIZE(sizes)];
@@ -86,8 +93,166 @@ static void test2(void) {
 	free(areas);
 }
 
+static void test3(void) {
+	uint64_t ftimes[ARRAY_SIZE(sizes)];
+	void **areas = (void**)malloc(sizeof(void*) * TEST_COUNT);
+
+	srand(rdtsc());
+	for(size_t s = 0; s < ARRAY_SIZE(sizes); ++s) {
+		for(uint i = 0; i < TEST_COUNT; ++i)
+			areas[i] = malloc(sizes[s]);
+		/* shuffle them, so that we free them in random order */
+		for(uint i = TEST_COUNT - 1; i > 0; --i) {
+			uint j = rand() % (i + 1);
+			void *tmp = areas[i];
+			areas[i] = areas[j];
+			areas[j] = tmp;
+		}
+
+		uint64_t total = 0;
+		for(uint i = 0; i < TEST_COUNT; ++i) {
+			uint64_t start = rdtsc();
+			free(areas[i]);
+			total += rdtsc() - start;
+		}
+		ftimes[s] = total;
+	}
+
+	printf("n*malloc + n*free in random order:\n");
+	for(size_t s = 0; s < ARRAY_SIZE(sizes); ++s)
+		printf("  free(%zu): %Lu cycles/call\n",sizes[s],ftimes[s] / TEST_COUNT);
+	free(areas);
+}
+
+static void test4(void) {
+	printf("n*(malloc+free) of large areas:\n");
+	for(size_t s = 0; s < ARRAY_SIZE(largeSizes); ++s) {
+		uint64_t atotal = 0, ftotal = 0;
+		for(uint i = 0; i < LARGE_COUNT; ++i) {
+			uint64_t start = rdtsc();
+			void *p = malloc(largeSizes[s]);
+			atotal += rdtsc() - start;
+
+			start = rdtsc();
+			free(p);
+			ftotal += rdtsc() - start;
+		}
+		printf("malloc(%zu): %Lu cycles/call\n",largeSizes[s],atotal / LARGE_COUNT);
+		printf("  free(%zu): %Lu cycles/call\n",largeSizes[s],ftotal / LARGE_COUNT);
+	}
+}
+
+static void test5(void) {
+	uint64_t total = 0;
+	size_t calls = 0;
+	for(uint i = 0; i < LARGE_COUNT; ++i) {
+		void *p = NULL;
+		/* grow an area step by step, as a vector would do it */
+		for(size_t size = 16; size <= 1024 * 1024; size += size / 2) {
+			uint64_t start = rdtsc();
+			p = realloc(p,size);
+			total += rdtsc() - start;
+			calls++;
+		}
+		free(p);
+	}
+
+	printf("realloc from 16 bytes to 1 MiB: %Lu cycles/call\n",total / calls);
+}
+
+static void test6(void) {
+	printf("n*(memalign+free):\n");
+	for(size_t a = 0; a < ARRAY_SIZE(aligns); ++a) {
+		uint64_t atotal = 0, ftotal = 0;
+		for(uint i = 0; i < LARGE_COUNT; ++i) {
+			uint64_t start = rdtsc();
+			void *p = memalign(aligns[a],100);
+			atotal += rdtsc() - start;
+
+			start = rdtsc();
+			free(p);
+			ftotal += rdtsc() - start;
+		}
+		printf("memalign(%zu,100): %Lu cycles/call\n",aligns[a],atotal / LARGE_COUNT);
+		printf("            free: %Lu cycles/call\n",ftotal / LARGE_COUNT);
+	}
+}
+
+static int thread_parallel(A_UNUSED void *arg) {
+	void **areas = (void**)malloc(sizeof(void*) * TEST_COUNT);
+	uint64_t start = rdtsc();
+	for(uint j = 0; j < 10; ++j) {
+		for(uint i = 0; i < TEST_COUNT; ++i)
+			areas[i] = malloc(sizes[i % ARRAY_SIZE(sizes)]);
+		for(uint i = 0; i < TEST_COUNT; ++i)
+			free(areas[i]);
+	}
+	uint64_t end = rdtsc();
+	printf("[%3d] %Lu cycles/(malloc+free)\n",gettid(),(end - start) / (TEST_COUNT * 10));
+	free(areas);
+	return 0;
+}
+
+static void **produced;
+static tUserSem producedSem;
+
+static int thread_consumer(A_UNUSED void *arg) {
+	usemdown(&producedSem);
+	uint64_t start = rdtsc();
+	for(uint i = 0; i < TEST_COUNT; ++i)
+		free(produced[i]);
+	uint64_t end = rdtsc();
+	printf("free() of objects from a different thread: %Lu cycles/call\n",(end - start) / TEST_COUNT);
+	return 0;
+}
+
+static void test7(void) {
+	printf("%d threads doing n*malloc + n*free in parallel:\n",THREAD_COUNT);
+	fflush(stdout);
+	for(int i = 0; i < THREAD_COUNT; ++i) {
+		if(startthread(thread_parallel,NULL) < 0)
+			printe("Unable to start thread");
+	}
+	join(0);
+}
+
+static void test8(void) {
+	if(usemcrt(&producedSem,0) < 0) {
+		printe("Unable to create usem");
+		return;
+	}
+	produced = (void**)malloc(sizeof(void*) * TEST_COUNT);
+	if(startthread(thread_consumer,NULL) < 0) {
+		printe("Unable to start thread");
+		return;
+	}
+
+	for(uint i = 0; i < TEST_COUNT; ++i)
+		produced[i] = malloc(sizes[i % ARRAY_SIZE(sizes)]);
+	usemup(&producedSem);
+	join(0);
+
+	/* the objects came back to the central lists, so that we get them from there again */
+	uint64_t start = rdtsc();
+	for(uint i = 0; i < TEST_COUNT; ++i)
+		produced[i] = malloc(sizes[i % ARRAY_SIZE(sizes)]);
+	uint64_t end = rdtsc();
+	printf("malloc() after the frees of a different thread: %Lu cycles/call\n",
+		(end - start) / TEST_COUNT);
+	for(uint i = 0; i < TEST_COUNT; ++i)
+		free(produced[i]);
+	free(produced);
+	usemdestr(&producedSem);
+}
+
 int mod_heap(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	test1();
 	test2();
+	test3();
+	test4();
+	test5();
+	test6();
+	test7();
+	test8();
 	return 0;
 }
@@ -0,0 +1,168 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/io.h>
+#include <sys/stat.h>
+#include <sys/sync.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+#define BLOCK_SIZE		4096
+#define TEST_COUNT		4096
+#define MAX_THREADS		32
+
+typedef struct {
+	int fd;
+	void *buf;
+	uint32_t seed;
+	size_t count;
+	bool failed;
+} sReader;
+
+static const char *path;
+static size_t blocks;
+static int readySem;
+static int startSem;
+static sReader readers[MAX_THREADS];
+
+static uint32_t next_rand(uint32_t *seed) {
+	/* xorshift; rand() is neither thread-safe nor random enough in the upper bits */
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed;
+}
+
+static int thread_reader(void *arg) {
+	sReader *r = (sReader*)arg;
+	r->failed = true;
+	r->fd = open(path,O_RDONLY);
+	if(r->fd < 0) {
+		printe("Unable to open %s",path);
+		semup(readySem);
+		return 1;
+	}
+	/* let the driver transfer the data directly into our buffer */
+	if(sharebuf(r->fd,BLOCK_SIZE,&r->buf,0) < 0) {
+		printe("Unable to share buffer with %s",path);
+		semup(readySem);
+		close(r->fd);
+		return 1;
+	}
+
+	semup(readySem);
+	semdown(startSem);
+
+	for(size_t i = 0; i < r->count; ++i) {
+		off_t off = (off_t)(next_rand(&r->seed) % blocks) * BLOCK_SIZE;
+		if(seek(r->fd,off,SEEK_SET) < 0 || read(r->fd,r->buf,BLOCK_SIZE) != BLOCK_SIZE) {
+			printe("Reading block @ %Lu from %s failed",(uint64_t)off,path);
+			goto done;
+		}
+	}
+	r->failed = false;
+
+done:
+	destroybuf(r->buf);
+	close(r->fd);
+	return 0;
+}
+
+static bool run_test(size_t threads) {
+	int tids[MAX_THREADS];
+	for(size_t i = 0; i < threads; ++i) {
+		readers[i].seed = 0x9E3779B9 * (i + 1);
+		readers[i].count = TEST_COUNT / threads;
+		tids[i] = startthread(thread_reader,readers + i);
+		if(tids[i] < 0) {
+			printe("Unable to start thread");
+			for(size_t j = 0; j < i; ++j)
+				semup(startSem);
+			for(size_t j = 0; j < i; ++j)
+				join(tids[j]);
+			return false;
+		}
+		semdown(readySem);
+	}
+
+	/* start all readers at once, so that the requests are in flight concurrently */
+	uint64_t start = rdtsc();
+	for(size_t i = 0; i < threads; ++i)
+		semup(startSem);
+
+	bool res = true;
+	for(size_t i = 0; i < threads; ++i) {
+		join(tids[i]);
+		res &= !readers[i].failed;
+	}
+	uint64_t end = rdtsc();
+	if(!res)
+		return false;
+
+	uint64_t usecs = tsctotime(end - start);
+	size_t count = (TEST_COUNT / threads) * threads;
+	printf("%2zu readers: %6Lu IOPS (%Lu us per read)\n",
+		threads,(count * 1000000ULL) / (usecs ? usecs : 1),usecs / (count / threads));
+	fflush(stdout);
+	return true;
+}
+
+int mod_iops(int argc,char *argv[]) {
+	path = argc > 2 ? argv[2] : "/dev/sda1";
+	size_t max = argc > 3 ? MIN(MAX_THREADS,atoi(argv[3])) : MAX_THREADS;
+
+	int fd = open(path,O_RDONLY);
+	if(fd < 0) {
+		printe("Unable to open %s",path);
+		return EXIT_FAILURE;
+	}
+	off_t size = filesize(fd);
+	close(fd);
+	blocks = size > 0 ? size / BLOCK_SIZE : 0;
+	if(blocks == 0) {
+		printe("Unable to determine the size of %s",path);
+		return EXIT_FAILURE;
+	}
+
+	readySem = semcrt(0);
+	startSem = semcrt(0);
+	if(readySem < 0 || startSem < 0) {
+		printe("Unable to create sems");
+		return EXIT_FAILURE;
+	}
+
+	printf("Random %d byte reads from %s (%zu blocks)...\n",BLOCK_SIZE,path,blocks);
+	fflush(stdout);
+	int res = EXIT_SUCCESS;
+	for(size_t threads = 1; threads <= max; threads *= 2) {
+		if(!run_test(threads)) {
+			res = EXIT_FAILURE;
+			break;
+		}
+	}
+
+	semdestr(startSem);
+	semdestr(readySem);
+	return res;
+}
@@ -22,6 +22,7 @@
 #include <sys/sync.h>
 #include <sys/thread.h>
 #include <sys/time.h>
+#include <pthread.h>
 #include <stdio.h>
 
 #include "../modules.h"
@@ -50,8 +51,29 @@ static void run_test(ulong ident,fLock lockFunc,fUnlock unlockFunc) {
 	printf("unlock(): %Lu cycles/call\n",unlockTotal / TEST_COUNT);
 }
 
+static tUserSem usem;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int usem_down(A_UNUSED int id) {
+	usemdown(&usem);
+	return 0;
+}
+static int usem_up(A_UNUSED int id) {
+	usemup(&usem);
+	return 0;
+}
+
+static int mutex_lock(A_UNUSED int id) {
+	return pthread_mutex_lock(&mutex);
+}
+static int mutex_unlock(A_UNUSED int id) {
+	return pthread_mutex_unlock(&mutex);
+}
+
 static int sem1;
 static int sem2;
+static tUserSem usem1;
+static tUserSem usem2;
 
 static int thread_pingpong(A_UNUSED void *arg) {
 	uint64_t start,end;
@@ -69,6 +91,20 @@ static int thread_pingpong(A_UNUSED void *arg) {
 	return 0;
 }
 
+static int thread_upingpong(A_UNUSED void *arg) {
+	uint64_t start,end;
+	tUserSem *s1 = arg ? &usem1 : &usem2;
+	tUserSem *s2 = arg ? &usem2 : &usem1;
+	start = rdtsc();
+	for(int i = 0; i < TEST_COUNT; ++i) {
+		usemdown(s1);
+		usemup(s2);
+	}
+	end = rdtsc();
+	printf("[%3d] %Lu cycles/pingpong\n",gettid(),(end - start) / TEST_COUNT);
+	return 0;
+}
+
 int mod_locks(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	printf("Local Semaphores...\n");
 	fflush(stdout);
@@ -105,5 +141,32 @@ int mod_locks(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	join(0);
 	semdestr(sem2);
 	semdestr(sem1);
+
+	printf("User Semaphores...\n");
+	fflush(stdout);
+	if(usemcrt(&usem,1) < 0) {
+		printe("Unable to create usem");
+		return 1;
+	}
+	run_test(0,usem_down,usem_up);
+	usemdestr(&usem);
+
+	printf("Pthread Mutex...\n");
+	fflush(stdout);
+	run_test(0,mutex_lock,mutex_unlock);
+
+	printf("User Semaphore pingpong...\n");
+	fflush(stdout);
+	if(usemcrt(&usem1,1) < 0 || usemcrt(&usem2,0) < 0) {
+		printe("Unable to create usems");
+		return 1;
+	}
+	if(startthread(thread_upingpong,(void*)0) < 0 || startthread(thread_upingpong,(void*)1) < 0) {
+		printe("Unable to start thread");
+		return 1;
+	}
+	join(0);
+	usemdestr(&usem2);
+	usemdestr(&usem1);
 	return 0;
 }
@@ -0,0 +1,119 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/proto/net.h>
+#include <esc/proto/socket.h>
+#include <sys/common.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+#define PACKET_COUNT	20000
+#define PORT			2345
+
+using namespace esc;
+
+static volatile bool done = false;
+static volatile size_t received = 0;
+static uint64_t recvStart = 0;
+static uint64_t recvEnd = 0;
+
+static Socket::Addr buildAddr() {
+	Socket::Addr addr;
+	addr.family = Socket::AF_INET;
+	addr.d.ipv4.addr = Net::IPv4Addr(127,0,0,1).value();
+	addr.d.ipv4.port = PORT;
+	return addr;
+}
+
+static int receiver(void *arg) {
+	Socket *sock = reinterpret_cast<Socket*>(arg);
+	char buf[1024];
+	try {
+		while(1) {
+			Socket::Addr src;
+			size_t res = sock->recvfrom(src,buf,sizeof(buf));
+			if(received == 0)
+				recvStart = rdtsc();
+			// a single byte indicates the end
+			if(res == 1)
+				break;
+			received++;
+		}
+	}
+	catch(const default_error &e) {
+		printe("recvfrom failed: %s",e.what());
+	}
+	recvEnd = rdtsc();
+	done = true;
+	return 0;
+}
+
+static void test_pps(size_t size) {
+	Socket rsock(Socket::SOCK_DGRAM,Socket::PROTO_UDP);
+	Socket ssock(Socket::SOCK_DGRAM,Socket::PROTO_UDP);
+	Socket::Addr addr = buildAddr();
+	rsock.bind(addr);
+
+	done = false;
+	received = 0;
+	int tid = startthread(receiver,&rsock);
+	if(tid < 0) {
+		printe("Unable to start receiver thread");
+		return;
+	}
+
+	char buf[1024] = {0};
+	uint64_t start = rdtsc();
+	for(int i = 0; i < PACKET_COUNT; ++i)
+		ssock.sendto(addr,buf,size);
+	uint64_t end = rdtsc();
+
+	// packets might be dropped; thus, repeat the end marker until the receiver is done
+	while(!done) {
+		ssock.sendto(addr,buf,1);
+		usleep(10 * 1000);
+	}
+	join(tid);
+
+	uint64_t sendUs = tsctotime(end - start);
+	uint64_t recvUs = tsctotime(recvEnd - recvStart);
+	printf("%4zu bytes: sent %Lu pkts/s, received %zu of %d (%Lu pkts/s)\n",
+		size,sendUs ? (PACKET_COUNT * 1000000ULL) / sendUs : 0,received,PACKET_COUNT,
+		recvUs ? (received * 1000000ULL) / recvUs : 0);
+	fflush(stdout);
+}
+
+int mod_netpps(int,char**) {
+	static size_t sizes[] = {16,64,256,1024};
+	printf("UDP packets per second over the loopback device...\n");
+	fflush(stdout);
+	try {
+		for(size_t i = 0; i < ARRAY_SIZE(sizes); ++i)
+			test_pps(sizes[i]);
+	}
+	catch(const default_error &e) {
+		printe("%s",e.what());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -31,7 +31,7 @@
 #define TEST_COUNT		2000
 #define MAP_SIZE		32
 
-static void causePagefaults(const char *path) {
+static void causePagefaults(const char *path,int flags,const char *name) {
 	uint64_t start,end;
 	uint64_t total = 0;
 	uint64_t min = ULLONG_MAX, max = 0;
@@ -46,7 +46,7 @@ static void causePagefaults(const char *path) {
 
 	for(int j = 0; j < TEST_COUNT; ++j) {
 		volatile char *addr = mmap(NULL,MAP_SIZE * PAGE_SIZE,path ? MAP_SIZE * PAGE_SIZE : 0,
-			PROT_READ | PROT_WRITE,MAP_PRIVATE,fd,0);
+			PROT_READ | PROT_WRITE,MAP_PRIVATE | flags,fd,0);
 		if(!addr) {
 			printe("mmap failed");
 			return;
@@ -70,9 +70,9 @@ static void causePagefaults(const char *path) {
 	if(path)
 		close(fd);
 
-	printf("%-30s: %Lu cycles average\n",path ? path : "NULL",total / (TEST_COUNT * MAP_SIZE));
-	printf("%-30s: %Lu cycles minimum\n",path ? path : "NULL",min);
-	printf("%-30s: %Lu cycles maximum\n",path ? path : "NULL",max);
+	printf("%-30s: %Lu cycles average\n",name,total / (TEST_COUNT * MAP_SIZE));
+	printf("%-30s: %Lu cycles minimum\n",name,min);
+	printf("%-30s: %Lu cycles maximum\n",name,max);
 }
 
 int mod_pagefault(A_UNUSED int argc,A_UNUSED char *argv[]) {
@@ -97,9 +97,12 @@ int mod_pagefault(A_UNUSED int argc,A_UNUSED char *argv[]) {
 	}
 	close(fd);
 
-	causePagefaults(NULL);
-	causePagefaults("/tmp/test");
-	causePagefaults("/home/hrniels/testdir/bbc.bmp");
+	causePagefaults(NULL,0,"NULL");
+	/* compare loading single pages with the adaptive and the max. readahead-window */
+	causePagefaults("/tmp/test",MAP_RANDOM,"/tmp/test (random)");
+	causePagefaults("/tmp/test",0,"/tmp/test");
+	causePagefaults("/tmp/test",MAP_SEQUENTIAL,"/tmp/test (sequential)");
+	causePagefaults("/home/hrniels/testdir/bbc.bmp",0,"/home/hrniels/testdir/bbc.bmp");
 
 	if(unlink("/tmp/test") < 0)
 		printe("Unable to unlink test-file");
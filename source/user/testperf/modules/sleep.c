@@ -0,0 +1,56 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+#define TEST_COUNT		100
+
+static const time_t durations[] = {50, 200, 1000, 5000, 20000};
+
+int mod_sleep(A_UNUSED int argc,A_UNUSED char *argv[]) {
+	printf("Sleep accuracy...\n");
+	fflush(stdout);
+	for(size_t i = 0; i < ARRAY_SIZE(durations); ++i) {
+		uint64_t total = 0;
+		uint64_t worst = 0;
+		for(int j = 0; j < TEST_COUNT; ++j) {
+			uint64_t start = rdtsc();
+			if(usleep(durations[i]) < 0) {
+				printe("usleep failed");
+				return EXIT_FAILURE;
+			}
+			uint64_t elapsed = tsctotime(rdtsc() - start);
+			/* the time we slept too long */
+			uint64_t late = elapsed > (uint64_t)durations[i] ? elapsed - durations[i] : 0;
+			total += late;
+			if(late > worst)
+				worst = late;
+		}
+		printf("%6ld us: %Lu us late on average, %Lu us at most\n",
+			(long)durations[i],total / TEST_COUNT,worst);
+		fflush(stdout);
+	}
+	return EXIT_SUCCESS;
+}
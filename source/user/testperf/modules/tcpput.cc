@@ -0,0 +1,118 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <esc/proto/net.h>
+#include <esc/proto/socket.h>
+#include <sys/common.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+#define TOTAL_SIZE		(8 * 1024 * 1024)
+#define CHUNK_SIZE		(16 * 1024)
+#define PORT			2346
+
+using namespace esc;
+
+static Socket *listener = NULL;
+static volatile size_t received = 0;
+static uint64_t recvStart = 0;
+static uint64_t recvEnd = 0;
+
+static Socket::Addr buildAddr() {
+	Socket::Addr addr;
+	addr.family = Socket::AF_INET;
+	addr.d.ipv4.addr = Net::IPv4Addr(127,0,0,1).value();
+	addr.d.ipv4.port = PORT;
+	return addr;
+}
+
+static int receiver(void*) {
+	static char buf[CHUNK_SIZE];
+	try {
+		Socket sock = listener->accept();
+		recvStart = rdtsc();
+		// the sender closes the connection at the end
+		size_t res;
+		while((res = sock.receive(buf,sizeof(buf))) > 0)
+			received += res;
+	}
+	catch(const default_error &e) {
+		printe("receive failed: %s",e.what());
+	}
+	recvEnd = rdtsc();
+	return 0;
+}
+
+static void test_throughput(Net &net,uint loss) {
+	static char buf[CHUNK_SIZE];
+	net.linkLoss("lo",loss);
+
+	Socket lsock(Socket::SOCK_STREAM,Socket::PROTO_TCP);
+	lsock.bind(buildAddr());
+	lsock.listen();
+
+	listener = &lsock;
+	received = 0;
+	int tid = startthread(receiver,NULL);
+	if(tid < 0) {
+		printe("Unable to start receiver thread");
+		return;
+	}
+
+	{
+		Socket ssock(Socket::SOCK_STREAM,Socket::PROTO_TCP);
+		ssock.connect(buildAddr());
+		for(size_t sent = 0; sent < TOTAL_SIZE; sent += CHUNK_SIZE)
+			ssock.send(buf,CHUNK_SIZE);
+	}
+	join(tid);
+
+	uint64_t us = tsctotime(recvEnd - recvStart);
+	printf("%2u.%u%% loss: received %zu of %d bytes with %Lu KiB/s\n",
+		loss / 10,loss % 10,received,TOTAL_SIZE,us ? (received * 1000000ULL) / (us * 1024) : 0);
+	fflush(stdout);
+}
+
+int mod_tcpput(int,char**) {
+	/* the loss rates in packets per thousand */
+	static uint losses[] = {0,10,20,50};
+	printf("TCP throughput over the loopback device with packet loss...\n");
+	fflush(stdout);
+	try {
+		Net net("/dev/tcpip");
+		try {
+			for(size_t i = 0; i < ARRAY_SIZE(losses); ++i)
+				test_throughput(net,losses[i]);
+		}
+		catch(...) {
+			net.linkLoss("lo",0);
+			throw;
+		}
+		net.linkLoss("lo",0);
+	}
+	catch(const default_error &e) {
+		printe("%s",e.what());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,103 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/proc.h>
+#include <sys/syscalls.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../modules.h"
+
+#define TEST_COUNT		100000
+
+static volatile ulong sink;
+
+static void sc_gettid(void) {
+	sink += syscall0(SYSCALL_GETTID);
+}
+static void vdso_gettid(void) {
+	sink += gettid();
+}
+
+static void sc_getpid(void) {
+	sink += syscall0(SYSCALL_PID);
+}
+static void vdso_getpid(void) {
+	sink += getpid();
+}
+
+static void sc_gettod(void) {
+	struct timeval tv;
+	syscall1(SYSCALL_GETTOD,(ulong)&tv);
+	sink += tv.tv_usec;
+}
+static void vdso_gettod(void) {
+	struct timeval tv;
+	gettimeofday(&tv);
+	sink += tv.tv_usec;
+}
+
+static void sc_tsctotime(void) {
+	uint64_t tsc = rdtsc();
+	syscall1(SYSCALL_TSCTOTIME,(ulong)&tsc);
+	sink += tsc;
+}
+static void vdso_tsctotime(void) {
+	sink += tsctotime(rdtsc());
+}
+
+static const struct {
+	const char *name;
+	void (*syscall)(void);
+	void (*vdso)(void);
+} tests[] = {
+	{"gettid",			sc_gettid,		vdso_gettid},
+	{"getpid",			sc_getpid,		vdso_getpid},
+	{"gettimeofday",	sc_gettod,		vdso_gettod},
+	{"tsctotime",		sc_tsctotime,	vdso_tsctotime},
+};
+
+static uint64_t measure(void (*func)(void)) {
+	uint64_t start = rdtsc();
+	for(int i = 0; i < TEST_COUNT; ++i)
+		func();
+	return (rdtsc() - start) / TEST_COUNT;
+}
+
+int mod_vdso(A_UNUSED int argc,A_UNUSED char *argv[]) {
+	/* check whether both paths agree before we measure them */
+	if(gettid() != (tid_t)syscall0(SYSCALL_GETTID) || getpid() != (pid_t)syscall0(SYSCALL_PID)) {
+		printe("The vDSO ids don't match the ones of the kernel");
+		return EXIT_FAILURE;
+	}
+
+	printf("Syscall vs. vDSO latency...\n");
+	fflush(stdout);
+	for(size_t i = 0; i < ARRAY_SIZE(tests); ++i) {
+		uint64_t sc = measure(tests[i].syscall);
+		uint64_t vdso = measure(tests[i].vdso);
+		printf("%-14s: syscall %6Lu cycles/call, vDSO %6Lu cycles/call\n",tests[i].name,sc,vdso);
+		fflush(stdout);
+	}
+	return EXIT_SUCCESS;
+}
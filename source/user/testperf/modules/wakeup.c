@@ -0,0 +1,131 @@
+/**
+ * $Id$
+ * Copyright (C) 2008 - 2014 Nils Asmussen
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <sys/common.h>
+#include <sys/sync.h>
+#include <sys/thread.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../modules.h"
+
+#define TEST_COUNT		10000
+#define MAX_SLEEPERS	1024
+
+static int sem1;
+static int sem2;
+static int sleeperSems[MAX_SLEEPERS];
+static int sleeperTids[MAX_SLEEPERS];
+
+static int thread_sleeper(void *arg) {
+	/* block on our own semaphore until the test is finished */
+	semdown((int)(intptr_t)arg);
+	return 0;
+}
+
+static int thread_pong(A_UNUSED void *arg) {
+	for(int i = 0; i < TEST_COUNT; ++i) {
+		semdown(sem1);
+		semup(sem2);
+	}
+	return 0;
+}
+
+static void stop_sleepers(size_t count) {
+	for(size_t i = 0; i < count; ++i) {
+		semup(sleeperSems[i]);
+		join(sleeperTids[i]);
+		semdestr(sleeperSems[i]);
+	}
+}
+
+static bool run_test(size_t sleepers) {
+	/* put <sleepers> unrelated threads to sleep, each one on a different semaphore */
+	for(size_t i = 0; i < sleepers; ++i) {
+		sleeperSems[i] = semcrt(0);
+		if(sleeperSems[i] < 0) {
+			printe("Unable to create semaphore");
+			stop_sleepers(i);
+			return false;
+		}
+		sleeperTids[i] = startthread(thread_sleeper,(void*)(intptr_t)sleeperSems[i]);
+		if(sleeperTids[i] < 0) {
+			printe("Unable to start thread");
+			semdestr(sleeperSems[i]);
+			stop_sleepers(i);
+			return false;
+		}
+	}
+	/* give them the chance to block */
+	usleep(100 * 1000);
+
+	sem1 = semcrt(0);
+	if(sem1 < 0) {
+		printe("Unable to create sem");
+		stop_sleepers(sleepers);
+		return false;
+	}
+	sem2 = semcrt(0);
+	if(sem2 < 0) {
+		printe("Unable to create sem");
+		semdestr(sem1);
+		stop_sleepers(sleepers);
+		return false;
+	}
+
+	int tid = startthread(thread_pong,NULL);
+	if(tid < 0) {
+		printe("Unable to start thread");
+		semdestr(sem2);
+		semdestr(sem1);
+		stop_sleepers(sleepers);
+		return false;
+	}
+
+	/* every iteration wakes up the pong-thread and the pong-thread wakes us up */
+	uint64_t start = rdtsc();
+	for(int i = 0; i < TEST_COUNT; ++i) {
+		semup(sem1);
+		semdown(sem2);
+	}
+	uint64_t end = rdtsc();
+	printf("%4zu sleepers: %Lu cycles/wakeup\n",sleepers,(end - start) / (TEST_COUNT * 2));
+	fflush(stdout);
+
+	join(tid);
+	semdestr(sem2);
+	semdestr(sem1);
+	stop_sleepers(sleepers);
+	return true;
+}
+
+int mod_wakeup(int argc,char *argv[]) {
+	size_t max = MAX_SLEEPERS;
+	if(argc > 2)
+		max = MIN(MAX_SLEEPERS,atoi(argv[2]));
+
+	printf("Semaphore wakeup latency with unrelated blocked threads...\n");
+	fflush(stdout);
+	for(size_t sleepers = 0; sleepers <= max; sleepers = sleepers ? sleepers * 4 : 4) {
+		if(!run_test(sleepers))
+			return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -51,6 +51,13 @@ static sTestModule modules[] = {
 	{"pagefault",	mod_pagefault},
 	{"heap",		mod_heap},
 	{"stdio",		mod_stdio},
+	{"wakeup",		mod_wakeup},
+	{"netpps",		mod_netpps},
+	{"cowfault",	mod_cowfault},
+	{"sleep",		mod_sleep},
+	{"vdso",		mod_vdso},
+	{"tcpput",		mod_tcpput},
+	{"iops",		mod_iops},
 };
 
 int main(int argc,char *argv[]) {